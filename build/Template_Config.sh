@@ -132,13 +132,16 @@
 # --------------------------------------- TreePM Options (recommended for cosmological sims)
 #PMGRID=512                     # adds Particle-Mesh grid for faster (but less accurate) long-range gravitational forces: value sets resolution (e.g. a PMGRID^3 grid will overlay the box, as the 'top level' grid)
 #PM_PLACEHIGHRESREGION=1+2+16   # adds a second-level (nested) PM grid before the tree: value denotes particle types (via bit-mask) to place high-res PMGRID around. Requires PMGRID.
+#PM_HIRES_NLEVELS=3             # generalizes PM_PLACEHIGHRESREGION to this many nested high-res PM levels (default=2 if no value set), each narrower by PM_HIRES_LEVEL_REFINE (default 4) and centered on the high-res mass inside the level above, with erfc force-splits between levels so the tree only handles the finest split scale. Requires PM_PLACEHIGHRESREGION.
 #PM_HIRES_REGION_CLIPPING=1000  # optional additional criterion for boundaries in 'zoom-in' type simulations: clips gas particles that escape the hires region in zoom/isolated sims, specifically those whose nearest-neighbor distance exceeds this value (in code units)
 #PM_HIRES_REGION_CLIPDM         # split low-res DM particles that enter high-res region (completely surrounded by high-res)
+#PM_SHORTRANGE_ANALYTIC         # evaluate the short-range tree-PM force/potential factors from a rational approximation to erfc (error <1e-6) at each interaction, instead of from the NTAB look-up tables (no table gather, so the tree interaction loop can vectorize; more accurate than the tables). Requires PMGRID.
 ## -----------------------------------------------------------------------------------------------------
 # ---------------------------------------- Adaptive Grav. Softening (including Lagrangian conservation terms!)
 #ADAPTIVE_GRAVSOFT_FORGAS       # allows variable softening length for gas particles (scaled with local inter-element separation), so gravity traces same density field seen by hydro
 #ADAPTIVE_GRAVSOFT_FORALL=1+2   # enable adaptive gravitational softening lengths for designated particle types (ADAPTIVE_GRAVSOFT_FORGAS should be disabled). the softening is set to the distance
                                 # enclosing a neighbor number set in the parameter file. flag value = bitflag like PM_PLACEHIGHRESREGION, which determines which particle types are adaptive (others use fixed softening). cite Hopkins et al., arXiv:1702.06148
+#ADAPTIVE_GRAVSOFT_FUSED_DENSITY # solve the AGS kernel lengths of collisionless types in the same neighbor iteration (one search and export per pass, type-masked) as the hydro kernel lengths, instead of in a second, separate loop. requires ADAPTIVE_GRAVSOFT_FORALL
 ## -----------------------------------------------------------------------------------------------------
 #SELFGRAVITY_OFF                # turn off self-gravity (compatible with GRAVITY_ANALYTIC); setting NOGRAVITY gives identical functionality
 #GRAVITY_NOT_PERIODIC           # self-gravity is not periodic, even though the rest of the box is periodic
@@ -222,6 +225,7 @@
 # -------- users are encouraged to explore their own stellar evolution models and include various types of feedback (e.g. SNe, stellar mass-loss, NS mergers, etc)
 #GALSF_FB_MECHANICAL            # explicit algorithm including thermal+kinetic/momentum terms from Hopkins+ 2018 (MNRAS, 477, 1578): manifestly conservative+isotropic, and accounts properly for un-resolved PdV work+cooling during blastwave expansion. cite Hopkins et al. 2018, MNRAS, 477, 1578, and Hopkins+ 2014 (MNRAS 445, 581)
 #GALSF_FB_THERMAL               # simple 'pure thermal energy dump' feedback: mass, metals, and thermal energy are injected locally in simple kernel-weighted fashion around young stars. tends to severely over-cool owing to lack of mechanical/kinetic treatment at finite resolution (better algorithm is mechanical)
+#GALSF_SSP_TABLES               # tabulate the age-dependent stellar-population fits in 'stellar_evolution.c' (ionizing/photo-electric/Lyman-Werner luminosities, optical fraction, cumulative SNe number) once at start-up and interpolate them per star; with GALSF_FB_MECHANICAL the SNe number is integrated exactly over each star's timestep
 ## ----------------------------------------------------------------------------------------------------
 ############################################################################################################################
 
@@ -238,6 +242,7 @@
 # ----- time integration, regularization, and explicit small-N-body dynamical treatments (for e.g. hard binaries, etc)
 ## ----------------------------------------------------------------------------------------------------
 #SINGLE_STAR_TIMESTEPPING=1     # use additional timestep criteria to ensure resolved binaries/multiples dont dissolve in close encounters. 0=most conservative. 1=super-timestep hard binaries by operator-splitting the binary orbit. 2=more aggressive super-timestep.
+#SINGLE_STAR_FEWBODY_SUBSYSTEMS # (needs SINGLE_STAR_TIMESTEPPING>0) binaries whose external perturbations are slow compared to the orbit are integrated as decoupled subsystems: the orbit is advanced privately (Kepler or Hermite sub-steps) and the members step on the external timescales, while other stars see the pair as a composite
 #HERMITE_INTEGRATION=32         # Instead of the usual 2nd order DKD Leapfrog timestep, do 4th order Hermite integration for particles matching the bitflag. Allows longer timesteps and higher accuracy collisional dynamics
 ## ----------------------------------------------------------------------------------------------------
 # ----- sink creation and accretion/growth/merger modules
@@ -395,6 +400,7 @@
 #OPENMP=2                       # top-level switch for explicit OpenMP implementation
 #PTHREADS_NUM_THREADS=4         # custom PTHREADs implementation (don't enable with OPENMP)
 #MULTIPLEDOMAINS=16             # Multi-Domain option for the top-tree level (alters load-balancing)
+#DOMAIN_LOADBALANCE_FEEDBACK    # corrects the modeled particle costs in the domain decomposition with the measured compute time of each task, adapts the work-vs-memory weighting to the measured imbalance, and spreads the heaviest domain pieces across shared-memory nodes
 ####################################################################################################
 
 
@@ -419,6 +425,9 @@
 #OUTPUT_LINEOFSIGHT				# enables on-the-fly output of Ly-alpha absorption spectra. requires METALS and COOLING.
 #OUTPUT_LINEOFSIGHT_SPECTRUM    # computes power spectrum of these (requires additional code integration)
 #OUTPUT_LINEOFSIGHT_PARTICLES   # computes power spectrum of these (requires additional code integration)
+#OUTPUT_SNAPSHOT_PROFILES=4     # partial 'snapshot profiles' (up to N, default 4), each with its own cadence and selection, set by the optional parameters SnapshotProfile<n>_TimeFirst/_TimeBetween (0=off), _Types (bitmask), _Fields (comma-separated dataset names, or 'all'), _Center_X/Y/Z + _Radius (spatial cut if >0), _IDFile (file of IDs, or 'none')
+#OUTPUT_LIGHTCONE               # on-the-fly lightcone output (cosmological runs): elements crossing the past lightcone of the observers in LightconeObserverFile (incl. periodic replicas), out to LightconeMaxRedshift (required; at most LIGHTCONE_MAX_REPLICAS box replicas may lie within it), for particle types in the bitmask LightconeTypes, are written per-task to lightcone/
+#OUTPUT_INSITU_MAPS             # on-the-fly projected images (gas/stellar/DM surface density, gas mass-weighted T and Z) and gas slices, written to insitu_maps/ every TimeBetInSituMaps (on coarse steps; 0=every coarse step). resolution/axis/region/fields set by InSituMapPixels, InSituMapAxis, InSituMapCenter_X/Y/Z + InSituMapWidth, InSituMapFields (bitmask: 1=gas surface density, 2=gas T, 4=gas Z, 8=stars, 16=DM, 32=gas slice)
 #OUTPUT_POWERSPEC               # compute and output cosmological power spectra. requires BOX_PERIODIC and PMGRID.
 #OUTPUT_RECOMPUTE_POTENTIAL     # update potential every output even it EVALPOTENTIAL is set
 #OUTPUT_DENS_AROUND_STAR        # output gas density in neighborhood of stars [collisionless particle types], not just gas
@@ -428,12 +437,14 @@
 #OUTPUT_BH_DISTANCES            # saves the distance to the nearest sink, if BH_CALC_DISTANCES is enabled, to snapshots
 #INPUT_READ_HSML                # force reading hsml from IC file (instead of re-computing them; in general this is redundant but useful if special guesses needed)
 #OUTPUT_TWOPOINT_ENABLED        # allows user to calculate mass 2-point function by enabling and setting restartflag=5
+#OUTPUT_PARTICLE_WORK_STATISTICS=10 # per-particle work counters (nodes opened, neighbors, exports, hsml-iterations, cooling-solver steps, gravity interactions) written as log2-histograms per task per loop to 'work_statistics/', plus the N (value set) most expensive elements per loop (debugging/load-balance diagnostics; costs extra memory and output)
 #IO_DISABLE_HDF5                # disable HDF5 I/O support (for both reading/writing; use only if HDF5 not install-able)
 #IO_COMPRESS_HDF5     		    # write HDF5 in compressed form (will slow down snapshot I/O and may cause issues on old machines, but reduce snapshots 2x)
 #IO_SUPPRESS_TIMEBIN_STDOUT=10  # only prints timebin-list to log file if highest active timebin index is within N (value set) of the highest timebin (dt_bin=2^(-N)*dt_bin,max)
 #IO_SUBFIND_IN_OLD_ASCII_FORMAT # write sub-find outputs in the old massive ascii-table format (unweildy and can cause lots of filesystem issues, but here for backwards compatibility)
 #IO_SUBFIND_READFOF_FROMIC      # try read already existing FOF files associated with a run instead of recomputing them: not de-bugged
 #IO_TURB_DIFF_DYNAMIC_ERROR     # save error terms from localized dynamic Smagorinsky model to snapshots
+#IO_SNAPSHOT_WARMSTART          # snapshots carry the derived state (kernel lengths of all types, OldAcc; with the AGS softenings and CHIMES abundances already written) plus a manifest of it in the header; restarts from them (RestartFlag=2) reuse it after a cheap validity check, skipping the kernel-length rebuild, the second initial gravity pass, and CHIMES equilibrium initialization
 #IO_MOLECFRAC_NOT_IN_ICFILE     # special flag needed if using certain molecular modules with restart flag=2 where molecular data was not in that snapshot, to tell code not to read it
 ####################################################################################################
 
@@ -476,6 +487,10 @@
 #SUPER_TIMESTEP_DIFFUSION       # use super-timestepping to accelerate integration of diffusion operators [for testing or if there are stability concerns]
 #EVALPOTENTIAL                  # computes gravitational potential
 #GRAVITY_HYBRID_OPENING_CRIT    # use -both- Barnes-Hut + relative angle opening criterion for the gravity tree (normally choose one or the other)
+#GRAVITY_TREE_QUADRUPOLE        # carry quadrupole moments on the gravity tree nodes (drifted and kicked with the nodes), and use the corresponding octupole-order relative opening criterion. more accurate per interaction, so a larger ErrTolForceAcc gives the same force error
+#GRAVITY_TREE_ACCURACY_SWEEP    # on the first all-active step, recompute the tree forces for a range of ErrTolForceAcc (and with/without GRAVITY_TREE_QUADRUPOLE) against a high-accuracy reference, writing error percentiles, interactions per element, and timings to gravity_accuracy_sweep.txt (diagnostic, for choosing the tolerance)
+#GRAVITY_FMM=3                  # on steps where all elements are active, compute the interactions between elements on the same task with a symmetric (momentum-conserving) dual-tree fast multipole method of order 2 or 3 (Dehnen 2002), instead of the one-sided tree-walk; remote contributions still come from the walk. non-periodic pure-tree gravity only (enables GRAVITY_TREE_QUADRUPOLE)
+#GRAVITY_FARFIELD_CACHE=3       # cache the tree-force from sources beyond ~30 softenings (with its gradient and time-derivative) per element, and on the sub-steps of deep time-bins walk only the near-field and extrapolate the cached far-field. the cache is refreshed when the bin this many levels above the element's own is synchronized, or when drifts since caching exceed the tolerance. not compatible with modules which evaluate other quantities in the gravity walk (RT_USE_GRAVTREE, RT_USE_TREECOL_FOR_NH, COUNT_MASS_IN_GRAVTREE, sink/BH distances)
 #TIDAL_TIMESTEP_CRITERION       # replace standard acceleration-based timestep criterion with one based on the tidal tensor norm, which is more accurate and adaptive (testing, but may be promoted to default code)
 #ADAPTIVE_TREEFORCE_UPDATE=0.0625      # use the tidal timescale to estimate how often gravity needs to be updated, updating a gas cell's gravity no more often than ADAPTIVE_TREEFORCE_UPDATE * dt_tidal, the factor N_f in Grudic 2020 arxiv:2010.13792 (cite this). Smaller is more accurate, larger is faster, should be tuned for your problem if used.
 #BH_WAKEUP_GAS                  # force all gas within the interaction radius of a BH/sink particle to timestep at the same rate (set to lowest timebin of any of the interacting neighbors)
@@ -509,9 +524,12 @@
 # ----- MPI & Parallel-FFTW De-Bugging
 #USE_MPI_IN_PLACE               # MPI debugging: makes AllGatherV compatible with MPI_IN_PLACE definitions in some MPI libraries
 #NO_ISEND_IRECV_IN_DOMAIN       # MPI debugging: slower, but fixes memory errors during exchange in the domain decomposition (ANY RUN with >2e9 particles MUST SET THIS OR FAIL!)
+#NO_ISEND_IRECV_IN_EXCHANGES    # MPI debugging: use blocking pairwise MPI_Sendrecv (instead of all-at-once non-blocking, node-ordered messages) in the neighbor-loop and gravity-tree exchanges
+#NO_SPARSE_COUNT_EXCHANGE       # MPI debugging: always use the dense MPI_Alltoall to exchange export counts (instead of the sparse non-blocking-consensus exchange used at large task numbers)
 #FIX_PATHSCALE_MPI_STATUS_IGNORE_BUG # MPI debugging
-#MPISENDRECV_SIZELIMIT=100      # MPI debugging
-#MPISENDRECV_CHECKSUM           # MPI debugging
+#MPISENDRECV_SIZELIMIT=100      # MPI debugging: split messages into pieces of at most this many MB (the exchanges post all pieces at once; messages >2GB are handled without this)
+#MPISENDRECV_CHECKSUM           # MPI debugging: full checksum + resend of every MPI_Sendrecv (slow: doubles exchange latency; for production use MPISENDRECV_CHECKSUM_SAMPLED)
+#MPISENDRECV_CHECKSUM_SAMPLED=64 # MPI debugging: verify a checksum on one in every N (default=64) messages to each partner in the neighbor/gravity exchanges, sent alongside the data (cheap enough for production)
 #DONOTUSENODELIST               # MPI debugging
 #NOTYPEPREFIX_FFTW              # FFTW debugging (fftw-header/libraries accessed without type prefix, adopting whatever was
                                 #   chosen as default at compile of fftw). Otherwise, the type prefix 'd' for double is used.
@@ -47,7 +47,12 @@ void compute_grav_accelerations(void)
   gravity_tree();		/* computes gravity accel. */
 
   /* For the first timestep, we redo it to allow usage of relative opening criterion for consistent accuracy */
-  if(All.TypeOfOpeningCriterion == 1 && All.Ti_Current == 0) {gravity_tree();}
+  if(All.TypeOfOpeningCriterion == 1 && All.Ti_Current == 0 && !(WarmStartFields & WARMSTART_OLDACC)) {gravity_tree();} /* not needed if OldAcc was restored on a warm start */
+
+#ifdef GRAVITY_TREE_ACCURACY_SWEEP /* once per run, on the first step where every element is active */
+  static int accuracy_sweep_done = 0;
+  if(!accuracy_sweep_done && GlobNumForceUpdate == All.TotNumPart) {accuracy_sweep_done = 1; gravity_tree_accuracy_sweep();}
+#endif
 
   PRINT_STATUS(" ..gravity force computation done");
 }
@@ -59,9 +64,13 @@ void compute_hydro_densities_and_forces(void)
   if(All.TotN_gas > 0)
     {
         PRINT_STATUS("Start hydrodynamics computation...");
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+        density_and_ags_density(); /* computes density, and pressure, and the AGS kernel lengths in the same neighbor iteration */
+#else
         density();		/* computes density, and pressure */
 #ifdef AGS_HSML_CALCULATION_IS_ACTIVE
         ags_density();
+#endif
 #endif
         force_update_hmax();	/* update kernel lengths in tree */
         /*! This function updates the hmax-values in tree nodes that hold SPH
@@ -50,6 +50,7 @@ int MaxTopNodes;		/*!< Maximum number of nodes in the top-level tree used for do
 int RestartFlag;		/*!< taken from command line used to start code. 0 is normal start-up from initial conditions, 1 is resuming a run from a set of restart files, while 2 marks a restart from a snapshot file. */
 
 int RestartSnapNum;
+int WarmStartFields;		/*!< derived fields restored from the snapshot on a warm restart (RestartFlag=2, IO_SNAPSHOT_WARMSTART), as a bitmask of WARMSTART_*; zero otherwise */
 int SelRnd;
 
 int *Exportflag;		/*!< Buffer used for flagging whether a particle needs to be exported to another process */
@@ -140,6 +141,13 @@ int Flag_FullStep;		/*!< Flag used to signal that the current step involves all
 
 
 int TreeReconstructFlag;
+#ifdef GRAVITY_TREE_QUADRUPOLE
+int TreeQuadrupoleFlag = 1;
+#endif
+#ifdef GRAVITY_FMM
+int FMMActiveFlag = 0;
+int FMMTreeModifiedFlag = 0;
+#endif
 #ifdef WAKEUP
 int NeedToWakeupParticles;      /*!< Flags used to signal that wakeups need to be processed at the beginning of the next timestep */
 int NeedToWakeupParticles_local;
@@ -255,6 +263,10 @@ FILE *FdBhWindDetails;
 #endif
 #endif
 #endif
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+FILE *FdWorkStats;
+FILE *FdWorkStragglers;
+#endif
 
 
 
@@ -236,6 +236,9 @@
 #if defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(FLAG_NOT_IN_PUBLIC_CODE) || defined(DM_FUZZY) || defined(AGS_FACE_CALCULATION_IS_ACTIVE) || defined(DM_SIDM)
 #define AGS_HSML_CALCULATION_IS_ACTIVE
 #endif
+#if defined(ADAPTIVE_GRAVSOFT_FUSED_DENSITY) && !defined(AGS_HSML_CALCULATION_IS_ACTIVE)
+#undef ADAPTIVE_GRAVSOFT_FUSED_DENSITY /* nothing to fuse without an AGS kernel-length loop */
+#endif
 
 
 
@@ -427,6 +430,19 @@ extern struct Chimes_depletion_data_structure *ChimesDepletionData;
 #endif    
 
 
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS /* the few-body subsystem integrator builds on the operator-split binary super-timestepping, and takes its external step from the tidal criterion */
+#ifndef SINGLE_STAR_TIMESTEPPING
+#define SINGLE_STAR_TIMESTEPPING 1
+#endif
+#if !(SINGLE_STAR_TIMESTEPPING > 0)
+#undef SINGLE_STAR_FEWBODY_SUBSYSTEMS /* the most conservative binary treatment was requested explicitly: no sub-stepping */
+#else
+#ifndef TIDAL_TIMESTEP_CRITERION
+#define TIDAL_TIMESTEP_CRITERION
+#endif
+#endif
+#endif
+
 #if (SINGLE_STAR_TIMESTEPPING > 0) /* if single-star timestepping is on, need to make sure the binary-identification flag is active */
 #ifndef SINGLE_STAR_FIND_BINARIES
 #define SINGLE_STAR_FIND_BINARIES
@@ -635,6 +651,20 @@ extern struct Chimes_depletion_data_structure *ChimesDepletionData;
 #endif
 
 
+#if defined(GRAVITY_FMM) && !defined(GRAVITY_TREE_QUADRUPOLE)
+#define GRAVITY_TREE_QUADRUPOLE /* the FMM uses the node quadrupole moments as its multipoles */
+#endif
+
+#ifdef GRAVITY_FARFIELD_CACHE
+#if (GRAVITY_FARFIELD_CACHE+0 > 0)
+#define FARFIELD_CACHE_LEVELS (GRAVITY_FARFIELD_CACHE) /* the far-field is refreshed when the time-bin this many levels above the element's own is synchronized */
+#else
+#define FARFIELD_CACHE_LEVELS 3
+#endif
+#define FARFIELD_CACHE_RCUT_IN_SOFTENINGS 30. /* radius of the near/far split, in units of the element's force softening */
+#define FARFIELD_CACHE_DRIFT_TOL 0.05 /* refresh once the element, or sources near the split, may have moved this fraction of the split radius */
+#endif
+
 #if defined(OUTPUT_POTENTIAL) && !defined(EVALPOTENTIAL)
 #define EVALPOTENTIAL
 #endif
@@ -1099,6 +1129,12 @@ typedef unsigned long long peanokey;
 #define FLAG_EVOLVED_2LPT      4
 #define FLAG_NORMALICS_2LPT    5
 
+/* bits of the field "flag_warmstart" in the file header: the derived state a snapshot carries for warm restarts from it (IO_SNAPSHOT_WARMSTART) */
+#define WARMSTART_HSML         1    /* kernel lengths of all element types */
+#define WARMSTART_AGS_HSML     2    /* adaptive gravitational softenings */
+#define WARMSTART_OLDACC       4    /* last acceleration magnitudes, for the relative tree-opening criterion */
+#define WARMSTART_CHIMES       8    /* CHIMES abundances */
+
 
 #ifndef PM_ASMTH
 #define PM_ASMTH (1.25) /*! PM_ASMTH gives the scale of the short-range/long-range force split in units of FFT-mesh cells */
@@ -1106,6 +1142,18 @@ typedef unsigned long long peanokey;
 #ifndef PM_RCUT
 #define PM_RCUT (4.5) /*! PM_RCUT gives the maximum distance (in units of the scale used for the force split) out to which short-range forces are evaluated in the short-range tree walk. */
 #endif
+#if defined(PM_HIRES_NLEVELS) && !(defined(PMGRID) && defined(PM_PLACEHIGHRESREGION))
+#undef PM_HIRES_NLEVELS /* nested levels are refinements of the PM_PLACEHIGHRESREGION grid, so need it */
+#endif
+#ifdef PM_HIRES_NLEVELS
+#if (PM_HIRES_NLEVELS+0 > 0)
+#define PM_NGRIDS (1+(PM_HIRES_NLEVELS)) /*! number of PM grids: the top-level (periodic or isolated) grid plus the nested high-res levels */
+#else
+#define PM_NGRIDS 3 /* default if no value is given: two nested high-res levels */
+#endif
+#else
+#define PM_NGRIDS 2
+#endif
 #define MAXLEN_OUTPUTLIST 1201	/*!< maxmimum number of entries in output list */
 #define DRIFT_TABLE_LENGTH 1000	/*!< length of the lookup table used to hold the drift and kick factors */
 #define MAXITER 150
@@ -1250,6 +1298,16 @@ typedef MyDouble MyBigFloat;
 
 #define CPU_STRING_LEN 120
 
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS /* indices of the per-particle work counters (see system/work_statistics.c) */
+#define WORK_NODESOPENED   0  /* tree-nodes opened in neighbor searches */
+#define WORK_NGBVISITED    1  /* candidate neighbors returned by neighbor searches */
+#define WORK_EXPORTS       2  /* export-list entries created for other tasks */
+#define WORK_ITERATIONS    3  /* hsml-iterations in the density-type loops */
+#define WORK_SOLVERSTEPS   4  /* cooling solver iterations (or, with CHIMES, solver wall-time in microseconds) */
+#define WORK_GRAVINTERACT  5  /* gravity-tree interactions */
+#define WORK_PARTS         6  /* number of counters above (must be last) */
+#endif
+
 #if (BOX_SPATIAL_DIMENSION==1) || defined(ONEDIM)
 #define NUMDIMS 1           /* define number of dimensions and volume normalization */
 #define NORM_COEFF 2.0
@@ -1454,6 +1512,8 @@ z=((z)>boxHalf_Z)?((z)-boxSize_Z):(((z)<-boxHalf_Z)?((z)+boxSize_Z):(z)))
 
 #define MACRO_NAME_CONCATENATE(A, B) MACRO_NAME_CONCATENATE_(A, B)
 #define MACRO_NAME_CONCATENATE_(A, B) A##B
+#define MACRO_NAME_STRINGIFY(A) MACRO_NAME_STRINGIFY_(A)
+#define MACRO_NAME_STRINGIFY_(A) #A
 
 
 /*********************************************************/
@@ -1511,6 +1571,7 @@ extern int NumSphUpdate;	/*!< number of active SPH particles on local processor
 extern int MaxTopNodes;	        /*!< Maximum number of nodes in the top-level tree used for domain decomposition */
 extern int RestartFlag;		/*!< taken from command line used to start code. 0 is normal start-up from initial conditions, 1 is resuming a run from a set of restart files, while 2 marks a restart from a snapshot file. */
 extern int RestartSnapNum;
+extern int WarmStartFields;     /*!< derived fields restored from the snapshot on a warm restart (RestartFlag=2, IO_SNAPSHOT_WARMSTART), as a bitmask of WARMSTART_*; zero otherwise */
 extern int SelRnd;
 extern int TakeLevel;
 extern int *Exportflag;	        /*!< Buffer used for flagging whether a particle needs to be exported to another process */
@@ -1533,6 +1594,13 @@ extern size_t HighMark_run,  HighMark_domain, HighMark_gravtree, HighMark_pmperi
 extern size_t HighMark_turbpower;
 #endif
 extern int TreeReconstructFlag;
+#ifdef GRAVITY_TREE_QUADRUPOLE
+extern int TreeQuadrupoleFlag;  /*!< if zero, the tree-walk ignores the node quadrupole moments (used to compare against monopole-only walks) */
+#endif
+#ifdef GRAVITY_FMM
+extern int FMMActiveFlag;  /*!< set while the local-local interactions of a force computation are done by the FMM (the tree-walk then only does the remote part) */
+extern int FMMTreeModifiedFlag;  /*!< set when elements were linked into the tree without a rebuild (force_add_star_to_tree): the FMM is then skipped until the next build */
+#endif
 extern int GlobFlag;
 extern char DumpFlag;
 #ifdef WAKEUP
@@ -1667,6 +1735,10 @@ extern FILE *FdBhWindDetails;
 #endif
 #endif
 #endif
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+extern FILE *FdWorkStats;       /*!< file handle for the per-task work_statistics_%d.txt log-files */
+extern FILE *FdWorkStragglers;  /*!< file handle for the work_stragglers.txt log-file (root task only) */
+#endif
 
 
 #if defined(COOLING) && defined(GALSF_EFFECTIVE_EQS)
@@ -1822,18 +1894,45 @@ extern struct global_data_all_processes
   integertime Previous_Ti_Current;
   integertime Ti_nextoutput;		/*!< next output time on integer timeline */
   integertime Ti_lastoutput;
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+#if (OUTPUT_SNAPSHOT_PROFILES+0 > 0)
+#define SNAPSHOT_PROFILES_MAX (OUTPUT_SNAPSHOT_PROFILES) /* maximum number of snapshot profiles */
+#else
+#define SNAPSHOT_PROFILES_MAX 4 /* default if no value is given */
+#endif
+  struct
+  {
+    double TimeFirst, TimeBetween; /*!< time of the first output and interval between outputs of this profile (disabled if TimeBetween<=0) */
+    double Center[3], Radius;      /*!< only elements within Radius of Center are written (if Radius>0) */
+    int Types;                     /*!< bitmask of the particle types written */
+    char Fields[200];              /*!< comma-separated list of the dataset names written, or 'all' */
+    char IDFile[100];              /*!< file with the IDs of the elements written, or 'none' */
+    int FileCount;                 /*!< number of the output of this profile that is written next */
+    integertime Ti_next;           /*!< next output time of this profile on the integer timeline */
+  } SnapshotProfile[SNAPSHOT_PROFILES_MAX];
+#endif
 
 #ifdef PMGRID
   integertime PM_Ti_endstep, PM_Ti_begstep;
-  double Asmth[2], Rcut[2];
-  double Corner[2][3], UpperCorner[2][3], Xmintot[2][3], Xmaxtot[2][3];
-  double TotalMeshSize[2];
+  double Asmth[PM_NGRIDS], Rcut[PM_NGRIDS];
+  double Corner[PM_NGRIDS][3], UpperCorner[PM_NGRIDS][3], Xmintot[PM_NGRIDS][3], Xmaxtot[PM_NGRIDS][3];
+  double TotalMeshSize[PM_NGRIDS];
 #endif
 
   integertime Ti_nextlineofsight;
 #ifdef OUTPUT_LINEOFSIGHT
   double TimeFirstLineOfSight;
 #endif
+#ifdef OUTPUT_LIGHTCONE
+  double LightconeMaxRedshift; /*!< elements are recorded on the lightcone out to this redshift */
+  int LightconeTypes; /*!< bitmask of the particle types recorded on the lightcone */
+  char LightconeObserverFile[100]; /*!< file with the observer positions ('x y z' per line), or 'none' for one observer at the box center */
+#endif
+#ifdef OUTPUT_INSITU_MAPS
+  double TimeBetInSituMaps, TimeLastInSituMap; /*!< time interval between (and time of the last) in-situ projected images */
+  double InSituMapCenter[3], InSituMapWidth; /*!< center and side-length of the imaged cube (width<=0 images the whole box) */
+  int InSituMapPixels, InSituMapAxis, InSituMapFields, InSituMapFileCount; /*!< image resolution, projection axis, bitmask of imaged fields, and output counter */
+#endif
 
   int    CPU_TimeBinCountMeasurements[TIMEBINS];
   double CPU_TimeBinMeasurements[TIMEBINS][NUMBER_OF_MEASUREMENTS_TO_RECORD];
@@ -2214,6 +2313,9 @@ extern ALIGN(32) struct particle_data
     MyDouble GravAccel[3];          /*!< particle acceleration due to gravity */
 #ifdef PMGRID
     MyFloat GravPM[3];		/*!< particle acceleration due to long-range PM gravity force */
+#ifdef PM_PLACEHIGHRESREGION
+    int PM_Level;                   /*!< finest PM level whose force the particle received at the last PM step (sets its tree split scale) */
+#endif
 #endif
     MyFloat OldAcc;			/*!< magnitude of old gravitational force. Used in relative opening criterion */
 #ifdef HERMITE_INTEGRATION
@@ -2425,9 +2527,17 @@ extern ALIGN(32) struct particle_data
     MyFloat min_bh_freefall_time;
     MyFloat min_bh_approach_time;
 #if (SINGLE_STAR_TIMESTEPPING > 0)
-    int SuperTimestepFlag; // >=2 if allowed to super-timestep (increases with each drift/kick), 1 if a candidate for super-timestepping, 0 otherwise
+    int SuperTimestepFlag; // 3 if the binary is integrated as a decoupled few-body subsystem (decided once per pair), >=2 if allowed to super-timestep (increases with each drift/kick), 1 if a candidate for super-timestepping, 0 otherwise
     MyDouble COM_dt_tidal; //timescale from tidal tensor evaluated at the center of mass without contribution from the companion
     MyDouble COM_GravAccel[3]; //gravitational acceleration evaluated at the center of mass without contribution from the companion
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+    MyFloat fewbody_tapp_comp; //approach time to the binary companion (kept apart only to combine the partial tree-walk results)
+    MyFloat fewbody_tapp_ext; //smallest approach time to any star other than the companion
+    MyFloat fewbody_pair_dt_tidal; //shortest COM tidal time of the two members of the pair (the pair values are identical on both members)
+    MyFloat fewbody_pair_tapp_ext; //shortest external approach time of the two members: sets the step of a decoupled subsystem (SuperTimestepFlag=3)
+    MyFloat fewbody_pair_t_orbital; //longer of the two members' orbital-time estimates
+    integertime fewbody_pair_ti; //time of the tree walk in which both members were matched and the pair values set (-1 if unmatched)
+#endif
 #endif
 #ifdef SINGLE_STAR_FB_TIMESTEPLIMIT
     MyFloat MaxFeedbackVel; // maximum signal velocity of any feedback mechanism emanating from the star
@@ -2470,6 +2580,28 @@ extern ALIGN(32) struct particle_data
 #endif
 
     float GravCost[GRAVCOSTLEVELS];   /*!< weight factor used for balancing the work-load */
+#ifdef GRAVITY_FARFIELD_CACHE
+    MyFloat FarAcc[3];                /*!< cached tree acceleration from sources beyond FarRcut of FarPos (without the G factor) */
+    MyFloat FarTidal[6];              /*!< its gradient with respect to the target position (xx,yy,zz,xy,xz,yz), for extrapolation */
+    MyFloat FarJerk[3];               /*!< its rate of change from the drift of the sources, per unit drift time */
+#ifdef EVALPOTENTIAL
+    MyFloat FarPot;                   /*!< cached far-field potential */
+#endif
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+    MyFloat FarTidalTensorps[6];      /*!< cached far-field part of tidal_tensorps (xx,yy,zz,xy,xz,yz) */
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+    MyFloat FarGravJerk[3];           /*!< cached far-field part of GravJerk */
+#endif
+    MyDouble FarPos[3];               /*!< position at which the far-field was cached (center of the near/far split) */
+    MyFloat FarRcut;                  /*!< radius of the near/far split */
+    integertime Ti_FarCache;          /*!< time at which the far-field was cached */
+    int FarMode;                      /*!< in the current force computation: 0=no cache, 1=refresh the cache, 2=near-field walk plus cached far-field */
+    int FarCacheValid;                /*!< 0 if the cache has to be refreshed at the next force computation of this element */
+#endif
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+    int WorkCount[WORK_PARTS];        /*!< per-particle work counters for diagnosing load-imbalance (re-zeroed after each loop) */
+#endif
 
 #ifdef WAKEUP
     integertime dt_step;
@@ -2759,6 +2891,11 @@ extern struct sph_particle_data
 #endif
 #endif
 
+#ifdef DO_DENSITY_AROUND_STAR_PARTICLES
+    MyFloat ColumnDensityEstimate;              /*!< local column [physical units] from evaluate_NH_from_GradRho, cached in the gradients pass */
+    integertime ColumnDensityEstimate_Ti;       /*!< time at which ColumnDensityEstimate was filled: only used within that same step (<0 if never filled) */
+#endif
+
 #ifdef MHD_NON_IDEAL
     MyFloat Eta_MHD_OhmicResistivity_Coeff;     /*!< Ohmic resistivity coefficient [physical units of L^2/t] */
     MyFloat Eta_MHD_HallEffect_Coeff;           /*!< Hall effect coefficient [physical units of L^2/t] */
@@ -2965,6 +3102,9 @@ extern struct gravdata_in
     MyFloat Vel[3];
 #endif
     int Type;
+#if defined(PMGRID) && defined(PM_PLACEHIGHRESREGION)
+    int PM_Level;
+#endif
 #if defined(BH_DYNFRICTION_FROMTREE)
     MyFloat BH_Mass;
 #endif
@@ -2983,6 +3123,12 @@ extern struct gravdata_in
 #endif
 #if (SINGLE_STAR_TIMESTEPPING > 0)
     int SuperTimestepFlag;  /*!< 2 if allowed to super-timestep, 1 if a candidate for super-timestepping, 0 otherwise */
+#endif
+#ifdef GRAVITY_FARFIELD_CACHE
+    MyFloat FarPos[3];
+    MyFloat FarRcut;
+    MyFloat FarDt;
+    int FarMode;
 #endif
     MyFloat OldAcc;
     int NodeList[NODELISTLENGTH];
@@ -2994,6 +3140,21 @@ extern struct gravdata_in
 extern struct gravdata_out
 {
     MyLongDouble Acc[3];
+#ifdef GRAVITY_FARFIELD_CACHE
+    MyFloat FarAcc[3];
+    MyFloat FarTidal[6];
+    MyFloat FarJerk[3];
+#ifdef EVALPOTENTIAL
+    MyFloat FarPot;
+#endif
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+    MyFloat FarTidalTensorps[6];
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+    MyFloat FarGravJerk[3];
+#endif
+    int FarInvalidate;
+#endif
 #ifdef RT_USE_TREECOL_FOR_NH
     MyDouble ColumnDensityBins[RT_USE_TREECOL_FOR_NH];
 #endif
@@ -3043,6 +3204,10 @@ extern struct gravdata_out
     MyDouble COM_GravAccel[3]; //gravitational acceleration evaluated at the center of mass without contribution from the companion
     int COM_calc_flag; //flag that tells whether this was only a rerun to get the acceleration ad the tidal tenor at the center of mass of a binary
     int SuperTimestepFlag; // 2 if allowed to super-timestep, 1 if a candidate for super-timestepping, 0 otherwise
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+    MyFloat fewbody_tapp_comp; // approach time to the companion candidate found on this task
+    MyFloat fewbody_tapp_ext; // smallest approach time to any other star found on this task
+#endif
 #endif
 #ifdef SINGLE_STAR_FB_TIMESTEPLIMIT
     MyFloat min_bh_fb_time; // minimum time for feedback to arrive from a star
@@ -3110,8 +3275,9 @@ extern struct io_header
                                      All other values, including 0 are interpreted as "don't know" for backwards compatability.
                                  */
   float lpt_scalingfactor;      /*!< scaling factor for 2lpt initial conditions */
+  int flag_warmstart;           /*!< bitmask (WARMSTART_*) of the derived state stored in the snapshot for warm restarts */
 
-  char fill[18];		/*!< fills to 256 Bytes */
+  char fill[14];		/*!< fills to 256 Bytes */
   char names[15][2];
 }
 header;				/*!< holds header for snapshot files */
@@ -3246,6 +3412,8 @@ enum iofields
   IO_SLUG_STATE_RNG,
   IO_SLUG_STATE_INT,
   IO_SLUG_STATE_DOUBLE, /* The change to the order may cause an error. */
+  IO_WARMSTART_HSML,
+  IO_WARMSTART_OLDACC,
   IO_LASTENTRY			/* This should be kept - it signals the end of the list */
 };
 
@@ -3364,6 +3532,9 @@ extern ALIGN(32) struct NODE
 #endif
 
   MyFloat maxsoft;		/*!< hold the maximum gravitational softening of particle in the node */
+#ifdef GRAVITY_TREE_QUADRUPOLE
+  MyFloat quad[6];		/*!< second mass moments sum(m*dx_i*dx_j) about the center of mass, in the order xx,yy,zz,xy,xz,yz */
+#endif
 
 #ifdef DM_SCALARFIELD_SCREENING
   MyFloat s_dm[3];
@@ -3392,6 +3563,10 @@ extern struct extNODE
   MyFloat divVmax;
   integertime Ti_lastkicked;
   int Flag;
+#ifdef GRAVITY_TREE_QUADRUPOLE
+  MyFloat dquad[6];		/*!< time-derivative of quad (from velocities relative to the node center-of-mass), used to drift it */
+  MyFloat dquad_kick[6];	/*!< change of dquad from kicks of local particles, accumulated for the exchange of top-level nodes */
+#endif
 }
  *Extnodes, *Extnodes_base;
 
@@ -286,6 +286,20 @@ void begrun(void)
 #ifdef CHIMES
       All.ChimesThermEvolOn = all.ChimesThermEvolOn;
 #endif
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+      int k_profile;
+      for(k_profile = 0; k_profile < SNAPSHOT_PROFILES_MAX; k_profile++) /* profile definitions can be changed on restart, but keep the output counters */
+      {
+          int filecount = All.SnapshotProfile[k_profile].FileCount;
+          All.SnapshotProfile[k_profile] = all.SnapshotProfile[k_profile];
+          All.SnapshotProfile[k_profile].FileCount = filecount;
+      }
+#endif
+#ifdef OUTPUT_INSITU_MAPS
+      All.TimeBetInSituMaps = all.TimeBetInSituMaps; All.InSituMapWidth = all.InSituMapWidth; /* imaging choices can be changed on restart */
+      All.InSituMapPixels = all.InSituMapPixels; All.InSituMapAxis = all.InSituMapAxis; All.InSituMapFields = all.InSituMapFields;
+      All.InSituMapCenter[0] = all.InSituMapCenter[0]; All.InSituMapCenter[1] = all.InSituMapCenter[1]; All.InSituMapCenter[2] = all.InSituMapCenter[2];
+#endif
 
         /* allow softenings to be modified during the run */
         if(All.ComovingIntegrationOn)
@@ -428,11 +442,17 @@ void begrun(void)
 #ifdef GALSF_EFFECTIVE_EQS
   init_clouds();
 #endif
+#ifdef GALSF_SSP_TABLES
+  init_stellar_population_tables();
+#endif
 
   char contfname[1000];
   sprintf(contfname, "%scont", All.OutputDir);
   unlink(contfname);
   open_outputfiles();
+#ifdef OUTPUT_LIGHTCONE
+  lightcone_init();
+#endif
 
 #ifdef PMGRID
   long_range_init_regionsize();
@@ -473,6 +493,14 @@ void begrun(void)
     {All.Ti_nextoutput = find_next_outputtime(All.Ti_Current + 1);}
   else
     {All.Ti_nextoutput = find_next_outputtime(All.Ti_Current);}
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+  int k_profile;
+  for(k_profile = 0; k_profile < SNAPSHOT_PROFILES_MAX; k_profile++)
+  {
+      if(RestartFlag != 1) {All.SnapshotProfile[k_profile].FileCount = (RestartFlag == 2) ? snapshot_profile_restart_count(k_profile) : 0;} /* continue the numbering on a snapshot restart */
+      All.SnapshotProfile[k_profile].Ti_next = find_next_snapshot_profile_outputtime(k_profile, All.Ti_Current + ((RestartFlag == 1) ? 1 : 0));
+  }
+#endif
 
   All.TimeLastRestartFile = CPUThisRun;
 }
@@ -600,6 +628,18 @@ void open_outputfiles(void)
 #endif // bh-output-more-info if
 #endif // black-holes if
 
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS /* per-task work histograms, plus the global list of most-expensive elements (root task only) */
+  if(ThisTask == 0) {sprintf(buf, "%swork_statistics", All.OutputDir); mkdir(buf, 02755);}
+  MPI_Barrier(MPI_COMM_WORLD);
+  sprintf(buf, "%swork_statistics/work_statistics_%d.txt", All.OutputDir, ThisTask);
+  if(!(FdWorkStats = fopen(buf, mode))) {printf("error in opening file '%s'\n", buf); endrun(1);}
+  if(ThisTask == 0)
+  {
+    sprintf(buf, "%swork_statistics/work_stragglers.txt", All.OutputDir);
+    if(!(FdWorkStragglers = fopen(buf, mode))) {printf("error in opening file '%s'\n", buf); endrun(1);}
+  }
+#endif
+
     if(ThisTask != 0) {return;}	/* only the root processors writes to the log files listed below */
 
     sprintf(buf, "%s%s", All.OutputDir, "cpu.txt");
@@ -729,7 +769,7 @@ void read_parameter_file(char *fname)
 #define REAL 1
 #define STRING 2
 #define INT 3
-#define MAXTAGS 300
+#define MAXTAGS 400
 
   FILE *fd, *fdout;
   char buf[200], buf1[200], buf2[200], buf3[400];
@@ -1298,6 +1338,69 @@ void read_parameter_file(char *fname)
       id[nt++] = REAL;
 #endif
 
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+      for(i = 0; i < SNAPSHOT_PROFILES_MAX; i++) /* tags are SnapshotProfile<n>_<Name>, with n=1,2,... */
+      {
+          sprintf(tag[nt], "SnapshotProfile%d_TimeBetween", i+1); addr[nt] = &All.SnapshotProfile[i].TimeBetween; id[nt++] = REAL;
+          sprintf(tag[nt], "SnapshotProfile%d_TimeFirst", i+1); addr[nt] = &All.SnapshotProfile[i].TimeFirst; id[nt++] = REAL;
+          sprintf(tag[nt], "SnapshotProfile%d_Types", i+1); addr[nt] = &All.SnapshotProfile[i].Types; id[nt++] = INT;
+          sprintf(tag[nt], "SnapshotProfile%d_Fields", i+1); addr[nt] = All.SnapshotProfile[i].Fields; id[nt++] = STRING;
+          sprintf(tag[nt], "SnapshotProfile%d_Center_X", i+1); addr[nt] = &All.SnapshotProfile[i].Center[0]; id[nt++] = REAL;
+          sprintf(tag[nt], "SnapshotProfile%d_Center_Y", i+1); addr[nt] = &All.SnapshotProfile[i].Center[1]; id[nt++] = REAL;
+          sprintf(tag[nt], "SnapshotProfile%d_Center_Z", i+1); addr[nt] = &All.SnapshotProfile[i].Center[2]; id[nt++] = REAL;
+          sprintf(tag[nt], "SnapshotProfile%d_Radius", i+1); addr[nt] = &All.SnapshotProfile[i].Radius; id[nt++] = REAL;
+          sprintf(tag[nt], "SnapshotProfile%d_IDFile", i+1); addr[nt] = All.SnapshotProfile[i].IDFile; id[nt++] = STRING;
+      }
+#endif
+
+#ifdef OUTPUT_LIGHTCONE
+      strcpy(tag[nt], "LightconeMaxRedshift");
+      addr[nt] = &All.LightconeMaxRedshift;
+      id[nt++] = REAL;
+
+      strcpy(tag[nt], "LightconeTypes");
+      addr[nt] = &All.LightconeTypes;
+      id[nt++] = INT;
+
+      strcpy(tag[nt], "LightconeObserverFile");
+      addr[nt] = All.LightconeObserverFile;
+      id[nt++] = STRING;
+#endif
+
+#ifdef OUTPUT_INSITU_MAPS
+      strcpy(tag[nt], "TimeBetInSituMaps");
+      addr[nt] = &All.TimeBetInSituMaps;
+      id[nt++] = REAL;
+
+      strcpy(tag[nt], "InSituMapPixels");
+      addr[nt] = &All.InSituMapPixels;
+      id[nt++] = INT;
+
+      strcpy(tag[nt], "InSituMapAxis");
+      addr[nt] = &All.InSituMapAxis;
+      id[nt++] = INT;
+
+      strcpy(tag[nt], "InSituMapFields");
+      addr[nt] = &All.InSituMapFields;
+      id[nt++] = INT;
+
+      strcpy(tag[nt], "InSituMapWidth");
+      addr[nt] = &All.InSituMapWidth;
+      id[nt++] = REAL;
+
+      strcpy(tag[nt], "InSituMapCenter_X");
+      addr[nt] = &All.InSituMapCenter[0];
+      id[nt++] = REAL;
+
+      strcpy(tag[nt], "InSituMapCenter_Y");
+      addr[nt] = &All.InSituMapCenter[1];
+      id[nt++] = REAL;
+
+      strcpy(tag[nt], "InSituMapCenter_Z");
+      addr[nt] = &All.InSituMapCenter[2];
+      id[nt++] = REAL;
+#endif
+
 
 
 
@@ -2044,6 +2147,31 @@ void read_parameter_file(char *fname)
                 if(strcmp("ST_Seed",tag[i])==0) {*((int *)addr[i])=42; printf("Tag %s (%s) not set in parameter file: defaulting to the answer to everything (=%d) \n",tag[i],alternate_tag[i],All.TurbDriving_Global_DrivingRandomNumberKey); continue;}
                 if(strcmp("ST_SolWeight",tag[i])==0) {*((double *)addr[i])=0.5; printf("Tag %s (%s) not set in parameter file: defaulting to assume the so-called natural mix of modes for pressure-free turbulence (=%g) \n",tag[i],alternate_tag[i],All.TurbDriving_Global_SolenoidalFraction); continue;}
 #endif
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+                if(strncmp("SnapshotProfile",tag[i],15)==0) /* all profile tags are optional: an unset profile is simply disabled */
+                {
+                    char *suffix = strchr(tag[i],'_');
+                    if(suffix && strcmp(suffix,"_Fields")==0) {strcpy((char *)addr[i],"all"); continue;}
+                    if(suffix && strcmp(suffix,"_IDFile")==0) {strcpy((char *)addr[i],"none"); continue;}
+                    if(suffix && strcmp(suffix,"_Types")==0) {*((int *)addr[i])=63; continue;}
+                    if(suffix && strcmp(suffix,"_TimeFirst")==0) {*((double *)addr[i])=All.TimeBegin; continue;}
+                    *((double *)addr[i])=0; continue; /* TimeBetween (0=disabled), Center, Radius (0=no spatial cut) */
+                }
+#endif
+#ifdef OUTPUT_LIGHTCONE
+                if(strcmp("LightconeTypes",tag[i])==0) {*((int *)addr[i])=63; printf("Tag %s (%s) not set in parameter file: defaulting to record all particle types (bitmask=%d) \n",tag[i],alternate_tag[i],All.LightconeTypes); continue;}
+                if(strcmp("LightconeObserverFile",tag[i])==0) {strcpy((char *)addr[i],"none"); printf("Tag %s (%s) not set in parameter file: defaulting to a single observer at the box center \n",tag[i],alternate_tag[i]); continue;}
+#endif
+#ifdef OUTPUT_INSITU_MAPS
+                if(strcmp("TimeBetInSituMaps",tag[i])==0) {*((double *)addr[i])=0; printf("Tag %s (%s) not set in parameter file: defaulting to image every coarse step (=%g) \n",tag[i],alternate_tag[i],All.TimeBetInSituMaps); continue;}
+                if(strcmp("InSituMapPixels",tag[i])==0) {*((int *)addr[i])=512; printf("Tag %s (%s) not set in parameter file: defaulting to images of (%d)^2 pixels \n",tag[i],alternate_tag[i],All.InSituMapPixels); continue;}
+                if(strcmp("InSituMapAxis",tag[i])==0) {*((int *)addr[i])=2; printf("Tag %s (%s) not set in parameter file: defaulting to project along the z-axis (=%d) \n",tag[i],alternate_tag[i],All.InSituMapAxis); continue;}
+                if(strcmp("InSituMapFields",tag[i])==0) {*((int *)addr[i])=127; printf("Tag %s (%s) not set in parameter file: defaulting to image all available fields (bitmask=%d) \n",tag[i],alternate_tag[i],All.InSituMapFields); continue;}
+                if(strcmp("InSituMapWidth",tag[i])==0) {*((double *)addr[i])=0; printf("Tag %s (%s) not set in parameter file: defaulting to image the full box/particle extent (=%g) \n",tag[i],alternate_tag[i],All.InSituMapWidth); continue;}
+                if(strcmp("InSituMapCenter_X",tag[i])==0) {*((double *)addr[i])=0; continue;}
+                if(strcmp("InSituMapCenter_Y",tag[i])==0) {*((double *)addr[i])=0; continue;}
+                if(strcmp("InSituMapCenter_Z",tag[i])==0) {*((double *)addr[i])=0; continue;}
+#endif
 #ifdef GALSF_FB_FIRE_AGE_TRACERS
                 if(strcmp("AgeTracerEventsPerTimeBin",tag[i])==0) {*((double *)addr[i])=10; printf("Tag %s (%s) not set in parameter file: defaulting to aim for ~10 age-tracer deposition events per timebin (=%g) \n",tag[i],alternate_tag[i],All.AgeTracerRateNormalization); continue;}
 #if !defined(GALSF_FB_FIRE_AGE_TRACERS_CUSTOM)
@@ -95,6 +95,9 @@ void cooling_parent_routine(void)
     }
     } /* close parallel block */
     free(active_indices); /* free memory */
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+    report_particle_work_statistics("cooling_parent_routine");
+#endif
 
 #ifdef CHIMES /* CHIMES records some extra timing information here owing to large possible imbalances */
   CPU_Step[CPU_COOLINGSFR] += measure_time(); MPI_Barrier(MPI_COMM_WORLD);
@@ -236,7 +239,13 @@ double DoCooling(double u_old, double rho, double dt, double ne_guess, int targe
 
     /* Call CHIMES to evolve the chemistry and temperature over
      * the hydro timestep. */
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+    double t_chimes_start = my_second(); /* CHIMES does not expose its internal step count, so record the solver wall-time [in microseconds] */
+#endif
     chimes_network(&(ChimesGasVars[target]), &ChimesGlobalVars);
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+    P[target].WorkCount[WORK_SOLVERSTEPS] += (int) (1.e6 * timediff(t_chimes_start, my_second()));
+#endif
 
     // Compute updated internal energy
     u = (double) ChimesGasVars[target].temperature * BOLTZMANN / ((GAMMA(target)-1) * PROTONMASS * calculate_mean_molecular_weight(&(ChimesGasVars[target]), &ChimesGlobalVars));
@@ -306,6 +315,9 @@ double DoCooling(double u_old, double rho, double dt, double ne_guess, int targe
     while(iter_condition); /* iteration condition */
     /* crash condition */
     if(iter >= MAXITER) {printf("failed to converge in DoCooling(): u_in=%g rho_in=%g dt=%g ne_in=%g target=%d \n",u_old,rho,dt,ne_guess,target); endrun(10);}
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+    P[target].WorkCount[WORK_SOLVERSTEPS] += iter + iter_upper + iter_lower;
+#endif
     double specific_energy_codeunits_toreturn = u / UNIT_SPECEGY_IN_CGS;    /* in internal units */
 
 #ifdef RT_CHEM_PHOTOION
@@ -940,7 +952,7 @@ double CoolingRate(double logT, double rho, double n_elec_guess, int target)
             photoelec += SphP[target].Rad_E_gamma[RT_FREQ_BIN_PHOTOELECTRIC] * (SphP[target].Density*All.cf_a3inv/P[target].Mass) * UNIT_PRESSURE_IN_CGS / 3.9e-14; // convert to Habing field //
 #endif
 #ifdef RT_ISRF_BACKGROUND // add a constant assumed FUV background, for isolated ISM simulations that don't get FUV from local sources self-consistently
-            double column = evaluate_NH_from_GradRho(P[target].GradRho,PPP[target].Hsml,SphP[target].Density,PPP[target].NumNgb,1,target) * UNIT_SURFDEN_IN_CGS; // converts to cgs            
+            double column = get_gas_column_density_estimate(target) * UNIT_SURFDEN_IN_CGS; // converts to cgs            
             photoelec += RT_ISRF_BACKGROUND * 1.7 * exp(-DMAX(P[target].Metallicity[0]/All.SolarAbundances[0],1e-4) * column * 500.); // RT_ISRF_BACKGROUND rescales the overal ISRF, factor of 1.7 gives Draine 1978 field in Habing units, extinction factor assumes the same FUV band-integrated dust opacity as RT module
 #endif
             if(photoelec > 0) {if(photoelec > 1.e4) {photoelec = 1.e4;}}
@@ -1534,7 +1546,7 @@ void update_explicit_molecular_fraction(int i, double dtime_cgs)
     double surface_density_H2_0 = 5.e14 * PROTONMASS, x_exp_fac=0.00085, w0=0.2; // characteristic cgs column for -molecular line- self-shielding
     w0 = 0.035; // actual calibration from Drain, Gnedin, Richings, others: 0.2 is more appropriate as a re-calibration for sims doing local eqm without ability to resolve shielding at higher columns
     //double surface_density_local = xH0 * SphP[i].Density * All.cf_a3inv * dx_cell * UNIT_SURFDEN_IN_CGS; // this is -just- the [neutral] depth through the local cell/slab. note G0 is -already- attenuated in the pre-processing by dust.
-    double surface_density_local = xH0 * evaluate_NH_from_GradRho(P[i].GradRho,PPP[i].Hsml,SphP[i].Density,PPP[i].NumNgb,1,i) * UNIT_SURFDEN_IN_CGS; // this is -just- the [neutral] depth to infinity with our Sobolev-type approximation. Note G0 is already attenuated by dust, but we need to include H2 self-shielding, for which it is appropriate to integrate to infinity.
+    double surface_density_local = xH0 * get_gas_column_density_estimate(i) * UNIT_SURFDEN_IN_CGS; // this is -just- the [neutral] depth to infinity with our Sobolev-type approximation. Note G0 is already attenuated by dust, but we need to include H2 self-shielding, for which it is appropriate to integrate to infinity.
     double v_thermal_rms = 0.111*sqrt(T); // sqrt(3*kB*T/2*mp), since want rms thermal speed of -molecular H2- in kms
     double dv2=0; int j,k; for(j=0;j<3;j++) {for(k=0;k<3;k++) {double vt = SphP[i].Gradients.Velocity[j][k]*All.cf_a2inv; /* physical velocity gradient */
         if(All.ComovingIntegrationOn) {if(j==k) {vt += All.cf_hubble_a;}} /* add hubble-flow correction */
@@ -1899,7 +1911,7 @@ void chimes_update_gas_vars(int target)
 
 #ifdef CHIMES_SOBOLEV_SHIELDING
   double surface_density;
-  surface_density = evaluate_NH_from_GradRho(P[target].GradRho,PPP[target].Hsml,SphP[target].Density,PPP[target].NumNgb,1,target) * UNIT_SURFDEN_IN_CGS; // converts to cgs
+  surface_density = get_gas_column_density_estimate(target) * UNIT_SURFDEN_IN_CGS; // converts to cgs
   ChimesGasVars[target].cell_size = (ChimesFloat) (shielding_length_factor * surface_density / rho_cgs);
 #else
   ChimesGasVars[target].cell_size = 1.0;
@@ -102,6 +102,87 @@ static double totgravcost, gravcost, totsphcost, sphcost;
 static long long totpartcount;
 static int UseAllParticles;
 
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+/* measured-cost feedback for the work-balanced decomposition. Between decompositions each task accumulates the wall-clock
+   time it spent in (compute-only) parts of the step; at the next decomposition this is compared to the share of the modeled
+   (GravCost + hydro) cost of the particles it held, and the ratio multiplies the cost of those particles (only while they are
+   still on the task they were measured on, i.e. before the exchange), so every top-node cost and hence the piece assignment
+   reflects the real time spent there. The weight given to the particle-count
+   (memory) term in the split is adjusted from the measured imbalance, and pieces are spread over shared-memory nodes. */
+static double DomainFeedback_BusyTime = 0;    /*!< compute time accumulated on this task since the last decomposition */
+static double DomainFeedback_CostFactor = 1;  /*!< measured/modeled cost ratio applied to the local particles in the current decomposition */
+static double DomainFeedback_LoadWeight = 1;  /*!< weight of the particle-load term relative to the work terms in the split */
+static int DomainFeedback_MemoryLimited = 0;  /*!< flags that the last decomposition had to fall back to the load-balanced split */
+static int *DomainFeedback_Node = NULL, *DomainFeedback_NodeNTask, DomainFeedback_NNodes = 0; /*!< compact node index of each task, and tasks per node */
+static int *DomainFeedback_TaskOrder; /*!< tasks ordered round-robin over the nodes (first task of each node, then the second, ...) */
+#define DOMAIN_FEEDBACK_FACTOR_MIN 0.2
+#define DOMAIN_FEEDBACK_FACTOR_MAX 5.0
+#define DOMAIN_FEEDBACK_LOADWEIGHT_MIN 0.1
+
+/*! called from write_cpu_log() before CPU_Step is reset: adds the compute-only parts of the step (not the waits, imbalance,
+    or communication, which are a consequence of the imbalance rather than of the local work) to the running total */
+void domain_feedback_record_step_time(void)
+{
+    int compute_parts[] = {CPU_TREEWALK1, CPU_TREEWALK2, CPU_TREEBUILD, CPU_DENSCOMPUTE, CPU_HYDCOMPUTE, CPU_AGSDENSCOMPUTE,
+        CPU_DYNDIFFCOMPUTE, CPU_IMPROVDIFFCOMPUTE, CPU_COOLINGSFR, CPU_RTNONFLUXOPS}, k;
+    for(k = 0; k < (int) (sizeof(compute_parts) / sizeof(int)); k++) {DomainFeedback_BusyTime += CPU_Step[compute_parts[k]];}
+}
+
+/*! builds (once) the compact shared-memory node index of every task from the node topology determined at startup, and the
+    node-interleaved task order used to seed the piece assignment */
+static void domain_feedback_init_nodes(void)
+{
+    int ta, r, *rank_on_node, *rank_offset;
+    if(DomainFeedback_Node) {return;}
+    DomainFeedback_Node = (int *) malloc(NTask * sizeof(int));
+    DomainFeedback_NodeNTask = (int *) calloc(NTask, sizeof(int));
+    DomainFeedback_TaskOrder = (int *) malloc(NTask * sizeof(int));
+    rank_on_node = (int *) malloc(NTask * sizeof(int));
+    rank_offset = (int *) calloc(NTask + 1, sizeof(int));
+    for(ta = 0; ta < NTask; ta++)
+    {
+        int leader = mpi_task_node_leader(ta);
+        if(leader == ta) {DomainFeedback_Node[ta] = DomainFeedback_NNodes++;} else {DomainFeedback_Node[ta] = DomainFeedback_Node[leader];} /* the leader is the lowest rank on its node, so it was already assigned */
+        rank_on_node[ta] = DomainFeedback_NodeNTask[DomainFeedback_Node[ta]]++;
+        rank_offset[rank_on_node[ta] + 1]++;
+    }
+    for(r = 0; r < NTask; r++) {rank_offset[r + 1] += rank_offset[r];} /* counting-sort by the rank within the node */
+    for(ta = 0; ta < NTask; ta++) {DomainFeedback_TaskOrder[rank_offset[rank_on_node[ta]]++] = ta;}
+    free(rank_offset); free(rank_on_node);
+    if(ThisTask == 0) {printf("Domain feedback: interleaving the domain pieces over %d shared-memory nodes\n", DomainFeedback_NNodes);}
+}
+
+/*! compare the measured compute time of this task since the last decomposition to the modeled (uncorrected) cost share of the
+    particles it holds, which are the ones it was measured on, and set the cost multiplier and the load weight used for the new
+    decomposition. the multiplier is derived afresh each time, so it never carries over to particles which were measured on
+    another task. must be called by all tasks, once per decomposition (not for each TopNodeAllocFactor retry). */
+static void domain_feedback_update(void)
+{
+    int i; double cost[2] = {0}, totcost[2], local[2], sum[2], maxbusy, model, measured, imbalance;
+    for(i = 0; i < NumPart; i++)
+    {
+        double wt = domain_particle_cost_multiplier(i);
+        cost[0] += (1 + wt) * domain_particle_costfactor(i);
+        if(TimeBinActive[P[i].TimeBin] || UseAllParticles) {cost[1] += wt;}
+    }
+    MPI_Allreduce(cost, totcost, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    local[0] = cost[0] / (totcost[0] + MIN_REAL_NUMBER) + cost[1] / (totcost[1] + MIN_REAL_NUMBER); /* modeled share of the total cost */
+    local[1] = DomainFeedback_BusyTime;
+    MPI_Allreduce(local, sum, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&DomainFeedback_BusyTime, &maxbusy, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    DomainFeedback_CostFactor = 1;
+    if(sum[1] <= 0 || sum[0] <= 0) {return;} /* nothing measured since the last decomposition: use the model as it is */
+
+    model = local[0] / sum[0]; measured = DomainFeedback_BusyTime / sum[1];
+    if(model > 0 && measured > 0) {DomainFeedback_CostFactor = DMIN(DOMAIN_FEEDBACK_FACTOR_MAX, DMAX(DOMAIN_FEEDBACK_FACTOR_MIN, measured / model));}
+
+    imbalance = maxbusy / (sum[1] / NTask);
+    if(DomainFeedback_MemoryLimited) {DomainFeedback_LoadWeight = DMIN(1., 1.25 * DomainFeedback_LoadWeight);} /* memory ceiling was hit: give the load more weight again */
+        else if(imbalance > 1.1) {DomainFeedback_LoadWeight = DMAX(DOMAIN_FEEDBACK_LOADWEIGHT_MIN, 0.8 * DomainFeedback_LoadWeight);} /* trade memory balance for work balance */
+    PRINT_STATUS(" ..measured compute-time imbalance (max/mean)=%g since the last decomposition: load-weight=%g", imbalance, DomainFeedback_LoadWeight);
+}
+#endif
+
 /*! This is the main routine for the domain decomposition.  It acts as a driver routine that allocates various temporary buffers, maps the
  *  particles back onto the periodic box if needed, and then does the domain decomposition, and a final Peano-Hilbert order of all particles as a tuning measure. */
 void domain_Decomposition(int UseAllTimeBins, int SaveKeys, int do_particle_mergesplit_key)
@@ -148,6 +229,9 @@ void domain_Decomposition(int UseAllTimeBins, int SaveKeys, int do_particle_merg
     
     PRINT_STATUS("Domain decomposition building... LevelToTimeBin[TakeLevel=%d]=%d  (presently allocated=%g MB)", TakeLevel, All.LevelToTimeBin[TakeLevel], AllocatedBytes / (1024.0 * 1024.0));
     t0 = my_second();
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+    domain_feedback_update(); /* once per decomposition, before any retry below */
+#endif
 
     do
     {
@@ -434,6 +518,11 @@ int domain_decompose(void)
 
     MPI_Allreduce(&gravcost, &totgravcost, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
     MPI_Allreduce(&sphcost, &totsphcost, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK /* correct the modeled costs of the local particles with the measured compute time */
+    gravcost *= DomainFeedback_CostFactor; sphcost *= DomainFeedback_CostFactor;
+    MPI_Allreduce(&gravcost, &totgravcost, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&sphcost, &totsphcost, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
 
     /* determine global dimensions of domain grid */
     domain_findExtent();
@@ -444,6 +533,9 @@ int domain_decompose(void)
     domain_assign_load_or_work_balanced(1,multipledomains);
 
     status = domain_check_memory_bound(multipledomains);
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+    DomainFeedback_MemoryLimited = (status != 0);
+#endif
 
     if(status != 0)		/* the optimum balanced solution violates memory constraint, let's try something different */
     {
@@ -539,6 +631,9 @@ int domain_decompose(void)
     }
     while(ret > 0);
 
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+    DomainFeedback_BusyTime = 0; /* the particle set has changed, so start a new measurement */
+#endif
     return 0;
 }
 
@@ -1205,6 +1300,9 @@ void domain_findSplit_work_balanced(int ncpu, int ndomain)
     }
  
     if(worksph>0) fac0=0.333333; else fac0=0.5;
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+    if(worksph>0) fac0=1./(2.+DomainFeedback_LoadWeight); else fac0=1./(1.+DomainFeedback_LoadWeight); /* keep the weights normalized with the adjusted load term */
+#endif
 #ifdef SEPARATE_STELLARDOMAINDECOMP
   //if(workstars>0)
   //  fac0 = 1./(1. + 1./fac0);
@@ -1213,6 +1311,9 @@ void domain_findSplit_work_balanced(int ncpu, int ndomain)
       /* in this case we give equal weight to gravitational work-load, SPH work load, and particle load */
       fac_work = fac0 / work;
       fac_load = fac0 / load;
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+      fac_load *= DomainFeedback_LoadWeight;
+#endif
       if(worksph>0)
         {fac_worksph = fac0 / worksph;}
       else
@@ -1324,12 +1425,20 @@ void domain_assign_load_or_work_balanced(int mode, int multipledomains)
 
   int best_queue, target, next, prev;
   int i, n, q, ta;
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+  double *nodework, target_node_balance;
+  domain_feedback_init_nodes();
+#endif
 
   domainAssign = (struct domain_segments_data *) mymalloc("domainAssign",
 							  multipledomains * NTask *
 							  sizeof(struct domain_segments_data));
 
   tasklist = (struct tasklist_data *) mymalloc("tasklist", NTask * sizeof(struct tasklist_data));
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+  nodework = (double *) mymalloc("nodework", DomainFeedback_NNodes * sizeof(double));
+  for(i = 0; i < DomainFeedback_NNodes; i++) {nodework[i] = 0;}
+#endif
 
   for(ta = 0; ta < NTask; ta++)
     {
@@ -1397,6 +1506,17 @@ void domain_assign_load_or_work_balanced(int mode, int multipledomains)
       queues[q].previous = (int *) mymalloc("queues[q].previous", NTask * sizeof(int));
       queues[q].value = (double *) mymalloc("queues[q].value", NTask * sizeof(double));
 
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+      for(i = 0; i < NTask; i++) /* seed in node-interleaved order, so the heaviest pieces (assigned first, to tasks of equal value) go to different nodes */
+	{
+	  ta = DomainFeedback_TaskOrder[i];
+	  queues[q].next[ta] = (i < NTask - 1) ? DomainFeedback_TaskOrder[i + 1] : -1;
+	  queues[q].previous[ta] = (i > 0) ? DomainFeedback_TaskOrder[i - 1] : -1;
+	  queues[q].value[ta] = 0;
+	}
+      queues[q].first = DomainFeedback_TaskOrder[0];
+      queues[q].last = DomainFeedback_TaskOrder[NTask - 1];
+#else
       for(ta = 0; ta < NTask; ta++)
 	{
 	  queues[q].next[ta] = ta + 1;
@@ -1407,6 +1527,7 @@ void domain_assign_load_or_work_balanced(int mode, int multipledomains)
       queues[q].next[NTask - 1] = -1;
       queues[q].first = 0;
       queues[q].last = NTask - 1;
+#endif
     }
 
   for(n = 0; n < multipledomains * NTask; n++)
@@ -1428,6 +1549,11 @@ void domain_assign_load_or_work_balanced(int mode, int multipledomains)
 	  target_max_balance = target_work_balance;
 	  if(target_max_balance < target_load_balance) {target_max_balance = target_load_balance;}
 	  if(target_max_balance < target_load_activesph_balance) {target_max_balance = target_load_activesph_balance;}
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+	  /* mean work per task of the node the target sits on: avoids piling the heavy pieces onto one node's shared memory bandwidth */
+	  target_node_balance = (domainAssign[n].work + nodework[DomainFeedback_Node[target]]) / ((tot_work + 1.0e-30) * DomainFeedback_NodeNTask[DomainFeedback_Node[target]]);
+	  if(target_max_balance < target_node_balance) {target_max_balance = target_node_balance;}
+#endif
 #ifdef SEPARATE_STELLARDOMAINDECOMP
       //if(target_max_balance < target_load_activestars_balance) {target_max_balance = target_load_activestars_balance;}
 #endif
@@ -1452,6 +1578,9 @@ void domain_assign_load_or_work_balanced(int mode, int multipledomains)
       //tasklist[target].load_activestars += domainAssign[n].load_activestars;
 #endif
       tasklist[target].count++;
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+      nodework[DomainFeedback_Node[target]] += domainAssign[n].work;
+#endif
 
       /* now we need to remove the element 'target' from the 3 queue's and reinsert it */
 //#ifdef SEPARATE_STELLARDOMAINDECOMP
@@ -1554,6 +1683,9 @@ void domain_assign_load_or_work_balanced(int mode, int multipledomains)
       myfree(queues[q].next);
     }
 
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+  myfree(nodework);
+#endif
   myfree(tasklist);
 
   myfree(domainAssign);
@@ -1697,10 +1829,10 @@ int domain_countToGo(size_t nlimit)
 	}
     }
 
-  MPI_Alltoall(toGo, 1, MPI_INT, toGet, 1, MPI_INT, MPI_COMM_WORLD);
-  MPI_Alltoall(toGoSph, 1, MPI_INT, toGetSph, 1, MPI_INT, MPI_COMM_WORLD);
+  mpi_sparse_alltoall_counts(toGo, toGet);
+  mpi_sparse_alltoall_counts(toGoSph, toGetSph);
 #ifdef SEPARATE_STELLARDOMAINDECOMP
-  MPI_Alltoall(toGoStars, 1, MPI_INT, toGetStars, 1, MPI_INT, MPI_COMM_WORLD);
+  mpi_sparse_alltoall_counts(toGoStars, toGetStars);
 #endif
 
   if(package >= nlimit) {ret = 1;} else {ret = 0;}
@@ -1947,11 +2079,11 @@ int domain_countToGo(size_t nlimit)
 #endif
 		}
 
-	      MPI_Alltoall(toGo, 1, MPI_INT, toGet, 1, MPI_INT, MPI_COMM_WORLD);
-	      MPI_Alltoall(toGoSph, 1, MPI_INT, toGetSph, 1, MPI_INT, MPI_COMM_WORLD);
+	      mpi_sparse_alltoall_counts(toGo, toGet);
+	      mpi_sparse_alltoall_counts(toGoSph, toGetSph);
 
 #ifdef SEPARATE_STELLARDOMAINDECOMP
-	      MPI_Alltoall(toGoStars, 1, MPI_INT, toGetStars, 1, MPI_INT, MPI_COMM_WORLD);
+	      mpi_sparse_alltoall_counts(toGoStars, toGetStars);
 	      myfree(local_toGoStars);
 #endif
 	      myfree(local_toGoSph);
@@ -2043,7 +2175,11 @@ int domain_check_for_local_refine(int i, double countlimit, double costlimit)
 			if(j >= 7) {break;}
 		      }
 
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+		  topNodes[sub].Cost += DomainFeedback_CostFactor * (1 + domain_particle_cost_multiplier(mp[p].index)) * domain_particle_costfactor(mp[p].index);
+#else
 		  topNodes[sub].Cost += (1 + domain_particle_cost_multiplier(mp[p].index)) * domain_particle_costfactor(mp[p].index);
+#endif
 		  topNodes[sub].Count++;
 		}
 
@@ -2448,10 +2584,13 @@ void domain_sumCost(void)
       while(topNodes[no].Daughter >= 0) {no = topNodes[no].Daughter + (Key[n] - topNodes[no].StartKey) / (topNodes[no].Size >> 3);}
 
       no = topNodes[no].Leaf;
-      double wt = domain_particle_cost_multiplier(n);
-      local_domainWork[no] += (1 + wt) * domain_particle_costfactor(n);
+      double wt = domain_particle_cost_multiplier(n), fb = 1;
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+      fb = DomainFeedback_CostFactor;
+#endif
+      local_domainWork[no] += fb * (1 + wt) * domain_particle_costfactor(n);
       local_domainCount[no] += 1;
-      if(TimeBinActive[P[n].TimeBin] || UseAllParticles) {local_domainWorkSph[no] += wt;}
+      if(TimeBinActive[P[n].TimeBin] || UseAllParticles) {local_domainWorkSph[no] += fb * wt;}
       if(P[n].Type == 0) {local_domainCountSph[no] += 1;}
 
 #ifdef SEPARATE_STELLARDOMAINDECOMP
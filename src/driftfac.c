@@ -28,6 +28,29 @@
 static double logTimeBegin;
 static double logTimeMax;
 
+/* slopes (with respect to the table index) of the integrals at the table nodes, for cubic Hermite interpolation:
+   node k sits at log(a)=logTimeBegin+k*(logTimeMax-logTimeBegin)/DRIFT_TABLE_LENGTH, and holds the integral up to there
+   (zero at k=0, DriftTable[k-1] etc otherwise) */
+static double DriftTableSlope[DRIFT_TABLE_LENGTH + 1];
+static double GravKickTableSlope[DRIFT_TABLE_LENGTH + 1];
+
+/* cache of the most recently used factors: all elements in a given timebin kick (and, mostly, drift) over the same
+   integertime interval within a step, so the interval (time0,time1) is stored in the slot given by the highest set bit of
+   its length, and looked up before interpolating. each thread keeps its own copy, since drifts happen inside the
+   threaded tree-walks; entries from before the last (re-)build of the tables are ignored. */
+#define DRIFTFAC_CACHE_SLOTS (TIMEBINS + 2)
+struct driftfac_cache_entry
+{
+  integertime time0, time1;
+  int generation;
+  double value;
+};
+static struct driftfac_cache_entry DriftFacCache[DRIFTFAC_CACHE_SLOTS], GravKickFacCache[DRIFTFAC_CACHE_SLOTS];
+#ifdef _OPENMP
+#pragma omp threadprivate(DriftFacCache, GravKickFacCache)
+#endif
+static int driftfac_table_generation = 0;
+
 
 double drift_integ(double a, void *param)
 {
@@ -61,13 +84,14 @@ void init_drift_table(void)
 {
 #define WORKSIZE 100000
   int i;
-  double result, abserr;
+  double result, abserr, a, dloga;
 
   gsl_function F;
   gsl_integration_workspace *workspace;
 
   logTimeBegin = log(All.TimeBegin);
   logTimeMax = log(All.TimeMax);
+  dloga = (logTimeMax - logTimeBegin) / DRIFT_TABLE_LENGTH;
 
   workspace = gsl_integration_workspace_alloc(WORKSIZE);
 
@@ -88,6 +112,51 @@ void init_drift_table(void)
       GravKickTable[i] = result;
     }
   gsl_integration_workspace_free(workspace);
+
+  /* the slopes follow exactly from the integrands: dF/di = a * f(a) * dlog(a)/di */
+  for(i = 0; i <= DRIFT_TABLE_LENGTH; i++)
+    {
+      a = exp(logTimeBegin + dloga * i);
+      DriftTableSlope[i] = a * drift_integ(a, NULL) * dloga;
+      GravKickTableSlope[i] = a * gravkick_integ(a, NULL) * dloga;
+    }
+  driftfac_table_generation++; /* invalidates all cached factors */
+}
+
+
+/*! cubic Hermite interpolation of the integral (table + slope, see above) up to the integer time 'time' */
+static double driftfac_table_interpolate(double *table, double *slope, integertime time)
+{
+  double u, t, f0, f1;
+  int i;
+
+  if(logTimeMax > logTimeBegin)
+    u = (time * All.Timebase_interval) / (logTimeMax - logTimeBegin) * DRIFT_TABLE_LENGTH;
+  else
+    u = 0;
+  i = (int) u;
+  if(i >= DRIFT_TABLE_LENGTH)
+    i = DRIFT_TABLE_LENGTH - 1;
+  if(i < 0)
+    i = 0;
+  t = u - i;
+
+  f0 = (i > 0) ? table[i - 1] : 0;
+  f1 = table[i];
+  return (1 + 2 * t) * (1 - t) * (1 - t) * f0 + t * (1 - t) * (1 - t) * slope[i]
+    + t * t * (3 - 2 * t) * f1 - t * t * (1 - t) * slope[i + 1];
+}
+
+
+/*! slot of the factor cache for the interval (time0,time1): the highest set bit of its length, so the synchronous
+ *  intervals of the different timebins land in different slots */
+static int driftfac_cache_slot(integertime time0, integertime time1)
+{
+  integertime dti = time1 - time0;
+  int slot = 0;
+  if(dti < 0) {dti = -dti;}
+  while(dti > 0 && slot < DRIFTFAC_CACHE_SLOTS - 1) {dti >>= 1; slot++;}
+  return slot;
 }
 
 
@@ -100,95 +169,29 @@ void init_drift_table(void)
  */
 double get_drift_factor(integertime time0, integertime time1)
 {
-  double a1, a2, df1, df2, u1, u2;
-  int i1, i2;
-  static integertime last_time0 = -1, last_time1 = -1;
-  static double last_value;
-
-  if(time0 == last_time0 && time1 == last_time1)
-    return last_value;
-
   /* note: will only be called for cosmological integration */
+  struct driftfac_cache_entry *c = &DriftFacCache[driftfac_cache_slot(time0, time1)];
 
-  a1 = logTimeBegin + time0 * All.Timebase_interval;
-  a2 = logTimeBegin + time1 * All.Timebase_interval;
-
-  if(logTimeMax > logTimeBegin)
-    u1 = (a1 - logTimeBegin) / (logTimeMax - logTimeBegin) * DRIFT_TABLE_LENGTH;
-  else
-    u1 = 0;
-  i1 = (int) u1;
-  if(i1 >= DRIFT_TABLE_LENGTH)
-    i1 = DRIFT_TABLE_LENGTH - 1;
+  if(c->time0 == time0 && c->time1 == time1 && c->generation == driftfac_table_generation)
+    return c->value;
 
-  if(i1 <= 1)
-    df1 = u1 * DriftTable[0];
-  else
-    df1 = DriftTable[i1 - 1] + (DriftTable[i1] - DriftTable[i1 - 1]) * (u1 - i1);
-
-  if(logTimeMax > logTimeBegin)
-    u2 = (a2 - logTimeBegin) / (logTimeMax - logTimeBegin) * DRIFT_TABLE_LENGTH;
-  else
-    u2 = 0;
-  i2 = (int) u2;
-  if(i2 >= DRIFT_TABLE_LENGTH)
-    i2 = DRIFT_TABLE_LENGTH - 1;
-
-  if(i2 <= 1)
-    df2 = u2 * DriftTable[0];
-  else
-    df2 = DriftTable[i2 - 1] + (DriftTable[i2] - DriftTable[i2 - 1]) * (u2 - i2);
-
-  last_time0 = time0;
-  last_time1 = time1;
-
-  return last_value = (df2 - df1);
+  c->time0 = time0;
+  c->time1 = time1;
+  c->generation = driftfac_table_generation;
+  return c->value = driftfac_table_interpolate(DriftTable, DriftTableSlope, time1) - driftfac_table_interpolate(DriftTable, DriftTableSlope, time0);
 }
 
 
 double get_gravkick_factor(integertime time0, integertime time1)
 {
-  double a1, a2, df1, df2, u1, u2;
-  int i1, i2;
-  static integertime last_time0 = -1, last_time1 = -1;
-  static double last_value;
-
-  if(time0 == last_time0 && time1 == last_time1)
-    return last_value;
-
   /* note: will only be called for cosmological integration */
+  struct driftfac_cache_entry *c = &GravKickFacCache[driftfac_cache_slot(time0, time1)];
 
-  a1 = logTimeBegin + time0 * All.Timebase_interval;
-  a2 = logTimeBegin + time1 * All.Timebase_interval;
-
-  if(logTimeMax > logTimeBegin)
-    u1 = (a1 - logTimeBegin) / (logTimeMax - logTimeBegin) * DRIFT_TABLE_LENGTH;
-  else
-    u1 = 0;
-  i1 = (int) u1;
-  if(i1 >= DRIFT_TABLE_LENGTH)
-    i1 = DRIFT_TABLE_LENGTH - 1;
-
-  if(i1 <= 1)
-    df1 = u1 * GravKickTable[0];
-  else
-    df1 = GravKickTable[i1 - 1] + (GravKickTable[i1] - GravKickTable[i1 - 1]) * (u1 - i1);
-
-  if(logTimeMax > logTimeBegin)
-    u2 = (a2 - logTimeBegin) / (logTimeMax - logTimeBegin) * DRIFT_TABLE_LENGTH;
-  else
-    u2 = 0;
-  i2 = (int) u2;
-  if(i2 >= DRIFT_TABLE_LENGTH)
-    i2 = DRIFT_TABLE_LENGTH - 1;
-
-  if(i2 <= 1)
-    df2 = u2 * GravKickTable[0];
-  else
-    df2 = GravKickTable[i2 - 1] + (GravKickTable[i2] - GravKickTable[i2 - 1]) * (u2 - i2);
-
-  last_time0 = time0;
-  last_time1 = time1;
+  if(c->time0 == time0 && c->time1 == time1 && c->generation == driftfac_table_generation)
+    return c->value;
 
-  return last_value = (df2 - df1);
+  c->time0 = time0;
+  c->time1 = time1;
+  c->generation = driftfac_table_generation;
+  return c->value = driftfac_table_interpolate(GravKickTable, GravKickTableSlope, time1) - driftfac_table_interpolate(GravKickTable, GravKickTableSlope, time0);
 }
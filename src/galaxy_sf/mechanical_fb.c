@@ -184,8 +184,8 @@ void determine_where_SNe_occur(void)
 #ifdef GALSF_FB_MECHANICAL
 
 
-int addFB_evaluate_active_check(int i, int fb_loop_iteration);
-int addFB_evaluate_active_check(int i, int fb_loop_iteration)
+int addFB_evaluate_active_check_base(int i, int fb_loop_iteration);
+int addFB_evaluate_active_check_base(int i, int fb_loop_iteration)
 {
     if(P[i].Type <= 1) {return 0;} // note quantities used here must -not- change in the loop [hence not using mass here], b/c can change offsets for return from different processors, giving a negative mass and undefined behaviors
     if(PPP[i].Hsml <= 0) {return 0;}
@@ -194,6 +194,27 @@ int addFB_evaluate_active_check(int i, int fb_loop_iteration)
     if(P[i].Type == 5 && !P[i].do_gas_search_this_timestep) {return 0;}
 #endif
     if(P[i].SNe_ThisTimeStep>0) {if(fb_loop_iteration<0 || fb_loop_iteration==0) {return 1;}}
+    return 0;
+}
+
+/* once the first weighting pass is done, a source whose total coupling weight is zero has no neighbor it can couple to: the later passes would
+    only walk the tree and export it to other tasks to get zero back, so it is skipped [Area_weighted_sum[0] is not modified after that pass] */
+int addFB_source_has_zero_weight(int i, int fb_loop_iteration);
+int addFB_source_has_zero_weight(int i, int fb_loop_iteration)
+{
+#ifdef GALSF_USE_SNE_ONELOOP_SCHEME
+    if(fb_loop_iteration < 0) {return 0;} /* weights are computed in this pass */
+#else
+    if(fb_loop_iteration < -1) {return 0;} /* weights are computed in this pass */
+#endif
+    return (P[i].Area_weighted_sum[0] <= 0);
+}
+
+int addFB_evaluate_active_check(int i, int fb_loop_iteration);
+int addFB_evaluate_active_check(int i, int fb_loop_iteration)
+{
+    if(!addFB_evaluate_active_check_base(i, fb_loop_iteration)) {return 0;}
+    return !addFB_source_has_zero_weight(i, fb_loop_iteration);
 }
 
 #define CORE_FUNCTION_NAME addFB_evaluate /* name of the 'core' function doing the actual inter-neighbor operations. this MUST be defined somewhere as "int CORE_FUNCTION_NAME(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)" */
@@ -297,7 +318,7 @@ int addFB_evaluate(int target, int mode, int *exportflag, int *exportnodecount,
     // now define quantities that will be used below //
     double Esne51; Esne51 = 0.5*local.SNe_v_ejecta*local.SNe_v_ejecta*local.Msne / unit_egy_SNe;
     double RsneKPC, RsneKPC_0; RsneKPC=0.; RsneKPC_0=(0.0284/unitlength_in_kpc) * pow(1+Esne51,0.286); //Cioffi: weak external pressure
-    double r2max_phys = 2.0/unitlength_in_kpc; r2max_phys *= r2max_phys; // no super-long-range effects allowed! (of course this is arbitrary in code units) //
+    double rmax_cut = 2.0/unitlength_in_kpc, r2max_phys = rmax_cut*rmax_cut; // no super-long-range effects allowed! (of course this is arbitrary in code units) //
 
     /* Now start the actual FB computation for this particle */
     if(mode == 0) {startnode = All.MaxPart;} else {startnode = DATAGET_NAME[target].NodeList[0]; startnode = Nodes[startnode].u.d.nextnode;} /* root node & node opening */
@@ -305,7 +326,7 @@ int addFB_evaluate(int target, int mode, int *exportflag, int *exportnodecount,
     {
         while(startnode >= 0)
         {
-            numngb_inbox = ngb_treefind_pairs_threads(local.Pos, local.Hsml, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
+            numngb_inbox = ngb_treefind_pairs_threads_culled(local.Pos, local.Hsml, rmax_cut, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist); /* no exports to tasks holding nothing inside the long-range cutoff */
             if(numngb_inbox < 0) {return -2;}
 
             E_coupled = dP_sum = dP_boost_sum = 0;
@@ -582,7 +603,7 @@ int addFB_evaluate(int target, int mode, int *exportflag, int *exportnodecount,
     } else {
         RsneKPC_0 *= pow(Esne51,0.286); // ensures smooth conservation for winds and tracers as mass-loading goes to vanishingly small values
     }
-    double r2max_phys = 2.0/unitlength_in_kpc; // no super-long-range effects allowed! (of course this is arbitrary in code units) //
+    double r2max_phys = 2.0/unitlength_in_kpc, rmax_cut = r2max_phys; // no super-long-range effects allowed! (of course this is arbitrary in code units) //
     if(local.Hsml >= r2max_phys) {psi_egycon=DMIN(psi_egycon,1); psi_cool=DMIN(psi_cool,1);}
     r2max_phys *= r2max_phys;
 
@@ -592,7 +613,7 @@ int addFB_evaluate(int target, int mode, int *exportflag, int *exportnodecount,
     {
         while(startnode >= 0)
         {
-            numngb_inbox = ngb_treefind_pairs_threads(local.Pos, local.Hsml, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
+            numngb_inbox = ngb_treefind_pairs_threads_culled(local.Pos, local.Hsml, rmax_cut, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist); /* no exports to tasks holding nothing inside the long-range cutoff */
             if(numngb_inbox < 0) {return -2;}
 
             E_coupled = dP_sum = dP_boost_sum = 0;
@@ -1009,10 +1030,17 @@ void mechanical_fb_calc(int fb_loop_iteration)
 #endif // SN_INJECTED_MOMENTUM_ACCOUNTING
 
     PRINT_STATUS(" ..mechanical feedback loop: iteration %d",fb_loop_iteration);
+    long long n_cull_loc[4]={0}, n_cull_tot[4]; /* sources active, sources skipped with zero weight, remote top-level nodes tested, and kept for export */
+    {int i; for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {if(addFB_evaluate_active_check_base(i, fb_loop_iteration)) {n_cull_loc[0]++; if(addFB_source_has_zero_weight(i, fb_loop_iteration)) {n_cull_loc[1]++;}}}}
+    Ngb_Export_Culling_Count[0] = Ngb_Export_Culling_Count[1] = 0;
     #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
     loop_iteration = fb_loop_iteration; /* sets the appropriate feedback type for the calls below */
     #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
     #include "../system/code_block_xchange_perform_ops_demalloc.h" /* this de-allocates the memory for the MPI/OPENMP/Pthreads parallelization block which must appear above */
+    n_cull_loc[2] = Ngb_Export_Culling_Count[0]; n_cull_loc[3] = Ngb_Export_Culling_Count[1];
+    MPI_Reduce(n_cull_loc, n_cull_tot, 4, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    PRINT_STATUS(" ..mechanical feedback loop %d: %lld sources (%lld skipped with zero coupling weight), %lld remote top-level nodes tested for export: %lld exported, %lld culled",
+        fb_loop_iteration, n_cull_tot[0], n_cull_tot[1], n_cull_tot[2], n_cull_tot[3], n_cull_tot[2]-n_cull_tot[3]);
     CPU_Step[CPU_SNIIHEATING] += measure_time(); /* collect timings and reset clock for next timing */
 
 #ifdef DEBUG_RADIAL_MOMENTUM
@@ -56,7 +56,7 @@ void assign_imf_properties_from_starforming_gas(int i)
 
     /* now we need to record all the properties we care to save about the star-forming gas, for the sake of later use: */
     int j,k;
-    double NH = evaluate_NH_from_GradRho(P[i].GradRho,PPP[i].Hsml,SphP[i].Density,PPP[i].NumNgb,1,i);
+    double NH = get_gas_column_density_estimate(i);
     double dv2abs_tot = 0; /* calculate complete velocity dispersion (including hubble-flow correction) in physical units */
     for(j=0;j<3;j++)
     {
@@ -193,7 +193,7 @@ double return_probability_of_this_forming_bh_from_seed_model(int i)
     if(S_u < 3.5) {p *= 1 - exp(-S_u*S_u);} // quadratic cutoff at low densities: probability drops as S^(2), saturates at 1
     p /= 1 + Z_u + 0.5*Z_u*Z_u; // quadratic expansion of exponential cutoff: probability drops as Z^(-2) rather than exp(-Z), saturates at 1
 #else
-    surfacedensity = evaluate_NH_from_GradRho(P[i].GradRho,PPP[i].Hsml,SphP[i].Density,PPP[i].NumNgb,1,i) * UNIT_SURFDEN_IN_CGS; /* this gives the Sobolev-estimated column density of -gas- alone */
+    surfacedensity = get_gas_column_density_estimate(i) * UNIT_SURFDEN_IN_CGS; /* this gives the Sobolev-estimated column density of -gas- alone */
     if(surfacedensity>0.1*surfacedensity_threshold_cgs) {p *= (1-exp(-surfacedensity/surfacedensity_threshold_cgs)) * exp(-Z_in_solar/Z_threshold_solar);} else {p=0;} /* apply threshold metallicity and density cutoff */
 #endif
 #endif
@@ -420,10 +420,23 @@ void star_formation_parent_routine(void)
     }
 #endif // HII_TEST_PROBLEM
 
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    /* build the list of active gas elements. its order (the active-list order) fixes the order of all random draws and conversions below, so the result does not depend on the number of threads */
+    int j, N_active=0, *active_indices; active_indices = (int *) malloc(N_gas * sizeof(int));
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {if((P[i].Type == 0)&&(P[i].Mass>0)) {active_indices[N_active] = i; N_active++;}}
+    double *sm_expected = (double *) malloc((N_active+1) * sizeof(double)); /* expected stellar mass formed this timestep, per list entry [<0 if not eligible] */
+
+    /* first pass: evaluate the eligibility criteria and the star formation rate of each element. this is the expensive part (velocity-gradient, virial, Jeans,
+        molecular criteria and the effective-eos update), and it only reads/writes the element itself, so it is openmp-parallelized like the cooling loop */
+#ifdef _OPENMP
+#pragma omp parallel private(i, j, flag, dtime)
+#endif
+    { /* open parallel block */
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for(j=0;j<N_active;j++)
     {
-      if((P[i].Type == 0)&&(P[i].Mass>0))
-      {
+        i = active_indices[j]; /* actual particle index */
         SphP[i].Sfr = 0; flag = 1; /* will be reset below if flag==0, but default to flag = 1 (non-eligible) */
         dtime = GET_PARTICLE_TIMESTEP_IN_PHYSICAL(i); /*  the actual time-step */
 
@@ -439,9 +452,26 @@ void star_formation_parent_routine(void)
         if(SphP[i].DelayTimeCoolingSNe > 0) {flag=1; SphP[i].DelayTimeCoolingSNe -= dtime;} /* no star formation for particles in the wind; update our wind delay-time calculations */
 #endif
 
+        sm_expected[j] = -1;
         if((flag == 0)&&(dtime>0))		/* active star formation (upon start-up, we need to protect against dt==0) */
+        {
+            sm_expected[j] = get_starformation_rate(i, 0) * dtime; // expected stellar mass formed this timestep (this also updates entropies for the effective equation-of-state model) //
+            SphP[i].Sfr = sm_expected[j] / dtime * UNIT_MASS_IN_SOLAR / UNIT_TIME_IN_YR;
+        }
+    }
+    } /* close parallel block */
+
+    /* second pass: serial and in list order -- accumulate the statistics, draw the random numbers, and apply the conversions (these spawn new elements and modify the tree and the time-bin lists) */
+    for(j=0;j<N_active;j++)
+    {
+      i = active_indices[j];
+      if((P[i].Type == 0)&&(P[i].Mass>0))
+      {
+        dtime = GET_PARTICLE_TIMESTEP_IN_PHYSICAL(i); /*  the actual time-step */
+        if(sm_expected[j] < 0) {flag = 1; sm = 0;} else {flag = 0; sm = sm_expected[j];}
+
+        if(flag == 0)
 	    {
-          sm = get_starformation_rate(i, 0) * dtime; // expected stellar mass formed this timestep (this also updates entropies for the effective equation-of-state model) //
 	      p = sm / P[i].Mass;
 	      sum_sm += P[i].Mass * (1 - exp(-p));
 
@@ -453,8 +483,7 @@ void star_formation_parent_routine(void)
 	      mass_of_star = P[i].Mass / (GALSF_GENERATIONS - number_of_stars_generated);
           if(number_of_stars_generated >= GALSF_GENERATIONS-1) mass_of_star=P[i].Mass;
 
-          SphP[i].Sfr = sm / dtime * UNIT_MASS_IN_SOLAR / UNIT_TIME_IN_YR;
-	      if(dtime>0) {TimeBinSfr[P[i].TimeBin] += SphP[i].Sfr;}
+	      TimeBinSfr[P[i].TimeBin] += SphP[i].Sfr;
 
           prob = P[i].Mass / mass_of_star * (1 - exp(-p));
 
@@ -596,7 +625,7 @@ void star_formation_parent_routine(void)
                 P[i].DensAroundStar = SphP[i].Density;
 
 #ifdef OUTPUT_SINK_FORMATION_PROPS //save the at-formation properties of sink particles
-                        MyDouble tempB[3]={0,0,0}; double NH = evaluate_NH_from_GradRho(P[i].GradRho,PPP[i].Hsml,SphP[i].Density,PPP[i].NumNgb,1,i); double dv2_abs = 0; /* calculate local velocity dispersion (including hubble-flow correction) in physical units */
+                        MyDouble tempB[3]={0,0,0}; double NH = get_gas_column_density_estimate(i); double dv2_abs = 0; /* calculate local velocity dispersion (including hubble-flow correction) in physical units */
 #ifdef MAGNETIC
                         tempB[0]=SphP[i].B[0];tempB[1]=SphP[i].B[1];tempB[2]=SphP[i].B[2]; //use particle magnetic field
 #endif
@@ -677,6 +706,7 @@ void star_formation_parent_routine(void)
 
 	} /* End of If Type = 0 */
     } /* end of main loop over active particles, huzzah! */
+    free(sm_expected); free(active_indices); /* free memory */
 
 
 
@@ -73,6 +73,63 @@ double calculate_relative_light_to_mass_ratio_from_imf(double stellar_age_in_gyr
 }
 
 
+/* fitting functions (in stellar age only) for the IMF-averaged stellar-population quantities listed in 'stellar_population_quantity_list':
+    these are the per-unit-mass fits used by the feedback and radiation modules. hard age cutoffs (e.g. no ionizing photons after 20 Myr)
+    are applied by the callers, so the functions here are smooth enough to tabulate. */
+static double stellar_population_fit(int k, double star_age)
+{
+    switch(k)
+    {
+        case SSP_IONIZING_LUM_PER_MASS: {double t0=0.0035; if(star_age < t0) {return 500.;} // updated SB99 tracks: including rotation, new mass-loss tracks, etc.
+            double log_age=log10(star_age/t0); return 470.*pow(10.,-2.24*log_age-4.2*log_age*log_age) + 60.*pow(10.,-3.6*log_age);}
+        case SSP_OPTICAL_FRACTION: {double f_op=0; if(star_age <= 0.0025) {f_op=0.09;} else { // Optical-NIR approximate spectra for stars as used in the FIRE (Hopkins et al.) models
+            if(star_age <= 0.006) {f_op=0.09*(1+((star_age-0.0025)/0.004)*((star_age-0.0025)/0.004));} else {f_op=1-0.8410937/(1+sqrt((star_age-0.006)/0.3));}}
+            return f_op;}
+        case SSP_PHOTOELECTRIC_LUM_PER_MASS: {double x_age_pe = star_age / 3.4e-3; // from integrating the spectra from STARBURST99 with the Geneva40 solar-metallicity + lower tracks, age relative to a convenient break time
+            if(x_age_pe <= 1) {return 1.07e36 * (1.+x_age_pe*x_age_pe);} else {return 2.14e36 / (x_age_pe * sqrt(x_age_pe));}}
+        case SSP_LYMAN_WERNER_LUM_PER_MASS: {double x_age_lw = star_age / 3.4e-3; // same source as the photo-electric band
+            if(x_age_lw <= 1) {return 0.429e36 * (1.+x_age_lw*x_age_lw);} else {return 0.962e36 * pow(x_age_lw,-1.6) * exp(-x_age_lw/117.6);}}
+        case SSP_SNE_CUMULATIVE_PER_MASS: // integral of the 'dummy' mechanical-feedback model in mechanical_fb_calculate_eventrates: 3e-4 SNe/Myr/Msun for t = 0-30 Myr //
+            return 3.e-4 * 1000. * DMIN(DMAX(star_age,0), 0.03);
+    }
+    return 0;
+}
+
+
+#ifdef GALSF_SSP_TABLES
+#define SSP_TABLE_NAGE 1024         /* number of tabulated ages */
+#define SSP_TABLE_LOGAGE_MIN (-4.)  /* log10 of the youngest tabulated age [Gyr] */
+#define SSP_TABLE_LOGAGE_MAX (1.25) /* log10 of the oldest tabulated age [Gyr] */
+static double SSP_Table_Age[SSP_TABLE_NAGE], SSP_Table[SSP_N_QUANTITIES][SSP_TABLE_NAGE];
+
+/* tabulate the fits above once, on a grid uniform in log(age), so the per-star evaluation is an index computation and a linear interpolation */
+void init_stellar_population_tables(void)
+{
+    int j, k;
+    for(j=0;j<SSP_TABLE_NAGE;j++)
+    {
+        SSP_Table_Age[j] = pow(10., SSP_TABLE_LOGAGE_MIN + (SSP_TABLE_LOGAGE_MAX-SSP_TABLE_LOGAGE_MIN) * j / (SSP_TABLE_NAGE-1.));
+        for(k=0;k<SSP_N_QUANTITIES;k++) {SSP_Table[k][j] = stellar_population_fit(k, SSP_Table_Age[j]);}
+    }
+    if(ThisTask==0) {printf(" ..tabulated %d stellar-population quantities at %d ages (%g-%g Gyr)\n", SSP_N_QUANTITIES, SSP_TABLE_NAGE, SSP_Table_Age[0], SSP_Table_Age[SSP_TABLE_NAGE-1]);}
+}
+#endif
+
+
+/* return the stellar-population quantity k (see 'stellar_population_quantity_list') at the given age: from the table if GALSF_SSP_TABLES is set, otherwise from the fit directly */
+double stellar_population_quantity(int k, double stellar_age_in_gyr)
+{
+#ifdef GALSF_SSP_TABLES
+    double x = (log10(stellar_age_in_gyr) - SSP_TABLE_LOGAGE_MIN) * ((SSP_TABLE_NAGE-1.) / (SSP_TABLE_LOGAGE_MAX-SSP_TABLE_LOGAGE_MIN));
+    if(!(x > 0) || (x >= SSP_TABLE_NAGE-1)) {return stellar_population_fit(k, stellar_age_in_gyr);} /* outside the table (or age<=0): rare, so just evaluate the fit */
+    int j = (int)x; double w = (stellar_age_in_gyr - SSP_Table_Age[j]) / (SSP_Table_Age[j+1] - SSP_Table_Age[j]); /* interpolate linearly in age [exact for the piecewise-linear cumulative SNe number] */
+    w = DMIN(DMAX(w,0),1); return SSP_Table[k][j] + w * (SSP_Table[k][j+1] - SSP_Table[k][j]);
+#else
+    return stellar_population_fit(k, stellar_age_in_gyr);
+#endif
+}
+
+
 #if defined(FLAG_NOT_IN_PUBLIC_CODE) || (defined(RT_CHEM_PHOTOION) && defined(GALSF))
 /* routine to compute the -ionizing- luminosity coming from either individual stars or an SSP */
 double particle_ionizing_luminosity_in_cgs(long i)
@@ -87,20 +144,13 @@ double particle_ionizing_luminosity_in_cgs(long i)
 
     if(P[i].Type != 5)
     {
-      double lm_ssp=0;
       double star_age=evaluate_stellar_age_Gyr(P[i].StellarAge);
-      double t0=0.0035;
       double tmax=0.02;
-      if(star_age < t0) {
-	lm_ssp=500.;
-      } else {
-	double log_age=log10(star_age/t0);
-	lm_ssp = 470.*pow(10.,-2.24*log_age-4.2*log_age*log_age) + 60.*pow(10.,-3.6*log_age);
-      }
-      lm_ssp *= calculate_relative_light_to_mass_ratio_from_imf(star_age, i);
       if(star_age >= tmax) {
 	return 0;
       } // skip since old stars don't contribute
+      double lm_ssp = stellar_population_quantity(SSP_IONIZING_LUM_PER_MASS, star_age);
+      lm_ssp *= calculate_relative_light_to_mass_ratio_from_imf(star_age, i);
       
       // converts to cgs luminosity [lm_ssp is in Lsun/Msun, here]
       return lm_ssp * SOLAR_LUM * (P[i].Mass*UNIT_MASS_IN_SOLAR);
@@ -205,9 +255,16 @@ double mechanical_fb_calculate_eventrates(int i, double dt)
 
 #ifdef GALSF_FB_MECHANICAL /* STELLAR-POPULATION version: mechanical feedback: 'dummy' example model below assumes a constant SNe rate for t < 30 Myr, then nothing. experiment! */
     double star_age = evaluate_stellar_age_Gyr(P[i].StellarAge);
+#ifdef GALSF_SSP_TABLES /* integrate the tabulated cumulative SNe number over this step [age-dt,age], so a step which straddles the end of the SNe phase gets its share */
+    double n_sne_per_msun = stellar_population_quantity(SSP_SNE_CUMULATIVE_PER_MASS, star_age) - stellar_population_quantity(SSP_SNE_CUMULATIVE_PER_MASS, star_age - dt*UNIT_TIME_IN_GYR);
+    if(n_sne_per_msun > 0)
+    {
+        double RSNe = n_sne_per_msun / (dt*UNIT_TIME_IN_MYR); // mean rate over the step, in SNe/Myr/solar mass //
+#else
     if(star_age < 0.03)
     {
         double RSNe = 3.e-4; // assume a constant rate ~ 3e-4 SNe/Myr/solar mass for t = 0-30 Myr //
+#endif
         double p = RSNe * (P[i].Mass*UNIT_MASS_IN_SOLAR) * (dt*UNIT_TIME_IN_MYR); // unit conversion factor
         double n_sn_0=(float)floor(p); p-=n_sn_0; if(get_random_number(P[i].ID+6) < p) {n_sn_0++;} // determine if SNe occurs
         P[i].SNe_ThisTimeStep = n_sn_0; // assign to particle
@@ -124,6 +124,67 @@ void ags_out2particle_density(struct OUTPUT_STRUCT_NAME *out, int i, int mode, i
 }
 
 
+/*! contribution of neighbor j (at separation dp, r2 < h^2) to the kernel-length sums of a target at pos/vel with AGS kernel length h=1/hinv.
+    this is the pair-wise part of ags_density_evaluate, shared with the fused hydro+AGS density pass in density.c. nv_t is only used (and may
+    be NULL otherwise) when AGS_FACE_CALCULATION_IS_ACTIVE is set */
+/*!   -- this subroutine writes to shared memory [updating the neighbor values, primarily for wakeup-type updates]: need to protect these writes for openmp below */
+void ags_density_kernel_contribution(int j, double dp[3], double r2, double hinv, double hinv3, double hinv4, MyFloat vel[3], MyDouble pos[3],
+                                     MyLongDouble *ngb, MyLongDouble *dhsmlngb, MyLongDouble *zeta, MyLongDouble *vsig_max, MyLongDouble *divvel, MyLongDouble nv_t[3][3])
+{
+    double r = sqrt(r2), u = r * hinv, wk, dwk, dv[3];
+    kernel_main(u, hinv3, hinv4, &wk, &dwk, 0);
+    *ngb += wk;
+    *dhsmlngb += -(NUMDIMS * hinv * wk + u * dwk);
+    *zeta += P[j].Mass * kernel_gravity(u, hinv, hinv3, 0); // needs to be here, should include self-contribution
+    if(r <= 0) {return;}
+    if(P[j].Type==0)
+    {
+        dv[0] = vel[0] - SphP[j].VelPred[0];
+        dv[1] = vel[1] - SphP[j].VelPred[1];
+        dv[2] = vel[2] - SphP[j].VelPred[2];
+    } else {
+        dv[0] = vel[0] - P[j].Vel[0];
+        dv[1] = vel[1] - P[j].Vel[1];
+        dv[2] = vel[2] - P[j].Vel[2];
+    }
+    NGB_SHEARBOX_BOUNDARY_VELCORR_(pos,P[j].Pos,dv,1); /* wrap velocities for shearing boxes if needed */
+    double v_dot_r = dp[0] * dv[0] + dp[1] * dv[1] + dp[2] * dv[2], fac_mu = -3 / (All.cf_afac3 * All.cf_atime);
+    if(v_dot_r > 0) {v_dot_r *= 0.333333;} // receding elements don't signal strong change in forces in the same manner as approaching/converging particles
+    double vsig = 0.5 * fabs( fac_mu * v_dot_r / r );
+    short int TimeBin_j = P[j].TimeBin; if(TimeBin_j < 0) {TimeBin_j = -TimeBin_j - 1;} // need to make sure we correct for the fact that TimeBin is used as a 'switch' here to determine if a particle is active for iteration, otherwise this gives nonsense!
+    if(vsig > *vsig_max) {*vsig_max = vsig;}
+#if defined(WAKEUP) && (defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(DM_FUZZY) || defined(FLAG_NOT_IN_PUBLIC_CODE))
+    int wakeup_condition = 0; // determine if wakeup is allowed
+    if(!(TimeBinActive[TimeBin_j]) && (All.Time > All.TimeBegin) && (vsig > WAKEUP*P[j].AGS_vsig)) {wakeup_condition = 1;}
+#if defined(GALSF)
+    if((P[j].Type == 4)||((All.ComovingIntegrationOn==0)&&((P[j].Type == 2)||(P[j].Type==3)))) {wakeup_condition = 0;} // don't wakeup star particles, or risk 2x-counting feedback events! //
+#endif
+    if(wakeup_condition) // do the wakeup
+    {
+            #pragma omp atomic write
+            P[j].wakeup = 1;
+            #pragma omp atomic write
+            NeedToWakeupParticles_local = 1;
+    }
+#endif
+    *divvel -= dwk * (dp[0] * dv[0] + dp[1] * dv[1] + dp[2] * dv[2]) / r;
+    /* this is the -particle- divv estimator, which determines how Hsml will evolve */
+#if defined(AGS_FACE_CALCULATION_IS_ACTIVE)
+    nv_t[0][0] +=  wk * dp[0] * dp[0];
+    nv_t[0][1] +=  wk * dp[0] * dp[1];
+    nv_t[0][2] +=  wk * dp[0] * dp[2];
+    nv_t[1][1] +=  wk * dp[1] * dp[1];
+    nv_t[1][2] +=  wk * dp[1] * dp[2];
+    nv_t[2][2] +=  wk * dp[2] * dp[2];
+#endif
+}
+#if defined(AGS_FACE_CALCULATION_IS_ACTIVE)
+#define AGS_OUT_NV_T(out) ((out).NV_T)
+#else
+#define AGS_OUT_NV_T(out) (NULL)
+#endif
+
+
 /*! This function represents the core of the density computation. The
  *  target particle may either be local, or reside in the communication
  *  buffer.
@@ -133,7 +194,7 @@ int ags_density_evaluate(int target, int mode, int *exportflag, int *exportnodec
 {
     int j, n;
     int startnode, numngb_inbox, listindex = 0;
-    double r2, h2, u;
+    double r2, h2;
     struct kernel_density kernel;
     struct INPUT_STRUCT_NAME local;
     struct OUTPUT_STRUCT_NAME out;
@@ -159,7 +220,6 @@ int ags_density_evaluate(int target, int mode, int *exportflag, int *exportnodec
     }
     
     
-    double fac_mu = -3 / (All.cf_afac3 * All.cf_atime);
     while(startnode >= 0)
     {
         while(startnode >= 0)
@@ -177,61 +237,7 @@ int ags_density_evaluate(int target, int mode, int *exportflag, int *exportnodec
                 kernel.dp[2] = local.Pos[2] - P[j].Pos[2];
                 NEAREST_XYZ(kernel.dp[0],kernel.dp[1],kernel.dp[2],1); // find the closest image in the given box size
                 r2 = kernel.dp[0] * kernel.dp[0] + kernel.dp[1] * kernel.dp[1] + kernel.dp[2] * kernel.dp[2];
-                if(r2 < h2)
-                {
-                    kernel.r = sqrt(r2);
-                    u = kernel.r * kernel.hinv;
-                    kernel_main(u, kernel.hinv3, kernel.hinv4, &kernel.wk, &kernel.dwk, 0);
-
-                    out.Ngb += kernel.wk;
-                    out.DhsmlNgb += -(NUMDIMS * kernel.hinv * kernel.wk + u * kernel.dwk);
-                    out.AGS_zeta += P[j].Mass * kernel_gravity(u, kernel.hinv, kernel.hinv3, 0); // needs to be here, should include self-contribution
-
-                    if(kernel.r > 0)
-                    {
-                        if(P[j].Type==0)
-                        {
-                            kernel.dv[0] = local.Vel[0] - SphP[j].VelPred[0];
-                            kernel.dv[1] = local.Vel[1] - SphP[j].VelPred[1];
-                            kernel.dv[2] = local.Vel[2] - SphP[j].VelPred[2];
-                        } else {
-                            kernel.dv[0] = local.Vel[0] - P[j].Vel[0];
-                            kernel.dv[1] = local.Vel[1] - P[j].Vel[1];
-                            kernel.dv[2] = local.Vel[2] - P[j].Vel[2];
-                        }
-                        NGB_SHEARBOX_BOUNDARY_VELCORR_(local.Pos,P[j].Pos,kernel.dv,1); /* wrap velocities for shearing boxes if needed */
-                        double v_dot_r = kernel.dp[0] * kernel.dv[0] + kernel.dp[1] * kernel.dv[1] + kernel.dp[2] * kernel.dv[2];
-                        if(v_dot_r > 0) {v_dot_r *= 0.333333;} // receding elements don't signal strong change in forces in the same manner as approaching/converging particles
-                        double vsig = 0.5 * fabs( fac_mu * v_dot_r / kernel.r );
-                        short int TimeBin_j = P[j].TimeBin; if(TimeBin_j < 0) {TimeBin_j = -TimeBin_j - 1;} // need to make sure we correct for the fact that TimeBin is used as a 'switch' here to determine if a particle is active for iteration, otherwise this gives nonsense!
-                        if(vsig > out.AGS_vsig) {out.AGS_vsig = vsig;}
-#if defined(WAKEUP) && (defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(DM_FUZZY) || defined(FLAG_NOT_IN_PUBLIC_CODE))
-                        int wakeup_condition = 0; // determine if wakeup is allowed
-                        if(!(TimeBinActive[TimeBin_j]) && (All.Time > All.TimeBegin) && (vsig > WAKEUP*P[j].AGS_vsig)) {wakeup_condition = 1;}
-#if defined(GALSF)
-                        if((P[j].Type == 4)||((All.ComovingIntegrationOn==0)&&((P[j].Type == 2)||(P[j].Type==3)))) {wakeup_condition = 0;} // don't wakeup star particles, or risk 2x-counting feedback events! //
-#endif
-                        if(wakeup_condition) // do the wakeup
-                        {
-                                #pragma omp atomic write
-                                P[j].wakeup = 1;
-                                #pragma omp atomic write
-                                NeedToWakeupParticles_local = 1;
-                        }
-#endif
-                        out.Particle_DivVel -= kernel.dwk * (kernel.dp[0] * kernel.dv[0] + kernel.dp[1] * kernel.dv[1] + kernel.dp[2] * kernel.dv[2]) / kernel.r;
-                        /* this is the -particle- divv estimator, which determines how Hsml will evolve */
-                        
-#if defined(AGS_FACE_CALCULATION_IS_ACTIVE)
-                        out.NV_T[0][0] +=  kernel.wk * kernel.dp[0] * kernel.dp[0];
-                        out.NV_T[0][1] +=  kernel.wk * kernel.dp[0] * kernel.dp[1];
-                        out.NV_T[0][2] +=  kernel.wk * kernel.dp[0] * kernel.dp[2];
-                        out.NV_T[1][1] +=  kernel.wk * kernel.dp[1] * kernel.dp[1];
-                        out.NV_T[1][2] +=  kernel.wk * kernel.dp[1] * kernel.dp[2];
-                        out.NV_T[2][2] +=  kernel.wk * kernel.dp[2] * kernel.dp[2];
-#endif
-                    }
-                }
+                if(r2 < h2) {ags_density_kernel_contribution(j, kernel.dp, r2, kernel.hinv, kernel.hinv3, kernel.hinv4, local.Vel, local.Pos, &out.Ngb, &out.DhsmlNgb, &out.AGS_zeta, &out.AGS_vsig, &out.Particle_DivVel, AGS_OUT_NV_T(out));}
             }
         }
         
@@ -251,261 +257,292 @@ int ags_density_evaluate(int target, int mode, int *exportflag, int *exportnodec
 
 
 
-void ags_density(void)
+/*! normalize the neighbor sums of element i after a pass of the AGS kernel-length loop, and update its AGS_Hsml if it has not
+    converged to the desired neighbor number. returns 1 if the element needs to be iterated again, 0 otherwise (the caller
+    marks converged elements). Left/Right/AGS_Prev are the bracketing and previous-value arrays of the caller's iteration */
+int ags_density_update_kernel_length(int i, int iter, MyFloat *Left, MyFloat *Right, MyFloat *AGS_Prev)
 {
-    /* initialize variables used below, in particlar the structures we need to call throughout the iteration */
-    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second(); MyFloat *Left, *Right, *AGS_Prev; double fac, fac_lim, desnumngb, desnumngbdev; long long ntot;
-    int i, npleft, iter=0, redo_particle, particle_set_to_minhsml_flag = 0, particle_set_to_maxhsml_flag = 0;
-    AGS_Prev = (MyFloat *) mymalloc("AGS_Prev", NumPart * sizeof(MyFloat));
-    Left = (MyFloat *) mymalloc("Left", NumPart * sizeof(MyFloat));
-    Right = (MyFloat *) mymalloc("Right", NumPart * sizeof(MyFloat));
-    /* initialize anything we need to about the active particles before their loop */
-    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {
-        if(ags_density_isactive(i)) {
-            Left[i] = Right[i] = 0; AGS_Prev[i] = PPP[i].AGS_Hsml; PPP[i].AGS_vsig = 0;
-#ifdef WAKEUP
-            P[i].wakeup = 0;
+    double fac, fac_lim, desnumngb, desnumngbdev; int redo_particle, particle_set_to_minhsml_flag = 0, particle_set_to_maxhsml_flag = 0;
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+    P[i].WorkCount[WORK_ITERATIONS]++;
 #endif
-      }}
-
-    /* allocate buffers to arrange communication */
-    #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
-    /* we will repeat the whole thing for those particles where we didn't find enough neighbours */
-    do
+#ifdef DM_FUZZY
+    P[i].AGS_Density = P[i].Mass * PPP[i].NumNgb;
+#endif
+    if(PPP[i].NumNgb > 0)
     {
-        #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
+        PPP[i].DhsmlNgbFactor *= PPP[i].AGS_Hsml / (NUMDIMS * PPP[i].NumNgb);
+        P[i].Particle_DivVel /= PPP[i].NumNgb;
+        /* spherical volume of the Kernel (use this to normalize 'effective neighbor number') */
+        PPP[i].NumNgb *= NORM_COEFF * pow(PPP[i].AGS_Hsml,NUMDIMS);
+    } else {
+        PPP[i].NumNgb = PPP[i].DhsmlNgbFactor = P[i].Particle_DivVel = 0;
+    }
+    
+    // inverse of SPH volume element (to satisfy constraint implicit in Lagrange multipliers)
+    if(PPP[i].DhsmlNgbFactor > -0.9)	/* note: this would be -1 if only a single particle at zero lag is found */
+        PPP[i].DhsmlNgbFactor = 1 / (1 + PPP[i].DhsmlNgbFactor);
+    else
+        PPP[i].DhsmlNgbFactor = 1;
+    P[i].Particle_DivVel *= PPP[i].DhsmlNgbFactor;
+    
+    /* now check whether we have enough neighbours */
+    redo_particle = 0;
+    
+    double minsoft = ags_return_minsoft(i);
+    double maxsoft = ags_return_maxsoft(i);
+    if(All.Time > All.TimeBegin)
+    {
+        minsoft = DMAX(minsoft , AGS_Prev[i]*AGS_DSOFT_TOL);
+        maxsoft = DMIN(maxsoft , AGS_Prev[i]/AGS_DSOFT_TOL);
+    }
+    desnumngb = All.AGS_DesNumNgb;
+    desnumngbdev = All.AGS_MaxNumNgbDeviation;
+    /* allow the neighbor tolerance to gradually grow as we iterate, so that we don't spend forever trapped in a narrow iteration */
+#if defined(AGS_FACE_CALCULATION_IS_ACTIVE)
+    double ConditionNumber = do_cbe_nvt_inversion_for_faces(i); // right now we don't do anything with this, but could use to force expansion of search, as in hydro
+    if(ConditionNumber > MAX_REAL_NUMBER) {PRINT_WARNING("CNUM for CBE: ThisTask=%d i=%d ConditionNumber=%g desnumngb=%g NumNgb=%g iter=%d NVT=%g/%g/%g/%g/%g/%g AGS_Hsml=%g \n",ThisTask,i,ConditionNumber,desnumngb,PPP[i].NumNgb,iter,P[i].NV_T[0][0],P[i].NV_T[1][1],P[i].NV_T[2][2],P[i].NV_T[0][1],P[i].NV_T[0][2],P[i].NV_T[1][2],PPP[i].AGS_Hsml);}
+    if(iter > 10) {desnumngbdev = DMIN( 0.25*desnumngb , desnumngbdev * exp(0.1*log(desnumngb/(16.*desnumngbdev))*((double)iter - 9.)) );}
+#else
+    if(iter > 4) {desnumngbdev = DMIN( 0.25*desnumngb , desnumngbdev * exp(0.1*log(desnumngb/(16.*desnumngbdev))*((double)iter - 3.)) );}
+#endif
+    if(All.Time<=All.TimeBegin) {if(desnumngbdev > 0.0005) desnumngbdev=0.0005; if(iter > 50) {desnumngbdev = DMIN( 0.25*desnumngb , desnumngbdev * exp(0.1*log(desnumngb/(16.*desnumngbdev))*((double)iter - 49.)) );}}
 
-      /* do check on whether we have enough neighbors, and iterate for density-hsml solution */
-        double tstart = my_second(), tend;
-        for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
+
+    /* check if we are in the 'normal' range between the max/min allowed values */
+    if((PPP[i].NumNgb < (desnumngb - desnumngbdev) && PPP[i].AGS_Hsml < 0.999*maxsoft) ||
+       (PPP[i].NumNgb > (desnumngb + desnumngbdev) && PPP[i].AGS_Hsml > 1.001*minsoft))
+        redo_particle = 1;
+    
+    /* check maximum kernel size allowed */
+    particle_set_to_maxhsml_flag = 0;
+    if((PPP[i].AGS_Hsml >= 0.999*maxsoft) && (PPP[i].NumNgb < (desnumngb - desnumngbdev)))
+    {
+        redo_particle = 0;
+        if(PPP[i].AGS_Hsml == maxsoft)
         {
-            if(ags_density_isactive(i))
+            /* iteration at the maximum value is already complete */
+            particle_set_to_maxhsml_flag = 0;
+        } else {
+            /* ok, the particle needs to be set to the maximum, and (if gas) iterated one more time */
+            redo_particle = 1;
+            PPP[i].AGS_Hsml = maxsoft;
+            particle_set_to_maxhsml_flag = 1;
+        }
+    }
+    
+    /* check minimum kernel size allowed */
+    particle_set_to_minhsml_flag = 0;
+    if((PPP[i].AGS_Hsml <= 1.001*minsoft) && (PPP[i].NumNgb > (desnumngb + desnumngbdev)))
+    {
+        redo_particle = 0;
+        if(PPP[i].AGS_Hsml == minsoft)
+        {
+            /* this means we've already done an iteration with the MinHsml value, so the
+             neighbor weights, etc, are not going to be wrong; thus we simply stop iterating */
+            particle_set_to_minhsml_flag = 0;
+        } else {
+            /* ok, the particle needs to be set to the minimum, and (if gas) iterated one more time */
+            redo_particle = 1;
+            PPP[i].AGS_Hsml = minsoft;
+            particle_set_to_minhsml_flag = 1;
+        }
+    }
+    
+    if(redo_particle)
+    {
+        if(iter >= MAXITER - 10)
+        {
+            PRINT_WARNING("AGS: i=%d task=%d ID=%llu Type=%d Hsml=%g dhsml=%g Left=%g Right=%g Ngbs=%g Right-Left=%g maxh_flag=%d minh_flag=%d  minsoft=%g maxsoft=%g desnum=%g desnumtol=%g redo=%d pos=(%g|%g|%g)\n",
+                   i, ThisTask, (unsigned long long) P[i].ID, P[i].Type, PPP[i].AGS_Hsml, PPP[i].DhsmlNgbFactor, Left[i], Right[i],
+                   (float) PPP[i].NumNgb, Right[i] - Left[i], particle_set_to_maxhsml_flag, particle_set_to_minhsml_flag, minsoft,
+                   maxsoft, desnumngb, desnumngbdev, redo_particle, P[i].Pos[0], P[i].Pos[1], P[i].Pos[2]);
+        }
+        
+        if(Left[i] > 0 && Right[i] > 0)
+            if((Right[i] - Left[i]) < 1.0e-3 * Left[i])
             {
-#ifdef DM_FUZZY
-                P[i].AGS_Density = P[i].Mass * PPP[i].NumNgb;
-#endif
-                if(PPP[i].NumNgb > 0)
+                /* this one should be ok */
+                return 0;
+            }
+        
+        if((particle_set_to_maxhsml_flag==0)&&(particle_set_to_minhsml_flag==0))
+        {
+            if(PPP[i].NumNgb < (desnumngb - desnumngbdev))
+            {
+                Left[i] = DMAX(PPP[i].AGS_Hsml, Left[i]);
+            }
+            else
+            {
+                if(Right[i] != 0)
                 {
-                    PPP[i].DhsmlNgbFactor *= PPP[i].AGS_Hsml / (NUMDIMS * PPP[i].NumNgb);
-                    P[i].Particle_DivVel /= PPP[i].NumNgb;
-                    /* spherical volume of the Kernel (use this to normalize 'effective neighbor number') */
-                    PPP[i].NumNgb *= NORM_COEFF * pow(PPP[i].AGS_Hsml,NUMDIMS);
-                } else {
-                    PPP[i].NumNgb = PPP[i].DhsmlNgbFactor = P[i].Particle_DivVel = 0;
+                    if(PPP[i].AGS_Hsml < Right[i])
+                        Right[i] = PPP[i].AGS_Hsml;
                 }
-                
-                // inverse of SPH volume element (to satisfy constraint implicit in Lagrange multipliers)
-                if(PPP[i].DhsmlNgbFactor > -0.9)	/* note: this would be -1 if only a single particle at zero lag is found */
-                    PPP[i].DhsmlNgbFactor = 1 / (1 + PPP[i].DhsmlNgbFactor);
                 else
-                    PPP[i].DhsmlNgbFactor = 1;
-                P[i].Particle_DivVel *= PPP[i].DhsmlNgbFactor;
-                
-                /* now check whether we have enough neighbours */
-                redo_particle = 0;
-                
-                double minsoft = ags_return_minsoft(i);
-                double maxsoft = ags_return_maxsoft(i);
-                if(All.Time > All.TimeBegin)
+                    Right[i] = PPP[i].AGS_Hsml;
+            }
+            
+            // right/left define upper/lower bounds from previous iterations
+            if(Right[i] > 0 && Left[i] > 0)
+            {
+                // geometric interpolation between right/left //
+                double maxjump=0;
+                if(iter>1) {maxjump = 0.2*log(Right[i]/Left[i]);}
+                if(PPP[i].NumNgb > 1)
                 {
-                    minsoft = DMAX(minsoft , AGS_Prev[i]*AGS_DSOFT_TOL);
-                    maxsoft = DMIN(maxsoft , AGS_Prev[i]/AGS_DSOFT_TOL);
+                    double jumpvar = PPP[i].DhsmlNgbFactor * log( desnumngb / PPP[i].NumNgb ) / NUMDIMS;
+                    if(iter>1) {if(fabs(jumpvar) < maxjump) {if(jumpvar<0) {jumpvar=-maxjump;} else {jumpvar=maxjump;}}}
+                    PPP[i].AGS_Hsml *= exp(jumpvar);
+                } else {
+                    PPP[i].AGS_Hsml *= 2.0;
                 }
-                desnumngb = All.AGS_DesNumNgb;
-                desnumngbdev = All.AGS_MaxNumNgbDeviation;
-                /* allow the neighbor tolerance to gradually grow as we iterate, so that we don't spend forever trapped in a narrow iteration */
-#if defined(AGS_FACE_CALCULATION_IS_ACTIVE)
-                double ConditionNumber = do_cbe_nvt_inversion_for_faces(i); // right now we don't do anything with this, but could use to force expansion of search, as in hydro
-                if(ConditionNumber > MAX_REAL_NUMBER) {PRINT_WARNING("CNUM for CBE: ThisTask=%d i=%d ConditionNumber=%g desnumngb=%g NumNgb=%g iter=%d NVT=%g/%g/%g/%g/%g/%g AGS_Hsml=%g \n",ThisTask,i,ConditionNumber,desnumngb,PPP[i].NumNgb,iter,P[i].NV_T[0][0],P[i].NV_T[1][1],P[i].NV_T[2][2],P[i].NV_T[0][1],P[i].NV_T[0][2],P[i].NV_T[1][2],PPP[i].AGS_Hsml);}
-                if(iter > 10) {desnumngbdev = DMIN( 0.25*desnumngb , desnumngbdev * exp(0.1*log(desnumngb/(16.*desnumngbdev))*((double)iter - 9.)) );}
-#else
-                if(iter > 4) {desnumngbdev = DMIN( 0.25*desnumngb , desnumngbdev * exp(0.1*log(desnumngb/(16.*desnumngbdev))*((double)iter - 3.)) );}
-#endif
-                if(All.Time<=All.TimeBegin) {if(desnumngbdev > 0.0005) desnumngbdev=0.0005; if(iter > 50) {desnumngbdev = DMIN( 0.25*desnumngb , desnumngbdev * exp(0.1*log(desnumngb/(16.*desnumngbdev))*((double)iter - 49.)) );}}
-
-
-                /* check if we are in the 'normal' range between the max/min allowed values */
-                if((PPP[i].NumNgb < (desnumngb - desnumngbdev) && PPP[i].AGS_Hsml < 0.999*maxsoft) ||
-                   (PPP[i].NumNgb > (desnumngb + desnumngbdev) && PPP[i].AGS_Hsml > 1.001*minsoft))
-                    redo_particle = 1;
-                
-                /* check maximum kernel size allowed */
-                particle_set_to_maxhsml_flag = 0;
-                if((PPP[i].AGS_Hsml >= 0.999*maxsoft) && (PPP[i].NumNgb < (desnumngb - desnumngbdev)))
+                if((PPP[i].AGS_Hsml<Right[i])&&(PPP[i].AGS_Hsml>Left[i]))
                 {
-                    redo_particle = 0;
-                    if(PPP[i].AGS_Hsml == maxsoft)
+                    if(iter > 1)
                     {
-                        /* iteration at the maximum value is already complete */
-                        particle_set_to_maxhsml_flag = 0;
-                    } else {
-                        /* ok, the particle needs to be set to the maximum, and (if gas) iterated one more time */
-                        redo_particle = 1;
-                        PPP[i].AGS_Hsml = maxsoft;
-                        particle_set_to_maxhsml_flag = 1;
+                        double hfac = exp(maxjump);
+                        if(PPP[i].AGS_Hsml > Right[i] / hfac) {PPP[i].AGS_Hsml = Right[i] / hfac;}
+                        if(PPP[i].AGS_Hsml < Left[i] * hfac) {PPP[i].AGS_Hsml = Left[i] * hfac;}
                     }
+                } else {
+                    if(PPP[i].AGS_Hsml>Right[i]) PPP[i].AGS_Hsml=Right[i];
+                    if(PPP[i].AGS_Hsml<Left[i]) PPP[i].AGS_Hsml=Left[i];
+                    PPP[i].AGS_Hsml = pow(PPP[i].AGS_Hsml * Left[i] * Right[i] , 1.0/3.0);
                 }
-                
-                /* check minimum kernel size allowed */
-                particle_set_to_minhsml_flag = 0;
-                if((PPP[i].AGS_Hsml <= 1.001*minsoft) && (PPP[i].NumNgb > (desnumngb + desnumngbdev)))
+            }
+            else
+            {
+                if(Right[i] == 0 && Left[i] == 0)
                 {
-                    redo_particle = 0;
-                    if(PPP[i].AGS_Hsml == minsoft)
-                    {
-                        /* this means we've already done an iteration with the MinHsml value, so the
-                         neighbor weights, etc, are not going to be wrong; thus we simply stop iterating */
-                        particle_set_to_minhsml_flag = 0;
-                    } else {
-                        /* ok, the particle needs to be set to the minimum, and (if gas) iterated one more time */
-                        redo_particle = 1;
-                        PPP[i].AGS_Hsml = minsoft;
-                        particle_set_to_minhsml_flag = 1;
-                    }
+                    char buf[1000]; sprintf(buf, "AGS: Right[i] == 0 && Left[i] == 0 && PPP[i].AGS_Hsml=%g\n", PPP[i].AGS_Hsml); terminate(buf);
                 }
                 
-                if(redo_particle)
+                if(Right[i] == 0 && Left[i] > 0)
                 {
-                    if(iter >= MAXITER - 10)
-                    {
-                        PRINT_WARNING("AGS: i=%d task=%d ID=%llu Type=%d Hsml=%g dhsml=%g Left=%g Right=%g Ngbs=%g Right-Left=%g maxh_flag=%d minh_flag=%d  minsoft=%g maxsoft=%g desnum=%g desnumtol=%g redo=%d pos=(%g|%g|%g)\n",
-                               i, ThisTask, (unsigned long long) P[i].ID, P[i].Type, PPP[i].AGS_Hsml, PPP[i].DhsmlNgbFactor, Left[i], Right[i],
-                               (float) PPP[i].NumNgb, Right[i] - Left[i], particle_set_to_maxhsml_flag, particle_set_to_minhsml_flag, minsoft,
-                               maxsoft, desnumngb, desnumngbdev, redo_particle, P[i].Pos[0], P[i].Pos[1], P[i].Pos[2]);
-                    }
+                    if (PPP[i].NumNgb > 1)
+                        fac_lim = log( desnumngb / PPP[i].NumNgb ) / NUMDIMS; // this would give desnumgb if constant density (+0.231=2x desnumngb)
+                    else
+                        fac_lim = 1.4; // factor ~66 increase in N_NGB in constant-density medium
                     
-                    /* need to redo this particle */
-                    npleft++;
-                    
-                    if(Left[i] > 0 && Right[i] > 0)
-                        if((Right[i] - Left[i]) < 1.0e-3 * Left[i])
-                        {
-                            /* this one should be ok */
-                            npleft--;
-                            P[i].TimeBin = -P[i].TimeBin - 1;	/* Mark as inactive */
-                            continue;
-                        }
-                    
-                    if((particle_set_to_maxhsml_flag==0)&&(particle_set_to_minhsml_flag==0))
+                    if((PPP[i].NumNgb < 2*desnumngb)&&(PPP[i].NumNgb > 0.1*desnumngb))
                     {
-                        if(PPP[i].NumNgb < (desnumngb - desnumngbdev))
+                        double slope = PPP[i].DhsmlNgbFactor;
+                        if(iter>2 && slope<1) slope = 0.5*(slope+1);
+                        fac = fac_lim * slope; // account for derivative in making the 'corrected' guess
+                        if(iter>=4)
+                            if(PPP[i].DhsmlNgbFactor==1) fac *= 10; // tries to help with being trapped in small steps
+                        
+                        if(fac < fac_lim+0.231)
                         {
-                            Left[i] = DMAX(PPP[i].AGS_Hsml, Left[i]);
+                            PPP[i].AGS_Hsml *= exp(fac); // more expensive function, but faster convergence
                         }
                         else
                         {
-                            if(Right[i] != 0)
-                            {
-                                if(PPP[i].AGS_Hsml < Right[i])
-                                    Right[i] = PPP[i].AGS_Hsml;
-                            }
-                            else
-                                Right[i] = PPP[i].AGS_Hsml;
+                            PPP[i].AGS_Hsml *= exp(fac_lim+0.231);
+                            // fac~0.26 leads to expected doubling of number if density is constant,
+                            //   insert this limiter here b/c we don't want to get *too* far from the answer (which we're close to)
                         }
+                    }
+                    else
+                        PPP[i].AGS_Hsml *= exp(fac_lim); // here we're not very close to the 'right' answer, so don't trust the (local) derivatives
+                }
+                
+                if(Right[i] > 0 && Left[i] == 0)
+                {
+                    if (PPP[i].NumNgb > 1)
+                        fac_lim = log( desnumngb / PPP[i].NumNgb ) / NUMDIMS; // this would give desnumgb if constant density (-0.231=0.5x desnumngb)
+                    else
+                        fac_lim = 1.4; // factor ~66 increase in N_NGB in constant-density medium
+                    
+                    if (fac_lim < -1.535) fac_lim = -1.535; // decreasing N_ngb by factor ~100
+                    
+                    if((PPP[i].NumNgb < 2*desnumngb)&&(PPP[i].NumNgb > 0.1*desnumngb))
+                    {
+                        double slope = PPP[i].DhsmlNgbFactor;
+                        if(iter>2 && slope<1) slope = 0.5*(slope+1);
+                        fac = fac_lim * slope; // account for derivative in making the 'corrected' guess
+                        if(iter>=10)
+                            if(PPP[i].DhsmlNgbFactor==1) fac *= 10; // tries to help with being trapped in small steps
                         
-                        // right/left define upper/lower bounds from previous iterations
-                        if(Right[i] > 0 && Left[i] > 0)
+                        if(fac > fac_lim-0.231)
                         {
-                            // geometric interpolation between right/left //
-                            double maxjump=0;
-                            if(iter>1) {maxjump = 0.2*log(Right[i]/Left[i]);}
-                            if(PPP[i].NumNgb > 1)
-                            {
-                                double jumpvar = PPP[i].DhsmlNgbFactor * log( desnumngb / PPP[i].NumNgb ) / NUMDIMS;
-                                if(iter>1) {if(fabs(jumpvar) < maxjump) {if(jumpvar<0) {jumpvar=-maxjump;} else {jumpvar=maxjump;}}}
-                                PPP[i].AGS_Hsml *= exp(jumpvar);
-                            } else {
-                                PPP[i].AGS_Hsml *= 2.0;
-                            }
-                            if((PPP[i].AGS_Hsml<Right[i])&&(PPP[i].AGS_Hsml>Left[i]))
-                            {
-                                if(iter > 1)
-                                {
-                                    double hfac = exp(maxjump);
-                                    if(PPP[i].AGS_Hsml > Right[i] / hfac) {PPP[i].AGS_Hsml = Right[i] / hfac;}
-                                    if(PPP[i].AGS_Hsml < Left[i] * hfac) {PPP[i].AGS_Hsml = Left[i] * hfac;}
-                                }
-                            } else {
-                                if(PPP[i].AGS_Hsml>Right[i]) PPP[i].AGS_Hsml=Right[i];
-                                if(PPP[i].AGS_Hsml<Left[i]) PPP[i].AGS_Hsml=Left[i];
-                                PPP[i].AGS_Hsml = pow(PPP[i].AGS_Hsml * Left[i] * Right[i] , 1.0/3.0);
-                            }
+                            PPP[i].AGS_Hsml *= exp(fac); // more expensive function, but faster convergence
                         }
                         else
-                        {
-                            if(Right[i] == 0 && Left[i] == 0)
-                            {
-                                char buf[1000]; sprintf(buf, "AGS: Right[i] == 0 && Left[i] == 0 && PPP[i].AGS_Hsml=%g\n", PPP[i].AGS_Hsml); terminate(buf);
-                            }
-                            
-                            if(Right[i] == 0 && Left[i] > 0)
-                            {
-                                if (PPP[i].NumNgb > 1)
-                                    fac_lim = log( desnumngb / PPP[i].NumNgb ) / NUMDIMS; // this would give desnumgb if constant density (+0.231=2x desnumngb)
-                                else
-                                    fac_lim = 1.4; // factor ~66 increase in N_NGB in constant-density medium
-                                
-                                if((PPP[i].NumNgb < 2*desnumngb)&&(PPP[i].NumNgb > 0.1*desnumngb))
-                                {
-                                    double slope = PPP[i].DhsmlNgbFactor;
-                                    if(iter>2 && slope<1) slope = 0.5*(slope+1);
-                                    fac = fac_lim * slope; // account for derivative in making the 'corrected' guess
-                                    if(iter>=4)
-                                        if(PPP[i].DhsmlNgbFactor==1) fac *= 10; // tries to help with being trapped in small steps
-                                    
-                                    if(fac < fac_lim+0.231)
-                                    {
-                                        PPP[i].AGS_Hsml *= exp(fac); // more expensive function, but faster convergence
-                                    }
-                                    else
-                                    {
-                                        PPP[i].AGS_Hsml *= exp(fac_lim+0.231);
-                                        // fac~0.26 leads to expected doubling of number if density is constant,
-                                        //   insert this limiter here b/c we don't want to get *too* far from the answer (which we're close to)
-                                    }
-                                }
-                                else
-                                    PPP[i].AGS_Hsml *= exp(fac_lim); // here we're not very close to the 'right' answer, so don't trust the (local) derivatives
-                            }
-                            
-                            if(Right[i] > 0 && Left[i] == 0)
-                            {
-                                if (PPP[i].NumNgb > 1)
-                                    fac_lim = log( desnumngb / PPP[i].NumNgb ) / NUMDIMS; // this would give desnumgb if constant density (-0.231=0.5x desnumngb)
-                                else
-                                    fac_lim = 1.4; // factor ~66 increase in N_NGB in constant-density medium
-                                
-                                if (fac_lim < -1.535) fac_lim = -1.535; // decreasing N_ngb by factor ~100
-                                
-                                if((PPP[i].NumNgb < 2*desnumngb)&&(PPP[i].NumNgb > 0.1*desnumngb))
-                                {
-                                    double slope = PPP[i].DhsmlNgbFactor;
-                                    if(iter>2 && slope<1) slope = 0.5*(slope+1);
-                                    fac = fac_lim * slope; // account for derivative in making the 'corrected' guess
-                                    if(iter>=10)
-                                        if(PPP[i].DhsmlNgbFactor==1) fac *= 10; // tries to help with being trapped in small steps
-                                    
-                                    if(fac > fac_lim-0.231)
-                                    {
-                                        PPP[i].AGS_Hsml *= exp(fac); // more expensive function, but faster convergence
-                                    }
-                                    else
-                                        PPP[i].AGS_Hsml *= exp(fac_lim-0.231); // limiter to prevent --too-- far a jump in a single iteration
-                                }
-                                else
-                                    PPP[i].AGS_Hsml *= exp(fac_lim); // here we're not very close to the 'right' answer, so don't trust the (local) derivatives
-                            }
-                        } // closes if(Right[i] > 0 && Left[i] > 0) else clause
-                        
-                    } // closes if[particle_set_to_max/minhsml_flag]
-                    /* resets for max/min values */
-                    if(PPP[i].AGS_Hsml < minsoft) PPP[i].AGS_Hsml = minsoft;
-                    if(particle_set_to_minhsml_flag==1) PPP[i].AGS_Hsml = minsoft;
-                    if(PPP[i].AGS_Hsml > maxsoft) PPP[i].AGS_Hsml = maxsoft;
-                    if(particle_set_to_maxhsml_flag==1) PPP[i].AGS_Hsml = maxsoft;
-                } // closes redo_particle
-                else
-                    P[i].TimeBin = -P[i].TimeBin - 1;	/* Mark as inactive */
+                            PPP[i].AGS_Hsml *= exp(fac_lim-0.231); // limiter to prevent --too-- far a jump in a single iteration
+                    }
+                    else
+                        PPP[i].AGS_Hsml *= exp(fac_lim); // here we're not very close to the 'right' answer, so don't trust the (local) derivatives
+                }
+            } // closes if(Right[i] > 0 && Left[i] > 0) else clause
+            
+        } // closes if[particle_set_to_max/minhsml_flag]
+        /* resets for max/min values */
+        if(PPP[i].AGS_Hsml < minsoft) PPP[i].AGS_Hsml = minsoft;
+        if(particle_set_to_minhsml_flag==1) PPP[i].AGS_Hsml = minsoft;
+        if(PPP[i].AGS_Hsml > maxsoft) PPP[i].AGS_Hsml = maxsoft;
+        if(particle_set_to_maxhsml_flag==1) PPP[i].AGS_Hsml = maxsoft;
+    } // closes redo_particle
+    return redo_particle;
+}
+
+
+/*! final operations on the converged AGS kernel length of element i: correction (zeta) terms and effective neighbor number */
+void ags_density_finalize_kernel_length(int i, MyFloat *AGS_Prev)
+{
+    if((P[i].Mass>0)&&(PPP[i].AGS_Hsml>0)&&(PPP[i].NumNgb>0))
+    {
+        double minsoft = ags_return_minsoft(i);
+        double maxsoft = ags_return_maxsoft(i);
+        minsoft = DMAX(minsoft , AGS_Prev[i]*AGS_DSOFT_TOL);
+        maxsoft = DMIN(maxsoft , AGS_Prev[i]/AGS_DSOFT_TOL);
+        if(PPP[i].AGS_Hsml >= maxsoft) {PPPZ[i].AGS_zeta = 0;} /* check that we're within the 'valid' range for adaptive softening terms, otherwise zeta=0 */
+
+        double z0 = 0.5 * PPPZ[i].AGS_zeta * PPP[i].AGS_Hsml / (NUMDIMS * P[i].Mass * PPP[i].NumNgb / ( NORM_COEFF * pow(PPP[i].AGS_Hsml,NUMDIMS) )); // zeta before various prefactors
+        double h_eff = 2. * (KERNEL_CORE_SIZE*All.ForceSoftening[P[i].Type]); // force softening defines where Jeans pressure needs to kick in; prefactor = NJeans [=2 here]
+        double Prho = 0 * h_eff*h_eff/2.; if(P[i].Particle_DivVel>0) {Prho=-Prho;} // truelove criterion. NJeans[above] , gamma=2 for effective EOS when this dominates, rho=ma*na; h_eff here can be Hsml [P/rho~H^-1] or gravsoft_min to really enforce that, as MIN, with P/rho~H^-3; if-check makes it so this term always adds KE to the system, pumping it up
+        PPPZ[i].AGS_zeta = P[i].Mass*P[i].Mass * PPP[i].DhsmlNgbFactor * ( z0 + Prho ); // force correction, including corrections for adaptive softenings and EOS terms
+        PPP[i].NumNgb = pow(PPP[i].NumNgb , 1./NUMDIMS); /* convert NGB to the more useful format, NumNgb^(1/NDIMS), which we can use to obtain the corrected particle sizes */
+    } else {
+        PPPZ[i].AGS_zeta = 0; PPP[i].NumNgb = 0; PPP[i].AGS_Hsml = All.ForceSoftening[P[i].Type];
+    }
+    apply_pm_hires_region_clipping_selection(i);
+}
+
+
+void ags_density(void)
+{
+    /* initialize variables used below, in particlar the structures we need to call throughout the iteration */
+    CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second(); MyFloat *Left, *Right, *AGS_Prev; long long ntot;
+    int i, npleft, iter=0;
+    AGS_Prev = (MyFloat *) mymalloc("AGS_Prev", NumPart * sizeof(MyFloat));
+    Left = (MyFloat *) mymalloc("Left", NumPart * sizeof(MyFloat));
+    Right = (MyFloat *) mymalloc("Right", NumPart * sizeof(MyFloat));
+    /* initialize anything we need to about the active particles before their loop */
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {
+        if(ags_density_isactive(i)) {
+            Left[i] = Right[i] = 0; AGS_Prev[i] = PPP[i].AGS_Hsml; PPP[i].AGS_vsig = 0;
+#ifdef WAKEUP
+            P[i].wakeup = 0;
+#endif
+      }}
+
+    /* allocate buffers to arrange communication */
+    #include "../system/code_block_xchange_perform_ops_malloc.h" /* this calls the large block of code which contains the memory allocations for the MPI/OPENMP/Pthreads parallelization block which must appear below */
+    /* we will repeat the whole thing for those particles where we didn't find enough neighbours */
+    do
+    {
+        #include "../system/code_block_xchange_perform_ops.h" /* this calls the large block of code which actually contains all the loops, MPI/OPENMP/Pthreads parallelization */
+
+      /* do check on whether we have enough neighbors, and iterate for density-hsml solution */
+        double tstart = my_second(), tend;
+        for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
+        {
+            if(ags_density_isactive(i))
+            {
+                if(ags_density_update_kernel_length(i, iter, Left, Right, AGS_Prev)) {npleft++;} /* need to redo this particle */
+                else {P[i].TimeBin = -P[i].TimeBin - 1;}	/* Mark as inactive */
             } //  if(ags_density_isactive(i))
         } // for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
         
@@ -534,26 +571,7 @@ void ags_density(void)
     /* now that we are DONE iterating to find hsml, we can do the REAL final operations on the results */
     for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
     {
-        if(ags_density_isactive(i))
-        {
-            if((P[i].Mass>0)&&(PPP[i].AGS_Hsml>0)&&(PPP[i].NumNgb>0))
-            {
-                double minsoft = ags_return_minsoft(i);
-                double maxsoft = ags_return_maxsoft(i);
-                minsoft = DMAX(minsoft , AGS_Prev[i]*AGS_DSOFT_TOL);
-                maxsoft = DMIN(maxsoft , AGS_Prev[i]/AGS_DSOFT_TOL);
-                if(PPP[i].AGS_Hsml >= maxsoft) {PPPZ[i].AGS_zeta = 0;} /* check that we're within the 'valid' range for adaptive softening terms, otherwise zeta=0 */
-
-                double z0 = 0.5 * PPPZ[i].AGS_zeta * PPP[i].AGS_Hsml / (NUMDIMS * P[i].Mass * PPP[i].NumNgb / ( NORM_COEFF * pow(PPP[i].AGS_Hsml,NUMDIMS) )); // zeta before various prefactors
-                double h_eff = 2. * (KERNEL_CORE_SIZE*All.ForceSoftening[P[i].Type]); // force softening defines where Jeans pressure needs to kick in; prefactor = NJeans [=2 here]
-                double Prho = 0 * h_eff*h_eff/2.; if(P[i].Particle_DivVel>0) {Prho=-Prho;} // truelove criterion. NJeans[above] , gamma=2 for effective EOS when this dominates, rho=ma*na; h_eff here can be Hsml [P/rho~H^-1] or gravsoft_min to really enforce that, as MIN, with P/rho~H^-3; if-check makes it so this term always adds KE to the system, pumping it up
-                PPPZ[i].AGS_zeta = P[i].Mass*P[i].Mass * PPP[i].DhsmlNgbFactor * ( z0 + Prho ); // force correction, including corrections for adaptive softenings and EOS terms
-                PPP[i].NumNgb = pow(PPP[i].NumNgb , 1./NUMDIMS); /* convert NGB to the more useful format, NumNgb^(1/NDIMS), which we can use to obtain the corrected particle sizes */
-            } else {
-                PPPZ[i].AGS_zeta = 0; PPP[i].NumNgb = 0; PPP[i].AGS_Hsml = All.ForceSoftening[P[i].Type];
-            }
-            apply_pm_hires_region_clipping_selection(i);
-        }
+        if(ags_density_isactive(i)) {ags_density_finalize_kernel_length(i, AGS_Prev);}
     }
     myfree(AGS_Prev);
     
@@ -240,4 +240,120 @@ void odeint_super_timestep(int i, double dt_super, double kick_dv[3], double dri
     
 }
 
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+/*
+Few-body subsystems: a super-timestepped binary (SuperTimestepFlag>=2) whose companion dominates its two-body timescale, and
+whose external perturbations (the tidal field at the center of mass and the approach of any other star) act on timescales
+much longer than the orbit, is 'decoupled' (SuperTimestepFlag=3). Its members then take timesteps set only by those external
+timescales, the internal orbit is advanced privately in the drift (analytically, or on Hermite sub-steps if it enters the
+softening kernel), and other stars see the pair as a single composite when computing their approach/freefall timesteps.
+The two members must take the same decision and the same external limits to stay in lock-step, so after each tree walk
+they are matched (on any task) and the pair-wide values are stored on both; a member whose companion was not matched in
+the same walk (e.g. because the two have already fallen out of lock-step) keeps the ordinary binary treatment.
+*/
+#define FEWBODY_DECOUPLING_RATIO 10.   /* external timescales must exceed this many orbital periods for the subsystem to decouple */
+#define FEWBODY_COMPOSITE_RADIUS 3.    /* stars further than this many separations away see the subsystem as a composite */
+#define FEWBODY_MATCH_TOLERANCE 1.e-3  /* members are matched if their centers of mass and (opposite) separations agree to this fraction of the separation */
+
+// decide whether the binary of star i can be integrated as a decoupled subsystem: uses only the pair-wide values, so both members agree
+int fewbody_subsystem_is_decoupled(int i)
+{
+    if((P[i].Type != 5) || (!P[i].is_in_a_binary) || (P[i].fewbody_pair_ti != All.Ti_Current)) {return 0;} // only decided from pair values set in this step's tree walk
+    double t_ext = DMIN(P[i].fewbody_pair_dt_tidal, P[i].fewbody_pair_tapp_ext);
+    return (t_ext > FEWBODY_DECOUPLING_RATIO * P[i].fewbody_pair_t_orbital);
+}
+
+struct fewbody_member_data {MyDouble com[3], sep[3]; double dt_tidal, tapp_ext, t_orbital; int task, index;};
+
+static int fewbody_compare_com(const void *a, const void *b)
+{
+    double xa = ((struct fewbody_member_data *) a)->com[0], xb = ((struct fewbody_member_data *) b)->com[0];
+    return (xa > xb) - (xa < xb);
+}
+
+// after the tree walk: match each active binary member to its companion by the center of mass and (opposite) separation both carry, and store the pair-wide
+// values (shorter external timescales, longer orbit) on both. only members active in this walk take part, so the values are from the same walk for both.
+void fewbody_pair_subsystems(void)
+{
+    int i, j, k, n_local = 0, n_all, *counts, *offsets;
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {if(P[i].Type == 5) {P[i].fewbody_pair_ti = -1; if(P[i].is_in_a_binary) {n_local++;}}}
+    counts = (int *) mymalloc("fewbody_counts", NTask * sizeof(int)); offsets = (int *) mymalloc("fewbody_offsets", NTask * sizeof(int));
+    MPI_Allgather(&n_local, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+    for(j = 0, n_all = 0; j < NTask; j++) {n_all += counts[j];}
+    if(n_all == 0) {myfree(offsets); myfree(counts); return;}
+    struct fewbody_member_data *local = (struct fewbody_member_data *) mymalloc("fewbody_local", (n_local + 1) * sizeof(struct fewbody_member_data));
+    struct fewbody_member_data *all = (struct fewbody_member_data *) mymalloc("fewbody_all", n_all * sizeof(struct fewbody_member_data));
+    for(i = FirstActiveParticle, n_local = 0; i >= 0; i = NextActiveParticle[i])
+    {
+        if((P[i].Type != 5) || (!P[i].is_in_a_binary)) {continue;}
+        double mfac = P[i].comp_Mass / (P[i].Mass + P[i].comp_Mass);
+        for(k = 0; k < 3; k++) {local[n_local].com[k] = P[i].Pos[k] + P[i].comp_dx[k] * mfac; local[n_local].sep[k] = P[i].comp_dx[k];}
+#ifdef BOX_PERIODIC
+        local[n_local].com[0] -= boxSize_X * floor(local[n_local].com[0] / boxSize_X); /* only used to sort: pairs straddling the box face are simply not matched */
+#endif
+        local[n_local].dt_tidal = P[i].COM_dt_tidal; local[n_local].tapp_ext = P[i].fewbody_tapp_ext; local[n_local].t_orbital = P[i].min_bh_t_orbital;
+        local[n_local].task = ThisTask; local[n_local].index = i; n_local++;
+    }
+    for(j = 0; j < NTask; j++) {counts[j] *= sizeof(struct fewbody_member_data);}
+    for(j = 1, offsets[0] = 0; j < NTask; j++) {offsets[j] = offsets[j-1] + counts[j-1];}
+    MPI_Allgatherv(local, n_local * sizeof(struct fewbody_member_data), MPI_BYTE, all, counts, offsets, MPI_BYTE, MPI_COMM_WORLD);
+    qsort(all, n_all, sizeof(struct fewbody_member_data), fewbody_compare_com);
+
+    for(j = 0; j < n_local; j++)
+    {
+        double sep2 = local[j].sep[0]*local[j].sep[0] + local[j].sep[1]*local[j].sep[1] + local[j].sep[2]*local[j].sep[2], tol = FEWBODY_MATCH_TOLERANCE * sqrt(sep2);
+        int lo = 0, hi = n_all, m; /* first entry with com[0] >= com[0]-tol */
+        while(lo < hi) {m = (lo + hi) / 2; if(all[m].com[0] < local[j].com[0] - tol) {lo = m + 1;} else {hi = m;}}
+        for(m = lo; (m < n_all) && (all[m].com[0] <= local[j].com[0] + tol); m++)
+        {
+            if((all[m].task == ThisTask) && (all[m].index == local[j].index)) {continue;}
+            double dc[3], ds2 = 0; for(k = 0; k < 3; k++) {dc[k] = all[m].com[k] - local[j].com[k]; ds2 += (all[m].sep[k] + local[j].sep[k]) * (all[m].sep[k] + local[j].sep[k]);}
+            dc[0] = 0; NEAREST_XYZ(dc[0],dc[1],dc[2],1);
+            if((dc[1]*dc[1] + dc[2]*dc[2] > tol*tol) || (ds2 > tol*tol)) {continue;}
+            i = local[j].index;
+            P[i].fewbody_pair_dt_tidal = DMIN(local[j].dt_tidal, all[m].dt_tidal);
+            P[i].fewbody_pair_tapp_ext = DMIN(local[j].tapp_ext, all[m].tapp_ext);
+            P[i].fewbody_pair_t_orbital = DMAX(local[j].t_orbital, all[m].t_orbital);
+            P[i].fewbody_pair_ti = All.Ti_Current;
+            break;
+        }
+    }
+    myfree(all); myfree(local); myfree(offsets); myfree(counts);
+}
+
+// replaces the separation (entering r2soft), squared relative velocity, and total mass used for the approach/freefall timescales
+// of a star at offset (dx,dy,dz) and relative velocity (dvx,dvy,dvz) from member 'no' of a decoupled subsystem by those of the composite, if the star is far enough away
+void fewbody_composite_kinematics(int no, double dx, double dy, double dz, double dvx, double dvy, double dvz, double r2, double *r2soft, double *vSqr, double *M_total)
+{
+    if((P[no].Type != 5) || (P[no].SuperTimestepFlag < 3)) {return;}
+    double sep2 = P[no].comp_dx[0]*P[no].comp_dx[0] + P[no].comp_dx[1]*P[no].comp_dx[1] + P[no].comp_dx[2]*P[no].comp_dx[2];
+    if(r2 < FEWBODY_COMPOSITE_RADIUS*FEWBODY_COMPOSITE_RADIUS * sep2) {return;} // close to (or the companion itself): use the member kinematics
+    double mfac = P[no].comp_Mass / (P[no].Mass + P[no].comp_Mass), cdx = dx + P[no].comp_dx[0]*mfac, cdy = dy + P[no].comp_dx[1]*mfac, cdz = dz + P[no].comp_dx[2]*mfac;
+    double cvx = dvx + P[no].comp_dv[0]*mfac, cvy = dvy + P[no].comp_dv[1]*mfac, cvz = dvz + P[no].comp_dv[2]*mfac; // offsets of the center of mass of the subsystem
+    *r2soft += (cdx*cdx + cdy*cdy + cdz*cdz) - r2;
+    *vSqr = cvx*cvx + cvy*cvy + cvz*cvz;
+    *M_total += P[no].comp_Mass;
+}
+
+/*
+Advances the internal orbit of a decoupled subsystem by dt (same modes and outputs as kepler_timestep/odeint_super_timestep):
+the analytic Kepler solution is exact and costs the same for any number of orbits per step, so it is used whenever the
+orbit stays outside the softening kernel; otherwise the (softened) orbit is integrated on Hermite sub-steps.
+*/
+void fewbody_internal_step(int i, double dt, double kick_dv[3], double drift_dx[3], int mode)
+{
+    double Mtot = P[i].Mass + P[i].comp_Mass, dr = 0, dv2 = 0, h[3], h2 = 0; int k, l, m;
+    for(k=0; k<3; k++) {dr += P[i].comp_dx[k]*P[i].comp_dx[k]; dv2 += P[i].comp_dv[k]*P[i].comp_dv[k];}
+    dr = sqrt(dr);
+    for(k=0; k<3; k++) {l = (k+1)%3; m = (k+2)%3; h[k] = P[i].comp_dx[l]*P[i].comp_dv[m] - P[i].comp_dx[m]*P[i].comp_dv[l]; h2 += h[k]*h[k];}
+    double specific_energy = 0.5*dv2 - All.G * Mtot / dr;
+    if(specific_energy < 0)
+    {
+        double semimajor_axis = -All.G * Mtot / (2*specific_energy), ecc = sqrt(DMAX(0, 1 + 2 * specific_energy * h2 / (All.G*All.G*Mtot*Mtot)));
+        if((ecc > 1.e-6) && (semimajor_axis*(1-ecc) > All.ForceSoftening[5])) {kepler_timestep(i, dt, kick_dv, drift_dx, mode); return;} // (circular orbits have no well-defined periapsis direction for the analytic solution)
+    }
+    odeint_super_timestep(i, dt, kick_dv, drift_dx, mode);
+}
+#endif
+
 #endif
@@ -0,0 +1,296 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../allvars.h"
+#include "../proto.h"
+#include "../kernel.h"
+
+/*
+ * This file contains a symmetric (momentum-conserving) dual-tree fast multipole method (FMM) for the interactions between
+ *  the elements on the local task, following Dehnen 2000 (ApJ 536, L39) and 2002 (JCP 179, 27). It re-uses the gravity tree
+ *  as built by force_treebuild: the node centers-of-mass and the quadrupole moments of GRAVITY_TREE_QUADRUPOLE are the
+ *  multipoles, and the roots of the dual walk are the local top-level leaves of the domain decomposition. Each accepted
+ *  cell-cell interaction is evaluated once and applied to both cells (with the sign of the odd-order terms flipped), into
+ *  Cartesian local (Taylor) expansions about the cell centers-of-mass, which are then passed down the tree to the elements.
+ *  Contributions from other tasks are still handled by the regular tree walk, which (while 'FMMActiveFlag' is set) skips
+ *  all local nodes and elements and uses only the exchanged top-level (pseudo-particle) multipoles, exporting an element
+ *  only if it has to open one of those branches. The FMM is only used on steps where all elements are active; partial
+ *  active sets use the normal one-sided walk, for which it would not pay off.
+ *
+ *  The expansion order GRAVITY_FMM=p (2 or 3, default 3) sets the total order of the terms kept in each interaction
+ *  (multipole order plus local order), as in Dehnen 2002: p=2 keeps the potential to second order and the force to
+ *  first order, p=3 adds the quadrupole contribution to the force and the third-order local coefficients.
+ */
+
+#ifdef GRAVITY_FMM
+
+#if (defined(BOX_PERIODIC) && !defined(GRAVITY_NOT_PERIODIC)) || defined(PMGRID) || defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(ADAPTIVE_GRAVSOFT_FORGAS)
+#error "GRAVITY_FMM is only implemented for non-periodic, pure-tree gravity with fixed softenings"
+#endif
+#if defined(COMPUTE_TIDAL_TENSOR_IN_GRAVTREE) || defined(RT_USE_GRAVTREE) || defined(BH_CALC_DISTANCES) || defined(COUNT_MASS_IN_GRAVTREE) || defined(RT_USE_TREECOL_FOR_NH) || defined(BH_SEED_FROM_LOCALGAS_TOTALMENCCRITERIA) || defined(DM_SCALARFIELD_SCREENING) || defined(BH_DYNFRICTION_FROMTREE) || defined(NEIGHBORS_MUST_BE_COMPUTED_EXPLICITLY_IN_FORCETREE) || defined(ADAPTIVE_TREEFORCE_UPDATE)
+#error "GRAVITY_FMM does not compute the additional quantities which these modules evaluate inside the gravity tree-walk"
+#endif
+
+#if (GRAVITY_FMM+0 == 2)
+#define FMM_ORDER 2
+#else
+#define FMM_ORDER 3
+#endif
+#define FMM_OPENING_ANGLE 0.5 /* cells interact if (r_A+r_B) < theta*|z_A-z_B|: at p=3 this gives rms force errors ~1e-3 */
+
+/* symmetric tensors are stored in compact form: rank-2 as (xx,yy,zz,xy,xz,yz), rank-3 in the order of fmm_i3 below */
+static const int fmm_i2[3][3] = {{0,3,4},{3,1,5},{4,5,2}};
+#if (FMM_ORDER >= 3)
+static const int fmm_t3[10][3] = {{0,0,0},{1,1,1},{2,2,2},{0,0,1},{0,0,2},{0,1,1},{1,1,2},{0,2,2},{1,2,2},{0,1,2}};
+static int fmm_i3[3][3][3];
+#endif
+
+struct fmm_local /* local expansion of the potential about a node center-of-mass */
+{
+    double L0, L1[3], L2[6];
+#if (FMM_ORDER >= 3)
+    double L3[10];
+#endif
+};
+
+struct fmm_cell /* what the dual walk needs to know about a node or element */
+{
+    int no;
+    double z[3], mass, rmax, soft;
+    MyFloat *quad;
+};
+
+static struct fmm_local *FMM_NodeLocal; /* indexed by (node - All.MaxPart) */
+static double *FMM_PartLocal; /* potential and its gradient at each local element: 4 numbers per element */
+static long long FMM_N_M2L, FMM_N_P2P;
+
+
+/*! fill the cell descriptor for tree index 'no' (a local element or local node), drifting it to the current time if needed.
+    returns 0 for pseudo-particles and massless cells, which are skipped */
+static int fmm_get_cell(int no, struct fmm_cell *c)
+{
+    int k; c->no = no;
+    if(no < All.MaxPart)
+    {
+        if(P[no].Ti_current != All.Ti_Current) {drift_particle(no, All.Ti_Current);}
+        for(k = 0; k < 3; k++) {c->z[k] = P[no].Pos[k];}
+        c->mass = P[no].Mass; c->rmax = 0; c->soft = All.ForceSoftening[P[no].Type]; c->quad = NULL;
+    }
+    else if(no < All.MaxPart + MaxNodes)
+    {
+        struct NODE *nop = &Nodes[no]; double d2 = 0;
+        if(nop->Ti_current != All.Ti_Current) {force_drift_node(no, All.Ti_Current);}
+        for(k = 0; k < 3; k++) {c->z[k] = nop->u.d.s[k]; d2 += (nop->u.d.s[k] - nop->center[k]) * (nop->u.d.s[k] - nop->center[k]);}
+        c->mass = nop->u.d.mass; c->rmax = sqrt(d2) + 0.8660254 * nop->len; c->soft = nop->maxsoft; c->quad = nop->quad;
+    }
+    else {return 0;}
+    return (c->mass > 0);
+}
+
+
+/*! step through the children of node 'no' using the threaded next/sibling pointers of the tree */
+static inline int fmm_first_child(int no) {return Nodes[no].u.d.nextnode;}
+static inline int fmm_next_child(int c)
+{
+    if(c < All.MaxPart) {return Nextnode[c];}
+    if(c < All.MaxPart + MaxNodes) {return Nodes[c].u.d.sibling;}
+    return Nextnode[c - MaxNodes];
+}
+
+
+/*! add the field of a source (mass m, second moments q [or NULL]) to the expansion of a target, given the derivative tensors
+    of 1/r at the separation vector pointing from the source to the target. 'sgn' is -1 if the separation vector is reversed
+    (so the odd-order derivatives flip sign). for element targets only L0 and L1 are accumulated (L=NULL). */
+static void fmm_add_field(double *L0, double *L1, struct fmm_local *L, double sgn, double m, MyFloat *q,
+                          double D0, double *D1, double *D2, double *D3)
+{
+    int i, j, k;
+    double qD2 = 0;
+    if(q) {for(i = 0; i < 3; i++) {for(j = 0; j < 3; j++) {qD2 += q[fmm_i2[i][j]] * D2[fmm_i2[i][j]];}}}
+    *L0 -= m * D0 + 0.5 * qD2;
+    for(i = 0; i < 3; i++)
+    {
+        double qD3 = 0;
+#if (FMM_ORDER >= 3)
+        if(q) {for(j = 0; j < 3; j++) {for(k = 0; k < 3; k++) {qD3 += q[fmm_i2[j][k]] * D3[fmm_i3[i][j][k]];}}}
+#endif
+        L1[i] -= sgn * (m * D1[i] + 0.5 * qD3);
+    }
+    if(!L) {return;}
+    for(k = 0; k < 6; k++) {L->L2[k] -= m * D2[k];}
+#if (FMM_ORDER >= 3)
+    for(k = 0; k < 10; k++) {L->L3[k] -= sgn * m * D3[k];}
+#endif
+}
+
+
+/*! symmetric cell-cell (or cell-element) interaction from the multipoles, added to the expansions of both */
+static void fmm_interact_m2l(struct fmm_cell *a, struct fmm_cell *b, double *R, double r2)
+{
+    int i, k; double D0, D1[3], D2[6], D3[10] = {0};
+    double rinv = 1. / sqrt(r2), r3inv = rinv * rinv * rinv, r5inv = r3inv * rinv * rinv;
+    D0 = rinv;
+    for(i = 0; i < 3; i++) {D1[i] = -R[i] * r3inv;}
+    for(k = 0; k < 6; k++)
+    {
+        int i1 = (k < 3) ? k : (k < 5 ? 0 : 1), i2 = (k < 3) ? k : (k == 3 ? 1 : 2);
+        D2[k] = 3. * R[i1] * R[i2] * r5inv - ((i1 == i2) ? r3inv : 0);
+    }
+#if (FMM_ORDER >= 3)
+    double r7inv = r5inv * rinv * rinv;
+    for(k = 0; k < 10; k++)
+    {
+        int i1 = fmm_t3[k][0], i2 = fmm_t3[k][1], i3 = fmm_t3[k][2];
+        D3[k] = -15. * R[i1] * R[i2] * R[i3] * r7inv + 3. * r5inv * (R[i1] * (i2 == i3) + R[i2] * (i1 == i3) + R[i3] * (i1 == i2));
+    }
+#endif
+    /* R points from b to a: a sees the field of b with the derivatives as computed, b sees that of a with odd orders flipped */
+    double *L0a, *L1a, *L0b, *L1b; struct fmm_local *La = NULL, *Lb = NULL;
+    if(a->no < All.MaxPart) {L0a = &FMM_PartLocal[4*a->no]; L1a = L0a + 1;} else {La = &FMM_NodeLocal[a->no - All.MaxPart]; L0a = &La->L0; L1a = La->L1; if(TakeLevel >= 0) {Nodes[a->no].GravCost += 1.0;}}
+    if(b->no < All.MaxPart) {L0b = &FMM_PartLocal[4*b->no]; L1b = L0b + 1;} else {Lb = &FMM_NodeLocal[b->no - All.MaxPart]; L0b = &Lb->L0; L1b = Lb->L1; if(TakeLevel >= 0) {Nodes[b->no].GravCost += 1.0;}}
+    fmm_add_field(L0a, L1a, La, +1., b->mass, b->quad, D0, D1, D2, D3);
+    fmm_add_field(L0b, L1b, Lb, -1., a->mass, a->quad, D0, D1, D2, D3);
+    FMM_N_M2L++;
+}
+
+
+/*! symmetric direct (softened) interaction between two elements */
+static void fmm_interact_p2p(struct fmm_cell *a, struct fmm_cell *b, double *R, double r2)
+{
+    int k; double r = sqrt(r2), h = DMAX(a->soft, b->soft), fac, facpot;
+    if(r >= h) {fac = 1. / (r2 * r); facpot = -1. / r;}
+    else {double h_inv = 1. / h, h3_inv = h_inv * h_inv * h_inv, u = r * h_inv; fac = kernel_gravity(u, h_inv, h3_inv, 1); facpot = kernel_gravity(u, h_inv, h3_inv, -1);}
+    double *La = &FMM_PartLocal[4*a->no], *Lb = &FMM_PartLocal[4*b->no];
+    La[0] += b->mass * facpot; Lb[0] += a->mass * facpot;
+    for(k = 0; k < 3; k++) {La[1+k] += b->mass * fac * R[k]; Lb[1+k] -= a->mass * fac * R[k];} /* gradient of the potential (minus the acceleration) */
+    if(TakeLevel >= 0) {P[a->no].GravCost[TakeLevel] += 1.0; P[b->no].GravCost[TakeLevel] += 1.0;}
+    FMM_N_P2P++;
+}
+
+
+/*! mutual interaction of two disjoint cells: accept it if they are well-separated (and outside each other's softening), otherwise
+    split the larger one and recurse */
+static void fmm_interact(struct fmm_cell *a, struct fmm_cell *b)
+{
+    int k; double R[3], r2 = 0;
+    for(k = 0; k < 3; k++) {R[k] = a->z[k] - b->z[k]; r2 += R[k] * R[k];}
+    if(a->no < All.MaxPart && b->no < All.MaxPart) {if(r2 > 0) {fmm_interact_p2p(a, b, R, r2);} return;}
+    double r = sqrt(r2), rsum = a->rmax + b->rmax;
+    if((rsum < FMM_OPENING_ANGLE * r) && (r - rsum > DMAX(a->soft, b->soft))) {fmm_interact_m2l(a, b, R, r2); return;}
+    struct fmm_cell *split = a, *other = b, c;
+    if(a->no < All.MaxPart || (b->no >= All.MaxPart && b->rmax > a->rmax)) {split = b; other = a;}
+    int end = Nodes[split->no].u.d.sibling, no;
+    for(no = fmm_first_child(split->no); no >= 0 && no != end; no = fmm_next_child(no))
+    {
+        if(fmm_get_cell(no, &c)) {fmm_interact(&c, other);}
+    }
+}
+
+
+/*! all interactions within a single node: those within each child, and those between each pair of children */
+static void fmm_interact_self(struct fmm_cell *a)
+{
+    if(a->no < All.MaxPart) {return;}
+    int end = Nodes[a->no].u.d.sibling, n = 0, i, j, no; struct fmm_cell child[8];
+    for(no = fmm_first_child(a->no); no >= 0 && no != end; no = fmm_next_child(no))
+    {
+        if(n >= 8) {terminate("more than 8 children in an oct-tree node");}
+        if(fmm_get_cell(no, &child[n])) {n++;}
+    }
+    for(i = 0; i < n; i++)
+    {
+        fmm_interact_self(&child[i]);
+        for(j = i + 1; j < n; j++) {fmm_interact(&child[i], &child[j]);}
+    }
+}
+
+
+/*! pass the local expansion of node 'no' (about its center-of-mass z) down to its children */
+static void fmm_downward_pass(int no, double *z)
+{
+    int end = Nodes[no].u.d.sibling, c, i, j, k; struct fmm_local *L = &FMM_NodeLocal[no - All.MaxPart]; struct fmm_cell cell;
+    for(c = fmm_first_child(no); c >= 0 && c != end; c = fmm_next_child(c))
+    {
+        if(!fmm_get_cell(c, &cell)) {continue;}
+        double a[3], L0, L1[3], L2a[3] = {0}, aL2a = 0;
+        for(k = 0; k < 3; k++) {a[k] = cell.z[k] - z[k];}
+        for(i = 0; i < 3; i++) {for(j = 0; j < 3; j++) {L2a[i] += L->L2[fmm_i2[i][j]] * a[j];}}
+        for(i = 0; i < 3; i++) {aL2a += a[i] * L2a[i];}
+        L0 = L->L0 + 0.5 * aL2a;
+        for(i = 0; i < 3; i++) {L0 += L->L1[i] * a[i]; L1[i] = L->L1[i] + L2a[i];}
+#if (FMM_ORDER >= 3)
+        double L3aa[3] = {0}, L3a[6] = {0};
+        for(i = 0; i < 3; i++) {for(j = 0; j < 3; j++) {for(k = 0; k < 3; k++) {L3aa[i] += L->L3[fmm_i3[i][j][k]] * a[j] * a[k];}}}
+        for(i = 0; i < 3; i++) {L0 += L3aa[i] * a[i] / 6.; L1[i] += 0.5 * L3aa[i];}
+        for(i = 0; i < 3; i++) {for(j = i; j < 3; j++) {for(k = 0; k < 3; k++) {L3a[fmm_i2[i][j]] += L->L3[fmm_i3[i][j][k]] * a[k];}}}
+#endif
+        if(c < All.MaxPart)
+        {
+            FMM_PartLocal[4*c] += L0; for(k = 0; k < 3; k++) {FMM_PartLocal[4*c+1+k] += L1[k];}
+        }
+        else
+        {
+            struct fmm_local *Lc = &FMM_NodeLocal[c - All.MaxPart];
+            Lc->L0 += L0; for(k = 0; k < 3; k++) {Lc->L1[k] += L1[k];}
+            for(k = 0; k < 6; k++) {Lc->L2[k] += L->L2[k];}
+#if (FMM_ORDER >= 3)
+            for(k = 0; k < 6; k++) {Lc->L2[k] += L3a[k];}
+            for(k = 0; k < 10; k++) {Lc->L3[k] += L->L3[k];}
+#endif
+            fmm_downward_pass(c, cell.z);
+        }
+    }
+}
+
+
+/*! compute all interactions between elements on the local task with the FMM, and add the resulting accelerations (and potential)
+    to the values already assigned by the tree-walk (which, with FMMActiveFlag set, only contains the contributions from other tasks).
+    called from gravity_tree() after the walk, on steps where all elements are active. returns the number of interactions evaluated. */
+double fmm_local_interactions(void)
+{
+    int i, j, k, m, n_roots = 0;
+#if (FMM_ORDER >= 3)
+    for(k = 0; k < 10; k++) {int a = fmm_t3[k][0], b = fmm_t3[k][1], c = fmm_t3[k][2]; fmm_i3[a][b][c] = fmm_i3[a][c][b] = fmm_i3[b][a][c] = fmm_i3[b][c][a] = fmm_i3[c][a][b] = fmm_i3[c][b][a] = k;}
+#endif
+    FMM_N_M2L = FMM_N_P2P = 0;
+    FMM_PartLocal = (double *) mymalloc("FMM_PartLocal", 4 * NumPart * sizeof(double));
+    FMM_NodeLocal = (struct fmm_local *) mymalloc("FMM_NodeLocal", MaxNodes * sizeof(struct fmm_local));
+    memset(FMM_PartLocal, 0, 4 * NumPart * sizeof(double));
+    memset(FMM_NodeLocal, 0, MaxNodes * sizeof(struct fmm_local));
+    struct fmm_cell *roots = (struct fmm_cell *) mymalloc("FMM_roots", NTopleaves * sizeof(struct fmm_cell));
+
+    /* the local top-level leaves are the roots of the dual walk: interact each with itself and with all the others */
+    for(m = 0; m < MULTIPLEDOMAINS; m++)
+    {
+        for(i = DomainStartList[ThisTask * MULTIPLEDOMAINS + m]; i <= DomainEndList[ThisTask * MULTIPLEDOMAINS + m]; i++)
+        {
+            if(fmm_get_cell(DomainNodeIndex[i], &roots[n_roots])) {n_roots++;}
+        }
+    }
+    for(i = 0; i < n_roots; i++)
+    {
+        fmm_interact_self(&roots[i]);
+        for(j = i + 1; j < n_roots; j++) {fmm_interact(&roots[i], &roots[j]);}
+    }
+    for(i = 0; i < n_roots; i++) {fmm_downward_pass(roots[i].no, roots[i].z);}
+
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    {
+        for(k = 0; k < 3; k++) {P[i].GravAccel[k] -= FMM_PartLocal[4*i+1+k];}
+#ifdef EVALPOTENTIAL
+        P[i].Potential += FMM_PartLocal[4*i];
+#endif
+    }
+    myfree(roots); myfree(FMM_NodeLocal); myfree(FMM_PartLocal);
+    if(All.HighestActiveTimeBin == All.HighestOccupiedTimeBin)
+    {
+        long long n_loc[2] = {FMM_N_M2L, FMM_N_P2P}, n_tot[2];
+        MPI_Reduce(n_loc, n_tot, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        PRINT_STATUS(" ..FMM (order %d) local interactions: cell-cell=%lld direct=%lld", FMM_ORDER, n_tot[0], n_tot[1]);
+    }
+    return (double) (FMM_N_M2L + FMM_N_P2P);
+}
+
+#endif
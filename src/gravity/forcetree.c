@@ -53,6 +53,55 @@ static float shortrange_table[NTAB], shortrange_table_potential[NTAB];
 #ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
 static float shortrange_table_tidal[NTAB];
 #endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+/*! short-range factors for the second and third radial derivatives of the potential, needed for the quadrupole terms */
+static float shortrange_table_quad2[NTAB], shortrange_table_quad3[NTAB];
+#endif
+
+#ifdef PM_SHORTRANGE_ANALYTIC
+/*! short-range tree-PM factors evaluated directly from u=r/(2*asmth) instead of read from the tables above: this avoids the
+    float->int conversion and the gather from the table (so the interaction loop can be vectorized), and the discretization error
+    of the table (the piecewise-constant table is only accurate to ~1e-3 at u~1). erfc(u) uses the rational approximation of
+    Abramowitz & Stegun 7.1.26 (absolute error <1.5e-7), sharing the single exp(-u^2) with the other factors. */
+struct shortrange_factors {double force, pot, tidal, quad2, quad3;};
+static inline int shortrange_factors_evaluate(double u, struct shortrange_factors *sr)
+{
+    if(!(u < 3.0)) {return 0;} /* same cutoff as the table (tabindex < NTAB) */
+    double e = exp(-u * u), t = 1. / (1. + 0.3275911 * u);
+    double g = 1.1283791670955126 * u * e; /* 2*u/sqrt(pi) * exp(-u^2) */
+    sr->pot = t * (0.254829592 + t * (-0.284496736 + t * (1.421413741 + t * (-1.453152027 + t * 1.061405429)))) * e;
+    sr->force = sr->pot + g;
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+    sr->tidal = 2. * u * u * g;
+#endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+    sr->quad2 = sr->force + (2./3.) * u * u * g;
+    sr->quad3 = sr->quad2 + (4./15.) * u * u * u * u * g;
+#endif
+    return 1;
+}
+#define SHORTRANGE_IN_RANGE(r) (shortrange_factors_evaluate((3.0 / NTAB) * asmthfac * (r), &sr_fac))
+#define SHORTRANGE_FORCE (sr_fac.force)
+#define SHORTRANGE_POT (sr_fac.pot)
+#define SHORTRANGE_TIDAL (sr_fac.tidal)
+#define SHORTRANGE_QUAD2 (sr_fac.quad2)
+#define SHORTRANGE_QUAD3 (sr_fac.quad3)
+#else
+#define SHORTRANGE_IN_RANGE(r) (((tabindex = (int) (asmthfac * (r))) < NTAB) && (tabindex >= 0))
+#define SHORTRANGE_FORCE (shortrange_table[tabindex])
+#define SHORTRANGE_POT (shortrange_table_potential[tabindex])
+#define SHORTRANGE_TIDAL (shortrange_table_tidal[tabindex])
+#define SHORTRANGE_QUAD2 (shortrange_table_quad2[tabindex])
+#define SHORTRANGE_QUAD3 (shortrange_table_quad3[tabindex])
+#endif
+
+/*! relative (acceleration-based) opening criterion: with quadrupole moments, the leading error term is the octupole,
+    ~M*len^3/r^5, instead of the quadrupole ~M*len^2/r^4, so nodes can be accepted much closer at the same tolerance */
+#ifdef GRAVITY_TREE_QUADRUPOLE
+#define TREE_RELATIVE_CRITERION_OPEN(mass,len,r2,aold) (TreeQuadrupoleFlag ? ((mass)*(len)*(len)*(len) > (r2)*(r2)*sqrt(r2)*(aold)) : ((mass)*(len)*(len) > (r2)*(r2)*(aold)))
+#else
+#define TREE_RELATIVE_CRITERION_OPEN(mass,len,r2,aold) ((mass)*(len)*(len) > (r2)*(r2)*(aold))
+#endif
 /*! toggles after first tree-memory allocation, has only influence on log-files */
 static int first_flag = 0;
 
@@ -143,6 +192,9 @@ int force_treebuild(int npart, struct unbind_data *mp)
     force_treeupdate_pseudos(All.MaxPart);
 
     TimeOfLastTreeConstruction = All.Time;
+#ifdef GRAVITY_FMM
+    FMMTreeModifiedFlag = 0;
+#endif
 
     return Numnodestree;
 }
@@ -866,6 +918,24 @@ void force_update_node_recursive(int no, int sib, int father)
             vs_dm[2] = 0;
         }
 #endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+        /* second pass over the daughters, now that the center-of-mass is known, to collect the second moments about it */
+        double quad[6]={0}, dquad[6]={0};
+        for(j = 0; j < 8; j++)
+        {
+            double d[3], dv[3];
+            if((p = suns[j]) < 0 || p >= All.MaxPart + MaxNodes) {continue;} /* pseudo-particles carry no mass yet */
+            if(p >= All.MaxPart)
+            {
+                for(k = 0; k < 3; k++) {d[k] = Nodes[p].u.d.s[k] - s[k]; dv[k] = Extnodes[p].vs[k] - vs[k];}
+                force_quadrupole_accumulate(quad, dquad, Nodes[p].u.d.mass, d, dv, Nodes[p].quad, Extnodes[p].dquad);
+            } else {
+                for(k = 0; k < 3; k++) {d[k] = P[p].Pos[k] - s[k]; dv[k] = P[p].Vel[k] - vs[k];}
+                force_quadrupole_accumulate(quad, dquad, P[p].Mass, d, dv, NULL, NULL);
+            }
+        }
+        for(k = 0; k < 6; k++) {Nodes[no].quad[k] = quad[k]; Extnodes[no].dquad[k] = dquad[k]; Extnodes[no].dquad_kick[k] = 0;}
+#endif
 
 
         Nodes[no].Ti_current = All.Ti_Current;
@@ -1021,6 +1091,10 @@ void force_exchange_pseudodata(void)
         MyFloat s_dm[3];
         MyFloat vs_dm[3];
         MyFloat mass_dm;
+#endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+        MyFloat quad[6];
+        MyFloat dquad[6];
 #endif
         unsigned int bitflags;
 #ifdef PAD_STRUCTURES
@@ -1103,6 +1177,9 @@ void force_exchange_pseudodata(void)
             DomainMoment[i].vs_dm[0] = Extnodes[no].vs_dm[0];
             DomainMoment[i].vs_dm[1] = Extnodes[no].vs_dm[1];
             DomainMoment[i].vs_dm[2] = Extnodes[no].vs_dm[2];
+#endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+            {int k; for(k=0;k<6;k++) {DomainMoment[i].quad[k] = Nodes[no].quad[k]; DomainMoment[i].dquad[k] = Extnodes[no].dquad[k];}}
 #endif
         }
 
@@ -1195,6 +1272,9 @@ void force_exchange_pseudodata(void)
                     Extnodes[no].vs_dm[0] = DomainMoment[i].vs_dm[0];
                     Extnodes[no].vs_dm[1] = DomainMoment[i].vs_dm[1];
                     Extnodes[no].vs_dm[2] = DomainMoment[i].vs_dm[2];
+#endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+                    {int k; for(k=0;k<6;k++) {Nodes[no].quad[k] = DomainMoment[i].quad[k]; Extnodes[no].dquad[k] = DomainMoment[i].dquad[k]; Extnodes[no].dquad_kick[k] = 0;}}
 #endif
                 }
 
@@ -1411,6 +1491,16 @@ void force_treeupdate_pseudos(int no)
         vs_dm[2] = 0;
     }
 #endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+    double quad[6]={0}, dquad[6]={0};
+    for(j = 0, p = Nodes[no].u.d.nextnode; j < 8; j++, p = Nodes[p].u.d.sibling) /* second pass: moments of the 8 daughters about the new center-of-mass */
+    {
+        double d[3], dv[3]; int k;
+        for(k = 0; k < 3; k++) {d[k] = Nodes[p].u.d.s[k] - s[k]; dv[k] = Extnodes[p].vs[k] - vs[k];}
+        force_quadrupole_accumulate(quad, dquad, Nodes[p].u.d.mass, d, dv, Nodes[p].quad, Extnodes[p].dquad);
+    }
+    {int k; for(k = 0; k < 6; k++) {Nodes[no].quad[k] = quad[k]; Extnodes[no].dquad[k] = dquad[k];}}
+#endif
 
 
     Nodes[no].u.d.s[0] = s[0];
@@ -1564,6 +1654,9 @@ void force_add_star_to_tree(int igas, int istar)
     double vmax = Extnodes[Father[igas]].vmax;
     int k; for(k=0; k<3; k++) {if(fabs(P[istar].Vel[k]) > vmax) {vmax = fabs(P[istar].Vel[k]);}}
     Extnodes[Father[igas]].vmax = vmax;
+#ifdef GRAVITY_FMM
+    FMMTreeModifiedFlag = 1; /* the node moments do not include the new element, and its leaf can now have more than 8 children */
+#endif
 }
 
 
@@ -1604,14 +1697,36 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
     double vel_x, vel_y, vel_z;
 #endif
 #ifdef PMGRID
+#ifdef PM_SHORTRANGE_ANALYTIC
+    struct shortrange_factors sr_fac;
+#else
     int tabindex;
+#endif
     double eff_dist, rcut, asmth, asmthfac, rcut2, dist;
     dist = 0;
 #endif
 #ifdef COUNT_MASS_IN_GRAVTREE
     MyFloat tree_mass = 0;
+#endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+    MyFloat *quad_src = NULL; /* second moments of the node being interacted with (NULL for single particles) */
+    int quad_newtonian = 0;
 #endif
     MyLongDouble acc_x, acc_y, acc_z;
+#ifdef GRAVITY_FARFIELD_CACHE
+    int farfield_mode = 0, far_this = 0, far_invalidate = 0; /* see gravity_farfield_cache_set_modes() for the meaning of the modes */
+    double far_c[3] = {0}, far_r2 = 0, far_dt = 0, far_vs[3] = {0}, far_acc[3] = {0}, far_tidal[6] = {0}, far_jerk[3] = {0};
+    MyLongDouble acc0_x = 0, acc0_y = 0, acc0_z = 0;
+#ifdef EVALPOTENTIAL
+    MyLongDouble pot0 = 0; double far_pot = 0;
+#endif
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+    double ttps0[6] = {0}, far_ttps[6] = {0}; /* far-field part of tidal_tensorps (xx,yy,zz,xy,xz,yz), cached alongside the acceleration */
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+    double jerk0[3] = {0}, far_gjerk[3] = {0}; /* far-field part of the jerk */
+#endif
+#endif
     // cache some global vars in local vars to help compiler with alias analysis
     int maxPart = All.MaxPart;
     long bunchSize = All.BunchSize;
@@ -1657,6 +1772,9 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 #ifdef SINGLE_STAR_FB_TIMESTEPLIMIT
     double min_bh_fb_time = MAX_REAL_NUMBER;
 #endif
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+    double fewbody_tapp_comp = MAX_REAL_NUMBER, fewbody_tapp_ext = MAX_REAL_NUMBER; /* approach time (squared) to the companion candidate, and to all other stars */
+#endif
 #endif
 #endif
 
@@ -1718,6 +1836,10 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
         if(ptype==5) {bh_mass = P[target].BH_Mass;}
 #endif
         aold = All.ErrTolForceAcc * P[target].OldAcc;
+#ifdef GRAVITY_FARFIELD_CACHE
+        farfield_mode = P[target].FarMode; far_r2 = P[target].FarRcut * P[target].FarRcut; far_dt = gravity_farfield_cache_dt(target);
+        far_c[0] = P[target].FarPos[0]; far_c[1] = P[target].FarPos[1]; far_c[2] = P[target].FarPos[2];
+#endif
 #if defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(ADAPTIVE_GRAVSOFT_FORGAS) || defined(RT_USE_GRAVTREE) || defined(SINGLE_STAR_TIMESTEPPING)
         soft = All.ForceSoftening[ptype];
 #endif
@@ -1734,10 +1856,11 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
         zeta = PPPZ[target].AGS_zeta;
 #endif
 #if defined(PMGRID) && defined(PM_PLACEHIGHRESREGION)
-        if(pmforce_is_particle_high_res(ptype, P[target].Pos))
+        int pm_level = P[target].PM_Level; /* finest PM level this target received at the last PM step, which sets its split scale */
+        if(pm_level > 0)
         {
-            rcut = All.Rcut[1];
-            asmth = All.Asmth[1];
+            rcut = All.Rcut[pm_level];
+            asmth = All.Asmth[pm_level];
         }
 #endif
     }
@@ -1759,6 +1882,10 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
         if(ptype==5) {bh_mass = GravDataGet[target].BH_Mass;}
 #endif
         aold = All.ErrTolForceAcc * GravDataGet[target].OldAcc;
+#ifdef GRAVITY_FARFIELD_CACHE
+        farfield_mode = GravDataGet[target].FarMode; far_r2 = GravDataGet[target].FarRcut * GravDataGet[target].FarRcut; far_dt = GravDataGet[target].FarDt;
+        far_c[0] = GravDataGet[target].FarPos[0]; far_c[1] = GravDataGet[target].FarPos[1]; far_c[2] = GravDataGet[target].FarPos[2];
+#endif
 #if defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(ADAPTIVE_GRAVSOFT_FORGAS) || defined(RT_USE_GRAVTREE) || defined(SINGLE_STAR_TIMESTEPPING)
         soft = GravDataGet[target].Soft;
 #if defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(ADAPTIVE_GRAVSOFT_FORGAS)
@@ -1766,10 +1893,11 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 #endif
 #endif
 #if defined(PMGRID) && defined(PM_PLACEHIGHRESREGION)
-        if(pmforce_is_particle_high_res(ptype, GravDataGet[target].Pos))
+        int pm_level = GravDataGet[target].PM_Level;
+        if(pm_level > 0)
         {
-            rcut = All.Rcut[1];
-            asmth = All.Asmth[1];
+            rcut = All.Rcut[pm_level];
+            asmth = All.Asmth[pm_level];
         }
 #endif
     }
@@ -1847,6 +1975,9 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
         {
             if(no < maxPart)
             {
+#ifdef GRAVITY_FMM
+                if(FMMActiveFlag && (mode == 0)) {no = Nextnode[no]; continue;} /* local-local interactions are done by the FMM */
+#endif
                 /* the index of the node is the index of the particle */
                 if(P[no].Ti_current != ti_Current)
                 {
@@ -1857,6 +1988,16 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                     drift_particle(no, ti_Current);
                     UNLOCK_PARTNODEDRIFT;
                 }
+#ifdef GRAVITY_FARFIELD_CACHE
+                if(farfield_mode) /* sources beyond the split radius are in the far-field */
+                {
+                    double fdx = P[no].Pos[0] - far_c[0], fdy = P[no].Pos[1] - far_c[1], fdz = P[no].Pos[2] - far_c[2];
+                    GRAVITY_NEAREST_XYZ(fdx,fdy,fdz,-1);
+                    far_this = (fdx*fdx + fdy*fdy + fdz*fdz > far_r2);
+                    if(far_this && (farfield_mode == 2)) {no = Nextnode[no]; continue;} /* already contained in the cached far-field */
+                    far_vs[0] = P[no].Vel[0]; far_vs[1] = P[no].Vel[1]; far_vs[2] = P[no].Vel[2];
+                }
+#endif
                 dx = P[no].Pos[0] - pos_x;
                 dy = P[no].Pos[1] - pos_y;
                 dz = P[no].Pos[2] - pos_z;
@@ -1868,6 +2009,9 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                 GRAVITY_NEAREST_XYZ(dx,dy,dz,-1);
                 r2 = dx * dx + dy * dy + dz * dz;
                 mass = P[no].Mass;
+#ifdef GRAVITY_TREE_QUADRUPOLE
+                quad_src = NULL;
+#endif
 #ifdef RT_USE_TREECOL_FOR_NH
                 if(P[no].Type == 0) gasmass = P[no].Mass;
 #ifdef BH_ALPHADISK_ACCRETION
@@ -1901,7 +2045,13 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                         if(tSqr_fb < min_bh_fb_time) {min_bh_fb_time = tSqr_fb;}
                     } // for gas, add the signal velocity of feedback from the star
 #endif                    
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS /* a member of a decoupled subsystem seen from outside is timed as the composite, so its internal orbit does not set the steps of its surroundings */
+                    double fewbody_r2soft = r2soft, fewbody_vSqr = vSqr, fewbody_M = M_total; int fewbody_is_comp = 0;
+                    fewbody_composite_kinematics(no, dx, dy, dz, bh_dvx, bh_dvy, bh_dvz, r2, &fewbody_r2soft, &fewbody_vSqr, &fewbody_M);
+                    double tSqr = fewbody_r2soft/(fewbody_vSqr + MIN_REAL_NUMBER), tff4 = fewbody_r2soft*fewbody_r2soft*fewbody_r2soft/(fewbody_M*fewbody_M);
+#else
                     double tSqr = r2soft/(vSqr + MIN_REAL_NUMBER), tff4 = r2soft*r2soft*r2soft/(M_total*M_total);
+#endif
 
                     if(tSqr < min_bh_approach_time) {min_bh_approach_time = tSqr;}
                     if(tff4 < min_bh_freefall_time) {min_bh_freefall_time = tff4;}
@@ -1922,10 +2072,16 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                             {
                                 min_bh_t_orbital=t_orbital; comp_Mass=P[no].Mass;
                                 comp_dx[0]=dx; comp_dx[1]=dy; comp_dx[2]=dz; comp_dv[0]=bh_dvx; comp_dv[1]=bh_dvy; comp_dv[2]=bh_dvz;
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+                                fewbody_is_comp = 1;
+#endif
                             }
                         } /* specific_energy < 0 */
                     } /* ptype == 5 */
 #endif //#ifdef SINGLE_STAR_FIND_BINARIES
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+                    if(fewbody_is_comp) {fewbody_tapp_ext = DMIN(fewbody_tapp_ext, fewbody_tapp_comp); fewbody_tapp_comp = tSqr;} else {fewbody_tapp_ext = DMIN(fewbody_tapp_ext, tSqr);}
+#endif
 #endif //#ifdef SINGLE_STAR_TIMESTEPPING
                 }
 #endif
@@ -2050,6 +2206,17 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                         continue;
                     }
                 }
+#ifdef GRAVITY_FMM
+                if(FMMActiveFlag && (mode == 0)) /* the FMM has done everything local: skip local branches, always open top-level nodes which contain them */
+                {
+                    if(!(nop->u.d.bitflags & (1 << BITFLAG_TOPLEVEL))) {no = nop->u.d.sibling; continue;}
+                    if(nop->u.d.bitflags & (1 << BITFLAG_DEPENDS_ON_LOCAL_MASS))
+                    {
+                        if(nop->u.d.bitflags & (1 << BITFLAG_INTERNAL_TOPLEVEL)) {no = nop->u.d.nextnode;} else {no = nop->u.d.sibling;}
+                        continue;
+                    }
+                }
+#endif
 
                 mass = nop->u.d.mass;
 #ifdef RT_USE_TREECOL_FOR_NH
@@ -2074,6 +2241,24 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                     force_drift_node(no, ti_Current);
                     UNLOCK_PARTNODEDRIFT;
                 }
+#ifdef GRAVITY_FARFIELD_CACHE
+                if(farfield_mode) /* classify the node against the split sphere: entirely outside (far), entirely inside (near), or straddling it (must be opened) */
+                {
+                    double fd[3] = {nop->center[0] - far_c[0], nop->center[1] - far_c[1], nop->center[2] - far_c[2]}, fd_min2 = 0, fd_max2 = 0; int kf;
+                    GRAVITY_NEAREST_XYZ(fd[0],fd[1],fd[2],-1);
+                    for(kf = 0; kf < 3; kf++) {double dmin = fabs(fd[kf]) - 0.5 * nop->len, dmax = fabs(fd[kf]) + 0.5 * nop->len; if(dmin > 0) {fd_min2 += dmin * dmin;} fd_max2 += dmax * dmax;}
+                    far_this = (fd_min2 > far_r2);
+                    if(far_this && (farfield_mode == 2)) {no = nop->u.d.sibling; continue;} /* already contained in the cached far-field */
+                    if(!far_this && (fd_max2 > far_r2))
+                    {
+                        /* sources close to the split may have crossed it since the cache was built: if they can have moved too far, request a refresh */
+                        if((farfield_mode == 2) && (1.7320508 * Extnodes[no].vmax * far_dt > FARFIELD_CACHE_DRIFT_TOL * sqrt(far_r2))) {far_invalidate = 1;}
+                        no = nop->u.d.nextnode;
+                        continue;
+                    }
+                    far_vs[0] = Extnodes[no].vs[0]; far_vs[1] = Extnodes[no].vs[1]; far_vs[2] = Extnodes[no].vs[2];
+                }
+#endif
 
                 dx = nop->u.d.s[0] - pos_x;
                 dy = nop->u.d.s[1] - pos_y;
@@ -2210,7 +2395,7 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                     }
 
 #if defined(REDUCE_TREEWALK_BRANCHING) && defined(PMGRID)
-                    if((mass * nop->len * nop->len > r2 * r2 * aold) |
+                    if(TREE_RELATIVE_CRITERION_OPEN(mass, nop->len, r2, aold) |
                        ((pdxx < 0.60 * nop->len) & (pdyy < 0.60 * nop->len) & (pdzz < 0.60 * nop->len)))
                     {
                         /* open cell */
@@ -2218,7 +2403,7 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                         continue;
                     }
 #else
-                    if(mass * nop->len * nop->len > r2 * r2 * aold)
+                    if(TREE_RELATIVE_CRITERION_OPEN(mass, nop->len, r2, aold))
                     {
                         /* open cell */
                         no = nop->u.d.nextnode;
@@ -2271,6 +2456,9 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 
                 if(TakeLevel >= 0) {nop->GravCost += 1.0;}
                 no = nop->u.d.sibling;	/* ok, node can be used */
+#ifdef GRAVITY_TREE_QUADRUPOLE
+                if(TreeQuadrupoleFlag) {quad_src = nop->quad;} else {quad_src = NULL;}
+#endif
 
 #ifdef BH_CALC_DISTANCES // NOTE: moved this to AFTER the checks for node opening, because we only want to record BH positions from the nodes that actually get used for the force calculation - MYG
                 if(nop->bh_mass > 0)        /* found a node with non-zero BH mass */
@@ -2292,6 +2480,9 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                     r2soft = DMAX(All.ForceSoftening[5], soft) * KERNEL_FAC_FROM_FORCESOFT_TO_PLUMMER;
                     r2soft = r2 + r2soft*r2soft;
                     double tSqr = r2soft/(vSqr + MIN_REAL_NUMBER), tff4 = r2soft*r2soft*r2soft/(M_total*M_total);
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+                    int fewbody_is_comp = 0; /* nodes holding both members of a subsystem already carry its composite mass and (mass-weighted) velocity */
+#endif
 #ifdef SINGLE_STAR_FB_TIMESTEPLIMIT
                     if(ptype == 0) {
                         double tSqr_fb = r2soft /(nop->MaxFeedbackVel * nop->MaxFeedbackVel + MIN_REAL_NUMBER);
@@ -2312,10 +2503,16 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                             {
                                 min_bh_t_orbital=t_orbital; comp_Mass=nop->bh_mass;
                                 comp_dx[0]=bh_dx; comp_dx[1]=bh_dy; comp_dx[2]=bh_dz; comp_dv[0]=bh_dvx; comp_dv[1]=bh_dvy; comp_dv[2]=bh_dvz;
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+                                fewbody_is_comp = 1;
+#endif
                             }
                         } /* specific_energy < 0 */
                     } /* ptype == 5 */
 #endif //#ifdef SINGLE_STAR_FIND_BINARIES
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+                    if(fewbody_is_comp) {fewbody_tapp_ext = DMIN(fewbody_tapp_ext, fewbody_tapp_comp); fewbody_tapp_comp = tSqr;} else {fewbody_tapp_ext = DMIN(fewbody_tapp_ext, tSqr);}
+#endif
 #endif //#ifdef SINGLE_STAR_TIMESTEPPING
                 }
 #endif
@@ -2336,10 +2533,16 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 #endif
 #ifdef EVALPOTENTIAL
                 facpot = -mass / r;
+#endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+                quad_newtonian = 1;
 #endif
             }
             else
             {
+#ifdef GRAVITY_TREE_QUADRUPOLE
+                quad_newtonian = 0; /* inside the softening the node is (almost always) opened anyway, so only the monopole is used */
+#endif
 #if !defined(ADAPTIVE_GRAVSOFT_FORALL) && !defined(ADAPTIVE_GRAVSOFT_FORGAS)
                 h_inv = 1.0 / h;
                 h3_inv = h_inv * h_inv * h_inv;
@@ -2440,21 +2643,32 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 
 
 #ifdef PMGRID
-            tabindex = (int) (asmthfac * r);
-            if(tabindex < NTAB && tabindex >= 0)
+            if(SHORTRANGE_IN_RANGE(r))
 #endif // PMGRID //
             {
+#ifdef GRAVITY_FARFIELD_CACHE
+                acc0_x = acc_x; acc0_y = acc_y; acc0_z = acc_z;
+#ifdef EVALPOTENTIAL
+                pot0 = pot;
+#endif
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+                ttps0[0] = tidal_tensorps[0][0]; ttps0[1] = tidal_tensorps[1][1]; ttps0[2] = tidal_tensorps[2][2]; ttps0[3] = tidal_tensorps[0][1]; ttps0[4] = tidal_tensorps[0][2]; ttps0[5] = tidal_tensorps[1][2];
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+                jerk0[0] = jerk[0]; jerk0[1] = jerk[1]; jerk0[2] = jerk[2];
+#endif
+#endif
 #ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
                 fac_tidal = fac; /* save original fac without shortrange_table factor (needed for tidal field calculation) */
 #endif
 
 #ifdef PMGRID
-                fac *= shortrange_table[tabindex];
+                fac *= SHORTRANGE_FORCE;
 #endif
 
 #ifdef EVALPOTENTIAL
 #ifdef PMGRID
-                facpot *= shortrange_table_potential[tabindex];
+                facpot *= SHORTRANGE_POT;
 #endif
                 pot += FLT(facpot);
 #if defined(BOX_PERIODIC) && !defined(GRAVITY_NOT_PERIODIC) && !defined(PMGRID)
@@ -2464,6 +2678,30 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                 acc_x += FLT(dx * fac);
                 acc_y += FLT(dy * fac);
                 acc_z += FLT(dz * fac);
+#ifdef GRAVITY_TREE_QUADRUPOLE
+                if(quad_src && quad_newtonian)
+                {
+                    /* quadrupole term from the second moments I_ij of the node: for a radial potential kernel g(r), with
+                       g2 = 3*s2/r^5 and g3 = -15*s3/r^7 its scaled derivatives (s2=s3=1 for pure Newtonian forces, or the
+                       short-range tree-PM factors), acc = -[g3*(dx.I.dx) + g2*tr(I)]*dx/2 - g2*(I.dx) */
+                    double s2 = 1, s3 = 1, r5_inv = 1. / (r2 * r2 * r), r7_inv = r5_inv / r2, qtr = quad_src[0] + quad_src[1] + quad_src[2];
+#ifdef PMGRID
+                    s2 = SHORTRANGE_QUAD2; s3 = SHORTRANGE_QUAD3;
+#endif
+                    double qdx = quad_src[0]*dx + quad_src[3]*dy + quad_src[4]*dz, qdy = quad_src[3]*dx + quad_src[1]*dy + quad_src[5]*dz, qdz = quad_src[4]*dx + quad_src[5]*dy + quad_src[2]*dz;
+                    double dqd = dx*qdx + dy*qdy + dz*qdz, fac_r = 7.5 * s3 * dqd * r7_inv - 1.5 * s2 * qtr * r5_inv, fac_q = -3.0 * s2 * r5_inv;
+                    acc_x += FLT(dx * fac_r + qdx * fac_q);
+                    acc_y += FLT(dy * fac_r + qdy * fac_q);
+                    acc_z += FLT(dz * fac_r + qdz * fac_q);
+#ifdef EVALPOTENTIAL
+                    double s1 = 1;
+#ifdef PMGRID
+                    s1 = SHORTRANGE_FORCE;
+#endif
+                    pot += FLT(-1.5 * s2 * dqd * r5_inv + 0.5 * s1 * qtr * r5_inv * r2);
+#endif
+                }
+#endif
 
 
 #if defined(BH_DYNFRICTION_FROMTREE)
@@ -2491,18 +2729,18 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                  |Tzx Tzy Tzz|   |tidal_tensorps[2][0] tidal_tensorps[2][1] tidal_tensorps[2][2]|
                  */
 #ifdef PMGRID
-                tidal_tensorps[0][0] += ((-fac_tidal + dx * dx * fac2_tidal) * shortrange_table[tabindex]) +
-                    dx * dx * fac2_tidal / 3.0 * shortrange_table_tidal[tabindex];
-                tidal_tensorps[0][1] += ((dx * dy * fac2_tidal) * shortrange_table[tabindex]) +
-                    dx * dy * fac2_tidal / 3.0 * shortrange_table_tidal[tabindex];
-                tidal_tensorps[0][2] += ((dx * dz * fac2_tidal) * shortrange_table[tabindex]) +
-                    dx * dz * fac2_tidal / 3.0 * shortrange_table_tidal[tabindex];
-                tidal_tensorps[1][1] += ((-fac_tidal + dy * dy * fac2_tidal) * shortrange_table[tabindex]) +
-                    dy * dy * fac2_tidal / 3.0 * shortrange_table_tidal[tabindex];
-                tidal_tensorps[1][2] += ((dy * dz * fac2_tidal) * shortrange_table[tabindex]) +
-                    dy * dz * fac2_tidal / 3.0 * shortrange_table_tidal[tabindex];
-                tidal_tensorps[2][2] += ((-fac_tidal + dz * dz * fac2_tidal) * shortrange_table[tabindex]) +
-                    dz * dz * fac2_tidal / 3.0 * shortrange_table_tidal[tabindex];
+                tidal_tensorps[0][0] += ((-fac_tidal + dx * dx * fac2_tidal) * SHORTRANGE_FORCE) +
+                    dx * dx * fac2_tidal / 3.0 * SHORTRANGE_TIDAL;
+                tidal_tensorps[0][1] += ((dx * dy * fac2_tidal) * SHORTRANGE_FORCE) +
+                    dx * dy * fac2_tidal / 3.0 * SHORTRANGE_TIDAL;
+                tidal_tensorps[0][2] += ((dx * dz * fac2_tidal) * SHORTRANGE_FORCE) +
+                    dx * dz * fac2_tidal / 3.0 * SHORTRANGE_TIDAL;
+                tidal_tensorps[1][1] += ((-fac_tidal + dy * dy * fac2_tidal) * SHORTRANGE_FORCE) +
+                    dy * dy * fac2_tidal / 3.0 * SHORTRANGE_TIDAL;
+                tidal_tensorps[1][2] += ((dy * dz * fac2_tidal) * SHORTRANGE_FORCE) +
+                    dy * dz * fac2_tidal / 3.0 * SHORTRANGE_TIDAL;
+                tidal_tensorps[2][2] += ((-fac_tidal + dz * dz * fac2_tidal) * SHORTRANGE_FORCE) +
+                    dz * dz * fac2_tidal / 3.0 * SHORTRANGE_TIDAL;
 #else
                 tidal_tensorps[0][0] += (-fac_tidal + dx * dx * fac2_tidal);
                 tidal_tensorps[0][1] += (dx * dy * fac2_tidal);
@@ -2525,6 +2763,29 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 		    jerk[1] += dvy * fac - dv_dot_dx * fac2_tidal * dy;
 		    jerk[2] += dvz * fac - dv_dot_dx * fac2_tidal * dz;
 		}
+#endif
+#ifdef GRAVITY_FARFIELD_CACHE
+                if(far_this && (farfield_mode == 1)) /* keep the far-field part separately, with its derivatives with respect to the target and source positions */
+                {
+                    double T[6]; int kf;
+                    far_acc[0] += acc_x - acc0_x; far_acc[1] += acc_y - acc0_y; far_acc[2] += acc_z - acc0_z;
+#ifdef EVALPOTENTIAL
+                    far_pot += pot - pot0;
+#endif
+                    T[0] = fac * (3. * dx * dx / r2 - 1.); T[1] = fac * (3. * dy * dy / r2 - 1.); T[2] = fac * (3. * dz * dz / r2 - 1.);
+                    T[3] = 3. * fac * dx * dy / r2; T[4] = 3. * fac * dx * dz / r2; T[5] = 3. * fac * dy * dz / r2;
+                    for(kf = 0; kf < 6; kf++) {far_tidal[kf] += T[kf];}
+                    far_jerk[0] -= T[0] * far_vs[0] + T[3] * far_vs[1] + T[4] * far_vs[2];
+                    far_jerk[1] -= T[3] * far_vs[0] + T[1] * far_vs[1] + T[5] * far_vs[2];
+                    far_jerk[2] -= T[4] * far_vs[0] + T[5] * far_vs[1] + T[2] * far_vs[2];
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+                    far_ttps[0] += tidal_tensorps[0][0] - ttps0[0]; far_ttps[1] += tidal_tensorps[1][1] - ttps0[1]; far_ttps[2] += tidal_tensorps[2][2] - ttps0[2];
+                    far_ttps[3] += tidal_tensorps[0][1] - ttps0[3]; far_ttps[4] += tidal_tensorps[0][2] - ttps0[4]; far_ttps[5] += tidal_tensorps[1][2] - ttps0[5];
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+                    for(kf = 0; kf < 3; kf++) {far_gjerk[kf] += jerk[kf] - jerk0[kf];}
+#endif
+                }
 #endif
             } // closes TABINDEX<NTAB
 
@@ -2622,12 +2883,11 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
                 /* assemble force with strength, screening length, and target charge.  */
                 fac *= All.ScalarBeta * (1 + r / All.ScalarScreeningLength) * exp(-r / All.ScalarScreeningLength);
 #ifdef PMGRID
-                tabindex = (int) (asmthfac * r);
-                if(tabindex < NTAB && tabindex >= 0)
+                if(SHORTRANGE_IN_RANGE(r))
 #endif
                 {
 #ifdef PMGRID
-                    fac *= shortrange_table[tabindex];
+                    fac *= SHORTRANGE_FORCE;
 #endif
                     acc_x += FLT(dx_dm * fac);
                     acc_y += FLT(dy_dm * fac);
@@ -2661,6 +2921,22 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
         P[target].GravAccel[0] = acc_x;
         P[target].GravAccel[1] = acc_y;
         P[target].GravAccel[2] = acc_z;
+#ifdef GRAVITY_FARFIELD_CACHE
+        if(farfield_mode == 1)
+        {
+            int kf; for(kf = 0; kf < 3; kf++) {P[target].FarAcc[kf] = far_acc[kf]; P[target].FarJerk[kf] = far_jerk[kf];} for(kf = 0; kf < 6; kf++) {P[target].FarTidal[kf] = far_tidal[kf];}
+#ifdef EVALPOTENTIAL
+            P[target].FarPot = far_pot;
+#endif
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+            for(kf = 0; kf < 6; kf++) {P[target].FarTidalTensorps[kf] = far_ttps[kf];}
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+            for(kf = 0; kf < 3; kf++) {P[target].FarGravJerk[kf] = far_gjerk[kf];}
+#endif
+        }
+        if(far_invalidate) {P[target].FarCacheValid = 0;}
+#endif
 #ifdef RT_USE_TREECOL_FOR_NH
         int k;
         for(k=0; k < RT_USE_TREECOL_FOR_NH; k++) P[target].ColumnDensityBins[k] = treecol_angular_bins[k];
@@ -2712,6 +2988,9 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 #ifdef SINGLE_STAR_TIMESTEPPING
         P[target].min_bh_approach_time = sqrt(min_bh_approach_time);
         P[target].min_bh_freefall_time = sqrt(sqrt(min_bh_freefall_time)/All.G);
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+        P[target].fewbody_tapp_comp = sqrt(fewbody_tapp_comp); P[target].fewbody_tapp_ext = sqrt(fewbody_tapp_ext);
+#endif
 #ifdef SINGLE_STAR_FB_TIMESTEPLIMIT
         P[target].min_bh_fb_time = sqrt(min_bh_fb_time);
 #endif  
@@ -2723,6 +3002,19 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
         GravDataResult[target].Acc[0] = acc_x;
         GravDataResult[target].Acc[1] = acc_y;
         GravDataResult[target].Acc[2] = acc_z;
+#ifdef GRAVITY_FARFIELD_CACHE
+        {int kf; for(kf = 0; kf < 3; kf++) {GravDataResult[target].FarAcc[kf] = far_acc[kf]; GravDataResult[target].FarJerk[kf] = far_jerk[kf];} for(kf = 0; kf < 6; kf++) {GravDataResult[target].FarTidal[kf] = far_tidal[kf];}}
+#ifdef EVALPOTENTIAL
+        GravDataResult[target].FarPot = far_pot;
+#endif
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+        {int kf; for(kf = 0; kf < 6; kf++) {GravDataResult[target].FarTidalTensorps[kf] = far_ttps[kf];}}
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+        {int kf; for(kf = 0; kf < 3; kf++) {GravDataResult[target].FarGravJerk[kf] = far_gjerk[kf];}}
+#endif
+        GravDataResult[target].FarInvalidate = far_invalidate;
+#endif
 #ifdef COUNT_MASS_IN_GRAVTREE
         GravDataResult[target].TreeMass = tree_mass;
 #endif
@@ -2769,6 +3061,9 @@ int force_treeevaluate(int target, int mode, int *exportflag, int *exportnodecou
 #ifdef SINGLE_STAR_TIMESTEPPING
         GravDataResult[target].min_bh_approach_time = sqrt(min_bh_approach_time);
         GravDataResult[target].min_bh_freefall_time = sqrt(sqrt(min_bh_freefall_time)/All.G);
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+        GravDataResult[target].fewbody_tapp_comp = sqrt(fewbody_tapp_comp); GravDataResult[target].fewbody_tapp_ext = sqrt(fewbody_tapp_ext);
+#endif
 #ifdef SINGLE_STAR_FB_TIMESTEPLIMIT
         GravDataResult[target].min_bh_fb_time = sqrt(min_bh_fb_time);
 #endif        
@@ -3167,7 +3462,11 @@ int force_treeevaluate_potential(int target, int mode, int *nexport, int *nsend_
     double pos_x, pos_y, pos_z, aold;
     double fac, dxx, dyy, dzz;
 #ifdef PMGRID
+#ifdef PM_SHORTRANGE_ANALYTIC
+    struct shortrange_factors sr_fac;
+#else
     int tabindex;
+#endif
     double eff_dist, rcut, asmth, asmthfac;
 #endif
 #if defined(ADAPTIVE_GRAVSOFT_FORGAS) || defined(ADAPTIVE_GRAVSOFT_FORALL)
@@ -3199,10 +3498,11 @@ int force_treeevaluate_potential(int target, int mode, int *nexport, int *nsend_
         soft = PPP[target].AGS_Hsml;
 #endif
 #if defined(PMGRID) && defined(PM_PLACEHIGHRESREGION)
-        if(pmforce_is_particle_high_res(ptype, P[target].Pos))
+        int pm_level = P[target].PM_Level;
+        if(pm_level > 0)
         {
-            rcut = All.Rcut[1];
-            asmth = All.Asmth[1];
+            rcut = All.Rcut[pm_level];
+            asmth = All.Asmth[pm_level];
         }
 #endif
     }
@@ -3217,10 +3517,11 @@ int force_treeevaluate_potential(int target, int mode, int *nexport, int *nsend_
         if(ptype == 0) {soft = GravDataGet[target].Soft;}
 #endif
 #if defined(PMGRID) && defined(PM_PLACEHIGHRESREGION)
-        if(pmforce_is_particle_high_res(ptype, GravDataGet[target].Pos))
+        int pm_level = GravDataGet[target].PM_Level;
+        if(pm_level > 0)
         {
-            rcut = All.Rcut[1];
-            asmth = All.Asmth[1];
+            rcut = All.Rcut[pm_level];
+            asmth = All.Asmth[pm_level];
         }
 #endif
 #ifdef ADAPTIVE_GRAVSOFT_FORALL
@@ -3486,12 +3787,11 @@ int force_treeevaluate_potential(int target, int mode, int *nexport, int *nsend_
 
             r = sqrt(r2);
 #ifdef PMGRID
-            tabindex = (int) (r * asmthfac);
-            if(tabindex < NTAB && tabindex >= 0)
+            if(SHORTRANGE_IN_RANGE(r))
 #endif
             {
 #ifdef PMGRID
-                fac = shortrange_table_potential[tabindex];
+                fac = SHORTRANGE_POT;
 #else
                 fac = 1;
 #endif
@@ -3769,8 +4069,27 @@ void force_treeallocate(int maxnodes, int maxpart)
             shortrange_table_potential[i] = erfc(u);
 #ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
             shortrange_table_tidal[i] = 4.0 * u * u * u / sqrt(M_PI) * exp(-u * u);
+#endif
+#ifdef GRAVITY_TREE_QUADRUPOLE
+            shortrange_table_quad2[i] = shortrange_table[i] + 4.0 * u * u * u / (3.0 * sqrt(M_PI)) * exp(-u * u);
+            shortrange_table_quad3[i] = shortrange_table_quad2[i] + 8.0 * u * u * u * u * u / (15.0 * sqrt(M_PI)) * exp(-u * u);
 #endif
         }
+#ifdef PM_SHORTRANGE_ANALYTIC
+        if(ThisTask == 0) /* report the maximum (absolute) error of the analytic and the tabulated force and potential factors, versus the exact expressions */
+        {
+            double err_an_f = 0, err_an_p = 0, err_tab_f = 0, err_tab_p = 0; struct shortrange_factors sr_test;
+            for(i = 0; i < 100 * NTAB; i++)
+            {
+                u = 3.0 / (100 * NTAB) * (i + 0.5);
+                double f_exact = erfc(u) + 2.0 * u / sqrt(M_PI) * exp(-u * u), p_exact = erfc(u); int k_tab = (int) (u * NTAB / 3.0);
+                shortrange_factors_evaluate(u, &sr_test);
+                err_an_f = DMAX(err_an_f, fabs(sr_test.force - f_exact)); err_an_p = DMAX(err_an_p, fabs(sr_test.pot - p_exact));
+                err_tab_f = DMAX(err_tab_f, fabs(shortrange_table[k_tab] - f_exact)); err_tab_p = DMAX(err_tab_p, fabs(shortrange_table_potential[k_tab] - p_exact));
+            }
+            printf("Short-range tree-PM factors evaluated analytically: max error (force, potential) = (%g, %g) [table: (%g, %g)]\n", err_an_f, err_an_p, err_tab_f, err_tab_p);
+        }
+#endif
     }
 }
 
@@ -29,6 +29,24 @@
 #define BITFLAG_MASK  ((1 << BITFLAG_MULTIPLEPARTICLES) + (1 << BITFLAG_MIXED_SOFTENINGS_IN_NODE) + (7 << BITFLAG_MAX_SOFTENING_TYPE))
 #define maskout_different_softening_flag(x) (x & (1 << BITFLAG_MIXED_SOFTENINGS_IN_NODE))
 
+#ifdef GRAVITY_TREE_QUADRUPOLE
+/*! adds a mass m at offset d (with velocity dv) from the parent center-of-mass to the parent second moments q and their
+    time-derivatives dq; q_c and dq_c are the child's own moments about its center-of-mass (NULL for a single particle) */
+static inline void force_quadrupole_accumulate(double *q, double *dq, double m, double *d, double *dv, MyFloat *q_c, MyFloat *dq_c)
+{
+    q[0] += m*d[0]*d[0]; q[1] += m*d[1]*d[1]; q[2] += m*d[2]*d[2]; q[3] += m*d[0]*d[1]; q[4] += m*d[0]*d[2]; q[5] += m*d[1]*d[2];
+    dq[0] += 2*m*d[0]*dv[0]; dq[1] += 2*m*d[1]*dv[1]; dq[2] += 2*m*d[2]*dv[2];
+    dq[3] += m*(d[0]*dv[1]+dv[0]*d[1]); dq[4] += m*(d[0]*dv[2]+dv[0]*d[2]); dq[5] += m*(d[1]*dv[2]+dv[1]*d[2]);
+    if(q_c) {int k; for(k=0;k<6;k++) {q[k] += q_c[k]; dq[k] += dq_c[k];}}
+}
+/*! change of the second-moment time-derivatives dq from a momentum kick dp applied at offset d from the center-of-mass */
+static inline void force_quadrupole_kick(MyFloat *dq, double *d, double *dp)
+{
+    dq[0] += 2*d[0]*dp[0]; dq[1] += 2*d[1]*dp[1]; dq[2] += 2*d[2]*dp[2];
+    dq[3] += d[0]*dp[1]+dp[0]*d[1]; dq[4] += d[0]*dp[2]+dp[0]*d[2]; dq[5] += d[1]*dp[2]+dp[1]*d[2];
+}
+#endif
+
 void force_update_tree(void);
 
 
@@ -104,6 +122,9 @@ void ngb_treefind_flagexport(MyDouble searchcenter[3], MyFloat hguess);
 
 int ngb_treefind_pairs_threads(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode,
 		       int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist);		       
+int ngb_treefind_pairs_threads_culled(MyDouble searchcenter[3], MyFloat hsml, MyFloat rmax, int target, int *startnode,
+                                      int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist);
+extern long long Ngb_Export_Culling_Count[2];
 int ngb_treefind_variable_targeted(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode, int mode,
  			  int *nexport, int *nsend_local, int TARGET_BITMASK);
 int ngb_treefind_pairs_targeted(MyDouble searchcenter[3], MyFloat hsml, int target, int *startnode, int mode,
@@ -82,6 +82,12 @@ void force_kick_node(int i, MyDouble * dp)
       if(Extnodes[no].vmax < vmax)
 	Extnodes[no].vmax = vmax;
 
+#ifdef GRAVITY_TREE_QUADRUPOLE
+      double d_com[3], dp_com[3];
+      for(j = 0; j < 3; j++) {d_com[j] = P[i].Pos[j] - Nodes[no].u.d.s[j]; dp_com[j] = dp[j];}
+      force_quadrupole_kick(Extnodes[no].dquad, d_com, dp_com);
+#endif
+
       Nodes[no].u.d.bitflags |= (1 << BITFLAG_NODEHASBEENKICKED);
       Extnodes[no].Ti_lastkicked = All.Ti_Current;
 
@@ -91,7 +97,13 @@ void force_kick_node(int i, MyDouble * dp)
 	    {
 	      Extnodes[no].Flag = GlobFlag;
 	      DomainList[DomainNumChanged++] = no;
+#ifdef GRAVITY_TREE_QUADRUPOLE
+	      for(j = 0; j < 6; j++) {Extnodes[no].dquad_kick[j] = 0;}
+#endif
 	    }
+#ifdef GRAVITY_TREE_QUADRUPOLE
+	  force_quadrupole_kick(Extnodes[no].dquad_kick, d_com, dp_com); /* kept separately, since it must be sent to the other tasks */
+#endif
 	  break;
 	}
 
@@ -118,6 +130,9 @@ void force_finish_kick_nodes(void)
   MyLongDouble *domainDp_dm_loc, *domainDp_dm_all;
 #endif
   MyFloat *domainVmax_loc, *domainVmax_all;
+#ifdef GRAVITY_TREE_QUADRUPOLE
+  MyFloat *domainDquad_loc, *domainDquad_all; int *counts_dquad, *offset_dquad;
+#endif
 
   /* share the momentum-data of the pseudo-particles accross CPUs */
 
@@ -135,6 +150,12 @@ void force_finish_kick_nodes(void)
   domainDp_dm_loc = (MyLongDouble *) mymalloc("domainDp_dm_loc", DomainNumChanged * 3 * sizeof(MyLongDouble));
 #endif
   domainVmax_loc = (MyFloat *) mymalloc("domainVmax_loc", DomainNumChanged * sizeof(MyFloat));
+#ifdef GRAVITY_TREE_QUADRUPOLE
+  counts_dquad = (int *) mymalloc("counts_dquad", sizeof(int) * NTask);
+  offset_dquad = (int *) mymalloc("offset_dquad", sizeof(int) * NTask);
+  domainDquad_loc = (MyFloat *) mymalloc("domainDquad_loc", DomainNumChanged * 6 * sizeof(MyFloat));
+  for(i = 0; i < DomainNumChanged; i++) {for(j = 0; j < 6; j++) {domainDquad_loc[i * 6 + j] = Extnodes[DomainList[i]].dquad_kick[j];}}
+#endif
 
   for(i = 0; i < DomainNumChanged; i++)
     {
@@ -177,6 +198,11 @@ void force_finish_kick_nodes(void)
   domainVmax_all = (MyFloat *) mymalloc("domainVmax_all", totDomainNumChanged * sizeof(MyFloat));
 
   domainList_all = (int *) mymalloc("domainList_all", totDomainNumChanged * sizeof(int));
+#ifdef GRAVITY_TREE_QUADRUPOLE
+  domainDquad_all = (MyFloat *) mymalloc("domainDquad_all", totDomainNumChanged * 6 * sizeof(MyFloat));
+  for(ta = 0; ta < NTask; ta++) {counts_dquad[ta] = counts[ta] * 6 * sizeof(MyFloat); offset_dquad[ta] = offset_list[ta] * 6 * sizeof(MyFloat);}
+  MPI_Allgatherv(domainDquad_loc, DomainNumChanged * 6 * sizeof(MyFloat), MPI_BYTE, domainDquad_all, counts_dquad, offset_dquad, MPI_BYTE, MPI_COMM_WORLD);
+#endif
 
   MPI_Allgatherv(DomainList, DomainNumChanged, MPI_INT,
 		 domainList_all, counts, offset_list, MPI_INT, MPI_COMM_WORLD);
@@ -208,6 +234,10 @@ void force_finish_kick_nodes(void)
   for(i = 0; i < totDomainNumChanged; i++)
     {
       no = domainList_all[i];
+#ifdef GRAVITY_TREE_QUADRUPOLE
+      int no_leaf = no;
+      force_drift_node(no_leaf, All.Ti_Current);
+#endif
 
       if(Nodes[no].u.d.bitflags & (1 << BITFLAG_DEPENDS_ON_LOCAL_MASS))	/* to avoid that the local one is kicked twice */
 	no = Nodes[no].u.d.father;
@@ -216,6 +246,14 @@ void force_finish_kick_nodes(void)
 	{
 	  force_drift_node(no, All.Ti_Current);
 
+#ifdef GRAVITY_TREE_QUADRUPOLE
+	  /* the kick changes of the leaf's second moments (about its own center-of-mass), shifted to this node's center-of-mass */
+	  double d_com[3], dp_com[3];
+	  for(j = 0; j < 3; j++) {d_com[j] = Nodes[no_leaf].u.d.s[j] - Nodes[no].u.d.s[j]; dp_com[j] = domainDp_all[3 * i + j];}
+	  for(j = 0; j < 6; j++) {Extnodes[no].dquad[j] += domainDquad_all[6 * i + j];}
+	  force_quadrupole_kick(Extnodes[no].dquad, d_com, dp_com);
+#endif
+
 	  for(j = 0; j < 3; j++)
 	    {
 	      Extnodes[no].dp[j] += domainDp_all[3 * i + j];
@@ -237,6 +275,9 @@ void force_finish_kick_nodes(void)
 	}
     }
 
+#ifdef GRAVITY_TREE_QUADRUPOLE
+  myfree(domainDquad_all);
+#endif
   myfree(domainList_all);
   myfree(domainVmax_all);
 #ifdef RT_SEPARATELY_TRACK_LUMPOS
@@ -246,6 +287,11 @@ void force_finish_kick_nodes(void)
   myfree(domainDp_dm_all);
 #endif
   myfree(domainDp_all);
+#ifdef GRAVITY_TREE_QUADRUPOLE
+  myfree(domainDquad_loc);
+  myfree(offset_dquad);
+  myfree(counts_dquad);
+#endif
   myfree(domainVmax_loc);
 #ifdef RT_SEPARATELY_TRACK_LUMPOS
     myfree(domainDp_stellarlum_loc);
@@ -332,6 +378,9 @@ void force_drift_node(int no, integertime time1)
 
     for(j = 0; j < 3; j++) {Nodes[no].u.d.s[j] += Extnodes[no].vs[j] * dt_drift;}
   Nodes[no].len += 2 * Extnodes[no].vmax * dt_drift;
+#ifdef GRAVITY_TREE_QUADRUPOLE
+    for(j = 0; j < 6; j++) {Nodes[no].quad[j] += Extnodes[no].dquad[j] * dt_drift;} /* first-order drift of the second moments */
+#endif
 
 #ifdef DM_SCALARFIELD_SCREENING
     for(j = 0; j < 3; j++) {Nodes[no].s_dm[j] += Extnodes[no].vs_dm[j] * dt_drift;}
@@ -44,6 +44,13 @@ double Ewaldcount, Costtotal;
 long long N_nodesinlist;
 int Ewald_iter;			/* global in file scope, for simplicity */
 void sum_top_level_node_costfactors(void);
+#ifdef GRAVITY_FARFIELD_CACHE
+#if defined(RT_USE_GRAVTREE) || defined(RT_USE_TREECOL_FOR_NH) || defined(COUNT_MASS_IN_GRAVTREE) || defined(BH_CALC_DISTANCES) || defined(BH_SEED_FROM_LOCALGAS_TOTALMENCCRITERIA)
+#error "GRAVITY_FARFIELD_CACHE only caches the acceleration, potential, tidal tensor and jerk: the other quantities these modules evaluate inside the gravity tree-walk would lose their far-field contributions"
+#endif
+static void gravity_farfield_cache_set_modes(void);
+static void gravity_farfield_cache_finish(void);
+#endif
 
 
 /*! This function computes the gravitational forces for all active elements. If needed, a new tree is constructed, otherwise the dynamically updated
@@ -88,7 +95,7 @@ void gravity_tree(void)
     DataIndexTable = (struct data_index *) mymalloc("DataIndexTable", All.BunchSize * sizeof(struct data_index));
     DataNodeList = (struct data_nodelist *) mymalloc("DataNodeList", All.BunchSize * sizeof(struct data_nodelist));
     if(All.HighestActiveTimeBin == All.HighestOccupiedTimeBin) {if(ThisTask == 0) printf(" ..All.BunchSize=%ld\n", All.BunchSize);}
-    int k, ewald_max, diff, save_NextParticle, ndone, ndone_flag, place, recvTask; double tstart, tend, ax, ay, az; MPI_Status status;
+    int k, ewald_max, diff, save_NextParticle, ndone, ndone_flag, place, recvTask; double tstart, tend, ax, ay, az;
     Ewaldcount = 0; Costtotal = 0; N_nodesinlist = 0; ewald_max=0;
 #if defined(BOX_PERIODIC) && !defined(GRAVITY_NOT_PERIODIC) && !defined(PMGRID)
     ewald_max = 1; /* the tree-code will need to iterate to perform the periodic boundary condition corrections */
@@ -133,6 +140,16 @@ void gravity_tree(void)
         TakeLevel = -1;
     }
     if(TakeLevel >= 0) {for(i = 0; i < NumPart; i++) {P[i].GravCost[TakeLevel] = 0;}} /* re-zero the cost [will be re-summed] */
+#ifdef GRAVITY_FARFIELD_CACHE
+    gravity_farfield_cache_set_modes();
+#endif
+#ifdef GRAVITY_FMM
+    FMMActiveFlag = (GlobNumForceUpdate == All.TotNumPart); /* synchronous step: local-local interactions by the FMM, the walk below only does the remote part */
+    if(FMMActiveFlag) {int modified = FMMTreeModifiedFlag, modified_any; MPI_Allreduce(&modified, &modified_any, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD); if(modified_any) {FMMActiveFlag = 0;}} /* elements spawned since the last tree build: use the full walk (the FMM is collective, so all tasks must agree) */
+#ifdef HERMITE_INTEGRATION
+    if(HermiteOnlyFlag) {FMMActiveFlag = 0;}
+#endif
+#endif
 
     /* begin main communication and tree-walk loop. note the ewald-iter terms here allow for multiple iterations for periodic-tree corrections if needed */
     for(Ewald_iter = 0; Ewald_iter <= ewald_max; Ewald_iter++)
@@ -206,7 +223,7 @@ void gravity_tree(void)
             for(j = 0; j < Nexport; j++) {Send_count[DataIndexTable[j].Task]++;}
             MYSORT_DATAINDEX(DataIndexTable, Nexport, sizeof(struct data_index), data_index_compare); /* construct export count tables */
             tstart = my_second();
-            MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD); /* broadcast import/export counts */
+            mpi_sparse_alltoall_counts(Send_count, Recv_count); /* broadcast import/export counts */
             tend = my_second(); timewait1 += timediff(tstart, tend);
 
             for(j = 0, Send_offset[0] = 0; j < NTask; j++) {if(j > 0) {Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];}} /* calculate export table offsets */
@@ -219,6 +236,9 @@ void gravity_tree(void)
                 /* assign values (input-function to pass in memory) */
                 GravDataIn[j].Type = P[place].Type;
                 GravDataIn[j].OldAcc = P[place].OldAcc;
+#if defined(PMGRID) && defined(PM_PLACEHIGHRESREGION)
+                GravDataIn[j].PM_Level = P[place].PM_Level;
+#endif
                 for(k = 0; k < 3; k++) {GravDataIn[j].Pos[k] = P[place].Pos[k];}
 #if defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(ADAPTIVE_GRAVSOFT_FORGAS) || defined(RT_USE_GRAVTREE) || defined(SINGLE_STAR_TIMESTEPPING)
                 GravDataIn[j].Mass = P[place].Mass;
@@ -251,6 +271,10 @@ void gravity_tree(void)
 #ifdef ADAPTIVE_GRAVSOFT_FORALL
                 GravDataIn[j].Soft = PPP[place].AGS_Hsml;
                 GravDataIn[j].AGS_zeta = PPPZ[place].AGS_zeta;
+#endif
+#ifdef GRAVITY_FARFIELD_CACHE
+                for(k = 0; k < 3; k++) {GravDataIn[j].FarPos[k] = P[place].FarPos[k];}
+                GravDataIn[j].FarRcut = P[place].FarRcut; GravDataIn[j].FarMode = P[place].FarMode; GravDataIn[j].FarDt = gravity_farfield_cache_dt(place);
 #endif
                 memcpy(GravDataIn[j].NodeList,DataNodeList[DataIndexTable[j].IndexGet].NodeList, NODELISTLENGTH * sizeof(int));
             }
@@ -280,21 +304,8 @@ void gravity_tree(void)
                 GravDataGet = (struct gravdata_in *) mymalloc("GravDataGet", Nimport * sizeof(struct gravdata_in));
                 GravDataResult = (struct gravdata_out *) mymalloc("GravDataResult", Nimport * sizeof(struct gravdata_out));
 
-                tstart = my_second(); Nimport = 0; /* reset because this will be cycled below to calculate the recieve offsets (Recv_offset) */
-                for(ngrp = ngrp_initial; ngrp < ngrp_initial + N_chunks_for_import; ngrp++) /* exchange particle data */
-                {
-                    recvTask = ThisTask ^ ngrp;
-                    if(recvTask < NTask)
-                    {
-                        if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0) /* get the particles */
-                        {
-                            MPI_Sendrecv(&GravDataIn[Send_offset[recvTask]], Send_count[recvTask] * sizeof(struct gravdata_in), MPI_BYTE, recvTask, TAG_GRAV_A,
-                                         &GravDataGet[Nimport], Recv_count[recvTask] * sizeof(struct gravdata_in), MPI_BYTE, recvTask, TAG_GRAV_A,
-                                         MPI_COMM_WORLD, &status);
-                            Nimport += Recv_count[recvTask];
-                        }
-                    }
-                }
+                tstart = my_second(); /* exchange particle data with all tasks in this sub-chunk which we send to or receive from */
+                mpi_exchange_with_partners(GravDataIn, Send_count, Send_offset, GravDataGet, Recv_count, NULL, sizeof(struct gravdata_in), ngrp_initial, ngrp_initial + N_chunks_for_import, TAG_GRAV_A);
                 tend = my_second(); timecommsumm1 += timediff(tstart, tend);
                 report_memory_usage(&HighMark_gravtree, "GRAVTREE");
 
@@ -322,21 +333,8 @@ void gravity_tree(void)
                 MPI_Barrier(MPI_COMM_WORLD); /* insert MPI Barrier here - will be forced by comms below anyways but this allows for clean timing measurements */
                 tend = my_second(); timewait2 += timediff(tstart, tend);
 
-                tstart = my_second(); Nimport = 0;
-                for(ngrp = ngrp_initial; ngrp < ngrp_initial + N_chunks_for_import; ngrp++) /* send the results for imported elements back to their host tasks */
-                {
-                    recvTask = ThisTask ^ ngrp;
-                    if(recvTask < NTask)
-                    {
-                        if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-                        {
-                            MPI_Sendrecv(&GravDataResult[Nimport], Recv_count[recvTask] * sizeof(struct gravdata_out), MPI_BYTE, recvTask, TAG_GRAV_B,
-                                         &GravDataOut[Send_offset[recvTask]], Send_count[recvTask] * sizeof(struct gravdata_out), MPI_BYTE, recvTask, TAG_GRAV_B,
-                                         MPI_COMM_WORLD, &status);
-                            Nimport += Recv_count[recvTask];
-                        }
-                    }
-                }
+                tstart = my_second(); /* send the results for imported elements back to their host tasks */
+                mpi_exchange_with_partners(GravDataResult, Recv_count, NULL, GravDataOut, Send_count, Send_offset, sizeof(struct gravdata_out), ngrp_initial, ngrp_initial + N_chunks_for_import, TAG_GRAV_B);
                 tend = my_second(); timecommsumm2 += timediff(tstart, tend);
                 myfree(GravDataResult); myfree(GravDataGet); /* free the structures used to send data back to tasks, its sent */
 
@@ -349,6 +347,23 @@ void gravity_tree(void)
                 place = DataIndexTable[j].Index;
                 for(k=0;k<3;k++) {P[place].GravAccel[k] += GravDataOut[j].Acc[k];}
                 if(Ewald_iter > 0) continue; /* everything below is ONLY evaluated if we are in the first sub-loop, not the periodic correction, or else we will get un-allocated memory or un-physical values */
+#ifdef GRAVITY_FARFIELD_CACHE
+                if(P[place].FarMode == 1)
+                {
+                    for(k = 0; k < 3; k++) {P[place].FarAcc[k] += GravDataOut[j].FarAcc[k]; P[place].FarJerk[k] += GravDataOut[j].FarJerk[k];}
+                    for(k = 0; k < 6; k++) {P[place].FarTidal[k] += GravDataOut[j].FarTidal[k];}
+#ifdef EVALPOTENTIAL
+                    P[place].FarPot += GravDataOut[j].FarPot;
+#endif
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+                    for(k = 0; k < 6; k++) {P[place].FarTidalTensorps[k] += GravDataOut[j].FarTidalTensorps[k];}
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+                    for(k = 0; k < 3; k++) {P[place].FarGravJerk[k] += GravDataOut[j].FarGravJerk[k];}
+#endif
+                }
+                if(GravDataOut[j].FarInvalidate) {P[place].FarCacheValid = 0;}
+#endif
 
 #ifdef EVALPOTENTIAL
                 P[place].Potential += GravDataOut[j].Potential;
@@ -367,6 +382,11 @@ void gravity_tree(void)
 #ifdef SINGLE_STAR_TIMESTEPPING
                 if(GravDataOut[j].min_bh_approach_time < P[place].min_bh_approach_time) {P[place].min_bh_approach_time = GravDataOut[j].min_bh_approach_time;}
                 if(GravDataOut[j].min_bh_freefall_time < P[place].min_bh_freefall_time) {P[place].min_bh_freefall_time = GravDataOut[j].min_bh_freefall_time;}
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS /* the companion candidate (the one with the shorter orbit) keeps its approach time apart; the other candidate joins the 'external' stars */
+                if((P[place].Type == 5) && (GravDataOut[j].min_bh_t_orbital < P[place].min_bh_t_orbital))
+                    {P[place].fewbody_tapp_ext = DMIN(P[place].fewbody_tapp_ext, DMIN(P[place].fewbody_tapp_comp, GravDataOut[j].fewbody_tapp_ext)); P[place].fewbody_tapp_comp = GravDataOut[j].fewbody_tapp_comp;}
+                    else {P[place].fewbody_tapp_ext = DMIN(P[place].fewbody_tapp_ext, DMIN(GravDataOut[j].fewbody_tapp_comp, GravDataOut[j].fewbody_tapp_ext));}
+#endif
 #ifdef SINGLE_STAR_FIND_BINARIES
                 if((P[place].Type == 5) && (GravDataOut[j].min_bh_t_orbital < P[place].min_bh_t_orbital))
                 {
@@ -415,6 +435,12 @@ void gravity_tree(void)
         while(ndone < NTask);
     } /* Ewald_iter */
     myfree(DataNodeList); myfree(DataIndexTable);
+#ifdef GRAVITY_FMM
+    if(FMMActiveFlag) {tstart = my_second(); Costtotal += fmm_local_interactions(); FMMActiveFlag = 0; tend = my_second(); timetree1 += timediff(tstart, tend);}
+#endif
+#ifdef GRAVITY_FARFIELD_CACHE
+    gravity_farfield_cache_finish();
+#endif
 
     /* assign node cost to particles */
     if(TakeLevel >= 0) {
@@ -562,6 +588,9 @@ void gravity_tree(void)
 
     } /* end of loop over active particles*/
 
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+    fewbody_pair_subsystems(); /* match the members of each binary so both take the same decoupling decision */
+#endif
 
 #endif /* end SELFGRAVITY operations (check if SELFGRAVITY_OFF not enabled) */
 
@@ -610,6 +639,9 @@ void gravity_tree(void)
         MPI_Reduce(&costtotal_new, &sum_costtotal_new, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
         if(sum_costtotal>0) {PRINT_STATUS(" ..relative error in the total number of tree-gravity interactions = %g", (sum_costtotal - sum_costtotal_new) / sum_costtotal);} /* can be non-zero if THREAD_SAFE_COSTS is not used (and due to round-off errors). */
     }
+#endif
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+    report_particle_work_statistics("gravity_tree");
 #endif
     CPU_Step[CPU_TREEMISC] += measure_time();
 }
@@ -656,6 +688,9 @@ void *gravity_primary_loop(void *p)
             ret = force_treeevaluate(i, 0, exportflag, exportnodecount, exportindex);
             if(ret < 0) {break;} /* export buffer has filled up */
             Costtotal += ret;
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+            P[i].WorkCount[WORK_GRAVINTERACT] += ret;
+#endif
         }
         ProcessedFlag[i] = 1;	/* particle successfully finished */
     } // while loop
@@ -837,3 +872,173 @@ int needs_new_treeforce(int n){
     }
 }
 #endif
+
+
+
+#ifdef GRAVITY_FARFIELD_CACHE
+/*! drift time (in the units with which positions are drifted by velocities) since the far-field of element i was cached */
+double gravity_farfield_cache_dt(int i)
+{
+    if(P[i].FarMode != 2) {return 0;}
+    if(All.ComovingIntegrationOn) {return get_drift_factor(P[i].Ti_FarCache, All.Ti_Current);}
+    return (All.Ti_Current - P[i].Ti_FarCache) * All.Timebase_interval;
+}
+
+/*! decide, for each active element, how its far-field is treated in this force computation. FarMode=1: full walk, with the
+    contribution of all sources beyond FarRcut of the current position stored separately, together with its gradient
+    (for the motion of the element) and its rate of change (from the velocities of the sources). FarMode=2: only the sources
+    within FarRcut of the position where the cache was built are walked (remote branches beyond it are never exported), and
+    the cached far-field is extrapolated. The cache is refreshed whenever the time-bin FARFIELD_CACHE_LEVELS above the
+    element's own is synchronized, on fully-active steps, when the element has moved a fraction FARFIELD_CACHE_DRIFT_TOL
+    of FarRcut, or when the previous walk found that sources near the split may have moved that far. */
+static void gravity_farfield_cache_set_modes(void)
+{
+    int i, k;
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    {
+#ifdef HERMITE_INTEGRATION
+        if(HermiteOnlyFlag) {P[i].FarMode = 0; continue;} /* the extra Hermite passes use the full walk, without touching the cache */
+#endif
+#ifdef ADAPTIVE_TREEFORCE_UPDATE
+        if(!needs_new_treeforce(i)) {P[i].FarMode = 0; continue;} /* not walked this step (its old GravAccel is extrapolated with the jerk instead), so neither add to it nor cache it */
+#endif
+#ifdef GRAVITY_FMM
+        if(GlobNumForceUpdate == All.TotNumPart) {P[i].FarMode = 0; P[i].FarCacheValid = 0; continue;} /* the FMM does the local part of fully-active steps, so the far-field cannot be split off here */
+#endif
+        int bin = P[i].TimeBin + FARFIELD_CACHE_LEVELS; if(bin > TIMEBINS - 1) {bin = TIMEBINS - 1;}
+        integertime ti_sync = ((integertime) 1) << bin;
+        double dx = P[i].Pos[0] - P[i].FarPos[0], dy = P[i].Pos[1] - P[i].FarPos[1], dz = P[i].Pos[2] - P[i].FarPos[2];
+        NEAREST_XYZ(dx,dy,dz,-1);
+        double dmax = FARFIELD_CACHE_DRIFT_TOL * P[i].FarRcut;
+        if(!P[i].FarCacheValid || (All.Ti_Current % ti_sync == 0) || (GlobNumForceUpdate == All.TotNumPart) || (dx*dx + dy*dy + dz*dz > dmax*dmax))
+        {
+            P[i].FarMode = 1;
+            for(k = 0; k < 3; k++) {P[i].FarPos[k] = P[i].Pos[k];}
+            P[i].FarRcut = FARFIELD_CACHE_RCUT_IN_SOFTENINGS * All.ForceSoftening[P[i].Type];
+        }
+        else {P[i].FarMode = 2;}
+    }
+}
+
+/*! after the walk: mark refreshed caches, and add the extrapolated far-field to the near-field walk results of the others */
+static void gravity_farfield_cache_finish(void)
+{
+    int i; long long n_mode[3] = {0}, n_mode_all[3];
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    {
+        n_mode[P[i].FarMode]++;
+        if(P[i].FarMode == 1) {P[i].Ti_FarCache = All.Ti_Current; P[i].FarCacheValid = 1;}
+        if(P[i].FarMode == 2)
+        {
+            double d[3] = {P[i].Pos[0] - P[i].FarPos[0], P[i].Pos[1] - P[i].FarPos[1], P[i].Pos[2] - P[i].FarPos[2]}, dt = gravity_farfield_cache_dt(i);
+            NEAREST_XYZ(d[0],d[1],d[2],-1);
+            MyFloat *T = P[i].FarTidal;
+            P[i].GravAccel[0] += P[i].FarAcc[0] + T[0]*d[0] + T[3]*d[1] + T[4]*d[2] + P[i].FarJerk[0] * dt;
+            P[i].GravAccel[1] += P[i].FarAcc[1] + T[3]*d[0] + T[1]*d[1] + T[5]*d[2] + P[i].FarJerk[1] * dt;
+            P[i].GravAccel[2] += P[i].FarAcc[2] + T[4]*d[0] + T[5]*d[1] + T[2]*d[2] + P[i].FarJerk[2] * dt;
+#ifdef EVALPOTENTIAL
+            P[i].Potential += P[i].FarPot - (P[i].FarAcc[0]*d[0] + P[i].FarAcc[1]*d[1] + P[i].FarAcc[2]*d[2]);
+#endif
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE /* the far-field tidal tensor and jerk are used as cached, without extrapolation */
+            MyFloat *TT = P[i].FarTidalTensorps;
+            P[i].tidal_tensorps[0][0] += TT[0]; P[i].tidal_tensorps[1][1] += TT[1]; P[i].tidal_tensorps[2][2] += TT[2];
+            P[i].tidal_tensorps[0][1] += TT[3]; P[i].tidal_tensorps[0][2] += TT[4]; P[i].tidal_tensorps[1][2] += TT[5];
+            P[i].tidal_tensorps[1][0] = P[i].tidal_tensorps[0][1]; P[i].tidal_tensorps[2][0] = P[i].tidal_tensorps[0][2]; P[i].tidal_tensorps[2][1] = P[i].tidal_tensorps[1][2];
+#endif
+#ifdef COMPUTE_JERK_IN_GRAVTREE
+            P[i].GravJerk[0] += P[i].FarGravJerk[0]; P[i].GravJerk[1] += P[i].FarGravJerk[1]; P[i].GravJerk[2] += P[i].FarGravJerk[2];
+#endif
+        }
+        P[i].FarMode = 0;
+    }
+    if(All.HighestActiveTimeBin == All.HighestOccupiedTimeBin) {return;} /* nothing is cached on fully-active steps */
+    MPI_Reduce(n_mode, n_mode_all, 3, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if(ThisTask == 0 && n_mode_all[1] + n_mode_all[2] > 0) {printf(" ..far-field cache: refreshed=%lld cached=%lld\n", n_mode_all[1], n_mode_all[2]);}
+}
+#endif
+
+
+#ifdef GRAVITY_TREE_ACCURACY_SWEEP
+#define SWEEP_NBINS 80 /* log10-spaced bins of the relative force error, from 1e-8 to 1 */
+/*! Diagnostic for choosing the tree-opening tolerance: recomputes the tree forces of all active elements for a range of
+    ErrTolForceAcc values (and, with GRAVITY_TREE_QUADRUPOLE, both with and without the quadrupole terms), and compares them
+    to a reference computed with a tolerance fifty times smaller than the smallest in the list. For each setting one line
+    is written to 'gravity_accuracy_sweep.txt': the tolerance, quadrupoles on/off, the mean number of interactions per
+    element, the wall-clock time of the force computation, and the 50/90/99th-percentile and maximum relative force errors.
+    Afterwards 'OldAcc' is restored and the production solve is repeated with the run's own settings, so every output of the
+    walk (accelerations, GravCost for the domain decomposition, potentials, tidal tensors, ...) is that of the run itself. This
+    is expensive (dominated by the reference calculation), so is meant for short test runs. */
+void gravity_tree_accuracy_sweep(void)
+{
+    static const double tol_list[] = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.02};
+    int n_tol = sizeof(tol_list) / sizeof(double), i, j, k, it, quad_mode, n_quad_modes = 1;
+    double errtol_save = All.ErrTolForceAcc, errtheta_save = All.ErrTolTheta;
+#ifdef GRAVITY_TREE_QUADRUPOLE
+    n_quad_modes = 2;
+#endif
+    MyFloat *acc_ref = (MyFloat *) mymalloc("acc_ref", 3 * NumPart * sizeof(MyFloat));
+    MyFloat *oldacc_save = (MyFloat *) mymalloc("oldacc_save", NumPart * sizeof(MyFloat));
+    for(i = 0; i < NumPart; i++) {oldacc_save[i] = P[i].OldAcc;}
+    FILE *fd = NULL;
+    if(ThisTask == 0)
+    {
+        char buf[512]; sprintf(buf, "%s%s", All.OutputDir, "gravity_accuracy_sweep.txt");
+        if(!(fd = fopen(buf, "w"))) {printf("error in opening file '%s'\n", buf); endrun(1);}
+        fprintf(fd, "# ErrTolForceAcc quadrupole interactions/element time[s] err_50%% err_90%% err_99%% err_max\n");
+    }
+
+    All.ErrTolTheta = 0; /* use the relative criterion throughout */
+    All.ErrTolForceAcc = 0.02 * tol_list[0];
+    gravity_tree();
+    for(i = 0; i < NumPart; i++) {for(k = 0; k < 3; k++) {acc_ref[3*i+k] = P[i].GravAccel[k];}}
+
+    for(quad_mode = n_quad_modes - 1; quad_mode >= 0; quad_mode--)
+    {
+#ifdef GRAVITY_TREE_QUADRUPOLE
+        TreeQuadrupoleFlag = quad_mode;
+#endif
+        for(it = 0; it < n_tol; it++)
+        {
+            long long hist[SWEEP_NBINS] = {0}, hist_all[SWEEP_NBINS], n_all = 0; double cost_all, t0;
+            All.ErrTolForceAcc = tol_list[it];
+            for(i = 0; i < NumPart; i++) {P[i].OldAcc = oldacc_save[i];} /* same opening criterion input for every setting */
+            MPI_Barrier(MPI_COMM_WORLD); t0 = my_second();
+            gravity_tree();
+            MPI_Barrier(MPI_COMM_WORLD); t0 = timediff(t0, my_second());
+            MPI_Allreduce(&Costtotal, &cost_all, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+            {
+                double da2 = 0, a2 = 0; for(k = 0; k < 3; k++) {da2 += (P[i].GravAccel[k] - acc_ref[3*i+k]) * (P[i].GravAccel[k] - acc_ref[3*i+k]); a2 += acc_ref[3*i+k] * acc_ref[3*i+k];}
+                if(a2 <= 0) {continue;}
+                double x = 0.5 * log10(da2 / a2 + 1.e-40); j = (int) floor((x + 8.) * SWEEP_NBINS / 8.);
+                if(j < 0) {j = 0;} if(j >= SWEEP_NBINS) {j = SWEEP_NBINS - 1;}
+                hist[j]++;
+            }
+            MPI_Reduce(hist, hist_all, SWEEP_NBINS, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+            if(ThisTask == 0)
+            {
+                double pct[3] = {0.5, 0.9, 0.99}, err_pct[3] = {0}, err_max = 0; long long n_cum = 0; int ip = 0;
+                for(j = 0; j < SWEEP_NBINS; j++) {n_all += hist_all[j];}
+                for(j = 0; j < SWEEP_NBINS; j++)
+                {
+                    n_cum += hist_all[j];
+                    while(ip < 3 && n_cum >= pct[ip] * n_all) {err_pct[ip++] = pow(10., -8. + 8. * (j + 1) / SWEEP_NBINS);} /* upper edge of the bin */
+                    if(hist_all[j] > 0) {err_max = pow(10., -8. + 8. * (j + 1) / SWEEP_NBINS);}
+                }
+                fprintf(fd, "%g %d %g %g %g %g %g %g\n", tol_list[it], quad_mode, cost_all / (1.e-20 + n_all), t0, err_pct[0], err_pct[1], err_pct[2], err_max);
+                fflush(fd);
+            }
+        }
+    }
+
+#ifdef GRAVITY_TREE_QUADRUPOLE
+    TreeQuadrupoleFlag = 1;
+#endif
+    All.ErrTolForceAcc = errtol_save; All.ErrTolTheta = errtheta_save;
+    for(i = 0; i < NumPart; i++) {P[i].OldAcc = oldacc_save[i];}
+    if(ThisTask == 0) {fclose(fd);}
+    myfree(oldacc_save); myfree(acc_ref);
+    gravity_tree(); /* redo the production solve last, so none of the trial settings leak into the run */
+    PRINT_STATUS(" ..tree-force accuracy sweep written to gravity_accuracy_sweep.txt");
+}
+#endif
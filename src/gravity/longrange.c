@@ -60,6 +60,25 @@ void long_range_init_regionsize(void)
 }
 
 
+#ifdef PM_HIRES_NLEVELS
+/*! Adds the force from the nested high-res levels beyond the first. Their targets lie inside their inner regions by
+ *  construction, so unlike the outer grids these never have to be re-placed because a particle escaped.
+ */
+static void long_range_force_nested_levels(void)
+{
+  int grnr;
+  for(grnr = 2; grnr < PM_NGRIDS; grnr++)
+    {
+      if(pmforce_nonperiodic(grnr) != 0)
+        endrun(68689);
+#ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
+      pmtidaltensor_nonperiodic_diff(grnr);
+#endif
+    }
+}
+#endif
+
+
 /*! This function computes the long-range PM force for all particles.
  */
 void long_range_force(void)
@@ -89,11 +108,19 @@ void long_range_force(void)
   return;
 #endif
 
+#ifdef PM_HIRES_NLEVELS
+  if(pm_nested_levels_need_update()) /* the high-res structure has moved: re-place all levels before computing any of them */
+    {
+      pm_init_regionsize();
+      pm_setup_nonperiodic_kernel();
+    }
+#endif
+
 
 #ifdef BOX_PERIODIC
   pmforce_periodic(0, NULL);
 #ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE   /* choose what kind of tidal field calculation you want (for this step use Fourier method; the direct-difference method is buggy still) */
-    pmtidaltensor_periodic_fourier(0); pmtidaltensor_periodic_fourier(1); pmtidaltensor_periodic_fourier(2); pmtidaltensor_periodic_fourier(3); pmtidaltensor_periodic_fourier(4); pmtidaltensor_periodic_fourier(5); /* fourier */
+    pmtidaltensor_periodic_fourier(); /* fourier (all components from a single density transform) */
     //pmtidaltensor_periodic_diff(); /* finite-difference */
 #endif
 #ifdef PM_PLACEHIGHRESREGION
@@ -115,6 +142,9 @@ void long_range_force(void)
   if(i == 1)
     endrun(68686);
 #endif
+#ifdef PM_HIRES_NLEVELS
+  long_range_force_nested_levels();
+#endif
 #else
   i = pmforce_nonperiodic(0);
 #ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
@@ -161,6 +191,13 @@ void long_range_force(void)
   if(i != 0)
     endrun(68688);
 #endif
+#ifdef PM_HIRES_NLEVELS
+  long_range_force_nested_levels();
+#endif
+#endif
+
+#ifdef PM_PLACEHIGHRESREGION /* the tree keeps using the split scale of the levels used here until the next PM step, even if the particle moves across a level boundary meanwhile */
+  for(i = 0; i < NumPart; i++) {P[i].PM_Level = pmforce_particle_level(P[i].Type, P[i].Pos);}
 #endif
 
 
@@ -57,12 +57,9 @@ typedef unsigned int large_array_offset;
 static rfftwnd_mpi_plan fft_forward_plan, fft_inverse_plan;
 #else 
 static fftw_plan fft_forward_plan, fft_inverse_plan;
-static fftw_plan fft_forward_kernel1_plan;
-#if !defined(BOX_PERIODIC)
-static fftw_plan fft_forward_kernel0_plan;
-#endif
+static fftw_plan fft_forward_kernel_plan[PM_NGRIDS];
 #ifdef DM_SCALARFIELD_SCREENING
-static fftw_plan fft_forward_kernel_scalarfield0_plan, fft_forward_kernel_scalarfield1_plan; 
+static fftw_plan fft_forward_kernel_scalarfield_plan[PM_NGRIDS];
 #endif
 #endif
 
@@ -84,8 +81,8 @@ static ptrdiff_t fftsize, maxfftsize;
 static MPI_Datatype MPI_TYPE_PTRDIFF; 
 #endif
 
-static fftw_real *kernel[2], *rhogrid, *forcegrid, *workspace;
-static fftw_complex *fft_of_kernel[2], *fft_of_rhogrid;
+static fftw_real *kernel[PM_NGRIDS], *rhogrid, *forcegrid, *workspace;
+static fftw_complex *fft_of_kernel[PM_NGRIDS], *fft_of_rhogrid;
 static d_fftw_real *d_rhogrid, *d_forcegrid, *d_workspace;
 
 #ifdef COMPUTE_TIDAL_TENSOR_IN_GRAVTREE
@@ -94,8 +91,8 @@ static fftw_real *d_tidal_workspace;
 #endif
 
 #ifdef DM_SCALARFIELD_SCREENING
-static fftw_real *kernel_scalarfield[2];
-static fftw_complex *fft_of_kernel_scalarfield[2];
+static fftw_real *kernel_scalarfield[PM_NGRIDS];
+static fftw_complex *fft_of_kernel_scalarfield[PM_NGRIDS];
 #endif
 
 void pm_nonperiodic_transposeA(fftw_real * field, fftw_real * scratch);
@@ -117,6 +114,145 @@ static struct part_slab_data
 static int *part_sortindex;
 
 
+#ifdef PM_HIRES_NLEVELS
+#ifndef PM_HIRES_LEVEL_REFINE
+#define PM_HIRES_LEVEL_REFINE 4.0   /* ratio of the widths of the inner (force-receiving) regions of successive nested levels */
+#endif
+#define PM_HIRES_LEVEL_RECENTER 0.25 /* nested levels are re-placed when their target center has moved by this fraction of their half-width */
+
+/*! This function determines where nested level grnr>=2 should sit: a cube PM_HIRES_LEVEL_REFINE times narrower than
+ *  the inner region of level grnr-1, centered on the mass-weighted center of the high-res particles inside that region
+ *  (so successive levels close in on the dominant high-res structure), and clipped to lie entirely inside it, so that
+ *  membership of the levels is strictly nested. sum_tot holds the (global) sums of m*x, m*y, m*z and m of those particles.
+ */
+static void pm_nested_level_center(int grnr, double sum_tot[4], double center[3], double *halfwidth)
+{
+  int j;
+  double xlo, xhi;
+
+  *halfwidth = 0.5 * (All.Xmaxtot[grnr - 1][0] - All.Xmintot[grnr - 1][0]) / PM_HIRES_LEVEL_REFINE;
+  for(j = 0; j < 3; j++)
+    {
+      xlo = All.Xmintot[grnr - 1][j] + *halfwidth;
+      xhi = All.Xmaxtot[grnr - 1][j] - *halfwidth;
+      if(sum_tot[3] > 0)
+	center[j] = DMIN(DMAX(sum_tot[j] / sum_tot[3], xlo), xhi);
+      else
+	center[j] = 0.5 * (xlo + xhi);
+    }
+}
+
+/*! places level grnr from the high-res particles inside the current inner region of level grnr-1 (see pm_nested_level_center) */
+static void pm_nested_level_placement(int grnr, double center[3], double *halfwidth)
+{
+  int i, j;
+  double sum[4] = {0, 0, 0, 0}, sum_tot[4];
+
+  for(i = 0; i < NumPart; i++)
+    {
+      if(!pmforce_is_particle_high_res(P[i].Type, P[i].Pos))
+	continue;
+      for(j = 0; j < 3; j++)
+	if(P[i].Pos[j] < All.Xmintot[grnr - 1][j] || P[i].Pos[j] > All.Xmaxtot[grnr - 1][j])
+	  break;
+      if(j < 3)
+	continue;
+      for(j = 0; j < 3; j++)
+	sum[j] += P[i].Mass * P[i].Pos[j];
+      sum[3] += P[i].Mass;
+    }
+  MPI_Allreduce(sum, sum_tot, 4, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+  pm_nested_level_center(grnr, sum_tot, center, halfwidth);
+}
+
+/*! This function places nested level grnr>=2 and sizes its mesh. Besides the inner region, the (non-zero-padded half
+ *  of the) mesh has to hold a buffer of Rcut of level grnr-1 around it, beyond which the split kernel between the two
+ *  levels vanishes, plus two cells for the 4-point finite differencing; this is the same layout used for the first
+ *  high-res level when its buffer is set by Rcut[0].
+ */
+static void pm_init_regionsize_nested_level(int grnr)
+{
+  int i;
+  double center[3], halfwidth;
+
+  pm_nested_level_placement(grnr, center, &halfwidth);
+  for(i = 0; i < 3; i++)
+    {
+      All.Xmintot[grnr][i] = center[i] - halfwidth;
+      All.Xmaxtot[grnr][i] = center[i] + halfwidth;
+    }
+
+  All.TotalMeshSize[grnr] = 2 * (2 * halfwidth + 2 * All.Rcut[grnr - 1]) * (GRID) / ((double) (GRID - 10));
+  for(i = 0; i < 3; i++)
+    {
+      All.Corner[grnr][i] = All.Xmintot[grnr][i] - 1.0001 * (All.Rcut[grnr - 1] + 2 * All.TotalMeshSize[grnr] / GRID);
+      All.UpperCorner[grnr][i] = All.Corner[grnr][i] + (GRID / 2 - 1) * (All.TotalMeshSize[grnr] / GRID);
+    }
+  All.Asmth[grnr] = PM_ASMTH * All.TotalMeshSize[grnr] / GRID;
+  All.Rcut[grnr] = PM_RCUT * All.Asmth[grnr];
+
+  if(All.Asmth[grnr] >= All.Asmth[grnr - 1])
+    {
+      if(ThisTask == 0)
+	printf("Nested PM level %d (asmth=%g) does not refine level %d (asmth=%g): increase PMGRID or PM_HIRES_LEVEL_REFINE, or use fewer levels.\n",
+	       grnr, All.Asmth[grnr], grnr - 1, All.Asmth[grnr - 1]);
+      endrun(68689);
+    }
+
+  if(ThisTask == 0)
+    {
+      printf("Allowed region for isolated PM mesh (high-res level %d):\n", grnr);
+      printf("(%g|%g|%g)  -> (%g|%g|%g)   ext=%g  totmeshsize=%g  meshsize=%g\n\n",
+	     All.Xmintot[grnr][0], All.Xmintot[grnr][1], All.Xmintot[grnr][2],
+	     All.Xmaxtot[grnr][0], All.Xmaxtot[grnr][1], All.Xmaxtot[grnr][2],
+	     2 * halfwidth, All.TotalMeshSize[grnr], All.TotalMeshSize[grnr] / GRID);
+    }
+}
+
+/*! Returns 1 if the high-res structure has moved far enough within the coarser levels that the nested levels (and their
+ *  kernels) should be re-placed. Collective, since it reduces over all tasks. Called on every PM step, so the target centers
+ *  of all levels are found with a single pass over the particles and a single reduction: since the current levels are
+ *  nested, a particle outside the inner region of one level is outside those of all finer levels.
+ */
+int pm_nested_levels_need_update(void)
+{
+  int i, grnr, j;
+  double center[3], halfwidth, sum[PM_NGRIDS][4], sum_tot[PM_NGRIDS][4];
+
+  for(grnr = 0; grnr < PM_NGRIDS; grnr++)
+    for(j = 0; j < 4; j++)
+      sum[grnr][j] = 0;
+  for(i = 0; i < NumPart; i++)
+    {
+      if(!pmforce_is_particle_high_res(P[i].Type, P[i].Pos))
+	continue;
+      for(grnr = 2; grnr < PM_NGRIDS; grnr++)
+	{
+	  for(j = 0; j < 3; j++)
+	    if(P[i].Pos[j] < All.Xmintot[grnr - 1][j] || P[i].Pos[j] > All.Xmaxtot[grnr - 1][j])
+	      break;
+	  if(j < 3)
+	    break;
+	  for(j = 0; j < 3; j++)
+	    sum[grnr][j] += P[i].Mass * P[i].Pos[j];
+	  sum[grnr][3] += P[i].Mass;
+	}
+    }
+  MPI_Allreduce(&sum[0][0], &sum_tot[0][0], 4 * PM_NGRIDS, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+  for(grnr = 2; grnr < PM_NGRIDS; grnr++)
+    {
+      pm_nested_level_center(grnr, sum_tot[grnr], center, &halfwidth);
+      for(j = 0; j < 3; j++)
+	if(fabs(center[j] - 0.5 * (All.Xmintot[grnr][j] + All.Xmaxtot[grnr][j])) > PM_HIRES_LEVEL_RECENTER * halfwidth)
+	  return 1;
+    }
+  return 0;
+}
+#endif
+
+
 /*! This function determines the particle extension of all particles, and for
  *  those types selected with PM_PLACEHIGHRESREGION if this is used, and then
  *  determines the boundaries of the non-periodic FFT-mesh that can be placed
@@ -252,6 +388,11 @@ void pm_init_regionsize(void)
 #endif
     }
 
+#ifdef PM_HIRES_NLEVELS
+  for(j = 2; j < PM_NGRIDS; j++)
+    pm_init_regionsize_nested_level(j);
+#endif
+
 }
 
 /*! Initialization of the non-periodic PM routines. The plan-files for FFTW
@@ -260,7 +401,7 @@ void pm_init_regionsize(void)
  */
 void pm_init_nonperiodic(void)
 {
-  int i, slab_to_task_local[GRID];
+  int i, grnr, slab_to_task_local[GRID];
   double bytes_tot = 0;
   size_t bytes;
 
@@ -332,7 +473,7 @@ void pm_init_nonperiodic(void)
   fft_of_kernel[0] = (fftw_complex *) kernel[0];
 
 #ifdef USE_FFTW3 
-  fft_forward_kernel0_plan = fftw_mpi_plan_dft_r2c_3d(GRID, GRID, GRID, kernel[0], fft_of_kernel[0], 
+  fft_forward_kernel_plan[0] = fftw_mpi_plan_dft_r2c_3d(GRID, GRID, GRID, kernel[0], fft_of_kernel[0], 
 	  MPI_COMM_WORLD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_OUT); 
 #endif
 #ifdef DM_SCALARFIELD_SCREENING
@@ -348,7 +489,7 @@ void pm_init_nonperiodic(void)
   fft_of_kernel_scalarfield[0] = (fftw_complex *) kernel_scalarfield[0];
 
 #ifdef USE_FFTW3 
-  fft_forward_kernel_scalarfield0_plan = fftw_mpi_plan_dft_r2c_3d(GRID, GRID, GRID, 
+  fft_forward_kernel_scalarfield_plan[0] = fftw_mpi_plan_dft_r2c_3d(GRID, GRID, GRID, 
 	  kernel_scalarfield[0], fft_of_kernel_scalarfield[0], 
 	  MPI_COMM_WORLD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_OUT); 
 #endif
@@ -356,37 +497,40 @@ void pm_init_nonperiodic(void)
 #endif
 
 #if defined(PM_PLACEHIGHRESREGION)
-  if(!(kernel[1] = (fftw_real *) mymalloc("kernel[1]", bytes = fftsize * sizeof(fftw_real))))
+  for(grnr = 1; grnr < PM_NGRIDS; grnr++) /* one kernel per high-res level; all levels share GRID, so they share the slab decomposition and the density/force FFT plans */
+  {
+  if(!(kernel[grnr] = (fftw_real *) mymalloc("kernel[hires]", bytes = fftsize * sizeof(fftw_real))))
     {
-      printf("failed to allocate memory for `FFT-kernel[1]' (%g MB).\n", bytes / (1024.0 * 1024.0));
+      printf("failed to allocate memory for `FFT-kernel[%d]' (%g MB).\n", grnr, bytes / (1024.0 * 1024.0));
       endrun(1);
     }
   bytes_tot += bytes;
-  fft_of_kernel[1] = (fftw_complex *) kernel[1];
+  fft_of_kernel[grnr] = (fftw_complex *) kernel[grnr];
 
 #ifdef USE_FFTW3 
-  fft_forward_kernel1_plan = fftw_mpi_plan_dft_r2c_3d(GRID, GRID, GRID, kernel[1], fft_of_kernel[1], 
+  fft_forward_kernel_plan[grnr] = fftw_mpi_plan_dft_r2c_3d(GRID, GRID, GRID, kernel[grnr], fft_of_kernel[grnr], 
 	  MPI_COMM_WORLD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_OUT); 
 #endif
  
 #ifdef DM_SCALARFIELD_SCREENING
   if(!
-     (kernel_scalarfield[1] =
-      (fftw_real *) mymalloc("kernel_scalarfield[1]", bytes = fftsize * sizeof(fftw_real))))
+     (kernel_scalarfield[grnr] =
+      (fftw_real *) mymalloc("kernel_scalarfield[hires]", bytes = fftsize * sizeof(fftw_real))))
     {
-      printf("failed to allocate memory for `FFT-kernel_scalarfield[1]' (%g MB).\n",
+      printf("failed to allocate memory for `FFT-kernel_scalarfield[%d]' (%g MB).\n", grnr,
 	     bytes / (1024.0 * 1024.0));
       endrun(1);
     }
   bytes_tot += bytes;
-  fft_of_kernel_scalarfield[1] = (fftw_complex *) kernel_scalarfield[1];
+  fft_of_kernel_scalarfield[grnr] = (fftw_complex *) kernel_scalarfield[grnr];
 
 #ifdef USE_FFTW3 
-  fft_forward_kernel_scalarfield1_plan = fftw_mpi_plan_dft_r2c_3d(GRID, GRID, GRID, 
-	  kernel_scalarfield[1], fft_of_kernel_scalarfield[1], 
+  fft_forward_kernel_scalarfield_plan[grnr] = fftw_mpi_plan_dft_r2c_3d(GRID, GRID, GRID, 
+	  kernel_scalarfield[grnr], fft_of_kernel_scalarfield[grnr], 
 	  MPI_COMM_WORLD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_OUT); 
 #endif
 #endif
+  }
 #endif
 
 #ifndef USE_FFTW3
@@ -507,6 +651,7 @@ void pm_init_nonperiodic_free(void)
 void pm_setup_nonperiodic_kernel(void)
 {
   long i, j, k, x, y, z, ip;
+  int grnr;
   double xx, yy, zz, r, u, fac;
   double kx, ky, kz, k2, fx, fy, fz, ff;
 
@@ -559,20 +704,22 @@ void pm_setup_nonperiodic_kernel(void)
   rfftwnd_mpi(fft_forward_plan, 1, kernel_scalarfield[0], workspace, FFTW_TRANSPOSED_ORDER);
 #endif
 #else  /* FFTW3 */
-  fftw_execute(fft_forward_kernel0_plan); 
+  fftw_execute(fft_forward_kernel_plan[0]); 
 #ifdef DM_SCALARFIELD_SCREENING
-  fftw_execute(fft_forward_kernel_scalarfield0_plan); 
+  fftw_execute(fft_forward_kernel_scalarfield_plan[0]); 
 #endif
 #endif
 #endif
 
 
 #if defined(PM_PLACEHIGHRESREGION)
+  for(grnr = 1; grnr < PM_NGRIDS; grnr++) /* level grnr carries the force between the split scales of levels grnr-1 and grnr */
+  {
   for(i = 0; i < fftsize; i++)	/* clear local density field */
-    kernel[1][i] = 0;
+    kernel[grnr][i] = 0;
 #ifdef DM_SCALARFIELD_SCREENING
   for(i = 0; i < fftsize; i++)	/* clear local density field */
-    kernel_scalarfield[1][i] = 0;
+    kernel_scalarfield[grnr][i] = 0;
 #endif
   for(i = slabstart_x; i < (slabstart_x + nslab_x); i++)
     for(j = 0; j < GRID; j++)
@@ -593,24 +740,24 @@ void pm_setup_nonperiodic_kernel(void)
 
 	  u = 0.5 * r / (((double) PM_ASMTH) / GRID);
 
-	  fac = erfc(u * All.Asmth[1] / All.Asmth[0]) - erfc(u);
+	  fac = erfc(u * All.Asmth[grnr] / All.Asmth[grnr-1]) - erfc(u);
 
 	  if(r > 0)
-	    kernel[1][GRID * GRID2 * (i - slabstart_x) + GRID2 * j + k] = -fac / r;
+	    kernel[grnr][GRID * GRID2 * (i - slabstart_x) + GRID2 * j + k] = -fac / r;
 	  else
 	    {
-	      fac = 1 - All.Asmth[1] / All.Asmth[0];
-	      kernel[1][GRID * GRID2 * (i - slabstart_x) + GRID2 * j + k] =
+	      fac = 1 - All.Asmth[grnr] / All.Asmth[grnr-1];
+	      kernel[grnr][GRID * GRID2 * (i - slabstart_x) + GRID2 * j + k] =
 		-fac / (sqrt(M_PI) * (((double) PM_ASMTH) / GRID));
 	    }
 #ifdef DM_SCALARFIELD_SCREENING
 	  if(r > 0)
-	    kernel_scalarfield[1][GRID * GRID2 * (i - slabstart_x) + GRID2 * j + k] =
+	    kernel_scalarfield[grnr][GRID * GRID2 * (i - slabstart_x) + GRID2 * j + k] =
 	      -fac * All.ScalarBeta * exp(-r / All.ScalarScreeningLength) / r;
 	  else
 	    {
-	      fac = 1 - All.Asmth[1] / All.Asmth[0];
-	      kernel_scalarfield[1][GRID * GRID2 * (i - slabstart_x) + GRID2 * j + k] =
+	      fac = 1 - All.Asmth[grnr] / All.Asmth[grnr-1];
+	      kernel_scalarfield[grnr][GRID * GRID2 * (i - slabstart_x) + GRID2 * j + k] =
 		-fac / (sqrt(M_PI) * (((double) PM_ASMTH) / GRID));
 	    }
 #endif
@@ -620,16 +767,17 @@ void pm_setup_nonperiodic_kernel(void)
 
   /* do the forward transform of the kernel */
 #ifndef USE_FFTW3
-  rfftwnd_mpi(fft_forward_plan, 1, kernel[1], workspace, FFTW_TRANSPOSED_ORDER);
+  rfftwnd_mpi(fft_forward_plan, 1, kernel[grnr], workspace, FFTW_TRANSPOSED_ORDER);
 #ifdef DM_SCALARFIELD_SCREENING
-  rfftwnd_mpi(fft_forward_plan, 1, kernel_scalarfield[1], workspace, FFTW_TRANSPOSED_ORDER);
+  rfftwnd_mpi(fft_forward_plan, 1, kernel_scalarfield[grnr], workspace, FFTW_TRANSPOSED_ORDER);
 #endif
 #else /* FFTW3 */
-  fftw_execute(fft_forward_kernel1_plan); 
+  fftw_execute(fft_forward_kernel_plan[grnr]); 
 #ifdef DM_SCALARFIELD_SCREENING
-  fftw_execute(fft_forward_kernel_scalarfield1_plan); 
+  fftw_execute(fft_forward_kernel_scalarfield_plan[grnr]); 
 #endif
 #endif
+  }
 #endif
 
   /* deconvolve the Greens function twice with the CIC kernel */
@@ -684,12 +832,15 @@ void pm_setup_nonperiodic_kernel(void)
 #endif
 #endif
 #if defined(PM_PLACEHIGHRESREGION)
-	      cmplx_re(fft_of_kernel[1][ip]) *= ff;
-	      cmplx_im(fft_of_kernel[1][ip]) *= ff;
+	      for(grnr = 1; grnr < PM_NGRIDS; grnr++)
+	      {
+	      cmplx_re(fft_of_kernel[grnr][ip]) *= ff;
+	      cmplx_im(fft_of_kernel[grnr][ip]) *= ff;
 #ifdef DM_SCALARFIELD_SCREENING
-	      cmplx_re(fft_of_kernel_scalarfield[1][ip]) *= ff;
-	      cmplx_im(fft_of_kernel_scalarfield[1][ip]) *= ff;
+	      cmplx_re(fft_of_kernel_scalarfield[grnr][ip]) *= ff;
+	      cmplx_im(fft_of_kernel_scalarfield[grnr][ip]) *= ff;
 #endif
+	      }
 #endif
 	    }
 	}
@@ -718,6 +869,26 @@ int pmforce_is_particle_high_res(int type, MyDouble * Pos)
   return flag;
 #endif
 }
+
+/*! Returns the finest PM level whose force a particle receives (and hence whose split scale the tree uses for it):
+ *  0 for particles only on the top-level grid, 1 for high-res particles, and with PM_HIRES_NLEVELS the deepest nested
+ *  level whose inner region contains the particle.
+ */
+int pmforce_particle_level(int type, MyDouble * Pos)
+{
+  if(!pmforce_is_particle_high_res(type, Pos))
+    return 0;
+#ifdef PM_HIRES_NLEVELS
+  int grnr, j;
+  for(grnr = 2; grnr < PM_NGRIDS; grnr++)
+    for(j = 0; j < 3; j++)
+      if(Pos[j] < All.Xmintot[grnr][j] || Pos[j] > All.Xmaxtot[grnr][j])
+	return grnr - 1;
+  return PM_NGRIDS - 1;
+#else
+  return 1;
+#endif
+}
 #endif
 
 /*! Calculates the long-range non-periodic forces using the PM method.  The
@@ -761,7 +932,7 @@ int pmforce_nonperiodic(int grnr)
   for(i = 0, flag = 0; i < NumPart; i++)
     {
 #ifdef PM_PLACEHIGHRESREGION
-      if(grnr == 0 || (grnr == 1 && pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+      if(grnr == 0 || (grnr >= 1 && pmforce_particle_level(P[i].Type, P[i].Pos) >= grnr))
 #endif
 	{
 	  for(j = 0; j < 3; j++)
@@ -1122,8 +1293,8 @@ int pmforce_nonperiodic(int grnr)
       for(i = 0, j = 0; i < NumPart; i++)
 	{
 #ifdef PM_PLACEHIGHRESREGION
-	  if(grnr == 1)
-	    if(!(pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+	  if(grnr >= 1)
+	    if(pmforce_particle_level(P[i].Type, P[i].Pos) < grnr)
 	      continue;
 #endif
 	  while(j < num_on_grid && (part[j].partindex >> 3) != i)
@@ -1285,8 +1456,8 @@ int pmforce_nonperiodic(int grnr)
 		  continue;
 #endif
 #ifdef PM_PLACEHIGHRESREGION
-	      if(grnr == 1)
-		if(!(pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+	      if(grnr >= 1)
+		if(pmforce_particle_level(P[i].Type, P[i].Pos) < grnr)
 		  continue;
 #endif
 	      while(j < num_on_grid && (part[j].partindex >> 3) != i)
@@ -1657,7 +1828,7 @@ int pmpotential_nonperiodic(int grnr)
   for(i = 0, flag = 0; i < NumPart; i++)
     {
 #ifdef PM_PLACEHIGHRESREGION
-      if(grnr == 0 || (grnr == 1 && pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+      if(grnr == 0 || (grnr >= 1 && pmforce_particle_level(P[i].Type, P[i].Pos) >= grnr))
 #endif
 	{
 	  for(j = 0; j < 3; j++)
@@ -1985,8 +2156,8 @@ int pmpotential_nonperiodic(int grnr)
   for(i = 0, j = 0; i < NumPart; i++)
     {
 #ifdef PM_PLACEHIGHRESREGION
-      if(grnr == 1)
-	if(!(pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+      if(grnr >= 1)
+	if(pmforce_particle_level(P[i].Type, P[i].Pos) < grnr)
 	  continue;
 #endif
       while(j < num_on_grid && (part[j].partindex >> 3) != i)
@@ -2140,7 +2311,7 @@ int pmtidaltensor_nonperiodic_diff(int grnr)
   for(i = 0, flag = 0; i < NumPart; i++)
     {
 #ifdef PM_PLACEHIGHRESREGION
-      if(grnr == 0 || (grnr == 1 && pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+      if(grnr == 0 || (grnr >= 1 && pmforce_particle_level(P[i].Type, P[i].Pos) >= grnr))
 #endif
 	{
 	  for(j = 0; j < 3; j++)
@@ -2505,8 +2676,8 @@ int pmtidaltensor_nonperiodic_diff(int grnr)
       for(i = 0, j = 0; i < NumPart; i++)
 	{
 #ifdef PM_PLACEHIGHRESREGION
-	  if(grnr == 1)
-	    if(!(pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+	  if(grnr >= 1)
+	    if(pmforce_particle_level(P[i].Type, P[i].Pos) < grnr)
 	      continue;
 #endif
 	  while(j < num_on_grid && (part[j].partindex >> 3) != i)
@@ -2741,8 +2912,8 @@ int pmtidaltensor_nonperiodic_diff(int grnr)
 		  continue;
 #endif
 #ifdef PM_PLACEHIGHRESREGION
-	      if(grnr == 1)
-		if(!(pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+	      if(grnr >= 1)
+		if(pmforce_particle_level(P[i].Type, P[i].Pos) < grnr)
 		  continue;
 #endif
 	      while(j < num_on_grid && (part[j].partindex >> 3) != i)
@@ -2855,7 +3026,7 @@ int pmtidaltensor_nonperiodic_fourier(int grnr, int component)
   for(i = 0, flag = 0; i < NumPart; i++)
     {
 #ifdef PM_PLACEHIGHRESREGION
-      if(grnr == 0 || (grnr == 1 && pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+      if(grnr == 0 || (grnr >= 1 && pmforce_particle_level(P[i].Type, P[i].Pos) >= grnr))
 #endif
 	{
 	  for(j = 0; j < 3; j++)
@@ -3247,8 +3418,8 @@ int pmtidaltensor_nonperiodic_fourier(int grnr, int component)
   for(i = 0, j = 0; i < NumPart; i++)
     {
 #ifdef PM_PLACEHIGHRESREGION
-      if(grnr == 1)
-	if(!(pmforce_is_particle_high_res(P[i].Type, P[i].Pos)))
+      if(grnr >= 1)
+	if(pmforce_particle_level(P[i].Type, P[i].Pos) < grnr)
 	  continue;
 #endif
       while(j < num_on_grid && (part[j].partindex >> 3) != i)
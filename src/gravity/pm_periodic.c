@@ -2448,21 +2448,20 @@ void pmtidaltensor_periodic_diff(void)
  *  methods. The CIC kernel is deconvolved.
  *  Note that the k's need a pre-factor of 2 M_PI / All.BoxSize.
  *  The procedure calculates the second derivates of the gravitational potential by "pulling" down k's in fourier space.
- *  Component specifies the entry in the tidal field tensor that should be calculated:
- *  0=xx 1=xy 2=xz 3=yy 4=yz 5=zz
+ *  All six independent entries of the tidal field tensor (0=xx 1=xy 2=xz 3=yy 4=yz 5=zz) are computed in one call:
+ *  the density is assigned and forward-transformed once (the transform is kept in tidal_workspace), each component
+ *  then only needs its own Green's function multiply and inverse FFT, and the mesh values of all components are
+ *  exchanged and interpolated to the particles together.
  */
-/* NOTES:
-   this procedure is not yet  optimized:
-   ->the FFT is done in both directions for all components
- */
-void pmtidaltensor_periodic_fourier(int component)
+void pmtidaltensor_periodic_fourier(void)
 {
-  double k2, kx, ky, kz, smth;
+  double k2, kx, ky, kz, smth, kk[3];
   double dx, dy, dz;
   double fx, fy, fz, ff;
-  double asmth2, fac, tidal;
+  double asmth2, fac, tidal[6], wcic[8];
+  static const int tidal_index[6][2] = {{0,0}, {0,1}, {0,2}, {1,1}, {1,2}, {2,2}};
   MyDouble pp[3];
-  int i, j, slab, level, sendTask, recvTask, task;
+  int i, j, slab, level, sendTask, recvTask, task, component, nimport, *import_offset;
   int x, y, z, ip;
   int slab_x, slab_y, slab_z;
   int slab_xx, slab_yy, slab_zz;
@@ -2472,8 +2471,9 @@ void pmtidaltensor_periodic_fourier(int component)
   large_array_offset offset, *localfield_globalindex, *import_globalindex;
   d_fftw_real *localfield_d_data, *import_d_data;
   fftw_real *localfield_data, *import_data;
+  fftw_complex *fft_of_rhogrid_saved;
  
-  PRINT_STATUS("Starting periodic PM-Tidaltensor (component=%d) calculation.  (presently allocated=%g MB)",component, AllocatedBytes / (1024.0 * 1024.0));
+  PRINT_STATUS("Starting periodic PM-Tidaltensor calculation.  (presently allocated=%g MB)", AllocatedBytes / (1024.0 * 1024.0));
   asmth2 = (2 * M_PI) * All.Asmth[0] / All.BoxSize;
   asmth2 *= asmth2;
 
@@ -2544,7 +2544,7 @@ void pmtidaltensor_periodic_fourier(int component)
   /* allocate the local field */
   localfield_globalindex =
     (large_array_offset *) mymalloc("localfield_globalindex", num_field_points * sizeof(large_array_offset));
-  localfield_d_data = (d_fftw_real *) mymalloc("localfield_d_data", num_field_points * sizeof(d_fftw_real));
+  localfield_d_data = (d_fftw_real *) mymalloc("localfield_d_data", 6 * num_field_points * sizeof(d_fftw_real)); /* density, then all six tidal components */
   localfield_data = (fftw_real *) localfield_d_data;
   localfield_first = (int *) mymalloc("localfield_first", NTask * sizeof(int));
   localfield_count = (int *) mymalloc("localfield_count", NTask * sizeof(int));
@@ -2692,114 +2692,133 @@ void pmtidaltensor_periodic_fourier(int component)
   fftw_execute(fft_forward_plan); 
 #endif
 
-  /* multiply with Green's function for the potential */
+  /* keep the transformed density: each component below is built from it, so only one forward FFT is needed */
+  memcpy(tidal_workspace, rhogrid, fftsize * sizeof(fftw_real));
+  fft_of_rhogrid_saved = (fftw_complex *) tidal_workspace;
 
-  for(y = slabstart_y; y < slabstart_y + nslab_y; y++)
-    for(x = 0; x < PMGRID; x++)
-      for(z = 0; z < PMGRID / 2 + 1; z++)
+  /* collect (once, for all components) the mesh points which the other tasks need from our slabs */
+  import_offset = (int *) mymalloc("import_offset", NTask * sizeof(int));
+  for(task = 0, nimport = 0; task < NTask; task++) {import_offset[task] = nimport; nimport += localfield_togo[task * NTask + ThisTask];}
+  import_globalindex = (large_array_offset *) mymalloc("import_globalindex", (nimport + 1) * sizeof(large_array_offset));
+  import_data = (fftw_real *) mymalloc("import_data", (6 * nimport + 1) * sizeof(fftw_real));
+
+  for(level = 0; level < (1 << PTask); level++)	/* note: for level=0, target is the same task */
+    {
+      sendTask = ThisTask;
+      recvTask = ThisTask ^ level;
+
+      if(recvTask < NTask)
 	{
-	  if(x > PMGRID / 2)
-	    kx = x - PMGRID;
-	  else
-	    kx = x;
-	  if(y > PMGRID / 2)
-	    ky = y - PMGRID;
-	  else
-	    ky = y;
-	  if(z > PMGRID / 2)
-	    kz = z - PMGRID;
+	  if(level > 0)
+	    {
+	      if(localfield_togo[sendTask * NTask + recvTask] > 0
+		 || localfield_togo[recvTask * NTask + sendTask] > 0)
+		{
+		  MPI_Sendrecv(localfield_globalindex + localfield_offset[recvTask],
+			       localfield_togo[sendTask * NTask + recvTask] * sizeof(large_array_offset),
+			       MPI_BYTE, recvTask, TAG_PERIODIC_C, import_globalindex + import_offset[recvTask],
+			       localfield_togo[recvTask * NTask + sendTask] * sizeof(large_array_offset),
+			       MPI_BYTE, recvTask, TAG_PERIODIC_C, MPI_COMM_WORLD, &status);
+		}
+	    }
 	  else
-	    kz = z;
+	    {
+	      memcpy(import_globalindex + import_offset[ThisTask], localfield_globalindex + localfield_offset[ThisTask],
+		     localfield_togo[ThisTask * NTask + ThisTask] * sizeof(large_array_offset));
+	    }
+	}
+    }
 
-	  k2 = kx * kx + ky * ky + kz * kz;
+  for(component = 0; component < 6; component++)
+    {
+      /* multiply with Green's function for the potential, and "pull down" the k's for this component */
 
-	  if(k2 > 0)
+      for(y = slabstart_y; y < slabstart_y + nslab_y; y++)
+	for(x = 0; x < PMGRID; x++)
+	  for(z = 0; z < PMGRID / 2 + 1; z++)
 	    {
-	      smth = -exp(-k2 * asmth2) / k2;
+	      if(x > PMGRID / 2)
+		kx = x - PMGRID;
+	      else
+		kx = x;
+	      if(y > PMGRID / 2)
+		ky = y - PMGRID;
+	      else
+		ky = y;
+	      if(z > PMGRID / 2)
+		kz = z - PMGRID;
+	      else
+		kz = z;
 
-	      /* do deconvolution */
+	      k2 = kx * kx + ky * ky + kz * kz;
 
-	      fx = fy = fz = 1;
-	      if(kx != 0)
-		{
-		  fx = (M_PI * kx) / PMGRID;
-		  fx = sin(fx) / fx;
-		}
-	      if(ky != 0)
-		{
-		  fy = (M_PI * ky) / PMGRID;
-		  fy = sin(fy) / fy;
-		}
-	      if(kz != 0)
+	      ip = PMGRID * (PMGRID / 2 + 1) * (y - slabstart_y) + (PMGRID / 2 + 1) * x + z;
+
+	      if(k2 > 0)
 		{
-		  fz = (M_PI * kz) / PMGRID;
-		  fz = sin(fz) / fz;
-		}
-	      ff = 1 / (fx * fy * fz);
-	      smth *= ff * ff * ff * ff;
+		  smth = -exp(-k2 * asmth2) / k2;
 
+		  /* do deconvolution */
 
-	      /* end deconvolution */
+		  fx = fy = fz = 1;
+		  if(kx != 0)
+		    {
+		      fx = (M_PI * kx) / PMGRID;
+		      fx = sin(fx) / fx;
+		    }
+		  if(ky != 0)
+		    {
+		      fy = (M_PI * ky) / PMGRID;
+		      fy = sin(fy) / fy;
+		    }
+		  if(kz != 0)
+		    {
+		      fz = (M_PI * kz) / PMGRID;
+		      fz = sin(fz) / fz;
+		    }
+		  ff = 1 / (fx * fy * fz);
+		  smth *= ff * ff * ff * ff;
 
-	      ip = PMGRID * (PMGRID / 2 + 1) * (y - slabstart_y) + (PMGRID / 2 + 1) * x + z;
+		  /* end deconvolution */
 
-	      /* modify greens function to get second derivatives of potential ("pulling" down k's) */
-	      if(component == 0)
-		{
-		  cmplx_re(fft_of_rhogrid[ip]) *= smth * kx * kx;
-		  cmplx_im(fft_of_rhogrid[ip]) *= smth * kx * kx;
-		}
-	      if(component == 1)
-		{
-		  cmplx_re(fft_of_rhogrid[ip]) *= smth * kx * ky;
-		  cmplx_im(fft_of_rhogrid[ip]) *= smth * kx * ky;
-		}
-	      if(component == 2)
-		{
-		  cmplx_re(fft_of_rhogrid[ip]) *= smth * kx * kz;
-		  cmplx_im(fft_of_rhogrid[ip]) *= smth * kx * kz;
-		}
-	      if(component == 3)
-		{
-		  cmplx_re(fft_of_rhogrid[ip]) *= smth * ky * ky;
-		  cmplx_im(fft_of_rhogrid[ip]) *= smth * ky * ky;
-		}
-	      if(component == 4)
-		{
-		  cmplx_re(fft_of_rhogrid[ip]) *= smth * ky * kz;
-		  cmplx_im(fft_of_rhogrid[ip]) *= smth * ky * kz;
+		  /* modify greens function to get second derivatives of potential ("pulling" down k's) */
+		  kk[0] = kx; kk[1] = ky; kk[2] = kz;
+		  smth *= kk[tidal_index[component][0]] * kk[tidal_index[component][1]];
+
+		  /* prefactor = (2*M_PI) / All.BoxSize */
+		  /* note: tidal tensor = - d^2 Phi/ dx_i dx_j  -- make sure the sign is correct here -- */
+		  smth *= (2 * M_PI) * (2 * M_PI) / (All.BoxSize * All.BoxSize);
+
+		  cmplx_re(fft_of_rhogrid[ip]) = cmplx_re(fft_of_rhogrid_saved[ip]) * smth;
+		  cmplx_im(fft_of_rhogrid[ip]) = cmplx_im(fft_of_rhogrid_saved[ip]) * smth;
 		}
-	      if(component == 5)
+	      else
 		{
-		  cmplx_re(fft_of_rhogrid[ip]) *= smth * kz * kz;
-		  cmplx_im(fft_of_rhogrid[ip]) *= smth * kz * kz;
+		  cmplx_re(fft_of_rhogrid[ip]) = cmplx_im(fft_of_rhogrid[ip]) = 0.0;
 		}
-
-	      /* prefactor = (2*M_PI) / All.BoxSize */
-	      /* note: tidal tensor = - d^2 Phi/ dx_i dx_j  -- make sure the sign is correct here -- */
-	      cmplx_re(fft_of_rhogrid[ip]) *= (2 * M_PI) * (2 * M_PI) / (All.BoxSize * All.BoxSize);
-	      cmplx_im(fft_of_rhogrid[ip]) *= (2 * M_PI) * (2 * M_PI) / (All.BoxSize * All.BoxSize);
-
 	    }
-	}
-
-  if(slabstart_y == 0)
-    cmplx_re(fft_of_rhogrid[0]) = cmplx_im(fft_of_rhogrid[0]) = 0.0;
 
-  /* Do the inverse FFT to get the tidal tensor component */
+      /* Do the inverse FFT to get the tidal tensor component */
 
 #ifndef USE_FFTW3
-  rfftwnd_mpi(fft_inverse_plan, 1, rhogrid, workspace, FFTW_TRANSPOSED_ORDER);
+      rfftwnd_mpi(fft_inverse_plan, 1, rhogrid, workspace, FFTW_TRANSPOSED_ORDER);
 #else 
-  fftw_execute(fft_inverse_plan); 
+      fftw_execute(fft_inverse_plan); 
 #endif
 
-  /* Now rhogrid holds the tidal tensor componet */
-
+      /* Now rhogrid holds the tidal tensor component: pick out the points requested by all tasks */
 
-  /* now read out the tidal tensor component */
+      for(i = 0; i < nimport; i++)
+	{
+	  /* determine offset in local FFT slab */
+	  offset =
+	    import_globalindex[i] -
+	    first_slab_of_task[ThisTask] * PMGRID * ((large_array_offset) PMGRID2);
+	  import_data[6 * i + component] = rhogrid[offset];
+	}
+    }
 
-  /* send the tidal tensor component to the right processors */
+  /* send all six tidal tensor components to the right processors in a single exchange */
 
   for(level = 0; level < (1 << PTask); level++)	/* note: for level=0, target is the same task */
     {
@@ -2810,55 +2829,30 @@ void pmtidaltensor_periodic_fourier(int component)
 	{
 	  if(level > 0)
 	    {
-	      import_data =
-		(fftw_real *) mymalloc("import_data",
-				       localfield_togo[recvTask * NTask + ThisTask] * sizeof(fftw_real));
-	      import_globalindex =
-		(large_array_offset *) mymalloc("import_globalindex",
-						localfield_togo[recvTask * NTask +
-								ThisTask] * sizeof(large_array_offset));
-
 	      if(localfield_togo[sendTask * NTask + recvTask] > 0
 		 || localfield_togo[recvTask * NTask + sendTask] > 0)
 		{
-		  MPI_Sendrecv(localfield_globalindex + localfield_offset[recvTask],
-			       localfield_togo[sendTask * NTask + recvTask] * sizeof(large_array_offset),
-			       MPI_BYTE, recvTask, TAG_PERIODIC_C, import_globalindex,
-			       localfield_togo[recvTask * NTask + sendTask] * sizeof(large_array_offset),
-			       MPI_BYTE, recvTask, TAG_PERIODIC_C, MPI_COMM_WORLD, &status);
+		  MPI_Sendrecv(import_data + 6 * import_offset[recvTask],
+			       6 * localfield_togo[recvTask * NTask + sendTask] * sizeof(fftw_real), MPI_BYTE,
+			       recvTask, TAG_PERIODIC_A,
+			       localfield_data + 6 * localfield_offset[recvTask],
+			       6 * localfield_togo[sendTask * NTask + recvTask] * sizeof(fftw_real), MPI_BYTE,
+			       recvTask, TAG_PERIODIC_A, MPI_COMM_WORLD, &status);
 		}
 	    }
 	  else
 	    {
-	      import_data = localfield_data + localfield_offset[ThisTask];
-	      import_globalindex = localfield_globalindex + localfield_offset[ThisTask];
-	    }
-
-	  for(i = 0; i < localfield_togo[recvTask * NTask + sendTask]; i++)
-	    {
-	      /* determine offset in local FFT slab */
-	      offset =
-		import_globalindex[i] -
-		first_slab_of_task[ThisTask] * PMGRID * ((large_array_offset) PMGRID2);
-	      import_data[i] = rhogrid[offset];
-	    }
-
-	  if(level > 0)
-	    {
-	      MPI_Sendrecv(import_data,
-			   localfield_togo[recvTask * NTask + sendTask] * sizeof(fftw_real), MPI_BYTE,
-			   recvTask, TAG_PERIODIC_A,
-			   localfield_data + localfield_offset[recvTask],
-			   localfield_togo[sendTask * NTask + recvTask] * sizeof(fftw_real), MPI_BYTE,
-			   recvTask, TAG_PERIODIC_A, MPI_COMM_WORLD, &status);
-
-	      myfree(import_globalindex);
-	      myfree(import_data);
+	      memcpy(localfield_data + 6 * localfield_offset[ThisTask], import_data + 6 * import_offset[ThisTask],
+		     6 * localfield_togo[ThisTask * NTask + ThisTask] * sizeof(fftw_real));
 	    }
 	}
     }
 
-  /* read out the tidal field values, which all have been assembled in localfield_data */
+  myfree(import_data);
+  myfree(import_globalindex);
+  myfree(import_offset);
+
+  /* read out the tidal field values, which all have been assembled in localfield_data: all components in one pass */
 
   for(i = 0, j = 0; i < NumPart; i++)
     {
@@ -2878,46 +2872,29 @@ void pmtidaltensor_periodic_fourier(int component)
         dx = to_slab_fac * pp[0] - slab_x;
         dy = to_slab_fac * pp[1] - slab_y;
         dz = to_slab_fac * pp[2] - slab_z; 
-	
-	tidal = 
-	    +localfield_data[part[j + 0].localindex] * (1.0 - dx) * (1.0 - dy) * (1.0 - dz)
-	    + localfield_data[part[j + 1].localindex] * (1.0 - dx) * (1.0 - dy) * dz
-	    + localfield_data[part[j + 2].localindex] * (1.0 - dx) * dy * (1.0 - dz)
-	    + localfield_data[part[j + 3].localindex] * (1.0 - dx) * dy * dz
-	    + localfield_data[part[j + 4].localindex] * (dx) * (1.0 - dy) * (1.0 - dz)
-	    + localfield_data[part[j + 5].localindex] * (dx) * (1.0 - dy) * dz
-	    + localfield_data[part[j + 6].localindex] * (dx) * dy * (1.0 - dz)
-	    + localfield_data[part[j + 7].localindex] * (dx) * dy * dz;
-
-	tidal *= fac;
-
-	if(component == 0) 
-	{ 
-	    P[i].tidal_tensorpsPM[0][0] += tidal;
-	} 
-	if(component == 1)
-	{ 
-	    P[i].tidal_tensorpsPM[0][1] += tidal; 
-	    P[i].tidal_tensorpsPM[1][0] += tidal;
-	} 
-	if(component == 2)
-	{
-	    P[i].tidal_tensorpsPM[0][2] += tidal; 
-	    P[i].tidal_tensorpsPM[2][0] += tidal;
-	} 
-	if(component == 3)
-	{ 
-	    P[i].tidal_tensorpsPM[1][1] += tidal;
-	} 
-	if(component == 4)
-	{ 
-	    P[i].tidal_tensorpsPM[1][2] += tidal; 
-	    P[i].tidal_tensorpsPM[2][1] += tidal;
-	} 
-	if(component == 5) 
-	{ 
-	    P[i].tidal_tensorpsPM[2][2] += tidal;
-	} 
+
+	wcic[0] = (1.0 - dx) * (1.0 - dy) * (1.0 - dz);
+	wcic[1] = (1.0 - dx) * (1.0 - dy) * dz;
+	wcic[2] = (1.0 - dx) * dy * (1.0 - dz);
+	wcic[3] = (1.0 - dx) * dy * dz;
+	wcic[4] = (dx) * (1.0 - dy) * (1.0 - dz);
+	wcic[5] = (dx) * (1.0 - dy) * dz;
+	wcic[6] = (dx) * dy * (1.0 - dz);
+	wcic[7] = (dx) * dy * dz;
+
+	for(component = 0; component < 6; component++) {tidal[component] = 0;}
+	for(xx = 0; xx < 8; xx++)
+	  {
+	    fftw_real *field = localfield_data + 6 * part[j + xx].localindex;
+	    for(component = 0; component < 6; component++) {tidal[component] += field[component] * wcic[xx];}
+	  }
+
+	for(component = 0; component < 6; component++)
+	  {
+	    int ti = tidal_index[component][0], tj = tidal_index[component][1];
+	    P[i].tidal_tensorpsPM[ti][tj] += fac * tidal[component];
+	    if(ti != tj) {P[i].tidal_tensorpsPM[tj][ti] += fac * tidal[component];}
+	  }
     }
 
   /* free locallist */
@@ -2930,7 +2907,7 @@ void pmtidaltensor_periodic_fourier(int component)
 
   pm_init_periodic_free();
 
-  PRINT_STATUS(" ..done PM-Tidaltensor (component=%d).", component);
+  PRINT_STATUS(" ..done PM-Tidaltensor (all components).");
 }
 
 #endif /*COMPUTE_TIDAL_TENSOR_IN_GRAVTREE*/
@@ -79,6 +79,9 @@ void compute_potential(void)
             
             for(k = 0; k < 3; k++) {GravDataIn[j].Pos[k] = P[place].Pos[k];}
             GravDataIn[j].Type = P[place].Type;
+#if defined(PMGRID) && defined(PM_PLACEHIGHRESREGION)
+            GravDataIn[j].PM_Level = P[place].PM_Level;
+#endif
 #if defined(RT_USE_GRAVTREE) || defined(ADAPTIVE_GRAVSOFT_FORALL) || defined(ADAPTIVE_GRAVSOFT_FORGAS)
             GravDataIn[j].Mass = P[place].Mass;
 #endif
@@ -174,6 +177,9 @@ void compute_potential(void)
     }
     if(i == 1) {endrun(88686);}
 #endif
+#ifdef PM_HIRES_NLEVELS
+    for(i = 2; i < PM_NGRIDS; i++) {if(pmpotential_nonperiodic(i) != 0) {endrun(88689);}}
+#endif
 #else
     i = pmpotential_nonperiodic(0);
     if(i == 1)            /* this is returned if a particle lied outside allowed range */
@@ -192,6 +198,9 @@ void compute_potential(void)
     }
     if(i != 0) {endrun(88688);}
 #endif
+#ifdef PM_HIRES_NLEVELS
+    for(i = 2; i < PM_NGRIDS; i++) {if(pmpotential_nonperiodic(i) != 0) {endrun(88689);}}
+#endif
 #endif
 #endif // PMGRID block
     
@@ -88,10 +88,34 @@ int density_isactive(int n)
 
 
 
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+/*! with this option, the AGS kernel lengths of the collisionless elements are solved for in the same iteration (and the same neighbor
+    search and export, with type-masked neighbor counting) as the hydro kernel lengths, instead of in a second, separate ags_density() pass.
+    each element carries a mask of which of the two solutions are still pending: it is marked converged (negative TimeBin) only once both are */
+#define DENSITY_FUSED_HYDRO 1 /* hydro kernel length still iterating */
+#define DENSITY_FUSED_AGS 2 /* AGS kernel length still iterating */
+#define DENSITY_FUSED_AGS_MEMBER 4 /* element takes part in the AGS solution (kept after convergence, for the final operations) */
+static int DensityFusedAGSFlag = 0; /* set only for the calls from density_and_ags_density() */
+static unsigned char *DensityFusedState;
+static MyFloat *DensityFusedAGS_Left, *DensityFusedAGS_Right, *DensityFusedAGS_Prev;
+static struct density_fused_ags_sums {MyFloat NumNgb, DhsmlNgbFactor, Particle_DivVel;} *DensityFusedAGS; /* AGS neighbor sums, kept apart from the hydro ones (elements can take part in both) */
+static int density_fused_isactive(int i) {if(P[i].TimeBin < 0) {return 0;} return (DensityFusedState[i] & (DENSITY_FUSED_HYDRO + DENSITY_FUSED_AGS)) ? 1 : 0;}
+#define DENSITY_HYDRO_PENDING(i) ((P[i].TimeBin >= 0) && (DensityFusedState[i] & DENSITY_FUSED_HYDRO))
+#define DENSITY_MARK_CONVERGED(i) {DensityFusedState[i] &= ~DENSITY_FUSED_HYDRO; if(!(DensityFusedState[i] & DENSITY_FUSED_AGS)) {P[i].TimeBin = -P[i].TimeBin - 1;}}
+#else
+#define DENSITY_HYDRO_PENDING(i) (density_isactive(i))
+#define DENSITY_MARK_CONVERGED(i) {P[i].TimeBin = -P[i].TimeBin - 1;}
+#endif
+
+
 #define CORE_FUNCTION_NAME density_evaluate /* name of the 'core' function doing the actual inter-neighbor operations. this MUST be defined somewhere as "int CORE_FUNCTION_NAME(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)" */
 #define INPUTFUNCTION_NAME hydrokerneldensity_particle2in    /* name of the function which loads the element data needed (for e.g. broadcast to other processors, neighbor search) */
 #define OUTPUTFUNCTION_NAME hydrokerneldensity_out2particle  /* name of the function which takes the data returned from other processors and combines it back to the original elements */
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+#define CONDITIONFUNCTION_FOR_EVALUATION if(density_fused_isactive(i))
+#else
 #define CONDITIONFUNCTION_FOR_EVALUATION if(density_isactive(i)) /* function for which elements will be 'active' and allowed to undergo operations. can be a function call, e.g. 'density_is_active(i)', or a direct function call like 'if(P[i].Mass>0)' */
+#endif
 #include "../system/code_block_xchange_initialize.h" /* pre-define all the ALL_CAPS variables we will use below, so their naming conventions are consistent and they compile together, as well as defining some of the function calls needed */
 
 /*! this structure defines the variables that need to be sent -from- the 'searching' element */
@@ -105,6 +129,10 @@ static struct INPUT_STRUCT_NAME
   MyFloat Hsml;
 #ifdef GALSF_SUBGRID_WINDS
   MyFloat DelayTime;
+#endif
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+  MyFloat AGS_Hsml;
+  int FusedMask;
 #endif
   int NodeList[NODELISTLENGTH];
   int Type;
@@ -119,6 +147,9 @@ void hydrokerneldensity_particle2in(struct INPUT_STRUCT_NAME *in, int i, int loo
     in->Hsml = PPP[i].Hsml;
     for(k=0;k<3;k++) {in->Pos[k] = P[i].Pos[k];}
     for(k=0;k<3;k++) {if(P[i].Type==0) {in->Vel[k]=SphP[i].VelPred[k];} else {in->Vel[k]=P[i].Vel[k];}}
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+    in->AGS_Hsml = PPP[i].AGS_Hsml; in->FusedMask = DensityFusedState[i] & (DENSITY_FUSED_HYDRO + DENSITY_FUSED_AGS);
+#endif
     if(P[i].Type == 0)
     {
 #if defined(SPHAV_CD10_VISCOSITY_SWITCH)
@@ -166,6 +197,12 @@ static struct OUTPUT_STRUCT_NAME
     MyDouble BH_dr_to_NearestGasNeighbor;
 #endif
 #endif
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+    MyLongDouble AGS_Ngb, AGS_DhsmlNgb, AGS_zeta_ags, AGS_vsig, AGS_DivVel;
+#if defined(AGS_FACE_CALCULATION_IS_ACTIVE)
+    MyLongDouble AGS_NV_T[3][3];
+#endif
+#endif
 #if defined(TURB_DRIVING) || defined(GRAIN_FLUID)
     MyDouble GasVel[3];
 #endif
@@ -182,6 +219,20 @@ static struct OUTPUT_STRUCT_NAME
 void hydrokerneldensity_out2particle(struct OUTPUT_STRUCT_NAME *out, int i, int mode, int loop_iteration)
 {
     int j,k;
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+    if(DensityFusedState[i] & DENSITY_FUSED_AGS)
+    {
+        ASSIGN_ADD(DensityFusedAGS[i].NumNgb, out->AGS_Ngb, mode);
+        ASSIGN_ADD(DensityFusedAGS[i].DhsmlNgbFactor, out->AGS_DhsmlNgb, mode);
+        ASSIGN_ADD(DensityFusedAGS[i].Particle_DivVel, out->AGS_DivVel, mode);
+        ASSIGN_ADD(PPPZ[i].AGS_zeta, out->AGS_zeta_ags, mode);
+        if(out->AGS_vsig > PPP[i].AGS_vsig) {PPP[i].AGS_vsig = out->AGS_vsig;}
+#if defined(AGS_FACE_CALCULATION_IS_ACTIVE)
+        for(k = 0; k < 3; k++) {for(j = 0; j < 3; j++) {ASSIGN_ADD(P[i].NV_T[k][j], out->AGS_NV_T[k][j], mode);}}
+#endif
+    }
+    if(!(DensityFusedState[i] & DENSITY_FUSED_HYDRO)) {return;} /* hydro kernel length already converged: leave its results alone */
+#endif
     ASSIGN_ADD(PPP[i].NumNgb, out->Ngb, mode);
     ASSIGN_ADD(PPP[i].DhsmlNgbFactor, out->DhsmlNgb, mode);
     ASSIGN_ADD(P[i].Particle_DivVel, out->Particle_DivVel,   mode);
@@ -262,6 +313,12 @@ void hydrokerneldensity_out2particle(struct OUTPUT_STRUCT_NAME *out, int i, int
 void density_evaluate_extra_physics_gas(struct INPUT_STRUCT_NAME *local, struct OUTPUT_STRUCT_NAME *out, struct kernel_density *kernel, int j);
 
 
+#if defined(ADAPTIVE_GRAVSOFT_FUSED_DENSITY) && defined(AGS_FACE_CALCULATION_IS_ACTIVE)
+#define DENSITY_FUSED_AGS_NV_T(out) ((out).AGS_NV_T)
+#else
+#define DENSITY_FUSED_AGS_NV_T(out) (NULL)
+#endif
+
 /*! This function represents the core of the initial hydro kernel-identification and volume computation. The target particle may either be local, or reside in the communication buffer. */
 /*!   -- this subroutine should in general contain no writes to shared memory. for optimization reasons, a couple of such writes have been included here in the sub-code for some sink routines -- those need to be handled with special care, both for thread safety and because of iteration. in general writes to shared memory in density.c are strongly discouraged -- */
 int density_evaluate(int target, int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist, int loop_iteration)
@@ -277,13 +334,34 @@ int density_evaluate(int target, int mode, int *exportflag, int *exportnodecount
 #endif
 #endif
     if(mode == 0) {startnode = All.MaxPart; /* root node */} else {startnode = DATAGET_NAME[target].NodeList[0]; startnode = Nodes[startnode].u.d.nextnode;    /* open it */}
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+    /* one search serves both kernel lengths: out to the larger of the two, over the union of the neighbor types, with the neighbors sorted below */
+    int search_bitmask = 0; double search_len = 0, h2_ags = 0, hinv_ags = 0, hinv3_ags = 0, hinv4_ags = 0;
+    if(local.FusedMask & DENSITY_FUSED_HYDRO) {search_bitmask |= 1; search_len = local.Hsml;}
+    int ags_bitmask = (local.FusedMask & DENSITY_FUSED_AGS) ? ags_gravity_kernel_shared_BITFLAG(local.Type) : 0;
+    if(ags_bitmask) {search_bitmask |= ags_bitmask; search_len = DMAX(search_len, local.AGS_Hsml); h2_ags = local.AGS_Hsml * local.AGS_Hsml; kernel_hinv(local.AGS_Hsml, &hinv_ags, &hinv3_ags, &hinv4_ags);}
+#endif
     while(startnode >= 0) {
         while(startnode >= 0) {
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+            numngb_inbox = ngb_treefind_variable_threads_targeted(local.Pos, search_len, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist, search_bitmask);
+#else
             numngb_inbox = ngb_treefind_variable_threads(local.Pos, local.Hsml, target, &startnode, mode, exportflag, exportnodecount, exportindex, ngblist);
+#endif
             if(numngb_inbox < 0) {return -2;}
             for(n = 0; n < numngb_inbox; n++)
             {
                 j = ngblist[n]; /* since we use the -threaded- version above of ngb-finding, its super-important this is the lower-case ngblist here! */
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+                if((1 << P[j].Type) & ags_bitmask)
+                {
+                    double dp_ags[3] = {local.Pos[0] - P[j].Pos[0], local.Pos[1] - P[j].Pos[1], local.Pos[2] - P[j].Pos[2]};
+                    NEAREST_XYZ(dp_ags[0],dp_ags[1],dp_ags[2],1);
+                    double r2_ags = dp_ags[0]*dp_ags[0] + dp_ags[1]*dp_ags[1] + dp_ags[2]*dp_ags[2];
+                    if(r2_ags < h2_ags) {ags_density_kernel_contribution(j, dp_ags, r2_ags, hinv_ags, hinv3_ags, hinv4_ags, local.Vel, local.Pos, &out.AGS_Ngb, &out.AGS_DhsmlNgb, &out.AGS_zeta_ags, &out.AGS_vsig, &out.AGS_DivVel, DENSITY_FUSED_AGS_NV_T(out));}
+                }
+                if((P[j].Type != 0) || !(local.FusedMask & DENSITY_FUSED_HYDRO)) {continue;} /* everything below is the hydro (gas-neighbor) part */
+#endif
 #ifdef GALSF_SUBGRID_WINDS /* check if partner is a wind particle: if I'm not wind, then ignore the wind particle */
                 if(SphP[j].DelayTime > 0) {if(!(local.DelayTime > 0)) {continue;}}
 #endif
@@ -466,11 +544,51 @@ void density_evaluate_extra_physics_gas(struct INPUT_STRUCT_NAME *local, struct
  * and rotation of the velocity field.  This is used then to compute the effective volume of the element in MFM/MFV/SPH-type methods, which is then used to
  * update volumetric quantities like density and pressure. The routine iterates to attempt to find a target kernel size set adaptively -- see code user guide for details
  */
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+/*! AGS kernel-length update of element i within the fused iteration: the AGS routines work on NumNgb/DhsmlNgbFactor/Particle_DivVel,
+    which for elements that also have a hydro kernel length hold the hydro sums, so swap the AGS sums in for the update */
+static int density_fused_ags_update(int i, int iter)
+{
+    MyFloat ngb = PPP[i].NumNgb, dhsml = PPP[i].DhsmlNgbFactor, divv = P[i].Particle_DivVel;
+    PPP[i].NumNgb = DensityFusedAGS[i].NumNgb; PPP[i].DhsmlNgbFactor = DensityFusedAGS[i].DhsmlNgbFactor; P[i].Particle_DivVel = DensityFusedAGS[i].Particle_DivVel;
+    int redo = ags_density_update_kernel_length(i, iter, DensityFusedAGS_Left, DensityFusedAGS_Right, DensityFusedAGS_Prev);
+    DensityFusedAGS[i].NumNgb = PPP[i].NumNgb; DensityFusedAGS[i].DhsmlNgbFactor = PPP[i].DhsmlNgbFactor; DensityFusedAGS[i].Particle_DivVel = P[i].Particle_DivVel;
+    PPP[i].NumNgb = ngb; PPP[i].DhsmlNgbFactor = dhsml; P[i].Particle_DivVel = divv;
+    return redo;
+}
+
+/*! hydro density and AGS kernel lengths together, replacing the sequence density(); ags_density(); */
+void density_and_ags_density(void)
+{
+    DensityFusedAGSFlag = 1; density(); DensityFusedAGSFlag = 0;
+}
+#endif
+
+
 void density(void)
 {
     /* initialize variables used below, in particlar the structures we need to call throughout the iteration */
     CPU_Step[CPU_MISC] += measure_time(); double t00_truestart = my_second(); MyFloat *Left, *Right; double fac, fac_lim, desnumngb, desnumngbdev; long long ntot;
     int i, npleft, iter=0, redo_particle, particle_set_to_minhsml_flag = 0, particle_set_to_maxhsml_flag = 0;
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+    DensityFusedState = (unsigned char *) mymalloc("DensityFusedState", NumPart * sizeof(unsigned char));
+    DensityFusedAGS = (struct density_fused_ags_sums *) mymalloc("DensityFusedAGS", NumPart * sizeof(struct density_fused_ags_sums));
+    DensityFusedAGS_Prev = (MyFloat *) mymalloc("DensityFusedAGS_Prev", NumPart * sizeof(MyFloat));
+    DensityFusedAGS_Left = (MyFloat *) mymalloc("DensityFusedAGS_Left", NumPart * sizeof(MyFloat));
+    DensityFusedAGS_Right = (MyFloat *) mymalloc("DensityFusedAGS_Right", NumPart * sizeof(MyFloat));
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    {
+        DensityFusedState[i] = density_isactive(i) ? DENSITY_FUSED_HYDRO : 0;
+        if(DensityFusedAGSFlag && ags_density_isactive(i))
+        {
+            DensityFusedState[i] |= DENSITY_FUSED_AGS + DENSITY_FUSED_AGS_MEMBER;
+            DensityFusedAGS_Left[i] = DensityFusedAGS_Right[i] = 0; DensityFusedAGS_Prev[i] = PPP[i].AGS_Hsml; PPP[i].AGS_vsig = 0;
+#ifdef WAKEUP
+            P[i].wakeup = 0;
+#endif
+        }
+    }
+#endif
     Left = (MyFloat *) mymalloc("Left", NumPart * sizeof(MyFloat));
     Right = (MyFloat *) mymalloc("Right", NumPart * sizeof(MyFloat));
     
@@ -526,8 +644,18 @@ void density(void)
         double tstart = my_second(), tend;
         for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
         {
-            if(density_isactive(i))
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+            if((P[i].TimeBin >= 0) && (DensityFusedState[i] & DENSITY_FUSED_AGS))
+            {
+                if(density_fused_ags_update(i, iter)) {npleft++;} /* need to redo this particle */
+                else {DensityFusedState[i] &= ~DENSITY_FUSED_AGS; if(!(DensityFusedState[i] & DENSITY_FUSED_HYDRO)) {P[i].TimeBin = -P[i].TimeBin - 1;}}
+            }
+#endif
+            if(DENSITY_HYDRO_PENDING(i))
             {
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+                P[i].WorkCount[WORK_ITERATIONS]++;
+#endif
                 if(PPP[i].NumNgb > 0)
                 {
                     PPP[i].DhsmlNgbFactor *= PPP[i].Hsml / (NUMDIMS * PPP[i].NumNgb);
@@ -751,7 +879,7 @@ void density(void)
                         {
                             /* this one should be ok */
                             npleft--;
-                            P[i].TimeBin = -P[i].TimeBin - 1;	/* Mark as inactive */
+                            DENSITY_MARK_CONVERGED(i);	/* Mark as inactive */
                             SphP[i].ConditionNumber = ConditionNumber;
                             continue;
                         }
@@ -862,7 +990,7 @@ void density(void)
                     if(PPP[i].Hsml > maxsoft) {PPP[i].Hsml = maxsoft;}
                     if(particle_set_to_maxhsml_flag==1) {PPP[i].Hsml = maxsoft;}
                 }
-                else {P[i].TimeBin = -P[i].TimeBin - 1;}	/* Mark as inactive */
+                else {DENSITY_MARK_CONVERGED(i);}	/* Mark as inactive */
             } //  if(density_isactive(i))
         } // for(i = FirstActiveParticle, npleft = 0; i >= 0; i = NextActiveParticle[i])
 
@@ -1066,6 +1194,20 @@ void density(void)
 
     } // for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
 
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+    /* final operations for the AGS kernel lengths: these overwrite the neighbor numbers etc. of elements with both kernel lengths, as the separate ags_density() pass would */
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    {
+        if(DensityFusedState[i] & DENSITY_FUSED_AGS_MEMBER)
+        {
+            PPP[i].NumNgb = DensityFusedAGS[i].NumNgb; PPP[i].DhsmlNgbFactor = DensityFusedAGS[i].DhsmlNgbFactor; P[i].Particle_DivVel = DensityFusedAGS[i].Particle_DivVel;
+            ags_density_finalize_kernel_length(i, DensityFusedAGS_Prev);
+        }
+        else if(DensityFusedAGSFlag) {ags_density_isactive(i);} /* sets the AGS_Hsml of elements with fixed or hydro-matched softenings, as the separate pass does */
+    }
+    myfree(DensityFusedAGS_Right); myfree(DensityFusedAGS_Left); myfree(DensityFusedAGS_Prev); myfree(DensityFusedAGS); myfree(DensityFusedState);
+#endif
+
     /* collect some timing information */
     double t1; t1 = WallclockTime = my_second(); timeall = timediff(t00_truestart, t1);
     CPU_Step[CPU_DENSCOMPUTE] += timecomp; CPU_Step[CPU_DENSWAIT] += timewait;
@@ -714,7 +714,7 @@ void hydro_gradient_calc(void)
             for(j = 0; j < Nexport; j++) {Send_count[DataIndexTable[j].Task]++;}
             MYSORT_DATAINDEX(DataIndexTable, Nexport, sizeof(struct data_index), data_index_compare); /* construct export count tables */
             tstart = my_second();
-            MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD); /* broadcast import/export counts */
+            mpi_sparse_alltoall_counts(Send_count, Recv_count); /* broadcast import/export counts */
             tend = my_second(); timewait1 += timediff(tstart, tend);
 
             for(j = 0, Send_offset[0] = 0; j < NTask; j++) {if(j > 0) {Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];}} /* calculate export table offsets */
@@ -1038,6 +1038,8 @@ void hydro_gradient_calc(void)
 #ifdef DO_DENSITY_AROUND_STAR_PARTICLES
             /* this is here because for the models of BH growth and self-shielding of stars, we need to calculate GradRho: we don't bother doing it in density.c if we're already calculating it here! but note, this is the -un-limited- gradient here */
             for(k=0;k<3;k++) {P[i].GradRho[k] = SphP[i].Gradients.Density[k];}
+            SphP[i].ColumnDensityEstimate = evaluate_NH_from_GradRho(P[i].GradRho,PPP[i].Hsml,SphP[i].Density,PPP[i].NumNgb,1,i); /* cache for the cooling, eos, and star formation modules which all need the same estimate */
+            SphP[i].ColumnDensityEstimate_Ti = All.Ti_Current;
 #endif
 
 #if defined(TURB_DRIVING) || defined(OUTPUT_VORTICITY)
@@ -86,8 +86,16 @@ void init(void)
             endrun(0);
     }
 
+    WarmStartFields = 0;
+#ifdef IO_SNAPSHOT_WARMSTART
+    if(RestartFlag == 2) {WarmStartFields = warmstart_fields_from_snapshot();} /* derived state carried by the snapshot, reused below instead of rebuilt */
+#ifndef GRAVITY_HYBRID_OPENING_CRIT
+    if((WarmStartFields & WARMSTART_OLDACC) && All.TypeOfOpeningCriterion == 1) {All.ErrTolTheta = 0;} /* the first force computation can use the relative opening criterion directly */
+#endif
+#endif
+
 #ifdef CHIMES_INITIALISE_IN_EQM
-    for (i = 0; i < N_gas; i++) {allocate_gas_abundances_memory(&(ChimesGasVars[i]), &ChimesGlobalVars);}
+    if(!(WarmStartFields & WARMSTART_CHIMES)) {for (i = 0; i < N_gas; i++) {allocate_gas_abundances_memory(&(ChimesGasVars[i]), &ChimesGlobalVars);}} /* otherwise allocated and read with the snapshot */
 #endif
 
     All.Time = All.TimeBegin;
@@ -155,6 +163,10 @@ void init(void)
     if(All.ComovingIntegrationOn) {check_omega();}
 #endif
     All.TimeLastStatistics = All.TimeBegin - All.TimeBetStatistics;
+#ifdef OUTPUT_INSITU_MAPS
+    All.TimeLastInSituMap = All.TimeBegin - All.TimeBetInSituMaps; All.InSituMapFileCount = 0;
+    if(RestartFlag == 2) {insitu_maps_restart_count();} /* do not overwrite the maps of the run we are restarting from */
+#endif
 #if (defined(BLACK_HOLES) || defined(GALSF_SUBGRID_WINDS)) && defined(FOF)
     All.TimeNextOnTheFlyFoF = All.TimeBegin;
 #endif
@@ -241,7 +253,10 @@ void init(void)
         P[i].Ti_current = (integertime)0;
         P[i].TimeBin = 0;
 
-        if(header.flag_ic_info != FLAG_SECOND_ORDER_ICS) {P[i].OldAcc = 0;}	/* Do not zero in 2lpt case as masses are stored here */
+        if(header.flag_ic_info != FLAG_SECOND_ORDER_ICS && !(WarmStartFields & WARMSTART_OLDACC)) {P[i].OldAcc = 0;}	/* Do not zero in 2lpt case as masses are stored here, or if restored on a warm start */
+#ifdef GRAVITY_FARFIELD_CACHE
+        P[i].FarCacheValid = 0; P[i].FarMode = 0;
+#endif
 
 #if defined(EVALPOTENTIAL) || defined(COMPUTE_POTENTIAL_ENERGY)
         P[i].Potential = 0;
@@ -441,6 +456,9 @@ void init(void)
 	    P[i].min_bh_approach_time = P[i].min_bh_freefall_time = MAX_REAL_NUMBER;
 #if (SINGLE_STAR_TIMESTEPPING > 0)
 	    P[i].SuperTimestepFlag = 0;
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+        P[i].fewbody_pair_ti = -1;
+#endif
 #endif
 #endif
         if(P[i].Type == 5)
@@ -504,6 +522,9 @@ void init(void)
         //SphP[i].dInternalEnergy = 0;//manifest-indiv-timestep-debug//
         P[i].Particle_DivVel = 0;
         SphP[i].ConditionNumber = 1;
+#ifdef DO_DENSITY_AROUND_STAR_PARTICLES
+        SphP[i].ColumnDensityEstimate_Ti = -1; /* evaluated on the fly until the first gradients pass fills the cache */
+#endif
         SphP[i].DtInternalEnergy = 0;
         SphP[i].FaceClosureError = 0;
 #ifdef ENERGY_ENTROPY_SWITCH_IS_ACTIVE
@@ -519,7 +540,7 @@ void init(void)
 #if defined(ADAPTIVE_GRAVSOFT_FORGAS) || defined(AGS_HSML_CALCULATION_IS_ACTIVE)
         PPPZ[i].AGS_zeta = 0;
 #ifdef ADAPTIVE_GRAVSOFT_FORALL
-        if(1 & ADAPTIVE_GRAVSOFT_FORALL) {PPP[i].AGS_Hsml = PPP[i].Hsml;} else {PPP[i].AGS_Hsml = All.ForceSoftening[0];}
+        if(!(WarmStartFields & WARMSTART_AGS_HSML)) {if(1 & ADAPTIVE_GRAVSOFT_FORALL) {PPP[i].AGS_Hsml = PPP[i].Hsml;} else {PPP[i].AGS_Hsml = All.ForceSoftening[0];}}
 #endif
 #endif
 
@@ -718,10 +739,11 @@ void init(void)
 
     All.Ti_Current = 0;
 
-    if(RestartFlag != 3 && RestartFlag != 5) {setup_smoothinglengths();}
+    if(RestartFlag != 3 && RestartFlag != 5 && !(WarmStartFields & WARMSTART_HSML)) {setup_smoothinglengths();} /* on a warm start the stored kernel lengths only need the single density() pass below */
+    if(WarmStartFields & WARMSTART_HSML) {for(i=N_gas;i<NumPart;i++) {if(!(PPP[i].Hsml > 0)) {PPP[i].Hsml = All.SofteningTable[P[i].Type];}}} /* kernel lengths not covered by the warm-start check start from the softening, as black holes do in a cold start */
 
 #ifdef AGS_HSML_CALCULATION_IS_ACTIVE
-    if(RestartFlag != 3 && RestartFlag != 5) {ags_setup_smoothinglengths();}
+    if(RestartFlag != 3 && RestartFlag != 5) {ags_setup_smoothinglengths();} /* on a warm start this skips only the tree-based initial guess */
 #endif
 
 #ifdef GALSF_SUBGRID_WINDS
@@ -928,7 +950,7 @@ void init(void)
     
 
 #ifdef CHIMES_INITIALISE_IN_EQM
-    if (RestartFlag != 1)
+    if (RestartFlag != 1 && !(WarmStartFields & WARMSTART_CHIMES))
       {
 	/* Note that stellar fluxes computed through the
 	 * gravity tree are all zero at this stage,
@@ -979,6 +1001,75 @@ void init(void)
 
 
 
+#ifdef IO_SNAPSHOT_WARMSTART
+/* element types whose stored kernel length seeds the first density() pass (by type, mirroring density_isactive; TimeBin is not set yet) */
+static int warmstart_hsml_is_used(int i)
+{
+    if(P[i].Type == 0) {return 1;}
+#if defined(GRAIN_FLUID)
+    if((1 << P[i].Type) & (GRAIN_PTYPES)) {return 1;}
+#endif
+#ifdef DO_DENSITY_AROUND_STAR_PARTICLES
+    if(((P[i].Type == 4)||((All.ComovingIntegrationOn==0)&&((P[i].Type == 2)||(P[i].Type==3))))&&(P[i].Mass>0)) {return 1;}
+#endif
+    return 0;
+}
+
+#ifdef AGS_HSML_CALCULATION_IS_ACTIVE
+/* element types whose stored AGS softening seeds the first ags_density() pass (by type, mirroring ags_density_isactive) */
+static int warmstart_ags_hsml_is_used(int i)
+{
+    if(P[i].Type == 0) {return 1;}
+#ifdef ADAPTIVE_GRAVSOFT_FORALL
+    if((1 << P[i].Type) & (ADAPTIVE_GRAVSOFT_FORALL)) {return 1;}
+#endif
+#ifdef DM_SIDM
+    if((1 << P[i].Type) & (DM_SIDM)) {return 1;}
+#endif
+#if defined(DM_FUZZY)
+    if(P[i].Type == 1) {return 1;}
+#endif
+    return 0;
+}
+#endif
+
+/*! On a restart from a snapshot, this returns which of the derived fields listed in the snapshot's manifest (header.flag_warmstart)
+ *  can be reused instead of rebuilt. The check is cheap: the values must be finite and positive (non-negative for OldAcc) for all
+ *  elements that use them on all tasks, otherwise that field is rebuilt as in a cold start. Kernel lengths and AGS softenings are only
+ *  checked for the element types that iterate them; an OldAcc that is zero everywhere is treated as absent (it would open every node
+ *  in the first tree walk). CHIMES abundances are taken as read.
+ */
+int warmstart_fields_from_snapshot(void)
+{
+    int i, fields = header.flag_warmstart, fields_all, has_oldacc = 0, has_oldacc_all = 0;
+#ifndef AGS_HSML_CALCULATION_IS_ACTIVE
+    fields &= ~WARMSTART_AGS_HSML;
+#endif
+#ifndef CHIMES
+    fields &= ~WARMSTART_CHIMES;
+#endif
+    for(i = 0; i < NumPart; i++)
+    {
+        if(warmstart_hsml_is_used(i)) {if(!(PPP[i].Hsml > 0 && PPP[i].Hsml < MAX_REAL_NUMBER)) {fields &= ~WARMSTART_HSML;}}
+#ifdef AGS_HSML_CALCULATION_IS_ACTIVE
+        if(warmstart_ags_hsml_is_used(i)) {if(!(PPP[i].AGS_Hsml > 0 && PPP[i].AGS_Hsml < MAX_REAL_NUMBER)) {fields &= ~WARMSTART_AGS_HSML;}}
+#endif
+        if(!(P[i].OldAcc >= 0 && P[i].OldAcc < MAX_REAL_NUMBER)) {fields &= ~WARMSTART_OLDACC;}
+        if(P[i].OldAcc > 0) {has_oldacc = 1;}
+    }
+    MPI_Allreduce(&has_oldacc, &has_oldacc_all, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if(!has_oldacc_all) {fields &= ~WARMSTART_OLDACC;}
+    MPI_Allreduce(&fields, &fields_all, 1, MPI_INT, MPI_BAND, MPI_COMM_WORLD);
+    if(ThisTask == 0)
+    {
+        printf("warm start: snapshot carries derived fields %d, reusing %d [kernel lengths=%d, AGS softenings=%d, OldAcc=%d, CHIMES abundances=%d]\n", header.flag_warmstart, fields_all,
+               (fields_all & WARMSTART_HSML) ? 1 : 0, (fields_all & WARMSTART_AGS_HSML) ? 1 : 0, (fields_all & WARMSTART_OLDACC) ? 1 : 0, (fields_all & WARMSTART_CHIMES) ? 1 : 0);
+    }
+    return fields_all;
+}
+#endif
+
+
 /*! This routine computes the mass content of the box and compares it to the specified value of Omega-matter.  If discrepant, the run is terminated. */
 #ifdef BOX_PERIODIC
 void check_omega(void)
@@ -1097,6 +1188,7 @@ void ags_setup_smoothinglengths(void)
             PPPZ[i].AGS_zeta = 0;
             if(ags_density_isactive(i) || P[i].Type==0) // type is AGS-active //
             {
+                if(WarmStartFields & WARMSTART_AGS_HSML) {continue;} // stored softening is the initial guess //
                 if(P[i].Type > 0)
                 {
                     no = Father[i];
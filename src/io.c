@@ -25,6 +25,31 @@ static int n_type[6];
 static long long ntot_type_all[6];
 
 static int n_info;
+static int *io_gather_index = NULL; /* gather plan: local indices of the elements written, grouped by type */
+static int io_gather_offset[6];     /* start of each type in the gather plan */
+#ifdef MAGNETIC
+static double io_gizmo2gauss = 1;  /* unit conversion shared by all blocks of one output */
+#endif
+#ifdef PMGRID
+static double io_dt_gravkick_pm = 0; /* PM half-kick shared by all blocks of one output */
+#endif
+static void io_gather_plan_build(void);
+static void fill_write_buffer_elements(enum iofields blocknr, int *plist, int pc, void *buffer);
+
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+static int io_profile = -1;                 /* snapshot profile currently being written, or -1 for a full snapshot */
+static char *io_profile_selected = NULL;    /* per-element flag: element is part of the profile output being written */
+static MyIDType *io_profile_ids[SNAPSHOT_PROFILES_MAX];     /* sorted ID lists of the profiles which select by ID */
+static long long io_profile_nids[SNAPSHOT_PROFILES_MAX];
+static int io_profile_ids_loaded[SNAPSHOT_PROFILES_MAX];
+static void io_profile_select(int k);
+static int io_block_in_profile(enum iofields blocknr);
+#define IO_WRITE_ELEMENT(i,type) ((P[i].Type == (type)) && (!io_profile_selected || io_profile_selected[i])) /* element is written in this block of the current output */
+#define IO_BLOCK_WRITTEN(blocknr) (blockpresent(blocknr) && io_block_in_profile(blocknr)) /* block is written in the current output */
+#else
+#define IO_WRITE_ELEMENT(i,type) (P[i].Type == (type))
+#define IO_BLOCK_WRITTEN(blocknr) (blockpresent(blocknr))
+#endif
 
 /*! This function writes a snapshot of the particle distribution to one or
  * several files using Gadget's default file format.  If
@@ -36,7 +61,7 @@ void savepositions(int num)
 {
     size_t bytes;
     char buf[500];
-    int n, filenr, gr, ngroups, primaryTask, lastTask;
+    int filenr, gr, ngroups, primaryTask, lastTask;
 
     CPU_Step[CPU_MISC] += measure_time();
 
@@ -48,6 +73,11 @@ void savepositions(int num)
     /* ensures that new tree will be constructed */
     All.NumForcesSinceLastDomainDecomp = (long long) (1 + All.TreeDomainUpdateFrequency * All.TotNumPart);
 
+    char snapbase[300], snapdir[300]; /* file and directory names: profile outputs get their own */
+    sprintf(snapbase, "%s", All.SnapshotFileBase); sprintf(snapdir, "snapdir");
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+    if(io_profile >= 0) {sprintf(snapbase, "%s_profile%d", All.SnapshotFileBase, io_profile + 1); sprintf(snapdir, "snapdir_profile%d", io_profile + 1);}
+#endif
 
     if(DumpFlag == 1)
     {
@@ -85,12 +115,12 @@ void savepositions(int num)
 #endif
 
 
-        /* determine global and local particle numbers */
-        for(n = 0; n < 6; n++)
-            n_type[n] = 0;
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+        if(io_profile >= 0) {io_profile_select(io_profile);} /* flag the elements written in this profile output */
+#endif
 
-        for(n = 0; n < NumPart; n++)
-            n_type[P[n].Type]++;
+        /* determine global and local particle numbers, and which local elements are written */
+        io_gather_plan_build();
 
         sumup_large_ints(6, n_type, ntot_type_all);
 
@@ -101,16 +131,16 @@ void savepositions(int num)
         {
             if(ThisTask == 0)
             {
-                sprintf(buf, "%s/snapdir_%03d", All.OutputDir, num);
+                sprintf(buf, "%s/%s_%03d", All.OutputDir, snapdir, num);
                 mkdir(buf, 02755);
             }
             MPI_Barrier(MPI_COMM_WORLD);
         }
 
         if(All.NumFilesPerSnapshot > 1)
-            sprintf(buf, "%s/snapdir_%03d/%s_%03d.%d", All.OutputDir, num, All.SnapshotFileBase, num, filenr);
+            sprintf(buf, "%s/%s_%03d/%s_%03d.%d", All.OutputDir, snapdir, num, snapbase, num, filenr);
         else
-            sprintf(buf, "%s%s_%03d", All.OutputDir, All.SnapshotFileBase, num);
+            sprintf(buf, "%s%s_%03d", All.OutputDir, snapbase, num);
 
 
         ngroups = All.NumFilesPerSnapshot / All.NumFilesWrittenInParallel;
@@ -125,7 +155,19 @@ void savepositions(int num)
             MPI_Barrier(MPI_COMM_WORLD);
         }
 
+        myfree(io_gather_index); io_gather_index = NULL;
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+        if(io_profile_selected) {myfree(io_profile_selected); io_profile_selected = NULL;}
+#endif
         myfree(CommBuffer);
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+        if(io_profile >= 0) /* partial outputs: no group-finding, and not counted as the last full output */
+        {
+            if(ThisTask == 0) {printf("done with snapshot profile %d.\n", io_profile + 1);}
+            CPU_Step[CPU_SNAPSHOT] += measure_time();
+            return;
+        }
+#endif
 
         if(ThisTask == 0)
             printf("done with snapshot.\n");
@@ -169,10 +211,142 @@ void savepositions(int num)
 
 
 
-/*! This function fills the write buffer with particle data. New output blocks can in
- *  principle be added here.
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+/*! write output number FileCount of snapshot profile k: a partial snapshot, restricted to the particle types, fields, and region
+    or ID list of the profile. uses the regular writer, which skips the excluded types, blocks, and elements entirely */
+void savepositions_profile(int k)
+{
+    int dumpflag = DumpFlag; DumpFlag = 1; io_profile = k;
+    savepositions(All.SnapshotProfile[k].FileCount++);
+    io_profile = -1; DumpFlag = dumpflag;
+}
+
+
+static int io_compare_MyIDType(const void *a, const void *b)
+{
+    if(*((MyIDType *) a) < *((MyIDType *) b)) {return -1;}
+    if(*((MyIDType *) a) > *((MyIDType *) b)) {return +1;}
+    return 0;
+}
+
+
+/*! set the per-element flags for the output of profile k (allocated here, freed once the output is written) */
+static void io_profile_select(int k)
+{
+    int i, j;
+    if(!io_profile_ids_loaded[k]) /* the ID list (if any) is read once by the root task, sorted, and broadcast */
+    {
+        long long nids = 0; MyIDType *ids = NULL;
+        if(ThisTask == 0 && strcmp(All.SnapshotProfile[k].IDFile, "none") != 0)
+        {
+            FILE *fd; unsigned long long id, nmax = 1024;
+            if(!(fd = fopen(All.SnapshotProfile[k].IDFile, "r"))) {printf("can't open ID file `%s' of snapshot profile %d\n", All.SnapshotProfile[k].IDFile, k+1); endrun(1);}
+            ids = (MyIDType *) malloc(nmax * sizeof(MyIDType));
+            while(fscanf(fd, "%llu", &id) == 1)
+            {
+                if(nids >= (long long)nmax) {nmax *= 2; ids = (MyIDType *) realloc(ids, nmax * sizeof(MyIDType));}
+                ids[nids++] = (MyIDType) id;
+            }
+            fclose(fd);
+            qsort(ids, nids, sizeof(MyIDType), io_compare_MyIDType);
+            printf("snapshot profile %d: read %lld IDs from `%s'\n", k+1, nids, All.SnapshotProfile[k].IDFile);
+        }
+        MPI_Bcast(&nids, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+        if(ThisTask != 0 && nids > 0) {ids = (MyIDType *) malloc(nids * sizeof(MyIDType));}
+        if(nids > 0) {MPI_Bcast(ids, nids * sizeof(MyIDType), MPI_BYTE, 0, MPI_COMM_WORLD);}
+        io_profile_ids[k] = ids; io_profile_nids[k] = nids; io_profile_ids_loaded[k] = 1;
+    }
+
+    double r2max = All.SnapshotProfile[k].Radius * All.SnapshotProfile[k].Radius;
+    io_profile_selected = (char *) mymalloc("io_profile_selected", NumPart * sizeof(char));
+    for(i = 0; i < NumPart; i++)
+    {
+        int sel = ((1 << P[i].Type) & All.SnapshotProfile[k].Types) ? 1 : 0;
+        if(sel && All.SnapshotProfile[k].Radius > 0)
+        {
+            double dp[3]; for(j = 0; j < 3; j++) {dp[j] = P[i].Pos[j] - All.SnapshotProfile[k].Center[j];}
+            NEAREST_XYZ(dp[0], dp[1], dp[2], 1);
+            sel = (dp[0]*dp[0] + dp[1]*dp[1] + dp[2]*dp[2] <= r2max);
+        }
+        if(sel && io_profile_nids[k] > 0) {sel = (bsearch(&P[i].ID, io_profile_ids[k], io_profile_nids[k], sizeof(MyIDType), io_compare_MyIDType) != NULL);}
+        io_profile_selected[i] = (char) sel;
+    }
+}
+
+
+/*! is this block in the field list of the profile being written? (always true for full snapshots) */
+static int io_block_in_profile(enum iofields blocknr)
+{
+    if(io_profile < 0) {return 1;}
+    const char *f = All.SnapshotProfile[io_profile].Fields;
+    if(strcmp(f, "all") == 0) {return 1;}
+    char name[1000]; get_dataset_name(blocknr, name); size_t len = strlen(name);
+    while(*f)
+    {
+        const char *e = strchr(f, ','); size_t n = e ? (size_t)(e - f) : strlen(f);
+        if(n == len && strncmp(f, name, len) == 0) {return 1;}
+        if(!e) {break;}
+        f = e + 1;
+    }
+    return 0;
+}
+#endif
+
+
+
+/*! build the gather plan for one output: the local indices of the elements written (in their order in P), grouped by
+ *  type, so each block fill walks exactly the elements it writes instead of re-scanning P. this also sets n_type, and the
+ *  unit and PM-kick factors which are the same for all blocks.
+ */
+static void io_gather_plan_build(void)
+{
+    int n, type, count[6];
+    for(type = 0; type < 6; type++) {n_type[type] = count[type] = 0;}
+    for(n = 0; n < NumPart; n++) {if(IO_WRITE_ELEMENT(n, P[n].Type)) {n_type[P[n].Type]++;}}
+    for(type = 0, n = 0; type < 6; type++) {io_gather_offset[type] = n; n += n_type[type];}
+    io_gather_index = (int *) mymalloc("io_gather_index", (n + 1) * sizeof(int));
+    for(n = 0; n < NumPart; n++) {if(IO_WRITE_ELEMENT(n, P[n].Type)) {type = P[n].Type; io_gather_index[io_gather_offset[type] + count[type]++] = n;}}
+
+#ifdef MAGNETIC /* NOTE: we always work -internally- in code units where MU_0 = 1; hence the 4pi here; [much simpler, but be sure of your conversions!] */
+    io_gizmo2gauss = UNIT_B_IN_GAUSS / All.UnitMagneticField_in_gauss;
+#endif
+#ifdef PMGRID
+    if(All.ComovingIntegrationOn)
+        {io_dt_gravkick_pm = get_gravkick_factor(All.PM_Ti_begstep, All.Ti_Current) - get_gravkick_factor(All.PM_Ti_begstep, (All.PM_Ti_begstep + All.PM_Ti_endstep) / 2);}
+    else
+        {io_dt_gravkick_pm = (All.Ti_Current - (All.PM_Ti_begstep + All.PM_Ti_endstep) / 2) * All.Timebase_interval;}
+#endif
+}
+
+
+/*! This function fills the write buffer with the next pc elements of the given type, starting at position *startindex in the
+ *  gather plan. Each block has a fixed size per element, so the elements are split into contiguous ranges which are filled
+ *  by the OpenMP threads in parallel, each into its own part of CommBuffer.
  */
 void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
+{
+    int *plist = io_gather_index + io_gather_offset[type] + *startindex, nchunk = 1, chunk;
+    size_t bytes_per_element = get_bytes_per_blockelement(blocknr, 0);
+#ifdef _OPENMP
+    nchunk = omp_get_max_threads();
+    if(pc < 256 * nchunk) {nchunk = 1;} /* not worth the threading overhead for small fills */
+#endif
+#ifdef _OPENMP
+#pragma omp parallel for private(chunk) schedule(static) if(nchunk > 1)
+#endif
+    for(chunk = 0; chunk < nchunk; chunk++)
+    {
+        int n0 = (int) (((long long) pc * chunk) / nchunk), n1 = (int) (((long long) pc * (chunk + 1)) / nchunk);
+        if(n1 > n0) {fill_write_buffer_elements(blocknr, plist + n0, n1 - n0, (char *) CommBuffer + n0 * bytes_per_element);}
+    }
+    *startindex += pc;
+}
+
+
+/*! This function fills a buffer with the data of the pc elements listed in plist. New output blocks can in
+ *  principle be added here.
+ */
+static void fill_write_buffer_elements(enum iofields blocknr, int *plist, int pc, void *buffer)
 {
     int n, k, pindex;
     MyOutputFloat *fp;
@@ -187,34 +361,26 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 #if defined(OUTPUT_GDE_DISTORTIONTENSOR)
     MyBigFloat half_kick_add[6][6];
 #endif
-#ifdef MAGNETIC /* NOTE: we always work -internally- in code units where MU_0 = 1; hence the 4pi here; [much simpler, but be sure of your conversions!] */
-    double gizmo2gauss = UNIT_B_IN_GAUSS / All.UnitMagneticField_in_gauss;
+#ifdef MAGNETIC
+    double gizmo2gauss = io_gizmo2gauss;
 #endif
 #ifdef GDE_DISTORTIONTENSOR
     MyBigFloat flde, psde;
 #endif
-#ifdef PMGRID
-    double dt_gravkick_pm = 0;
-    if(All.ComovingIntegrationOn)
-        {dt_gravkick_pm = get_gravkick_factor(All.PM_Ti_begstep, All.Ti_Current) - get_gravkick_factor(All.PM_Ti_begstep, (All.PM_Ti_begstep + All.PM_Ti_endstep) / 2);}
-    else
-        {dt_gravkick_pm = (All.Ti_Current - (All.PM_Ti_begstep + All.PM_Ti_endstep) / 2) * All.Timebase_interval;}
-#endif
 
-    fp = (MyOutputFloat *) CommBuffer;
-    fp_single = (float *) CommBuffer;
-    fp_pos = (MyOutputPosFloat *) CommBuffer;
-    ip = (MyIDType *) CommBuffer;
-    ip_int = (int *) CommBuffer;
-    ip_int64 = (uint64_t *) CommBuffer;
-    pindex = *startindex;
+    fp = (MyOutputFloat *) buffer;
+    fp_single = (float *) buffer;
+    fp_pos = (MyOutputPosFloat *) buffer;
+    ip = (MyIDType *) buffer;
+    ip_int = (int *) buffer;
+    ip_int64 = (uint64_t *) buffer;
 
     switch (blocknr)
     {
         case IO_POS:		/* positions */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k = 0; k < 3; k++)
                     {
                         fp_pos[k] = P[pindex].Pos[k];
@@ -228,14 +394,13 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 #endif
                     }
                     fp_pos += 3;
-                    n++;
                 }
             break;
 
         case IO_VEL:		/* velocities [we're drifting here to the snapshot, note this is -not- the exact velocity in-code b/c we're alternating drifts and kicks!] */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
 #if 1
                     for(k=0;k<3;k++) {fp[k] = (MyOutputFloat) (P[pindex].Vel[k] * sqrt(All.cf_a3inv));} // JUST write the conserved velocity here, not the drifted one in this manner //
 #else
@@ -252,85 +417,77 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                         if(P[pindex].Type == 0) {fp[k] += SphP[pindex].HydroAccel[k] * dt_hydrokick * All.cf_atime;}
                     }
 #ifdef PMGRID
-                    for(k = 0; k < 3; k++) {fp[k] += P[pindex].GravPM[k] * dt_gravkick_pm;}
+                    for(k = 0; k < 3; k++) {fp[k] += P[pindex].GravPM[k] * io_dt_gravkick_pm;}
 #endif
                     for(k = 0; k < 3; k++) {fp[k] *= sqrt(All.cf_a3inv);}
 #endif
                     fp += 3;
-                    n++;
                 }
             break;
 
         case IO_ID:		/* particle ID */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *ip++ = P[pindex].ID;
-                    n++;
                 }
             break;
 
         case IO_CHILD_ID:		/* particle 'child' ID (for splits/mergers) */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *ip++ = P[pindex].ID_child_number;
-                    n++;
                 }
             break;
 
         case IO_GENERATION_ID:	/* particle ID generation (for splits/mergers) */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *ip++ = P[pindex].ID_generation;
-                    n++;
                 }
             break;
 
         case IO_MASS:		/* particle mass */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].Mass;
-                    n++;
                 }
             break;
 
         case IO_U:			/* internal energy */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = DMAX(All.MinEgySpec, SphP[pindex].InternalEnergyPred);
-                    n++;
                 }
             break;
 
         case IO_RHO:		/* density */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].Density;
-                    n++;
                 }
             break;
 
         case IO_NE:		/* electron abundance */
 #if (defined(COOLING) || defined(RT_CHEM_PHOTOION)) && !defined(CHIMES)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].Ne;
-                    n++;
                 }
 #endif
             break;
 
         case IO_NH:		/* neutral hydrogen fraction */
 #if (defined(COOLING) || defined(RT_CHEM_PHOTOION)) && !defined(CHIMES)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
 #if defined(RT_CHEM_PHOTOION)
                     *fp++ = SphP[pindex].HI;
 #elif (COOL_GRACKLE_CHEMISTRY > 0)
@@ -340,249 +497,226 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                     temp = ThermalProperties(u, SphP[pindex].Density * All.cf_a3inv, pindex, &mu, &ne, &nh0, &nhp, &nHe0, &nHeII, &nHepp);
                     *fp++ = (MyOutputFloat) nh0;
 #endif
-                    n++;
                 }
 #endif
             break;
 
         case IO_HII:		/* ionized hydrogen abundance */
 #if defined(RT_CHEM_PHOTOION)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].HII;
-                    n++;
                 }
 #endif
             break;
 
         case IO_HeI:		/* neutral Helium */
 #if defined(RT_CHEM_PHOTOION_HE)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].HeI;
-                    n++;
                 }
 #endif
             break;
 
         case IO_HeII:		/* ionized Helium */
 #if defined(RT_CHEM_PHOTOION_HE)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].HeII;
-                    n++;
                 }
 #endif
             break;
             
         case IO_INIB:
 #if defined(SPAWN_B_POL_TOR_SET_IN_PARAMS) && defined(BH_DEBUG_SPAWN_JET_TEST)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k=0;k<3;k++) {*fp++ = SphP[pindex].IniB[k];}
-                    n++;
                 }
 #endif               
             break;
             
         case IO_IDEN:
 #if defined(SPAWN_B_POL_TOR_SET_IN_PARAMS) && defined(BH_DEBUG_SPAWN_JET_TEST)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].IniDen;
-                    n++;
                 }
 #endif                
             break;
             
         case IO_UNSPMASS:
 #if defined(BH_WIND_SPAWN) && defined(BH_DEBUG_SPAWN_JET_TEST)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].unspawned_wind_mass;
-                    n++;
                 }
 #endif           
             break;
             
         case IO_CRATE:
 #if defined(OUTPUT_COOLRATE_DETAIL) && defined(COOLING)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].CoolingRate;
-                    n++;
                 }
 #endif
             break;
 
         case IO_HRATE:
 #if defined(OUTPUT_COOLRATE_DETAIL) && defined(COOLING)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].HeatingRate;
-                    n++;
                 }
 #endif
             break;
 
         case IO_NHRATE:
 #if defined(OUTPUT_COOLRATE_DETAIL) && defined(COOLING)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].NetHeatingRateQ;
-                    n++;
                 }
 #endif
             break;
 
         case IO_HHRATE:
 #if defined(OUTPUT_COOLRATE_DETAIL) && defined(COOLING)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].HydroHeatingRate;
-                    n++;
                 }
 #endif
             break;
 
         case IO_MCRATE:
 #if defined(OUTPUT_COOLRATE_DETAIL) && defined(COOLING)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].MetalCoolingRate;
-                    n++;
                 }
 #endif
             break;
 
         case IO_HSML:		/* gas kernel length */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = PPP[pindex].Hsml;
-                    n++;
                 }
             break;
 
         case IO_SFR:		/* star formation rate */
 #ifdef GALSF
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {   /* units convert to solar masses per yr */
+                    pindex = plist[n];
                     *fp++ = get_starformation_rate(pindex, 1) * UNIT_MASS_IN_SOLAR / UNIT_TIME_IN_YR;
-                    n++;
                 }
 #endif
             break;
 
         case IO_AGE:		/* stellar formation time */
 #ifdef GALSF
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].StellarAge;
-                    n++;
                 }
 #endif
             break;
 
         case IO_OSTAR:
 #ifdef GALSF_SFR_IMF_SAMPLING
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].IMF_NumMassiveStars;
-                    n++;
                   }
 #endif
             break;
 
         case IO_GRAINSIZE:		/* grain size */
 #ifdef GRAIN_FLUID
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].Grain_Size;
-                    n++;
                 }
 #endif
             break;
 
         case IO_GRAINTYPE:      /* grain type */
 #if defined(PIC_MHD)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *ip_int++ = P[pindex].Grain_SubType;
-                    n++;
                 }
 #endif
             break;
 
         case IO_VSTURB_DISS:
 #if defined(TURB_DRIVING)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].DuDt_diss;
-                    n++;
                 }
 #endif
             break;
 
         case IO_VSTURB_DRIVE:
 #if defined(TURB_DRIVING)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].DuDt_drive;
-                    n++;
                 }
 #endif
             break;
 
         case IO_HSMS:		/* kernel length for star particles */
 #ifdef SUBFIND
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].DM_Hsml;
-                    n++;
                 }
 #endif
             break;
 
         case IO_Z:			/* gas and star metallicity */
 #ifdef METALS
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k=0;k<NUM_METAL_SPECIES;k++) {fp[k] = P[pindex].Metallicity[k];}
                     fp += NUM_METAL_SPECIES;
-                    n++;
                 }
 #endif
             break;
 
         case IO_CHIMES_ABUNDANCES:
 #ifdef CHIMES
-            for (n = 0; n < pc; pindex++)
-                if (P[pindex].Type == type)
+            for (n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for (k = 0; k < ChimesGlobalVars.totalNumberOfSpecies; k++) {fp[k] = (MyOutputFloat) ChimesGasVars[pindex].abundances[k];}
                     fp += ChimesGlobalVars.totalNumberOfSpecies;
-                    n++;
                 }
 #endif
             break;
@@ -590,57 +724,53 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_CHIMES_MU:
 #ifdef CHIMES
-            for (n = 0; n < pc; pindex++)
-                if (P[pindex].Type == type)
+            for (n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) calculate_mean_molecular_weight(&(ChimesGasVars[pindex]), &ChimesGlobalVars);
-                    n++;
                 }
 #endif
             break;
 
         case IO_CHIMES_REDUCED:
 #ifdef CHIMES_REDUCED_OUTPUT
-            for (n = 0; n < pc; pindex++)
-                if (P[pindex].Type == type)
+            for (n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     fp[0] = (MyOutputFloat) ChimesGasVars[pindex].abundances[ChimesGlobalVars.speciesIndices[sp_elec]];
                     fp[1] = (MyOutputFloat) ChimesGasVars[pindex].abundances[ChimesGlobalVars.speciesIndices[sp_HI]];
                     fp[2] = (MyOutputFloat) ChimesGasVars[pindex].abundances[ChimesGlobalVars.speciesIndices[sp_H2]];
                     fp[3] = (MyOutputFloat) ChimesGasVars[pindex].abundances[ChimesGlobalVars.speciesIndices[sp_CO]];
                     fp += 4;
-                    n++;
                 }
 #endif
             break;
 
         case IO_CHIMES_NH:
 #if defined(CHIMES_NH_OUTPUT)
-            for (n = 0; n < pc; pindex++)
-                if (P[pindex].Type == type)
+            for (n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) (evaluate_NH_from_GradRho(P[pindex].GradRho,PPP[pindex].Hsml,SphP[pindex].Density,PPP[pindex].NumNgb,1,pindex) * UNIT_SURFDEN_IN_CGS * shielding_length_factor * (1.0 - (P[pindex].Metallicity[0] + P[pindex].Metallicity[1])) / PROTONMASS);
-                    n++;
                 }
 #endif
             break;
 
         case IO_CHIMES_STAR_SIGMA:
 #if defined(CHIMES_NH_OUTPUT) && defined(OUTPUT_DENS_AROUND_STAR)
-            for (n = 0; n < pc; pindex++)
-                if (P[pindex].Type == type)
+            for (n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) (evaluate_NH_from_GradRho(P[pindex].GradRho,PPP[pindex].Hsml,P[pindex].DensAroundStar,PPP[pindex].NumNgb,0,pindex) * UNIT_SURFDEN_IN_CGS);  // g cm^-2
-                    n++;
                 }
 #endif
             break;
 
         case IO_CHIMES_FLUX_G0:
 #ifdef CHIMES_STELLAR_FLUXES
-            for (n = 0; n < pc; pindex++)
-                if (P[pindex].Type == type)
+            for (n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
 #ifdef CHIMES_HII_REGIONS
                     if(SphP[pindex].DelayTimeHII > 0) {for (k = 0; k < CHIMES_LOCAL_UV_NBINS; k++) {fp[k] = (MyOutputFloat) (SphP[pindex].Chimes_G0[k] + SphP[pindex].Chimes_G0_HII[k]);}}
                         else {for(k = 0; k < CHIMES_LOCAL_UV_NBINS; k++) {fp[k] = (MyOutputFloat) SphP[pindex].Chimes_G0[k];}}
@@ -648,16 +778,15 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                     for (k = 0; k < CHIMES_LOCAL_UV_NBINS; k++) {fp[k] = (MyOutputFloat) SphP[pindex].Chimes_G0[k]; }
 #endif
                     fp += CHIMES_LOCAL_UV_NBINS;
-                    n++;
                 }
 #endif
             break;
 
         case IO_CHIMES_FLUX_ION:
 #ifdef CHIMES_STELLAR_FLUXES
-            for (n = 0; n < pc; pindex++)
-                if (P[pindex].Type == type)
+            for (n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
 #ifdef CHIMES_HII_REGIONS
                     if(SphP[pindex].DelayTimeHII > 0) {for (k = 0; k < CHIMES_LOCAL_UV_NBINS; k++) {fp[k] = (MyOutputFloat) (SphP[pindex].Chimes_fluxPhotIon[k] + SphP[pindex].Chimes_fluxPhotIon_HII[k]);}}
                         else {for (k = 0; k < CHIMES_LOCAL_UV_NBINS; k++) {fp[k] = (MyOutputFloat) SphP[pindex].Chimes_fluxPhotIon[k];}}
@@ -665,18 +794,36 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                     for (k = 0; k < CHIMES_LOCAL_UV_NBINS; k++) {fp[k] = (MyOutputFloat) SphP[pindex].Chimes_fluxPhotIon[k];}
 #endif
                     fp += CHIMES_LOCAL_UV_NBINS;
-                    n++;
+                }
+#endif
+            break;
+
+        case IO_WARMSTART_HSML:		/* kernel lengths of the non-gas elements, to restart from this snapshot without re-iterating them */
+#ifdef IO_SNAPSHOT_WARMSTART
+            for(n = 0; n < pc; n++)
+                {
+                    pindex = plist[n];
+                    *fp++ = PPP[pindex].Hsml;
+                }
+#endif
+            break;
+
+        case IO_WARMSTART_OLDACC:		/* last acceleration magnitude, for the relative tree-opening criterion on the first step after a restart */
+#ifdef IO_SNAPSHOT_WARMSTART
+            for(n = 0; n < pc; n++)
+                {
+                    pindex = plist[n];
+                    *fp++ = P[pindex].OldAcc;
                 }
 #endif
             break;
 
         case IO_DENS_AROUND_STAR:
 #ifdef OUTPUT_DENS_AROUND_STAR
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) P[pindex].DensAroundStar;
-                    n++;
                 }
 #endif
             break;
@@ -686,9 +833,9 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_MOLECULARFRACTION:
 #if defined(OUTPUT_MOLECULAR_FRACTION)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
 #if defined(COOL_MOLECFRAC_NONEQM)
                     *fp++ = (MyOutputFloat) SphP[pindex].MolecularMassFraction_perNeutralH; /* more useful to output this particular value, rather than fH2 */
 #else
@@ -696,151 +843,138 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                     temp = ThermalProperties(u, SphP[pindex].Density * All.cf_a3inv, pindex, &mu, &ne, &nh0, &nhp, &nHe0, &nHeII, &nHepp);
                     *fp++ = (MyOutputFloat) SphP[pindex].MolecularMassFraction; /* we call the subroutine above to make sure this quantity is as up-to-the-moment updated as possible, going into our next routine */
 #endif
-                    n++;
                 }
 #endif
             break;
 
         case IO_POT:		/* gravitational potential */
 #if defined(OUTPUT_POTENTIAL)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].Potential;
-                    n++;
                 }
 #endif
             break;
 
         case IO_BH_DIST:
 #if defined(BH_CALC_DISTANCES) && defined(OUTPUT_BH_DISTANCES)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].min_dist_to_bh;
-                    n++;
                 }
 #endif
             break;
 
         case IO_ACCEL:		/* acceleration */
 #ifdef OUTPUT_ACCELERATION
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k = 0; k < 3; k++) {fp[k] = All.cf_a2inv * P[pindex].GravAccel[k];}
 #ifdef PMGRID
                     for(k = 0; k < 3; k++) {fp[k] += All.cf_a2inv * P[pindex].GravPM[k];}
 #endif
                     if(P[pindex].Type == 0) {for(k = 0; k < 3; k++) {fp[k] += SphP[pindex].HydroAccel[k];}}
                     fp += 3;
-                    n++;
                 }
 #endif
             break;
 
         case IO_DTENTR:		/* rate of change of internal energy */
 #ifdef OUTPUT_CHANGEOFENERGY
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].DtInternalEnergy;
-                    n++;
                 }
 #endif
             break;
 
         case IO_DELAYTIME:
 #ifdef GALSF_SUBGRID_WINDS
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].DelayTime;
-                    n++;
                 }
 #endif
             break;
 
         case IO_TSTP:		/* timestep  */
 #ifdef OUTPUT_TIMESTEP
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = GET_PARTICLE_TIMESTEP_IN_PHYSICAL(pindex);
-                    n++;
                 }
 #endif
             break;
 
         case IO_BFLD:		/* magnetic field  */
 #ifdef MAGNETIC
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k=0;k<3;k++) {fp[k] = (MyOutputFloat) (Get_Gas_BField(pindex,k) * All.cf_a2inv * gizmo2gauss);}
                     fp += 3;
-                    n++;
                 }
 #endif
             break;
 
         case IO_VDIV:		/* Divergence of Vel */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].Particle_DivVel;
-                    n++;
                 }
             break;
 
         case IO_VORT:		/* Vorticity */
 #if defined(TURB_DRIVING) || defined(OUTPUT_VORTICITY)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k=0;k<3;k++) {fp[k] = SphP[pindex].Vorticity[k];}
                     fp += 3;
-                    n++;
                 }
 #endif
             break;
         
         case IO_SLUG_STATE_INITIAL: /* It is a true/false entry, recording whether the slug cluster is turned on*/
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *ip_int++ = (int) P[pindex].slug_state_initialized;
-                    n++;
                 }
             break;
         
         case IO_SLUG_STATE_RNG:  /* It is an 128 bit integer. I split it into 2 64 bit integers for easier output */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {   rng_state_t x;
+                    pindex = plist[n];
                     x = P[pindex].slug_state.rngStateAtBirth;
                     uint64_t part1 = (uint64_t) x;
                     uint64_t part2 = (x >> 64);
                     *ip_int64++ = part1;
                     *ip_int64++ = part2;
-                    n++;
                 }
             break;
 
         case IO_SLUG_STATE_INT:
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *ip_int64++ = (uint64_t) P[pindex].slug_state.id;
                     *ip_int64++ = (uint64_t) P[pindex].slug_state.stoch_sn;
-                    n++;
                 }
             break;
 
         case IO_SLUG_STATE_DOUBLE: /*I did not include the last three quantities since I dont know how to deal with N */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) P[pindex].slug_state.targetMass;
                     *fp++ = (MyOutputFloat) P[pindex].slug_state.birthMass;
                     *fp++ = (MyOutputFloat) P[pindex].slug_state.aliveMass;
@@ -864,14 +998,13 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                     *fp++ = (MyOutputFloat) P[pindex].slug_state.Lbol_ext;
                     *fp++ = (MyOutputFloat) P[pindex].slug_state.tot_sn;
                     *fp++ = (MyOutputFloat) P[pindex].slug_state.last_yield_time;
-                    n++;
                 }
             break;
 
         case IO_VGRADNORM: /* Velocity gradient */
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     MyOutputFloat vgn = 0.;
                     for(k = 0; k < 3; k++)
                     {
@@ -880,18 +1013,16 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                     }
                     SphP[pindex].GradVelNorm = sqrt(vgn);
                     *fp++ = SphP[pindex].GradVelNorm;
-                    n++;
                 }
         break;
 
         case IO_IMF:		/* parameters describing the IMF  */
 #ifdef GALSF_SFR_IMF_VARIATION
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k = 0; k < N_IMF_FORMPROPS; k++) {fp[k] = P[pindex].IMF_FormProps[k];}
                     fp += N_IMF_FORMPROPS;
-                    n++;
                 }
 #endif
             break;
@@ -912,22 +1043,20 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_DIVB:		/* divergence of magnetic field  */
 #if defined(MAGNETIC) && defined(OUTPUT_BFIELD_DIVCLEAN_INFO)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 { /* divB is saved in physical units */
+                    pindex = plist[n];
                     *fp++ = (SphP[pindex].divB * gizmo2gauss * (SphP[pindex].Density*All.cf_a3inv / P[pindex].Mass));
-                    n++;
                 }
 #endif
             break;
 
         case IO_ABVC:		/* artificial viscosity of particle  */
 #if defined(SPHAV_CD10_VISCOSITY_SWITCH)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].alpha * SphP[pindex].alpha_limiter;
-                    n++;
                 }
 #endif
             break;
@@ -935,43 +1064,40 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_AMDC:		/* artificial magnetic dissipation of particle  */
 #if defined(SPH_TP12_ARTIFICIAL_RESISTIVITY)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].Balpha;
-                    n++;
                 }
 #endif
             break;
 
         case IO_PHI:		/* divBcleaning fuction of particle  */
 #if defined(DIVBCLEANING_DEDNER) && defined(OUTPUT_BFIELD_DIVCLEAN_INFO)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (Get_Gas_PhiField(pindex) * All.cf_a3inv * gizmo2gauss);
-                    n++;
                 }
 #endif
             break;
 
         case IO_GRADPHI:		/* divBcleaning fuction of particle  */
 #if defined(DIVBCLEANING_DEDNER) && defined(OUTPUT_BFIELD_DIVCLEAN_INFO)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k=0;k<3;k++) {fp[k] = (SphP[pindex].Gradients.Phi[k] * All.cf_a2inv*All.cf_a2inv * gizmo2gauss);}
                     fp += 3;
-                    n++;
                 }
 #endif
             break;
 
         case IO_COOLRATE:		/* current cooling rate of particle  */
 #ifdef OUTPUT_COOLRATE
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     double ne = SphP[pindex].Ne;
                     /* get cooling time */
                     u = SphP[pindex].InternalEnergyPred;
@@ -981,63 +1107,57 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                         {*fp++ = u / tcool;}
                     else
                         {*fp++ = 0;}
-                    n++;
                 }
 #endif // OUTPUT_COOLRATE
             break;
 
         case IO_BHMASS:
 #ifdef BLACK_HOLES
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = BPP(pindex).BH_Mass;
-                    n++;
                 }
 #endif
             break;
 
         case IO_BHDUSTMASS:
 #if defined(BLACK_HOLES) && defined(GRAIN_FLUID)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = BPP(pindex).BH_Dust_Mass;
-                    n++;
                 }
 #endif
             break;
 
         case IO_BHMASSALPHA:
 #ifdef BH_ALPHADISK_ACCRETION
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = BPP(pindex).BH_Mass_AlphaDisk;
-                    n++;
                 }
 #endif
             break;
 
         case IO_BH_ANGMOM:
 #ifdef BH_FOLLOW_ACCRETED_ANGMOM
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k = 0; k < 3; k++) {fp[k] = BPP(pindex).BH_Specific_AngMom[k];}
                     fp += 3;
-                    n++;
                 }
 #endif
             break;
 
         case IO_BHMDOT:
 #ifdef BLACK_HOLES
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = BPP(pindex).BH_Mdot;
-                    n++;
                 }
 #endif
             break;
@@ -1062,43 +1182,39 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_BHPROGS:
 #ifdef BH_COUNTPROGS
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *ip_int++ = BPP(pindex).BH_CountProgs;
-                    n++;
                 }
 #endif
             break;
 
         case IO_ACRB:
 #ifdef BLACK_HOLES
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].Hsml;
-                    n++;
                 }
 #endif
             break;
 
         case IO_SINKRAD:
 #ifdef BH_GRAVCAPTURE_FIXEDSINKRADIUS
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].SinkRadius;
-                    n++;
                 }
 #endif
             break;
 
         case IO_TIDALTENSORPS:   /* 3x3 configuration-space tidal tensor that is driving the GDE */
 #ifdef OUTPUT_TIDAL_TENSOR
-            for(n = 0; n < pc; pindex++)
-
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k = 0; k < 3; k++)
                     {
                         int l_tt_tmp;
@@ -1112,7 +1228,6 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                         }
                     }
                     //fflush(stderr);
-                    n++;
                     fp += 9;
                 }
 #endif
@@ -1120,9 +1235,9 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_GDE_DISTORTIONTENSOR:   /* full 6D phase-space distortion tensor from GDE integration */
 #ifdef OUTPUT_GDE_DISTORTIONTENSOR
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     get_half_kick_distortion(pindex, half_kick_add);
                     for(k = 0; k < 6; k++)
                     {
@@ -1131,7 +1246,6 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                             fp[k * 6 + l] = (MyOutputFloat) (P[pindex].distortion_tensorps[k][l] + half_kick_add[k][l]);
                         }
                     }
-                    n++;
                     fp += 36;
 
                 }
@@ -1140,68 +1254,63 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_CAUSTIC_COUNTER:   /* caustic counter */
 #ifdef GDE_DISTORTIONTENSOR
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) P[pindex].caustic_counter;
-                    n++;
                 }
 #endif
             break;
 
         case IO_FLOW_DETERMINANT:   /* physical NON-CUTOFF corrected stream determinant = 1.0/normed stream density * 1.0/initial stream density */
 #if defined(GDE_DISTORTIONTENSOR) && !defined(GDE_LEAN)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     get_current_ps_info(pindex, &flde, &psde);
                     *fp++ = (MyOutputFloat) flde;
-                    n++;
                 }
 #endif
             break;
 
         case IO_STREAM_DENSITY:   /* physical CUTOFF corrected stream density = normed stream density * initial stream density */
 #ifdef GDE_DISTORTIONTENSOR
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) (P[pindex].stream_density);
-                    n++;
                 }
 #endif
             break;
 
         case IO_PHASE_SPACE_DETERMINANT:   /* determinant of phase-space distortion tensor -> should be 1 due to Liouville theorem */
 #ifdef GDE_DISTORTIONTENSOR
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     get_current_ps_info(pindex, &flde, &psde);
                     *fp++ = (MyOutputFloat) psde;
-                    n++;
                 }
 #endif
             break;
 
         case IO_ANNIHILATION_RADIATION:   /* time integrated stream density in physical units */
 #if defined(GDE_DISTORTIONTENSOR) && !defined(GDE_LEAN)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) (P[pindex].annihilation * GDE_INITDENSITY(pindex));
                     *fp++ = (MyOutputFloat) (P[pindex].analytic_caustics);
                     *fp++ = (MyOutputFloat) (P[pindex].analytic_annihilation * GDE_INITDENSITY(pindex));
-                    n++;
                 }
 #endif
             break;
 
         case IO_LAST_CAUSTIC:   /* extensive information on the last caustic the particle has passed */
 #ifdef OUTPUT_GDE_LASTCAUSTIC
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) P[pindex].lc_Time;
                     *fp++ = (MyOutputFloat) P[pindex].lc_Pos[0];
                     *fp++ = (MyOutputFloat) P[pindex].lc_Pos[1];
@@ -1224,16 +1333,15 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                     *fp++ = (MyOutputFloat) P[pindex].lc_smear_x;
                     *fp++ = (MyOutputFloat) P[pindex].lc_smear_y;
                     *fp++ = (MyOutputFloat) P[pindex].lc_smear_z;
-                    n++;
                 }
 #endif
             break;
 
         case IO_SHEET_ORIENTATION:   /* initial orientation of the CDM sheet where the particle started */
 #if defined(GDE_DISTORTIONTENSOR) && (!defined(GDE_LEAN) || defined(GDE_READIC))
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = (MyOutputFloat) GDE_VMATRIX(pindex,0,0);
                     *fp++ = (MyOutputFloat) GDE_VMATRIX(pindex,0,1);
                     *fp++ = (MyOutputFloat) GDE_VMATRIX(pindex,0,2);
@@ -1243,43 +1351,39 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                     *fp++ = (MyOutputFloat) GDE_VMATRIX(pindex,2,0);
                     *fp++ = (MyOutputFloat) GDE_VMATRIX(pindex,2,1);
                     *fp++ = (MyOutputFloat) GDE_VMATRIX(pindex,2,2);
-                    n++;
                 }
 #endif
             break;
 
         case IO_INIT_DENSITY:   /* initial stream density in physical units  */
 #if defined(GDE_DISTORTIONTENSOR) && (!defined(GDE_LEAN) || defined(GDE_READIC))
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     if(All.ComovingIntegrationOn)
                         {*fp++ = GDE_INITDENSITY(pindex) / (GDE_TIMEBEGIN(pindex) * GDE_TIMEBEGIN(pindex) * GDE_TIMEBEGIN(pindex));}
                     else
                         {*fp++ = GDE_INITDENSITY(pindex);}
-                    n++;
                 }
 #endif
             break;
 
         case IO_EOSABAR:
 #ifdef EOS_CARRIES_ABAR
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].Abar;
-                    n++;
                 }
 #endif
             break;
 
         case IO_TURB_DYNAMIC_COEFF:
 #ifdef TURB_DIFF_DYNAMIC
-            for (n = 0; n < pc; pindex++) {
-                if (P[pindex].Type == type)
+            for (n = 0; n < pc; n++) {
                 {
-                    *fp++ = SphP[pindex].TD_DynDiffCoeff;
-                    n++;
+                pindex = plist[n];
+                *fp++ = SphP[pindex].TD_DynDiffCoeff;
                 }
             }
 #endif
@@ -1287,44 +1391,40 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_EOSYE:
 #ifdef EOS_CARRIES_YE
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].Ye;
-                    n++;
                 }
 #endif
             break;
 
         case IO_EOSTEMP:
 #ifdef EOS_CARRIES_TEMPERATURE
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].Temperature;
-                    n++;
                 }
 #endif
             break;
 
         case IO_PRESSURE:
 #if defined(EOS_GENERAL)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].Pressure;
-                    n++;
                 }
 #endif
             break;
 
             case IO_EOSCS:
 #if defined(EOS_GENERAL)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = SphP[pindex].SoundSpeed;
-                    n++;
                 }
 #endif
             break;
@@ -1334,9 +1434,9 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_EOS_STRESS_TENSOR:
 #if defined(EOS_ELASTIC)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k = 0; k < 3; k++)
                     {
                         int kf;
@@ -1344,102 +1444,93 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
                             fp[3*k + kf] = SphP[pindex].Elastic_Stress_Tensor[kf][k];
                     }
                     fp += 9;
-                    n++;
                 }
 #endif
             break;
 
             case IO_EOSCOMP:
 #ifdef EOS_TILLOTSON
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *ip_int++ = SphP[pindex].CompositionType;
-                    n++;
                 }
 #endif
             break;
 
         case IO_PARTVEL:
 #ifdef HYDRO_MESHLESS_FINITE_VOLUME
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k = 0; k < 3; k++) {fp[k] = SphP[pindex].ParticleVel[k];}
                     fp += 3;
-                    n++;
                 }
 #endif
             break;
 
         case IO_RADGAMMA:
 #if defined(RADTRANSFER) || defined(RT_USE_GRAVTREE_SAVE_RAD_ENERGY)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k=0;k<N_RT_FREQ_BINS;k++) {fp[k] = SphP[pindex].Rad_E_gamma[k];}
                     fp += N_RT_FREQ_BINS;
-                    n++;
                 }
 #endif
             break;
 
         case IO_RAD_ACCEL:
 #ifdef RT_RAD_PRESSURE_OUTPUT
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k=0;k<3;k++) {fp[k] = SphP[pindex].Rad_Accel[k];}
                     fp += 3;
-                    n++;
                 }
 #endif
             break;
 
         case IO_EDDINGTON_TENSOR:
 #ifdef RADTRANSFER
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     for(k=0;k<6;k++) {int kf; for(kf=0;kf<N_RT_FREQ_BINS;kf++) {fp[N_RT_FREQ_BINS*k + kf] = SphP[pindex].ET[kf][k];}}
                     fp += 6*N_RT_FREQ_BINS;
-                    n++;
                 }
 #endif
             break;
 
         case IO_AGS_SOFT:		/* Adaptive Gravitational Softening: softening */
 #if defined(AGS_HSML_CALCULATION_IS_ACTIVE) && defined(AGS_OUTPUTGRAVSOFT)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = PPP[pindex].AGS_Hsml;
-                    n++;
                 }
 #endif
             break;
 
         case IO_AGS_RHO:        /* Adaptive Gravitational Softening: density */
 #if defined(AGS_HSML_CALCULATION_IS_ACTIVE) && defined(DM_FUZZY)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = PPP[pindex].AGS_Density;
-                    n++;
                 }
 #endif
             break;
 
         case IO_AGS_QPT:        /* quantum potential (Q) */
 #if defined(AGS_HSML_CALCULATION_IS_ACTIVE) && defined(DM_FUZZY)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     double d2rho = P[pindex].AGS_Gradients2_Density[0][0] + P[pindex].AGS_Gradients2_Density[1][1] + P[pindex].AGS_Gradients2_Density[2][2]; // laplacian
                     double drho2 = P[pindex].AGS_Gradients_Density[0]*P[pindex].AGS_Gradients_Density[0] + P[pindex].AGS_Gradients_Density[1]*P[pindex].AGS_Gradients_Density[1] + P[pindex].AGS_Gradients_Density[2]*P[pindex].AGS_Gradients_Density[2];
                     double AGS_QuantumPotential = (0.25*All.ScalarField_hbar_over_mass*All.ScalarField_hbar_over_mass / P[pindex].AGS_Density) * (d2rho - 0.5*drho2/P[pindex].AGS_Density);
                     *fp++ = AGS_QuantumPotential;
-                    n++;
                 }
 #endif
             break;
@@ -1447,11 +1538,10 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
         case IO_AGS_PSI_RE:        /* real part of wavefunction */
 #if defined(AGS_HSML_CALCULATION_IS_ACTIVE) && defined(DM_FUZZY)
 #if (DM_FUZZY > 0)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].AGS_Psi_Re * P[pindex].AGS_Density / P[pindex].Mass;
-                    n++;
                 }
 #endif
 #endif
@@ -1460,11 +1550,10 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
         case IO_AGS_PSI_IM:        /* imaginary part of wavefunction */
 #if defined(AGS_HSML_CALCULATION_IS_ACTIVE) && defined(DM_FUZZY)
 #if (DM_FUZZY > 0)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = P[pindex].AGS_Psi_Im * P[pindex].AGS_Density / P[pindex].Mass;
-                    n++;
                 }
 #endif
 #endif
@@ -1472,143 +1561,118 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
         case IO_AGS_ZETA:		/* Adaptive Gravitational Softening: zeta */
 #if defined(AGS_HSML_CALCULATION_IS_ACTIVE) && defined(AGS_OUTPUTZETA)
-            for(n = 0; n < pc; pindex++)
-                if(P[pindex].Type == type)
+            for(n = 0; n < pc; n++)
                 {
+                    pindex = plist[n];
                     *fp++ = PPPZ[pindex].AGS_zeta;
-                    n++;
                 }
 #endif
             break;
 
         case IO_grHI:
 #if (COOL_GRACKLE_CHEMISTRY >= 1)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grHI;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grHI;
             }
 #endif
             break;
 
         case IO_grHII:
 #if (COOL_GRACKLE_CHEMISTRY >= 1)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grHII;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grHII;
             }
 #endif
             break;
 
         case IO_grHM:
 #if (COOL_GRACKLE_CHEMISTRY >= 1)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grHM;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grHM;
             }
 #endif
             break;
 
         case IO_grHeI:
 #if (COOL_GRACKLE_CHEMISTRY >= 1)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grHeI;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grHeI;
             }
 #endif
             break;
 
         case IO_grHeII:
 #if (COOL_GRACKLE_CHEMISTRY >= 1)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grHeII;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grHeII;
             }
 #endif
             break;
 
         case IO_grHeIII:
 #if (COOL_GRACKLE_CHEMISTRY >= 1)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grHeIII;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grHeIII;
             }
 #endif
             break;
 
         case IO_grH2I:
 #if (COOL_GRACKLE_CHEMISTRY >= 2)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grH2I;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grH2I;
             }
 #endif
             break;
 
         case IO_grH2II:
 #if (COOL_GRACKLE_CHEMISTRY >= 2)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grH2II;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grH2II;
             }
 #endif
             break;
 
         case IO_grDI:
 #if (COOL_GRACKLE_CHEMISTRY >= 3)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grDI;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grDI;
             }
 #endif
             break;
 
         case IO_grDII:
 #if (COOL_GRACKLE_CHEMISTRY >= 3)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grDII;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grDII;
             }
 #endif
             break;
 
         case IO_grHDI:
 #if (COOL_GRACKLE_CHEMISTRY >= 3)
-            for(n = 0; n < pc; pindex++){
-                if(P[pindex].Type == type){
-                    *fp++ = SphP[pindex].grHDI;
-                    n++;
-                }
+            for(n = 0; n < pc; n++){
+                pindex = plist[n];
+                *fp++ = SphP[pindex].grHDI;
             }
 #endif
             break;
 
     case IO_TURB_DIFF_COEFF:
 #ifdef TURB_DIFF_DYNAMIC
-        for (n = 0; n < pc; pindex++) {
-            if (P[pindex].Type == type) {
-                *fp++ = SphP[pindex].TD_DiffCoeff;
-                n++;
-            }
+        for (n = 0; n < pc; n++) {
+            pindex = plist[n];
+            *fp++ = SphP[pindex].TD_DiffCoeff;
         }
 #endif
 
@@ -1616,22 +1680,18 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
 
     case IO_DYNERROR:
 #ifdef IO_TURB_DIFF_DYNAMIC_ERROR
-        for (n = 0; n < pc; pindex++) {
-            if (P[pindex].Type == type) {
-                *fp++ = SphP[pindex].TD_DynDiffCoeff_error;
-                n++;
-            }
+        for (n = 0; n < pc; n++) {
+            pindex = plist[n];
+            *fp++ = SphP[pindex].TD_DynDiffCoeff_error;
         }
 #endif
         break;
 
     case IO_DYNERRORDEFAULT:
 #ifdef IO_TURB_DIFF_DYNAMIC_ERROR
-        for (n = 0; n < pc; pindex++) {
-            if (P[pindex].Type == type) {
-                *fp++ = SphP[pindex].TD_DynDiffCoeff_error_default;
-                n++;
-            }
+        for (n = 0; n < pc; n++) {
+            pindex = plist[n];
+            *fp++ = SphP[pindex].TD_DynDiffCoeff_error_default;
         }
 #endif
         break;
@@ -1641,7 +1701,6 @@ void fill_write_buffer(enum iofields blocknr, int *startindex, int pc, int type)
             break;
     }
 
-    *startindex = pindex;
 }
 
 
@@ -1801,6 +1860,8 @@ int get_bytes_per_blockelement(enum iofields blocknr, int mode)
         case IO_DENS_AROUND_STAR:
         case IO_DELAY_TIME_HII:
         case IO_MOLECULARFRACTION:
+        case IO_WARMSTART_HSML:
+        case IO_WARMSTART_OLDACC:
             if(mode)
                 bytes_per_blockelement = sizeof(MyInputFloat);
             else
@@ -2098,6 +2159,8 @@ int get_values_per_blockelement(enum iofields blocknr)
         case IO_DENS_AROUND_STAR:
         case IO_DELAY_TIME_HII:
         case IO_MOLECULARFRACTION:
+        case IO_WARMSTART_HSML:
+        case IO_WARMSTART_OLDACC:
             values = 1;
             break;
 
@@ -2223,6 +2286,7 @@ long get_particles_in_block(enum iofields blocknr, int *typelist)
         case IO_AGS_ZETA:
         case IO_BH_DIST:
         case IO_CBE_MOMENTS:
+        case IO_WARMSTART_OLDACC:
             return nall;
             break;
 
@@ -2365,6 +2429,7 @@ long get_particles_in_block(enum iofields blocknr, int *typelist)
             break;
 
         case IO_DENS_AROUND_STAR:
+        case IO_WARMSTART_HSML:
             typelist[0] = 0;
             return header.npart[1]+header.npart[2]+header.npart[3]+header.npart[4]+header.npart[5];
             break;
@@ -2531,6 +2596,13 @@ int blockpresent(enum iofields blocknr)
 #endif
             break;
 
+        case IO_WARMSTART_HSML:
+        case IO_WARMSTART_OLDACC:
+#ifdef IO_SNAPSHOT_WARMSTART
+            return 1;
+#endif
+            break;
+
         case IO_DELAY_TIME_HII:
             break;
 
@@ -3061,6 +3133,12 @@ void get_Tab_IO_Label(enum iofields blocknr, char *label)
         case IO_DENS_AROUND_STAR:
             strncpy(label, "DNST", 4);
             break;
+        case IO_WARMSTART_HSML:
+            strncpy(label, "WHSM", 4);
+            break;
+        case IO_WARMSTART_OLDACC:
+            strncpy(label, "WACC", 4);
+            break;
         case IO_DELAY_TIME_HII:
             strncpy(label, "DHII", 4);
             break;
@@ -3450,6 +3528,12 @@ void get_dataset_name(enum iofields blocknr, char *buf)
         case IO_DENS_AROUND_STAR:
             strcpy(buf, "DensityAtParticleLocation");
             break;
+        case IO_WARMSTART_HSML:
+            strcpy(buf, "WarmStart_KernelLength");
+            break;
+        case IO_WARMSTART_OLDACC:
+            strcpy(buf, "WarmStart_OldAcc");
+            break;
         case IO_DELAY_TIME_HII:
             strcpy(buf, "DelayTime_HIIRegion_Cooling");
             break;
@@ -3806,6 +3890,14 @@ void write_file(char *fname, int writeTask, int lastTask)
     header.flag_metals = NUM_METAL_SPECIES;
 #endif
 
+    header.flag_warmstart = 0; /* manifest of the derived state carried by this snapshot, for warm restarts from it */
+#ifdef IO_SNAPSHOT_WARMSTART
+    if(IO_BLOCK_WRITTEN(IO_HSML) && IO_BLOCK_WRITTEN(IO_WARMSTART_HSML)) {header.flag_warmstart |= WARMSTART_HSML;}
+    if(IO_BLOCK_WRITTEN(IO_AGS_SOFT)) {header.flag_warmstart |= WARMSTART_AGS_HSML;}
+    if(IO_BLOCK_WRITTEN(IO_WARMSTART_OLDACC)) {header.flag_warmstart |= WARMSTART_OLDACC;}
+    if(IO_BLOCK_WRITTEN(IO_CHIMES_ABUNDANCES)) {header.flag_warmstart |= WARMSTART_CHIMES;}
+#endif
+
     header.num_files = All.NumFilesPerSnapshot;
     header.BoxSize = All.BoxSize;
     header.OmegaMatter = All.OmegaMatter;
@@ -3879,7 +3971,7 @@ void write_file(char *fname, int writeTask, int lastTask)
             if(blocknr == IO_LASTENTRY)
                 break;
 
-            if(blockpresent(blocknr))
+            if(IO_BLOCK_WRITTEN(blocknr))
             {
                 bytes_per_blockelement = get_bytes_per_blockelement(blocknr, 0);
                 npart = get_particles_in_block(blocknr, &typelist[0]);
@@ -3942,7 +4034,7 @@ void write_file(char *fname, int writeTask, int lastTask)
         blocknr = (enum iofields) bnr;
         if(blocknr == IO_LASTENTRY) {break;}
 
-        if(blockpresent(blocknr))
+        if(IO_BLOCK_WRITTEN(blocknr))
         {
             bytes_per_blockelement = get_bytes_per_blockelement(blocknr, 0);
             size_t MyBufferSize = All.BufferSize;
@@ -4245,6 +4337,22 @@ void write_header_attributes_in_hdf5(hid_t handle)
     hdf5_dataspace = H5Screate(H5S_SCALAR); hdf5_attribute = H5Acreate(handle, "Flag_IC_Info", H5T_NATIVE_INT, hdf5_dataspace, H5P_DEFAULT);
     H5Awrite(hdf5_attribute, H5T_NATIVE_INT, &header.flag_ic_info); H5Aclose(hdf5_attribute); H5Sclose(hdf5_dataspace);
 
+#ifdef IO_SNAPSHOT_WARMSTART
+    hdf5_dataspace = H5Screate(H5S_SCALAR); hdf5_attribute = H5Acreate(handle, "Flag_WarmStart", H5T_NATIVE_INT, hdf5_dataspace, H5P_DEFAULT);
+    H5Awrite(hdf5_attribute, H5T_NATIVE_INT, &header.flag_warmstart); H5Aclose(hdf5_attribute); H5Sclose(hdf5_dataspace);
+    { /* human-readable manifest of the same: the datasets holding the derived state */
+        char manifest[500]; manifest[0] = 0;
+        if(header.flag_warmstart & WARMSTART_HSML) {strcat(manifest, "SmoothingLength,WarmStart_KernelLength,");}
+        if(header.flag_warmstart & WARMSTART_AGS_HSML) {strcat(manifest, "AGS-Softening,");}
+        if(header.flag_warmstart & WARMSTART_OLDACC) {strcat(manifest, "WarmStart_OldAcc,");}
+        if(header.flag_warmstart & WARMSTART_CHIMES) {strcat(manifest, "ChimesAbundances,");}
+        if(strlen(manifest) > 0) {manifest[strlen(manifest)-1] = 0;} else {strcpy(manifest, "none");}
+        hid_t hdf5_strtype = H5Tcopy(H5T_C_S1); H5Tset_size(hdf5_strtype, strlen(manifest) + 1);
+        hdf5_dataspace = H5Screate(H5S_SCALAR); hdf5_attribute = H5Acreate(handle, "WarmStart_Fields", hdf5_strtype, hdf5_dataspace, H5P_DEFAULT);
+        H5Awrite(hdf5_attribute, hdf5_strtype, manifest); H5Aclose(hdf5_attribute); H5Sclose(hdf5_dataspace); H5Tclose(hdf5_strtype);
+    }
+#endif
+
     {int ivar=KERNEL_FUNCTION; hdf5_dataspace=H5Screate(H5S_SCALAR); hdf5_attribute=H5Acreate(handle,"Kernel_Function_ID",H5T_NATIVE_INT,hdf5_dataspace,H5P_DEFAULT);
         H5Awrite(hdf5_attribute,H5T_NATIVE_INT,&ivar); H5Aclose(hdf5_attribute); H5Sclose(hdf5_dataspace);}
 
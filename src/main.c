@@ -93,6 +93,7 @@ int main(int argc, char **argv)
 #endif
 
   for(PTask = 0; NTask > (1 << PTask); PTask++);
+  mpi_init_node_topology(); /* determine which tasks share a node, for ordering the point-to-point exchanges */
 
   if(argc < 2)
     {
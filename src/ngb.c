@@ -111,6 +111,26 @@ int ngb_treefind_pairs_threads(MyDouble searchcenter[3], MyFloat hsml, int targe
 }
 
 
+/*! Identical to 'ngb_treefind_pairs_threads', for callers which ignore pairs separated by more than 'rmax' (e.g. the long-range cutoff of the
+ *  mechanical feedback coupling). Before an element is exported, the remote top-level node is re-tested with the search radius max(hmax,hsml)
+ *  capped at rmax: tasks which hold no possible partner are skipped. The local search is unchanged (pairs beyond rmax are still returned).
+ *  Ngb_Export_Culling_Count[0,1] accumulate the number of remote top-level nodes tested and kept [for reporting; the caller resets them].
+ */
+long long Ngb_Export_Culling_Count[2];
+int ngb_treefind_pairs_threads_culled(MyDouble searchcenter[3], MyFloat hsml, MyFloat rmax, int target, int *startnode,
+                                      int mode, int *exportflag, int *exportnodecount, int *exportindex, int *ngblist)
+{
+#include "system/ngb_codeblock_before_condition.h"
+    if(P[p].Type > 0) continue; // skip particles with non-gas types
+    if(P[p].Mass <= 0) continue; // skip zero-mass particles
+#define SEARCHBOTHWAYS 1 // need neighbors that can -mutually- see one another, not just single-directional searching here
+#define NGB_EXPORT_CULLING_RMAX rmax // cap on the mutual search radius used to pre-filter exports
+#include "system/ngb_codeblock_after_condition_threaded.h"
+#undef NGB_EXPORT_CULLING_RMAX
+#undef SEARCHBOTHWAYS
+}
+
+
 /*! This function returns neighbours with distance <= hsml and returns them in Ngblist. Actually, particles in a box of half side length hsml are
  *  returned, i.e. the reduction to a sphere still needs to be done in the calling routine.
  */
@@ -107,6 +107,9 @@ void drift_particle(int i, integertime time1)
     if(All.ComovingIntegrationOn) {dt_drift = get_drift_factor(time0, time1);}
         else {dt_drift = (time1 - time0) * All.Timebase_interval;}
     
+#ifdef OUTPUT_LIGHTCONE
+    double lightcone_x0[3]; for(j=0;j<3;j++) {lightcone_x0[j] = P[i].Pos[j];} /* position before the drift, for the lightcone-crossing check */
+#endif
     
 #if !defined(FREEZE_HYDRO) && !defined(FREEZE_ALL_EXCEPT_DM)
 #if defined(HYDRO_MESHLESS_FINITE_VOLUME)
@@ -121,6 +124,9 @@ void drift_particle(int i, integertime time1)
             COM_Vel[j] = P[i].Vel[j] + P[i].comp_dv[j] * P[i].comp_Mass/(P[i].Mass+P[i].comp_Mass); //center of mass velocity
             P[i].Pos[j] += COM_Vel[j] * dt_drift; //center of mass drift
         }
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+        if(P[i].SuperTimestepFlag >= 3) {fewbody_internal_step(i, dt_drift, fewbody_kick_dv, fewbody_drift_dx, 1);} else // decoupled subsystem: may span many orbits
+#endif
         odeint_super_timestep(i, dt_drift, fewbody_kick_dv, fewbody_drift_dx, 1); // do_fewbody_drift
         for(j=0;j<3;j++)
         {
@@ -150,6 +156,9 @@ void drift_particle(int i, integertime time1)
 #if (NUMDIMS==2)
     P[i].Pos[2]=0; // force zero-ing
 #endif
+#ifdef OUTPUT_LIGHTCONE
+    lightcone_check_crossing(i, lightcone_x0, time0, time1);
+#endif
     
     double divv_fac = P[i].Particle_DivVel * dt_drift;
     double divv_fac_max = 0.3; //1.5; // don't allow Hsml to change too much in predict-step //
@@ -427,6 +436,20 @@ double evaluate_NH_from_GradRho(MyFloat gradrho[3], double hsml, double rho, dou
 }
 
 
+/* return the local column (physical units) for gas element i with the default arguments used by the shielding models: this is the value cached
+    in this step's gradients pass (so all modules see the same estimate within a step), and is evaluated directly from the current density and
+    kernel length otherwise (inactive elements, calls between density() and the gradients pass, or before the first gradients pass) */
+double get_gas_column_density_estimate(int i)
+{
+#ifdef DO_DENSITY_AROUND_STAR_PARTICLES
+    if(SphP[i].ColumnDensityEstimate_Ti == All.Ti_Current) {return SphP[i].ColumnDensityEstimate;}
+    return evaluate_NH_from_GradRho(P[i].GradRho,PPP[i].Hsml,SphP[i].Density,PPP[i].NumNgb,1,i);
+#else
+    return 0;
+#endif
+}
+
+
 
 
 
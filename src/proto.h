@@ -192,14 +192,24 @@ int MPI_Sizelimited_Sendrecv(void *sendbuf, int sendcount, MPI_Datatype sendtype
 			     MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status * status);
 
 int mpi_calculate_offsets(int *send_count, int *send_offset, int *recv_count, int *recv_offset, int send_identical);
+void mpi_init_node_topology(void);
+int mpi_task_node_leader(int task);
+unsigned long long mpi_buffer_checksum(void *buf, size_t nbytes);
+void mpi_sparse_alltoall_counts(int *send_count, int *recv_count);
+void mpi_exchange_with_partners(void *sendbuf, int *send_count, int *send_offset, void *recvbuf, int *recv_count, int *recv_offset,
+                                size_t item_size, int ngrp_min, int ngrp_max, int tag);
 void sort_based_on_field(void *data, int field_offset, int n_items, int item_size, void **data2ptr);
 void mpi_distribute_items_to_tasks(void *data, int task_offset, int *n_items, int *max_n, int item_size);
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+void report_particle_work_statistics(const char *loopname);
+#endif
 
 void parallel_sort_special_P_GrNr_ID(void);
 void calculate_power_spectra(int num, long long *ntot_type_all);
 
 
 int pmforce_is_particle_high_res(int type, MyDouble *pos);
+int pmforce_particle_level(int type, MyDouble *pos);
 
 void compare_partitions(void);
 void assign_unique_ids(void);
@@ -231,10 +241,19 @@ int io_compare_P_GrNr_SubNr(const void *a, const void *b);
 void drift_particle(int i, integertime time1);
 void put_symbol(double t0, double t1, char c);
 void write_cpu_log(void);
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+void domain_feedback_record_step_time(void);
+#endif
 int get_timestep_bin(integertime ti_step);
 const char* svn_version(void);
 void find_particles_and_save_them(int num);
 void lineofsight_output(void);
+void insitu_maps_output(void);
+void insitu_maps_restart_count(void);
+void lightcone_init(void);
+void lightcone_prepare_step(integertime ti_next);
+void lightcone_check_crossing(int i, double *x0, integertime time0, integertime time1);
+void lightcone_flush(int mode);
 void sum_over_processors_and_normalize(void);
 void absorb_along_lines_of_sight(void);
 void output_lines_of_sight(int num);
@@ -474,6 +493,7 @@ void st_turbdrive_calc_phases(void);
 double st_return_driving_scale(void);
 #endif
 double evaluate_NH_from_GradRho(MyFloat gradrho[3], double hsml, double rho, double numngb_ndim, double include_h, int target);
+double get_gas_column_density_estimate(int i);
 
 
 #ifdef GALSF
@@ -482,6 +502,19 @@ double evaluate_light_to_mass_ratio(double stellar_age_in_gyr, int i);
 double calculate_relative_light_to_mass_ratio_from_imf(double stellar_age_in_gyr, int i);
 double calculate_individual_stellar_luminosity(double mdot, double mass, long i);
 double return_probability_of_this_forming_bh_from_seed_model(int i);
+enum stellar_population_quantity_list /* age-dependent, IMF-averaged properties of a stellar population, per unit stellar mass (see stellar_evolution.c) */
+{
+    SSP_IONIZING_LUM_PER_MASS,      /* ionizing light-to-mass ratio [Lsun/Msun] */
+    SSP_OPTICAL_FRACTION,           /* fraction of the non-ionizing luminosity in the optical-NIR band */
+    SSP_PHOTOELECTRIC_LUM_PER_MASS, /* photo-electric (8-13.6 eV) luminosity [erg/s/Msun] */
+    SSP_LYMAN_WERNER_LUM_PER_MASS,  /* Lyman-Werner (11.2-13.6 eV) luminosity [erg/s/Msun] */
+    SSP_SNE_CUMULATIVE_PER_MASS,    /* cumulative number of SNe since formation [1/Msun] */
+    SSP_N_QUANTITIES
+};
+double stellar_population_quantity(int k, double stellar_age_in_gyr);
+#ifdef GALSF_SSP_TABLES
+void init_stellar_population_tables(void);
+#endif
 
 // this structure needs to be defined here, because routines for feedback event rates, etc, are shared among files
 struct addFB_evaluate_data_in_
@@ -612,6 +645,11 @@ double ewald_psi(double x[3]);
 double ewald_pot_corr(double dx, double dy, double dz);
 int find_ancestor(int i);
 integertime find_next_outputtime(integertime time);
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+integertime find_next_snapshot_profile_outputtime(int k, integertime ti_curr);
+int snapshot_profile_restart_count(int k);
+void savepositions_profile(int k);
+#endif
 void find_next_time(void);
 integertime find_next_time_walk(int node);
 void free_memory(void);
@@ -620,8 +658,20 @@ integertime get_timestep(int p, double *a, int flag);
 
 void determine_PMinterior(void);
 void gravity_tree(void);
+#ifdef GRAVITY_TREE_ACCURACY_SWEEP
+void gravity_tree_accuracy_sweep(void);
+#endif
+#ifdef GRAVITY_FMM
+double fmm_local_interactions(void);
+#endif
+#ifdef GRAVITY_FARFIELD_CACHE
+double gravity_farfield_cache_dt(int i);
+#endif
 void hydro_force(void);
 void init(void);
+#ifdef IO_SNAPSHOT_WARMSTART
+int warmstart_fields_from_snapshot(void);
+#endif
 void do_the_cooling_for_particle(int i);
 double get_equilibrium_dust_temperature_estimate(int i, double shielding_factor_for_exgalbg);
 double return_electron_fraction_from_heavy_ions(int target, double temperature, double density_cgs, double n_elec_HHe);
@@ -703,6 +753,9 @@ void readjust_timebase(double TimeMax_old, double TimeMax_new);
 
 double enclosed_mass(double R);
 void pm_setup_nonperiodic_kernel(void);
+#ifdef PM_HIRES_NLEVELS
+int pm_nested_levels_need_update(void);
+#endif
 
 
 #if defined(RADTRANSFER) || defined(RT_USE_GRAVTREE)
@@ -799,7 +852,7 @@ void jacobi(MyBigFloat ** a, int n, MyBigFloat d[], MyBigFloat ** v, int *nrot);
 #ifdef PMGRID
 void pmtidaltensor_periodic_diff(void);
 int pmtidaltensor_nonperiodic_diff(int grnr);
-void pmtidaltensor_periodic_fourier(int component);
+void pmtidaltensor_periodic_fourier(void);
 int pmtidaltensor_nonperiodic_fourier(int component, int grnr);
 #endif
 #endif
@@ -809,6 +862,13 @@ int ags_gravity_kernel_shared_BITFLAG(short int particle_type_primary);
 void ags_setup_smoothinglengths(void);
 void ags_density(void);
 int ags_density_isactive(int i);
+int ags_density_update_kernel_length(int i, int iter, MyFloat *Left, MyFloat *Right, MyFloat *AGS_Prev);
+void ags_density_finalize_kernel_length(int i, MyFloat *AGS_Prev);
+void ags_density_kernel_contribution(int j, double dp[3], double r2, double hinv, double hinv3, double hinv4, MyFloat vel[3], MyDouble pos[3],
+                                     MyLongDouble *ngb, MyLongDouble *dhsmlngb, MyLongDouble *zeta, MyLongDouble *vsig_max, MyLongDouble *divvel, MyLongDouble nv_t[3][3]);
+#ifdef ADAPTIVE_GRAVSOFT_FUSED_DENSITY
+void density_and_ags_density(void);
+#endif
 double ags_return_maxsoft(int i);
 double ags_return_minsoft(int i);
 void AGSForce_calc(void);
@@ -886,6 +946,12 @@ void dm_fuzzy_reconstruct_and_slopelimit(double *u_R, double du_R[3], double *u_
 #ifdef SINGLE_STAR_TIMESTEPPING
 void kepler_timestep(int i, double dt, double kick_dv[3], double drift_dx[3], int mode);
 void odeint_super_timestep(int i, double dt_super, double kick_dv[3], double drift_dx[3], int mode);
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+int fewbody_subsystem_is_decoupled(int i);
+void fewbody_pair_subsystems(void);
+void fewbody_composite_kinematics(int no, double dx, double dy, double dz, double dvx, double dvy, double dvz, double r2, double *r2soft, double *vSqr, double *M_total);
+void fewbody_internal_step(int i, double dt, double kick_dv[3], double drift_dx[3], int mode);
+#endif
 double gravfac(double r, double mass);
 double gravfac2(double r, double mass);
 void grav_accel_jerk(double mass, double dx[3], double dv[3], double accel[3], double jerk[3]);
@@ -333,33 +333,27 @@ int rt_get_lum_band_stellarpopulation(int i, int mode, double *lum)
 
 #if defined(RT_OPTICAL_NIR) /* Optical-NIR approximate spectra for stars as used in the FIRE (Hopkins et al.) models */
     SET_ACTIVE_RT_CHECK();
-    double f_op=0; if(star_age <= 0.0025) {f_op=0.09;} else {
-        if(star_age <= 0.006) {f_op=0.09*(1+((star_age-0.0025)/0.004)*((star_age-0.0025)/0.004));} else {f_op=1-0.8410937/(1+sqrt((star_age-0.006)/0.3));}}
+    double f_op = stellar_population_quantity(SSP_OPTICAL_FRACTION, star_age);
     lum[RT_FREQ_BIN_OPTICAL_NIR] = f_op * evaluate_light_to_mass_ratio(star_age, i) * m_sol / UNIT_LUM_IN_SOLAR;
 #endif
 
 #if defined(RT_NUV) /* Near-UV approximate spectra (UV/optical spectra, sub-photo-electric, but high-opacity) for stars as used in the FIRE (Hopkins et al.) models */
     SET_ACTIVE_RT_CHECK();
 #if !defined(RT_OPTICAL_NIR)
-    double f_op=0; if(star_age <= 0.0025) {f_op=0.09;} else {
-        if(star_age <= 0.006) {f_op=0.09*(1+((star_age-0.0025)/0.004)*((star_age-0.0025)/0.004));} else {f_op=1-0.8410937/(1+sqrt((star_age-0.006)/0.3));}}
+    double f_op = stellar_population_quantity(SSP_OPTICAL_FRACTION, star_age);
 #endif
     lum[RT_FREQ_BIN_NUV] = (1-f_op) * evaluate_light_to_mass_ratio(star_age, i) * m_sol / UNIT_LUM_IN_SOLAR;
 #endif
 
 #if defined(RT_PHOTOELECTRIC) /* photo-electric bands (8-13.6 eV, specifically): below is from integrating the spectra from STARBURST99 with the Geneva40 solar-metallicity + lower tracks */
     SET_ACTIVE_RT_CHECK();
-    double l_band_pe, x_age_pe = star_age / 3.4e-3; // converts to code units, and defines age relative to convenient break time
-    if(x_age_pe <= 1) {l_band_pe = 1.07e36 * (1.+x_age_pe*x_age_pe) * m_sol / UNIT_LUM_IN_CGS;}
-        else {l_band_pe = 2.14e36 / (x_age_pe * sqrt(x_age_pe)) * m_sol / UNIT_LUM_IN_CGS;} // 0.1 solar, with nebular. very weak metallicity dependence, with slightly slower decay in time for lower-metallicity pops; effect smaller than binaries
+    double l_band_pe = stellar_population_quantity(SSP_PHOTOELECTRIC_LUM_PER_MASS, star_age) * m_sol / UNIT_LUM_IN_CGS; // 0.1 solar, with nebular. very weak metallicity dependence, with slightly slower decay in time for lower-metallicity pops; effect smaller than binaries
     lum[RT_FREQ_BIN_PHOTOELECTRIC] = l_band_pe; // band luminosity //
 #endif
     
 #if defined(RT_LYMAN_WERNER)  /* lyman-werner bands (11.2-13.6 eV, specifically): below is from integrating the spectra from STARBURST99 with the Geneva40 solar-metallicity + lower tracks */
     SET_ACTIVE_RT_CHECK();
-    double l_band_lw, x_age_lw = star_age / 3.4e-3; // converts to code units, and defines age relative to convenient break time
-    if(x_age_lw <= 1) {l_band_lw = 0.429e36 * (1.+x_age_lw*x_age_lw) * m_sol / UNIT_LUM_IN_CGS;}
-        else {l_band_lw = 0.962e36 * pow(x_age_lw,-1.6) * exp(-x_age_lw/117.6) * m_sol / UNIT_LUM_IN_CGS;} // 0.1 solar, with nebular. very weak metallicity dependence, with slightly slower decay in time for lower-metallicity pops; effect smaller than binaries
+    double l_band_lw = stellar_population_quantity(SSP_LYMAN_WERNER_LUM_PER_MASS, star_age) * m_sol / UNIT_LUM_IN_CGS; // 0.1 solar, with nebular. very weak metallicity dependence, with slightly slower decay in time for lower-metallicity pops; effect smaller than binaries
     lum[RT_FREQ_BIN_LYMAN_WERNER] = l_band_lw; // band luminosity //
 #endif
 
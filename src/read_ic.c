@@ -442,7 +442,7 @@ void empty_read_buffer(enum iofields blocknr, int offset, int pc, int type)
             break;
 
         case IO_CHIMES_ABUNDANCES:
-#if defined(CHIMES) && !defined(CHIMES_INITIALISE_IN_EQM)
+#if defined(CHIMES) && (!defined(CHIMES_INITIALISE_IN_EQM) || defined(IO_SNAPSHOT_WARMSTART)) /* with CHIMES_INITIALISE_IN_EQM, only read for warm restarts */
             for (n = 0; n < pc; n++)
             {
     	        allocate_gas_abundances_memory(&(ChimesGasVars[offset + n]), &ChimesGlobalVars);
@@ -557,6 +557,18 @@ void empty_read_buffer(enum iofields blocknr, int offset, int pc, int type)
                 }
             break;
 
+        case IO_WARMSTART_HSML:
+#ifdef IO_SNAPSHOT_WARMSTART
+            for(n = 0; n < pc; n++) {PPP[offset + n].Hsml = *fp++;}
+#endif
+            break;
+
+        case IO_WARMSTART_OLDACC:
+#ifdef IO_SNAPSHOT_WARMSTART
+            for(n = 0; n < pc; n++) {P[offset + n].OldAcc = *fp++;}
+#endif
+            break;
+
         /* the other input fields (if present) are not needed to define the
              initial conditions of the code */
 
@@ -941,6 +953,14 @@ void read_file(char *fname, int readTask, int lastTask)
             if(RestartFlag == 2 && blocknr == IO_MOLECULARFRACTION) {continue;}
 #endif
 
+#ifdef IO_SNAPSHOT_WARMSTART /* the derived state is only read if the snapshot's manifest lists it */
+            if(blocknr == IO_WARMSTART_HSML && !(header.flag_warmstart & WARMSTART_HSML)) {continue;}
+            if(blocknr == IO_WARMSTART_OLDACC && !(header.flag_warmstart & WARMSTART_OLDACC)) {continue;}
+#ifdef CHIMES_INITIALISE_IN_EQM
+            if(blocknr == IO_CHIMES_ABUNDANCES && (RestartFlag != 2 || !(header.flag_warmstart & WARMSTART_CHIMES))) {continue;}
+#endif
+#endif
+
             
             if(blocknr == IO_HSMS) {continue;}
 
@@ -1344,6 +1364,16 @@ void read_header_attributes_in_hdf5(char *fname)
         H5Aclose(hdf5_attribute);
     }
 #endif
+
+    header.flag_warmstart = 0;
+#ifdef IO_SNAPSHOT_WARMSTART
+    if(RestartFlag==2 && H5Aexists(hdf5_headergrp, "Flag_WarmStart") > 0)
+    {
+        hdf5_attribute = H5Aopen_name(hdf5_headergrp, "Flag_WarmStart");
+        H5Aread(hdf5_attribute, H5T_NATIVE_INT, &header.flag_warmstart);
+        H5Aclose(hdf5_attribute);
+    }
+#endif
     
     H5Gclose(hdf5_headergrp);
     H5Fclose(hdf5_file);
@@ -57,6 +57,10 @@ void restart(int modus)
 #ifdef CHIMES 
     int partIndex, abunIndex; 
 #endif 
+
+#ifdef OUTPUT_LIGHTCONE
+    if(modus == 0) {lightcone_flush(1);} /* buffered lightcone crossings are not part of the restart files, so write them out now */
+#endif
     
     if(ThisTask == 0 && modus == 0) // writing re-start files: move old files to .bak
     {
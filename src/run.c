@@ -50,6 +50,10 @@ void run(void)
     {
         compute_statistics();	/* regular statistics outputs (like total energy) */
 
+#ifdef OUTPUT_INSITU_MAPS
+        insitu_maps_output();	/* projected images and slices at the requested interval (on coarse steps only) */
+#endif
+
         write_cpu_log();		/* output some CPU usage log-info (accounts for everything needed up to the current sync-point) */
 
         if((All.Ti_Current >= TIMEBASE) || (All.Time > All.TimeMax)) /* check whether we reached the final time */
@@ -374,18 +378,34 @@ void find_next_sync_point_and_drift(void)
     }
 
   MPI_Allreduce(&ti_next_kick, &ti_next_kick_global, 1, MPI_TYPE_TIME, MPI_MIN, MPI_COMM_WORLD);
+#ifdef OUTPUT_LIGHTCONE
+  lightcone_prepare_step(ti_next_kick_global); /* before any element is drifted towards the new sync-point */
+#endif
 
-  while(ti_next_kick_global >= All.Ti_nextoutput && All.Ti_nextoutput >= 0)
+  while(1)
     {
-        All.Ti_Current = All.Ti_nextoutput;
+        integertime ti_output = All.Ti_nextoutput; /* next output: a full snapshot, or (if it comes first) one of the snapshot profiles */
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+        int k, profile = -1; for(k = 0; k < SNAPSHOT_PROFILES_MAX; k++) {if(All.SnapshotProfile[k].Ti_next >= 0 && (ti_output < 0 || All.SnapshotProfile[k].Ti_next < ti_output)) {ti_output = All.SnapshotProfile[k].Ti_next; profile = k;}}
+#endif
+        if(!(ti_next_kick_global >= ti_output && ti_output >= 0)) {break;}
+        All.Ti_Current = ti_output;
 
         if(All.ComovingIntegrationOn) {All.Time = All.TimeBegin * exp(All.Ti_Current * All.Timebase_interval);}
             else {All.Time = All.TimeBegin + All.Ti_Current * All.Timebase_interval;}
 
         set_cosmo_factors_for_current_time();
 
-        move_particles(All.Ti_nextoutput);
+        move_particles(ti_output);
         MPI_Barrier(MPI_COMM_WORLD); CPU_Step[CPU_DRIFT] += measure_time();
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+        if(profile >= 0)
+        {
+            savepositions_profile(profile); /* partial snapshot: only the selected types, fields, and region/IDs */
+            All.SnapshotProfile[profile].Ti_next = find_next_snapshot_profile_outputtime(profile, ti_output + 1);
+            continue;
+        }
+#endif
 
 #ifdef OUTPUT_POTENTIAL
 #if !defined(EVALPOTENTIAL) || (defined(EVALPOTENTIAL) && defined(OUTPUT_RECOMPUTE_POTENTIAL))
@@ -614,6 +634,44 @@ integertime find_next_outputtime(integertime ti_curr)
 
 
 
+#ifdef OUTPUT_SNAPSHOT_PROFILES
+/*! next output time (on the integer timeline, at or after ti_curr) of snapshot profile k, or -1 if there is none. outputs are spaced
+    linearly in time (multiplicatively in scale factor for cosmological runs), like the regular snapshots */
+integertime find_next_snapshot_profile_outputtime(int k, integertime ti_curr)
+{
+    double time = All.SnapshotProfile[k].TimeFirst, dt = All.SnapshotProfile[k].TimeBetween; int iter;
+    if((All.ComovingIntegrationOn && dt <= 1) || (!All.ComovingIntegrationOn && dt <= 0)) {return -1;} /* profile is disabled */
+    for(iter = 0; iter < 1000000 && time <= All.TimeMax; iter++)
+    {
+        if(time >= All.TimeBegin)
+        {
+            integertime ti;
+            if(All.ComovingIntegrationOn) {ti = (integertime) (log(time / All.TimeBegin) / All.Timebase_interval);}
+                else {ti = (integertime) ((time - All.TimeBegin) / All.Timebase_interval);}
+            if(ti >= ti_curr) {return ti;}
+        }
+        if(All.ComovingIntegrationOn) {time *= dt;} else {time += dt;}
+    }
+    return -1;
+}
+
+/*! number of outputs of snapshot profile k scheduled before the start time: on a restart from a snapshot (RestartFlag=2) the numbering
+    continues from there, so the profiles the earlier run wrote before the restart time are kept and the later ones are overwritten */
+int snapshot_profile_restart_count(int k)
+{
+    double time = All.SnapshotProfile[k].TimeFirst, dt = All.SnapshotProfile[k].TimeBetween; int count = 0;
+    if((All.ComovingIntegrationOn && dt <= 1) || (!All.ComovingIntegrationOn && dt <= 0)) {return 0;} /* profile is disabled */
+    while(count < 1000000 && time < All.TimeBegin && time <= All.TimeMax)
+    {
+        count++;
+        if(All.ComovingIntegrationOn) {time *= dt;} else {time += dt;}
+    }
+    return count;
+}
+#endif
+
+
+
 /*! This routine writes for every synchronisation point in the timeline information to two log-files:
  * In FdInfo, we just list the timesteps that have been done, while in
  * FdTimebins we inform about the distribution of particles over the timebins, and which timebins are active on this step.
@@ -776,6 +834,9 @@ void write_cpu_log(void)
     }
 
     CPUThisRun += CPU_Step[0];
+#ifdef DOMAIN_LOADBALANCE_FEEDBACK
+    domain_feedback_record_step_time(); /* accumulate this task's compute time for the measured-cost correction of the next domain decomposition */
+#endif
 
     for(i = 0; i < CPU_PARTS; i++) {CPU_Step[i] = 0;}
     if(ThisTask == 0)
@@ -0,0 +1,380 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../allvars.h"
+#include "../proto.h"
+#include "../kernel.h"
+
+/*! \file insitu_maps.c
+ *  \brief on-the-fly projected images and slices, for monitoring runs without writing full snapshots
+ */
+
+/*
+ * This file contains the in-situ imaging enabled with OUTPUT_INSITU_MAPS. At a user-specified interval (checked on coarse,
+ *  fully-synchronized steps only), every task deposits its own elements onto a set of 2D images of a square region:
+ *  gas is smoothed with the line-of-sight-integrated kernel at its Hsml (projections) or the 3D kernel evaluated in the
+ *  image plane (slices), while stars and dark matter are deposited with a simple cloud-in-cell assignment. The deposit is
+ *  threaded with OpenMP (atomic adds into the shared per-task images), the images are summed onto the root task with a
+ *  single reduction, and written as one small (optionally compressed) HDF5 file per output. Since no particle data is
+ *  communicated, the cost is a single pass over the local elements plus one reduction of the images.
+ */
+
+#ifdef OUTPUT_INSITU_MAPS
+
+#if (NUMDIMS==1)
+#error OUTPUT_INSITU_MAPS requires NUMDIMS >= 2
+#endif
+
+#define INSITU_COLUMN_TABLE 256 /* number of bins in (R/h)^2 used to tabulate the line-of-sight-integrated kernel */
+
+/* the image fields: the bit (1<<field) in InSituMapFields switches the corresponding image on */
+enum insitu_map_field {MAP_GAS_SIGMA, MAP_GAS_TEMP, MAP_GAS_Z, MAP_STAR_SIGMA, MAP_DM_SIGMA, MAP_GAS_SLICE_RHO, MAP_GAS_SLICE_TEMP, MAP_NFIELDS};
+static const char *InSituMap_Name[MAP_NFIELDS] = {"GasSurfaceDensity", "GasTemperature", "GasMetallicity", "StellarSurfaceDensity",
+    "DarkMatterSurfaceDensity", "GasDensitySlice", "GasTemperatureSlice"};
+
+static void insitu_maps_write(double *map, int *slot, int Npix, int axis, double *center, double width);
+static double insitu_column_kernel[INSITU_COLUMN_TABLE + 1]; /* column kernel (in units with h=1) as a function of (R/h)^2 */
+static int insitu_column_kernel_initialized = 0;
+
+
+/*! tabulate the kernel integrated along the line-of-sight, so the projected deposit is consistent with the kernel used in the hydro */
+static void insitu_maps_init_column_kernel(void)
+{
+    int k, j, nz = 128; double wk, dwk;
+    for(k = 0; k <= INSITU_COLUMN_TABLE; k++)
+    {
+        double q2 = (double)k / INSITU_COLUMN_TABLE, sum = 0;
+#if (NUMDIMS==3)
+        double zmax = sqrt(DMAX(1. - q2, 0)), dz = zmax / nz;
+        for(j = 0; j < nz; j++) {double z = (j + 0.5) * dz; kernel_main(sqrt(q2 + z*z), 1, 1, &wk, &dwk, -1); sum += 2. * wk * dz;} /* midpoint rule, symmetric in z */
+#else
+        kernel_main(sqrt(q2), 1, 1, &wk, &dwk, -1); sum = wk; j = nz; /* in 2D the kernel is already a surface density */
+#endif
+        insitu_column_kernel[k] = sum;
+    }
+    insitu_column_kernel[INSITU_COLUMN_TABLE] = 0;
+    insitu_column_kernel_initialized = 1;
+}
+
+static inline double insitu_column_kernel_eval(double q2)
+{
+    if(q2 >= 1) {return 0;}
+    double x = q2 * INSITU_COLUMN_TABLE; int k = (int)x; x -= k;
+    return (1. - x) * insitu_column_kernel[k] + x * insitu_column_kernel[k + 1];
+}
+
+
+/*! gas temperature in K, from the internal energy (cheap estimate: uses the tracked electron fraction if available, otherwise assumes fully-ionized gas) */
+static double insitu_maps_gas_temperature(int i)
+{
+#if defined(COOLING) && !defined(CHIMES)
+    double mu = 4. / (1. + 3.*HYDROGEN_MASSFRAC + 4.*HYDROGEN_MASSFRAC * SphP[i].Ne);
+#else
+    double mu = 4. / (8. - 5. * (1. - HYDROGEN_MASSFRAC));
+#endif
+    return mu * (GAMMA(i) - 1.) * U_TO_TEMP_UNITS * SphP[i].InternalEnergyPred;
+}
+
+
+/*! deposit all local elements onto the (per-task) images, reduce onto the root task, and write the output file. collective: must be called by all tasks */
+void insitu_maps_output(void)
+{
+    if(All.HighestActiveTimeBin != All.HighestOccupiedTimeBin) {return;} /* only image on coarse steps, where all elements are synchronized */
+    if((All.Time - All.TimeLastInSituMap) < All.TimeBetInSituMaps) {return;}
+    All.TimeLastInSituMap = All.Time;
+
+    CPU_Step[CPU_MISC] += measure_time();
+    double t0 = my_second();
+    if(!insitu_column_kernel_initialized) {insitu_maps_init_column_kernel();}
+
+    int i, k, f, nfields = 0, slot[MAP_NFIELDS], Npix = All.InSituMapPixels, ax = All.InSituMapAxis, i0 = (ax + 1) % 3, i1 = (ax + 2) % 3;
+    if(Npix < 1 || ax < 0 || ax > 2) {if(ThisTask == 0) {printf("InSituMapPixels=%d and InSituMapAxis=%d must be >=1 and in [0,2]\n", Npix, ax);} endrun(1);}
+#if (NUMDIMS==2)
+    ax = 2; i0 = 0; i1 = 1; /* only the projection along z is meaningful */
+#endif
+    int fields = All.InSituMapFields;
+#ifndef METALS
+    fields &= ~(1 << MAP_GAS_Z);
+#endif
+    if(fields & (1 << MAP_GAS_SLICE_RHO)) {if(fields & (1 << MAP_GAS_TEMP)) {fields |= (1 << MAP_GAS_SLICE_TEMP);}} else {fields &= ~(1 << MAP_GAS_SLICE_TEMP);}
+    int need_gas_mass = (fields & ((1 << MAP_GAS_SIGMA) | (1 << MAP_GAS_TEMP) | (1 << MAP_GAS_Z))) ? 1 : 0; /* weighted fields are normalized by the projected gas mass */
+    if(need_gas_mass) {fields |= (1 << MAP_GAS_SIGMA);}
+    for(f = 0; f < MAP_NFIELDS; f++) {slot[f] = (fields & (1 << f)) ? nfields++ : -1;}
+    if(nfields == 0) {return;}
+
+    /* determine the imaged region: either the user-specified cube, or (if InSituMapWidth<=0) the box or the global extent of the particles */
+    double center[3], width = All.InSituMapWidth;
+    for(k = 0; k < 3; k++) {center[k] = All.InSituMapCenter[k];}
+    if(width <= 0)
+    {
+#ifdef BOX_PERIODIC
+        double boxlen[3] = {boxSize_X, boxSize_Y, boxSize_Z};
+        for(k = 0; k < 3; k++) {center[k] = 0.5 * boxlen[k];}
+        width = DMAX(boxlen[i0], boxlen[i1]);
+#else
+        double xmin[3], xmax[3], xmin_all[3], xmax_all[3];
+        for(k = 0; k < 3; k++) {xmin[k] = MAX_REAL_NUMBER; xmax[k] = -MAX_REAL_NUMBER;}
+        for(i = 0; i < NumPart; i++) {for(k = 0; k < 3; k++) {xmin[k] = DMIN(xmin[k], P[i].Pos[k]); xmax[k] = DMAX(xmax[k], P[i].Pos[k]);}}
+        MPI_Allreduce(xmin, xmin_all, 3, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(xmax, xmax_all, 3, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        for(k = 0; k < 3; k++) {center[k] = 0.5 * (xmin_all[k] + xmax_all[k]);}
+        width = DMAX(xmax_all[i0] - xmin_all[i0], xmax_all[i1] - xmin_all[i1]);
+        if(width <= 0) {width = 1;}
+#endif
+    }
+    double pix = width / Npix, pixinv = 1. / pix, half = 0.5 * width;
+    size_t npix2 = (size_t)Npix * (size_t)Npix;
+
+    double *map = (double *) mymalloc("insitu_map", nfields * npix2 * sizeof(double));
+    memset(map, 0, nfields * npix2 * sizeof(double));
+
+    /* deposit the local elements. images are indexed as map[slot*Npix^2 + ix*Npix + iy], with ix along axis i0 and iy along i1 */
+#ifdef _OPENMP
+#pragma omp parallel for private(i, k) schedule(dynamic, 256)
+#endif
+    for(i = 0; i < NumPart; i++)
+    {
+        if(P[i].Mass <= 0) {continue;}
+        double dp[3]; for(k = 0; k < 3; k++) {dp[k] = P[i].Pos[k] - center[k];}
+        NEAREST_XYZ(dp[0], dp[1], dp[2], 1);
+        double x = dp[i0] + half, y = dp[i1] + half, z = dp[ax];
+        int type = P[i].Type;
+
+        if(type == 0)
+        {
+            if(!need_gas_mass && slot[MAP_GAS_SLICE_RHO] < 0) {continue;}
+            double h = DMAX(PPP[i].Hsml, pix), hinv, hinv2, hinv3, hinv4, wk, dwk, m = P[i].Mass, T = 0, Z = 0;
+            kernel_hinv(h, &hinv, &hinv3, &hinv4); hinv2 = hinv * hinv;
+            int do_proj = (need_gas_mass && fabs(z) <= half), do_slice = (slot[MAP_GAS_SLICE_RHO] >= 0 && fabs(z) < h);
+            if(!do_proj && !do_slice) {continue;}
+            int ix0 = (int)floor((x - h) * pixinv), ix1 = (int)floor((x + h) * pixinv), iy0 = (int)floor((y - h) * pixinv), iy1 = (int)floor((y + h) * pixinv), ix, iy;
+            if(ix1 < 0 || iy1 < 0 || ix0 >= Npix || iy0 >= Npix) {continue;}
+            if(slot[MAP_GAS_TEMP] >= 0) {T = insitu_maps_gas_temperature(i);}
+#ifdef METALS
+            Z = P[i].Metallicity[0];
+#endif
+            /* normalization of the projected weights: for footprints of only a few pixels, sum the sampled kernel directly so mass is conserved exactly */
+            double wnorm = pix * pix * hinv2;
+            if(do_proj && (ix1 - ix0) < 8 && (iy1 - iy0) < 8)
+            {
+                double wsum = 0;
+                for(ix = ix0; ix <= ix1; ix++) {for(iy = iy0; iy <= iy1; iy++) {
+                    double dx = (ix + 0.5) * pix - x, dy = (iy + 0.5) * pix - y;
+                    wsum += insitu_column_kernel_eval((dx*dx + dy*dy) * hinv2);}}
+                if(wsum > 0) {wnorm = 1. / wsum;}
+            }
+            if(ix0 < 0) {ix0 = 0;}
+            if(iy0 < 0) {iy0 = 0;}
+            if(ix1 >= Npix) {ix1 = Npix - 1;}
+            if(iy1 >= Npix) {iy1 = Npix - 1;}
+            for(ix = ix0; ix <= ix1; ix++)
+            {
+                for(iy = iy0; iy <= iy1; iy++)
+                {
+                    double dx = (ix + 0.5) * pix - x, dy = (iy + 0.5) * pix - y, r2 = (dx*dx + dy*dy) * hinv2;
+                    if(r2 >= 1) {continue;}
+                    size_t n = (size_t)ix * Npix + iy;
+                    if(do_proj)
+                    {
+                        double w = m * wnorm * insitu_column_kernel_eval(r2);
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                        map[slot[MAP_GAS_SIGMA] * npix2 + n] += w;
+                        if(slot[MAP_GAS_TEMP] >= 0)
+                        {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                            map[slot[MAP_GAS_TEMP] * npix2 + n] += w * T;
+                        }
+                        if(slot[MAP_GAS_Z] >= 0)
+                        {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                            map[slot[MAP_GAS_Z] * npix2 + n] += w * Z;
+                        }
+                    }
+                    if(do_slice)
+                    {
+                        double u2 = r2 + z * z * hinv2;
+                        if(u2 >= 1) {continue;}
+                        kernel_main(sqrt(u2), hinv3, hinv4, &wk, &dwk, -1);
+                        double rho = m * wk;
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                        map[slot[MAP_GAS_SLICE_RHO] * npix2 + n] += rho;
+                        if(slot[MAP_GAS_SLICE_TEMP] >= 0)
+                        {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                            map[slot[MAP_GAS_SLICE_TEMP] * npix2 + n] += rho * T;
+                        }
+                    }
+                }
+            }
+            continue;
+        }
+
+        /* collisionless elements: cloud-in-cell deposit of the projected mass */
+        int s = -1;
+        if(type == 4) {s = slot[MAP_STAR_SIGMA];}
+        if(type == 1) {s = slot[MAP_DM_SIGMA];}
+        if(type == 2 || type == 3) {s = All.ComovingIntegrationOn ? slot[MAP_DM_SIGMA] : slot[MAP_STAR_SIGMA];} /* low-res DM in cosmological runs, pre-existing disk/bulge stars otherwise */
+        if(s < 0 || fabs(z) > half) {continue;}
+        double fx = x * pixinv - 0.5, fy = y * pixinv - 0.5;
+        int jx = (int)floor(fx), jy = (int)floor(fy), a, b; fx -= jx; fy -= jy;
+        for(a = 0; a < 2; a++)
+        {
+            for(b = 0; b < 2; b++)
+            {
+                int ix = jx + a, iy = jy + b;
+                if(ix < 0 || iy < 0 || ix >= Npix || iy >= Npix) {continue;}
+                double w = P[i].Mass * (a ? fx : 1. - fx) * (b ? fy : 1. - fy);
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                map[s * npix2 + (size_t)ix * Npix + iy] += w;
+            }
+        }
+    }
+
+    /* sum the images onto the root task (in chunks, so the count stays within the range of an int) */
+    size_t ntot = nfields * npix2, chunk = 1 << 26, off;
+    for(off = 0; off < ntot; off += chunk)
+    {
+        int count = (int)((ntot - off < chunk) ? (ntot - off) : chunk);
+        if(ThisTask == 0) {MPI_Reduce(MPI_IN_PLACE, map + off, count, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);}
+            else {MPI_Reduce(map + off, NULL, count, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);}
+    }
+
+    if(ThisTask == 0)
+    {
+        size_t n;
+        /* convert the weighted sums to mass-(or density-)weighted averages, and the projected masses to surface densities */
+        for(n = 0; n < npix2; n++)
+        {
+            double mgas = (slot[MAP_GAS_SIGMA] >= 0) ? map[slot[MAP_GAS_SIGMA] * npix2 + n] : 0, rho = (slot[MAP_GAS_SLICE_RHO] >= 0) ? map[slot[MAP_GAS_SLICE_RHO] * npix2 + n] : 0;
+            if(slot[MAP_GAS_TEMP] >= 0) {map[slot[MAP_GAS_TEMP] * npix2 + n] /= DMAX(mgas, MIN_REAL_NUMBER);}
+            if(slot[MAP_GAS_Z] >= 0) {map[slot[MAP_GAS_Z] * npix2 + n] /= DMAX(mgas, MIN_REAL_NUMBER);}
+            if(slot[MAP_GAS_SLICE_TEMP] >= 0) {map[slot[MAP_GAS_SLICE_TEMP] * npix2 + n] /= DMAX(rho, MIN_REAL_NUMBER);}
+            if(slot[MAP_GAS_SIGMA] >= 0) {map[slot[MAP_GAS_SIGMA] * npix2 + n] *= pixinv * pixinv;}
+            if(slot[MAP_STAR_SIGMA] >= 0) {map[slot[MAP_STAR_SIGMA] * npix2 + n] *= pixinv * pixinv;}
+            if(slot[MAP_DM_SIGMA] >= 0) {map[slot[MAP_DM_SIGMA] * npix2 + n] *= pixinv * pixinv;}
+        }
+        insitu_maps_write(map, slot, Npix, ax, center, width);
+    }
+    myfree(map);
+
+    double t1 = my_second();
+    PRINT_STATUS(" ..wrote in-situ map #%d (%d images of %d^2 pixels) in %g sec", All.InSituMapFileCount, nfields, Npix, timediff(t0, t1));
+    All.InSituMapFileCount++;
+    CPU_Step[CPU_SNAPSHOT] += measure_time();
+}
+
+
+/*! write the finished images (root task only) */
+static void insitu_maps_write(double *map, int *slot, int Npix, int axis, double *center, double width)
+{
+    char buf[1000]; int f; size_t n, npix2 = (size_t)Npix * (size_t)Npix;
+    float *image = (float *) mymalloc("insitu_image", npix2 * sizeof(float));
+    sprintf(buf, "%sinsitu_maps", All.OutputDir); mkdir(buf, 02755);
+#ifdef HAVE_HDF5
+    sprintf(buf, "%sinsitu_maps/map_%04d.hdf5", All.OutputDir, All.InSituMapFileCount);
+    hid_t file = H5Fcreate(buf, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT), space, attr, dset;
+    if(file < 0) {printf("error in opening file '%s'\n", buf); endrun(1);}
+    /* header attributes: enough to place the images in physical units */
+    double attr_d[4] = {All.Time, width, All.HubbleParam, All.UnitLength_in_cm}; int attr_i[2] = {Npix, axis};
+    const char *attr_d_name[4] = {"Time", "Width", "HubbleParam", "UnitLength_In_CGS"}, *attr_i_name[2] = {"NumPixels", "ProjectionAxis"};
+    space = H5Screate(H5S_SCALAR);
+    for(f = 0; f < 4; f++) {attr = H5Acreate(file, attr_d_name[f], H5T_NATIVE_DOUBLE, space, H5P_DEFAULT); H5Awrite(attr, H5T_NATIVE_DOUBLE, &attr_d[f]); H5Aclose(attr);}
+    for(f = 0; f < 2; f++) {attr = H5Acreate(file, attr_i_name[f], H5T_NATIVE_INT, space, H5P_DEFAULT); H5Awrite(attr, H5T_NATIVE_INT, &attr_i[f]); H5Aclose(attr);}
+    H5Sclose(space);
+    hsize_t adims[1] = {3}; space = H5Screate_simple(1, adims, NULL);
+    attr = H5Acreate(file, "Center", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT); H5Awrite(attr, H5T_NATIVE_DOUBLE, center); H5Aclose(attr);
+    H5Sclose(space);
+
+    hsize_t dims[2] = {(hsize_t)Npix, (hsize_t)Npix};
+    for(f = 0; f < MAP_NFIELDS; f++)
+    {
+        if(slot[f] < 0) {continue;}
+        for(n = 0; n < npix2; n++) {image[n] = (float) map[slot[f] * npix2 + n];}
+        space = H5Screate_simple(2, dims, NULL);
+#ifndef IO_COMPRESS_HDF5
+        dset = H5Dcreate(file, InSituMap_Name[f], H5T_NATIVE_FLOAT, space, H5P_DEFAULT);
+#else
+        hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+        hsize_t cdims[2]; cdims[0] = (hsize_t) DMAX(Npix / 8, 1); cdims[1] = (hsize_t) Npix;
+        H5Pset_chunk(plist_id, 2, cdims); H5Pset_deflate(plist_id, 4);
+        dset = H5Dcreate2(file, InSituMap_Name[f], H5T_NATIVE_FLOAT, space, H5P_DEFAULT, plist_id, H5P_DEFAULT);
+        H5Pclose(plist_id);
+#endif
+        H5Dwrite(dset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, image);
+        H5Dclose(dset); H5Sclose(space);
+    }
+    H5Fclose(file);
+#else
+    /* plain binary: header, then for each image a 32-character name followed by the Npix^2 floats */
+    sprintf(buf, "%sinsitu_maps/map_%04d.bin", All.OutputDir, All.InSituMapFileCount);
+    FILE *fd = fopen(buf, "w");
+    if(!fd) {printf("error in opening file '%s'\n", buf); endrun(1);}
+    int nfields = 0; for(f = 0; f < MAP_NFIELDS; f++) {if(slot[f] >= 0) {nfields++;}}
+    fwrite(&Npix, sizeof(int), 1, fd); fwrite(&axis, sizeof(int), 1, fd); fwrite(&nfields, sizeof(int), 1, fd);
+    fwrite(&All.Time, sizeof(double), 1, fd); fwrite(center, sizeof(double), 3, fd); fwrite(&width, sizeof(double), 1, fd);
+    for(f = 0; f < MAP_NFIELDS; f++)
+    {
+        if(slot[f] < 0) {continue;}
+        char name[32]; memset(name, 0, 32); strncpy(name, InSituMap_Name[f], 31);
+        for(n = 0; n < npix2; n++) {image[n] = (float) map[slot[f] * npix2 + n];}
+        fwrite(name, 1, 32, fd); fwrite(image, sizeof(float), npix2, fd);
+    }
+    fclose(fd);
+#endif
+    myfree(image);
+}
+
+
+/*! read the time stored in an existing map file: returns 0 on success, nonzero if the file does not exist or cannot be read */
+static int insitu_maps_read_time(int num, double *time)
+{
+    char buf[1000]; FILE *fd;
+#ifdef HAVE_HDF5
+    sprintf(buf, "%sinsitu_maps/map_%04d.hdf5", All.OutputDir, num);
+    if(!(fd = fopen(buf, "r"))) {return 1;}
+    fclose(fd);
+    hid_t file = H5Fopen(buf, H5F_ACC_RDONLY, H5P_DEFAULT); if(file < 0) {return 1;}
+    hid_t attr = H5Aopen_name(file, "Time"); herr_t status = -1;
+    if(attr >= 0) {status = H5Aread(attr, H5T_NATIVE_DOUBLE, time); H5Aclose(attr);}
+    H5Fclose(file);
+    return (status < 0);
+#else
+    int header[3]; size_t nread;
+    sprintf(buf, "%sinsitu_maps/map_%04d.bin", All.OutputDir, num);
+    if(!(fd = fopen(buf, "r"))) {return 1;}
+    nread = fread(header, sizeof(int), 3, fd); nread += fread(time, sizeof(double), 1, fd);
+    fclose(fd);
+    return (nread != 4);
+#endif
+}
+
+
+/*! on a restart from a snapshot (RestartFlag=2), continue the map numbering after the maps the earlier run wrote before the restart time:
+    maps it wrote at or after that time are superseded (overwritten), the same way the snapshots after the restart snapshot are. collective */
+void insitu_maps_restart_count(void)
+{
+    int count = 0; double time;
+    if(ThisTask == 0) {while(insitu_maps_read_time(count, &time) == 0 && time < All.TimeBegin) {count++;}}
+    MPI_Bcast(&count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    All.InSituMapFileCount = count;
+    if(ThisTask == 0 && count > 0) {printf("in-situ maps: continuing after the %d maps written before the restart time\n", count);}
+}
+
+#endif
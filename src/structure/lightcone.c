@@ -0,0 +1,341 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../allvars.h"
+#include "../proto.h"
+
+/*! \file lightcone.c
+ *  \brief on-the-fly lightcone output: records elements as they cross the past lightcone of one or more observers
+ */
+
+/*
+ * This file contains the lightcone output enabled with OUTPUT_LIGHTCONE. The check is done inside drift_particle: every drift
+ *  moves an element from (x0,a0) to (x1,a1), during which the past lightcone of an observer at a=1 shrinks from comoving radius
+ *  chi(a0) to chi(a1). If the distance to the observer (of the element or, in periodic boxes, of one of its replicas) changes from
+ *  inside to outside the lightcone, the crossing point is found by linear interpolation of both in the drift, and the element is
+ *  appended to a per-task buffer. Since consecutive drifts of an element are contiguous, every crossing is found exactly once, at
+ *  the resolution of the element's own drifts. Drifts inside the threaded tree-walks are already serialized (they hold the
+ *  partnodedrift lock), so a single buffer per task suffices. The buffer is written out, independently by each task (no collective
+ *  operations, so tasks never wait on each other), once it exceeds LIGHTCONE_CHUNK records, and whenever a restart file is written.
+ *  The replicas of the box which can intersect the lightcone shell swept during the current step are collected once per step, ordered
+ *  by their distance to the observer, so each drift only loops over the replicas which can intersect the (thinner) shell swept by that
+ *  drift. The total number of replicas is capped at LIGHTCONE_MAX_REPLICAS, which bounds both the memory and the per-drift cost: deep
+ *  lightcones in small boxes need a lower LightconeMaxRedshift.
+ */
+
+#ifdef OUTPUT_LIGHTCONE
+
+#define LIGHTCONE_TABLE 4096              /* number of bins in log(a) used to tabulate the comoving distance chi(a) */
+#define LIGHTCONE_MAX_OBSERVERS 16        /* maximum number of observers */
+#define LIGHTCONE_CHUNK (1 << 18)         /* write the buffer out once it holds this many records */
+#ifndef LIGHTCONE_MAX_REPLICAS
+#define LIGHTCONE_MAX_REPLICAS (1 << 17)  /* maximum number of (observer, box replica) pairs within LightconeMaxRedshift */
+#endif
+
+struct lightcone_record
+{
+    MyIDType ID;
+    double Pos[3];
+    float Vel[3], Mass, Time;
+    short Type, Observer;
+};
+
+struct lightcone_replica
+{
+    double Offset[3];                    /* offset of the replica (multiple of the box size) minus the observer position */
+    double DistMin, DistMax;             /* min/max distance of the points of the replica box to the observer */
+    int Observer;
+};
+
+static double Lightcone_Chi[LIGHTCONE_TABLE + 1], Lightcone_LogaMin, Lightcone_dLoga, Lightcone_ChiMax;
+static double Lightcone_ObserverPos[LIGHTCONE_MAX_OBSERVERS][3];
+static int Lightcone_NObservers;
+static struct lightcone_replica *Lightcone_Replica, *Lightcone_ActiveReplica;
+static long Lightcone_NReplica, Lightcone_NActiveReplica;
+static double Lightcone_ReplicaDiag; /* largest DistMax-DistMin of any replica */
+static integertime Lightcone_Ti_ActiveBeg, Lightcone_Ti_ActiveEnd;
+static struct lightcone_record *Lightcone_Buffer;
+static long long Lightcone_NBuffer, Lightcone_MaxBuffer;
+
+
+/*! comoving distance to an observer at a=1 of the lightcone at log(a), interpolated from the table */
+static inline double lightcone_chi(double loga)
+{
+    double x = (loga - Lightcone_LogaMin) / Lightcone_dLoga; int k;
+    if(x <= 0) {return Lightcone_Chi[0];}
+    if(x >= LIGHTCONE_TABLE) {return 0;}
+    k = (int)x; x -= k;
+    return (1. - x) * Lightcone_Chi[k] + x * Lightcone_Chi[k + 1];
+}
+
+static inline double lightcone_loga_of_ti(integertime ti) {return log(All.TimeBegin) + ti * All.Timebase_interval;}
+
+static int lightcone_compare_replica(const void *a, const void *b)
+{
+    if(((struct lightcone_replica *) a)->DistMin < ((struct lightcone_replica *) b)->DistMin) {return -1;}
+    if(((struct lightcone_replica *) a)->DistMin > ((struct lightcone_replica *) b)->DistMin) {return +1;}
+    return 0;
+}
+
+/*! index of the first of the n replicas (sorted by DistMin) with DistMin >= dist */
+static inline long lightcone_first_replica(struct lightcone_replica *rep, long n, double dist)
+{
+    long lo = 0, hi = n;
+    while(lo < hi) {long mid = (lo + hi) / 2; if(rep[mid].DistMin < dist) {lo = mid + 1;} else {hi = mid;}}
+    return lo;
+}
+
+
+static void lightcone_too_many_replicas(void)
+{
+    if(ThisTask == 0) {printf("Lightcone: out to LightconeMaxRedshift=%g (comoving distance %g) the lightcone covers more than LIGHTCONE_MAX_REPLICAS=%d replicas of the box: lower LightconeMaxRedshift\n", All.LightconeMaxRedshift, Lightcone_ChiMax, LIGHTCONE_MAX_REPLICAS);}
+    endrun(6715);
+}
+
+
+/*! tabulate chi(a), read the observer list, and build the list of replicas of the box which can intersect the lightcone */
+void lightcone_init(void)
+{
+    int k, j, m; long n_rep;
+    if(!All.ComovingIntegrationOn) {if(ThisTask == 0) {printf("OUTPUT_LIGHTCONE requires ComovingIntegrationOn=1\n");} endrun(6712);}
+    if(All.TimeBegin >= 1) {if(ThisTask == 0) {printf("OUTPUT_LIGHTCONE requires TimeBegin < 1 (observers are at a=1)\n");} endrun(6713);}
+
+    /* chi(a) = c * int_a^1 da' / (a'^2 H(a')) = c * int_{log a}^0 dlog(a') / (a' H(a')), integrated with the trapezoidal rule from a=1 downwards */
+    Lightcone_LogaMin = log(All.TimeBegin); Lightcone_dLoga = -Lightcone_LogaMin / LIGHTCONE_TABLE;
+    Lightcone_Chi[LIGHTCONE_TABLE] = 0;
+    for(k = LIGHTCONE_TABLE - 1; k >= 0; k--)
+    {
+        double a_lo = exp(Lightcone_LogaMin + k * Lightcone_dLoga), a_hi = exp(Lightcone_LogaMin + (k + 1) * Lightcone_dLoga);
+        Lightcone_Chi[k] = Lightcone_Chi[k + 1] + 0.5 * C_LIGHT_CODE * Lightcone_dLoga * (1. / (a_lo * hubble_function(a_lo)) + 1. / (a_hi * hubble_function(a_hi)));
+    }
+    double a_min = DMAX(All.TimeBegin, 1. / (1. + All.LightconeMaxRedshift));
+    Lightcone_ChiMax = lightcone_chi(log(a_min));
+
+    /* observers: read from file (one 'x y z' per line) on the root task, defaulting to a single observer at the box center */
+    if(ThisTask == 0)
+    {
+        FILE *fd; Lightcone_NObservers = 0;
+        if(strcmp(All.LightconeObserverFile, "none") != 0 && (fd = fopen(All.LightconeObserverFile, "r")))
+        {
+            while(Lightcone_NObservers < LIGHTCONE_MAX_OBSERVERS && fscanf(fd, "%lg %lg %lg", &Lightcone_ObserverPos[Lightcone_NObservers][0],
+                  &Lightcone_ObserverPos[Lightcone_NObservers][1], &Lightcone_ObserverPos[Lightcone_NObservers][2]) == 3) {Lightcone_NObservers++;}
+            fclose(fd);
+        }
+        if(Lightcone_NObservers == 0)
+        {
+            Lightcone_NObservers = 1;
+#ifdef BOX_PERIODIC
+            Lightcone_ObserverPos[0][0] = 0.5 * boxSize_X; Lightcone_ObserverPos[0][1] = 0.5 * boxSize_Y; Lightcone_ObserverPos[0][2] = 0.5 * boxSize_Z;
+#else
+            Lightcone_ObserverPos[0][0] = Lightcone_ObserverPos[0][1] = Lightcone_ObserverPos[0][2] = 0;
+#endif
+        }
+        printf("Lightcone: %d observer(s), out to comoving distance %g (z=%g)\n", Lightcone_NObservers, Lightcone_ChiMax, 1./a_min - 1.);
+    }
+    MPI_Bcast(&Lightcone_NObservers, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&Lightcone_ObserverPos[0][0], 3 * LIGHTCONE_MAX_OBSERVERS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    /* replicas: in a periodic box, every image of the box within Lightcone_ChiMax of an observer; otherwise just the box itself */
+    double boxlen[3] = {0, 0, 0}, nrep_d[3] = {0, 0, 0}; long nrep[3] = {0, 0, 0};
+#ifdef BOX_PERIODIC
+    boxlen[0] = boxSize_X; boxlen[1] = boxSize_Y; boxlen[2] = boxSize_Z;
+#if !(defined(BOX_REFLECT_X) || defined(BOX_OUTFLOW_X))
+    nrep_d[0] = ceil(Lightcone_ChiMax / boxlen[0]) + 1;
+#endif
+#if !(defined(BOX_REFLECT_Y) || defined(BOX_OUTFLOW_Y))
+    nrep_d[1] = ceil(Lightcone_ChiMax / boxlen[1]) + 1;
+#endif
+#if !(defined(BOX_REFLECT_Z) || defined(BOX_OUTFLOW_Z))
+    nrep_d[2] = ceil(Lightcone_ChiMax / boxlen[2]) + 1;
+#endif
+#endif
+    /* at the size where this triggers, the sphere fills over a quarter of the cube of candidates: reject before looping over it */
+    double ncube = Lightcone_NObservers * (2*nrep_d[0]+1) * (2*nrep_d[1]+1) * (2*nrep_d[2]+1);
+    if(ncube > 4. * LIGHTCONE_MAX_REPLICAS) {lightcone_too_many_replicas();}
+    for(j = 0; j < 3; j++) {nrep[j] = (long) nrep_d[j];}
+    Lightcone_Replica = (struct lightcone_replica *) malloc(LIGHTCONE_MAX_REPLICAS * sizeof(struct lightcone_replica));
+    if(!Lightcone_Replica) {printf("Task %d: failed to allocate the lightcone replica list\n", ThisTask); endrun(6716);}
+    for(m = 0, n_rep = 0; m < Lightcone_NObservers; m++)
+    {
+        long n[3];
+        for(n[0] = -nrep[0]; n[0] <= nrep[0]; n[0]++) {for(n[1] = -nrep[1]; n[1] <= nrep[1]; n[1]++) {for(n[2] = -nrep[2]; n[2] <= nrep[2]; n[2]++)
+        {
+            struct lightcone_replica r_new, *r = &r_new; double dmin2 = 0, dmax2 = 0;
+            for(j = 0; j < 3; j++)
+            {
+                r->Offset[j] = n[j] * boxlen[j] - Lightcone_ObserverPos[m][j]; /* element position + Offset = position relative to the observer */
+#ifdef BOX_PERIODIC
+                double lo = r->Offset[j], hi = r->Offset[j] + boxlen[j];
+#else
+                double lo = -MAX_REAL_NUMBER, hi = MAX_REAL_NUMBER; /* non-periodic: no bound on the extent */
+#endif
+                if(lo > 0) {dmin2 += lo*lo;} else if(hi < 0) {dmin2 += hi*hi;}
+                dmax2 += DMAX(lo*lo, hi*hi);
+            }
+            r->DistMin = sqrt(dmin2); r->DistMax = sqrt(dmax2); r->Observer = m;
+            if(r->DistMin > Lightcone_ChiMax) {continue;}
+            if(n_rep >= LIGHTCONE_MAX_REPLICAS) {lightcone_too_many_replicas();}
+            Lightcone_Replica[n_rep++] = r_new;
+        }}}
+    }
+    Lightcone_NReplica = n_rep;
+    Lightcone_Replica = (struct lightcone_replica *) realloc(Lightcone_Replica, Lightcone_NReplica * sizeof(struct lightcone_replica));
+    Lightcone_ActiveReplica = (struct lightcone_replica *) malloc(Lightcone_NReplica * sizeof(struct lightcone_replica));
+    if(!Lightcone_Replica || !Lightcone_ActiveReplica) {printf("Task %d: failed to allocate the lightcone replica list\n", ThisTask); endrun(6716);}
+    qsort(Lightcone_Replica, Lightcone_NReplica, sizeof(struct lightcone_replica), lightcone_compare_replica); /* so the list of active replicas is sorted too */
+    for(n_rep = 0, Lightcone_ReplicaDiag = 0; n_rep < Lightcone_NReplica; n_rep++) {Lightcone_ReplicaDiag = DMAX(Lightcone_ReplicaDiag, Lightcone_Replica[n_rep].DistMax - Lightcone_Replica[n_rep].DistMin);}
+    if(ThisTask == 0) {printf("Lightcone: %ld replicas of the box (over all observers) intersect the lightcone\n", Lightcone_NReplica);}
+    Lightcone_NActiveReplica = 0; Lightcone_Ti_ActiveBeg = Lightcone_Ti_ActiveEnd = -1;
+
+    Lightcone_MaxBuffer = LIGHTCONE_CHUNK; Lightcone_NBuffer = 0;
+    Lightcone_Buffer = (struct lightcone_record *) malloc(Lightcone_MaxBuffer * sizeof(struct lightcone_record));
+    if(!Lightcone_Buffer) {printf("Task %d: failed to allocate the lightcone buffer\n", ThisTask); endrun(6714);}
+    if(ThisTask == 0) {char buf[1000]; sprintf(buf, "%slightcone", All.OutputDir); mkdir(buf, 02755);}
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+
+/*! called at each sync-point, once the end of the next step is known (before any element is drifted to it): writes the buffer if it
+    is large, and collects the replicas which can intersect the shell swept by the lightcone over the longest step that can still be drifted */
+void lightcone_prepare_step(integertime ti_next)
+{
+    long k;
+    if(Lightcone_NBuffer >= LIGHTCONE_CHUNK) {lightcone_flush(0);}
+    integertime ti_beg = ti_next - (((integertime) 1) << All.HighestOccupiedTimeBin); if(ti_beg < 0) {ti_beg = 0;}
+    double chi_hi = lightcone_chi(lightcone_loga_of_ti(ti_beg)), chi_lo = lightcone_chi(lightcone_loga_of_ti(ti_next));
+    for(k = 0, Lightcone_NActiveReplica = 0; k < Lightcone_NReplica; k++)
+    {
+        if(Lightcone_Replica[k].DistMin > DMIN(chi_hi, Lightcone_ChiMax) || Lightcone_Replica[k].DistMax < chi_lo) {continue;}
+        Lightcone_ActiveReplica[Lightcone_NActiveReplica++] = Lightcone_Replica[k];
+    }
+    Lightcone_Ti_ActiveBeg = ti_beg; Lightcone_Ti_ActiveEnd = ti_next;
+}
+
+
+/*! check whether element i, drifted from x0 (at time0) to its current position (at time1), crossed the lightcone of any observer */
+void lightcone_check_crossing(int i, double *x0, integertime time0, integertime time1)
+{
+    if(P[i].Mass <= 0 || !((1 << P[i].Type) & All.LightconeTypes)) {return;}
+    double loga0 = lightcone_loga_of_ti(time0), loga1 = lightcone_loga_of_ti(time1), chi0 = lightcone_chi(loga0), chi1 = lightcone_chi(loga1);
+    if(chi1 >= Lightcone_ChiMax) {return;} /* the lightcone has not yet reached back to this drift */
+
+    struct lightcone_replica *rep = Lightcone_ActiveReplica; long nrep = Lightcone_NActiveReplica, k, k_end; int j;
+    if(time0 < Lightcone_Ti_ActiveBeg || time1 > Lightcone_Ti_ActiveEnd) {rep = Lightcone_Replica; nrep = Lightcone_NReplica;} /* outside the prepared step: check every replica */
+
+    double xa[3], dx[3], disp2 = 0;
+#ifdef BOX_PERIODIC
+    double boxlen[3] = {boxSize_X, boxSize_Y, boxSize_Z};
+#endif
+    for(j = 0; j < 3; j++)
+    {
+        dx[j] = P[i].Pos[j] - x0[j]; disp2 += dx[j]*dx[j]; xa[j] = x0[j];
+#ifdef BOX_PERIODIC
+        while(xa[j] >= boxlen[j]) {xa[j] -= boxlen[j];} /* elements are not box-wrapped until the next domain decomposition */
+        while(xa[j] < 0) {xa[j] += boxlen[j];}
+#endif
+    }
+    double disp = sqrt(disp2);
+
+    /* only replicas with DistMin < chi0+disp and DistMax >= chi1-disp can be crossed in this drift: a contiguous range of the sorted list */
+    k_end = lightcone_first_replica(rep, nrep, chi0 + disp);
+    for(k = lightcone_first_replica(rep, nrep, chi1 - disp - Lightcone_ReplicaDiag); k < k_end; k++)
+    {
+        if(rep[k].DistMin - disp > chi0 || rep[k].DistMax + disp < chi1) {continue;}
+        double r0 = 0, r1 = 0;
+        for(j = 0; j < 3; j++) {double p0 = xa[j] + rep[k].Offset[j], p1 = p0 + dx[j]; r0 += p0*p0; r1 += p1*p1;}
+        double f0 = sqrt(r0) - chi0, f1 = sqrt(r1) - chi1;
+        if(!(f0 < 0 && f1 >= 0)) {continue;} /* crossing: the element goes from inside to outside the (shrinking) lightcone */
+        double s = f0 / (f0 - f1), loga = loga0 + s * (loga1 - loga0), a = exp(loga);
+        if(lightcone_chi(loga) > Lightcone_ChiMax) {continue;}
+
+        if(Lightcone_NBuffer >= Lightcone_MaxBuffer) /* grow the buffer: only possible if many crossings occur within one step */
+        {
+            Lightcone_MaxBuffer *= 2;
+            Lightcone_Buffer = (struct lightcone_record *) realloc(Lightcone_Buffer, Lightcone_MaxBuffer * sizeof(struct lightcone_record));
+            if(!Lightcone_Buffer) {printf("Task %d: failed to grow the lightcone buffer to %lld records\n", ThisTask, Lightcone_MaxBuffer); endrun(6714);}
+        }
+        struct lightcone_record *rec = &Lightcone_Buffer[Lightcone_NBuffer++];
+        rec->ID = P[i].ID; rec->Type = P[i].Type; rec->Observer = rep[k].Observer; rec->Mass = P[i].Mass; rec->Time = a;
+        for(j = 0; j < 3; j++)
+        {
+            rec->Pos[j] = xa[j] + s * dx[j] + rep[k].Offset[j] + Lightcone_ObserverPos[rep[k].Observer][j]; /* comoving position in the replicated volume */
+            rec->Vel[j] = P[i].Vel[j] / a; /* peculiar velocity */
+        }
+    }
+}
+
+
+/*! write the buffered crossings of this task to their own file (no communication). 'mode'=1 marks the flush when a restart file is written */
+void lightcone_flush(int mode)
+{
+    if(Lightcone_NBuffer <= 0) {return;}
+    char buf[1000]; long long n, N = Lightcone_NBuffer; int j;
+    double amin = MAX_REAL_NUMBER, amax = 0;
+    for(n = 0; n < N; n++) {amin = DMIN(amin, Lightcone_Buffer[n].Time); amax = DMAX(amax, Lightcone_Buffer[n].Time);}
+#ifdef HAVE_HDF5
+    sprintf(buf, "%slightcone/lightcone_%08lld%s.%d.hdf5", All.OutputDir, (long long) All.NumCurrentTiStep, mode ? "r" : "", ThisTask);
+    hid_t file = H5Fcreate(buf, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT), space, attr, dset;
+    if(file < 0) {printf("error in opening file '%s'\n", buf); endrun(1);}
+    space = H5Screate(H5S_SCALAR);
+    attr = H5Acreate(file, "NumObservers", H5T_NATIVE_INT, space, H5P_DEFAULT); H5Awrite(attr, H5T_NATIVE_INT, &Lightcone_NObservers); H5Aclose(attr);
+    attr = H5Acreate(file, "ScaleFactorMin", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT); H5Awrite(attr, H5T_NATIVE_DOUBLE, &amin); H5Aclose(attr);
+    attr = H5Acreate(file, "ScaleFactorMax", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT); H5Awrite(attr, H5T_NATIVE_DOUBLE, &amax); H5Aclose(attr);
+    attr = H5Acreate(file, "HubbleParam", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT); H5Awrite(attr, H5T_NATIVE_DOUBLE, &All.HubbleParam); H5Aclose(attr);
+    H5Sclose(space);
+    hsize_t odims[2] = {(hsize_t)Lightcone_NObservers, 3}; space = H5Screate_simple(2, odims, NULL);
+    attr = H5Acreate(file, "ObserverPositions", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT); H5Awrite(attr, H5T_NATIVE_DOUBLE, &Lightcone_ObserverPos[0][0]); H5Aclose(attr);
+    H5Sclose(space);
+
+    /* each field is copied into a contiguous array and written as its own dataset, matching the snapshot layout */
+    void *tmp = malloc(N * 3 * sizeof(double));
+    hsize_t dims[2] = {(hsize_t)N, 3};
+#ifdef LONGIDS
+    hid_t idtype = H5T_NATIVE_UINT64;
+#else
+    hid_t idtype = H5T_NATIVE_UINT;
+#endif
+    for(n = 0; n < N; n++) {((MyIDType *)tmp)[n] = Lightcone_Buffer[n].ID;}
+    space = H5Screate_simple(1, dims, NULL); dset = H5Dcreate(file, "ParticleIDs", idtype, space, H5P_DEFAULT);
+    H5Dwrite(dset, idtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, tmp); H5Dclose(dset); H5Sclose(space);
+    for(n = 0; n < N; n++) {((int *)tmp)[n] = Lightcone_Buffer[n].Type;}
+    space = H5Screate_simple(1, dims, NULL); dset = H5Dcreate(file, "ParticleType", H5T_NATIVE_INT, space, H5P_DEFAULT);
+    H5Dwrite(dset, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, tmp); H5Dclose(dset); H5Sclose(space);
+    for(n = 0; n < N; n++) {((int *)tmp)[n] = Lightcone_Buffer[n].Observer;}
+    space = H5Screate_simple(1, dims, NULL); dset = H5Dcreate(file, "Observer", H5T_NATIVE_INT, space, H5P_DEFAULT);
+    H5Dwrite(dset, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, tmp); H5Dclose(dset); H5Sclose(space);
+    for(n = 0; n < N; n++) {((float *)tmp)[n] = Lightcone_Buffer[n].Time;}
+    space = H5Screate_simple(1, dims, NULL); dset = H5Dcreate(file, "ScaleFactor", H5T_NATIVE_FLOAT, space, H5P_DEFAULT);
+    H5Dwrite(dset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, tmp); H5Dclose(dset); H5Sclose(space);
+    for(n = 0; n < N; n++) {((float *)tmp)[n] = Lightcone_Buffer[n].Mass;}
+    space = H5Screate_simple(1, dims, NULL); dset = H5Dcreate(file, "Masses", H5T_NATIVE_FLOAT, space, H5P_DEFAULT);
+    H5Dwrite(dset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, tmp); H5Dclose(dset); H5Sclose(space);
+    for(n = 0; n < N; n++) {for(j = 0; j < 3; j++) {((double *)tmp)[3*n + j] = Lightcone_Buffer[n].Pos[j];}}
+    space = H5Screate_simple(2, dims, NULL); dset = H5Dcreate(file, "Coordinates", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT);
+    H5Dwrite(dset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, tmp); H5Dclose(dset); H5Sclose(space);
+    for(n = 0; n < N; n++) {for(j = 0; j < 3; j++) {((float *)tmp)[3*n + j] = Lightcone_Buffer[n].Vel[j];}}
+    space = H5Screate_simple(2, dims, NULL); dset = H5Dcreate(file, "Velocities", H5T_NATIVE_FLOAT, space, H5P_DEFAULT);
+    H5Dwrite(dset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, tmp); H5Dclose(dset); H5Sclose(space);
+    free(tmp);
+    H5Fclose(file);
+#else
+    /* plain binary: the number of records followed by the raw records */
+    sprintf(buf, "%slightcone/lightcone_%08lld%s.%d", All.OutputDir, (long long) All.NumCurrentTiStep, mode ? "r" : "", ThisTask);
+    FILE *fd = fopen(buf, "w");
+    if(!fd) {printf("error in opening file '%s'\n", buf); endrun(1);}
+    fwrite(&N, sizeof(long long), 1, fd); fwrite(Lightcone_Buffer, sizeof(struct lightcone_record), N, fd);
+    fclose(fd);
+#endif
+    Lightcone_NBuffer = 0;
+    if(Lightcone_MaxBuffer > LIGHTCONE_CHUNK) /* shrink back, if the buffer had to grow */
+    {
+        Lightcone_MaxBuffer = LIGHTCONE_CHUNK;
+        Lightcone_Buffer = (struct lightcone_record *) realloc(Lightcone_Buffer, Lightcone_MaxBuffer * sizeof(struct lightcone_record));
+    }
+}
+
+#endif
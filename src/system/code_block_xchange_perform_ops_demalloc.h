@@ -1,2 +1,5 @@
 /*! just de-allocate buffers from code_block_xchange_perform_ops_malloc in reverse order they were malloc'd */
 myfree(DataNodeList); myfree(DataIndexTable); myfree(Ngblist);
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+report_particle_work_statistics(MACRO_NAME_STRINGIFY(CORE_FUNCTION_NAME)); /* write the per-particle work histograms for this loop [collective, all tasks reach this point] */
+#endif
@@ -10,6 +10,7 @@
 
 #include <mpi.h>
 #include <string.h>
+#include <limits.h>
 #include "../allvars.h"
 #include "../proto.h"
 
@@ -127,6 +128,238 @@ void mpi_distribute_items_to_tasks(void *data, int task_offset, int *n_items, in
 
 
 
+
+/* node-topology information for the point-to-point exchanges below: Task_NodeID[task] is the world-rank of the lowest task
+   sharing a physical (shared-memory) node with 'task', so two tasks are on the same node if their Task_NodeID match */
+static int *Task_NodeID = NULL, *Exchange_SendOffset, *Exchange_RecvOffset, Exchange_NRequests_Alloc = 0;
+static MPI_Request *Exchange_Requests;
+static MPI_Comm NodeComm = MPI_COMM_NULL;
+
+#ifdef MPISENDRECV_CHECKSUM_SAMPLED
+#if (MPISENDRECV_CHECKSUM_SAMPLED+0 > 0)
+#define EXCHANGE_CHECKSUM_EVERY (MPISENDRECV_CHECKSUM_SAMPLED) /* verify one in this many messages to each partner */
+#else
+#define EXCHANGE_CHECKSUM_EVERY 64 /* default if no value is given */
+#endif
+/* per-partner message counters (identical on both ends of every message, since each exchange is called collectively with
+   matching counts, so both sides agree which messages are sampled without extra communication), and checksum buffers */
+static unsigned long long *Exchange_NSent, *Exchange_NRecv, *Exchange_SendChecksum, *Exchange_RecvChecksum;
+static char *Exchange_RecvSampled;
+#endif
+
+/** Builds the node-local versus inter-node hierarchy (via MPI_Comm_split_type) used to order the point-to-point
+    exchanges, and allocates the (small, NTask-sized) request and offset arrays for them. Must be called by all tasks,
+    once, after NTask is known. */
+void mpi_init_node_topology(void)
+{
+  int node_leader = ThisTask, n_nodes = 0, j;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, ThisTask, MPI_INFO_NULL, &NodeComm);
+  MPI_Bcast(&node_leader, 1, MPI_INT, 0, NodeComm); /* rank 0 of the node communicator is the lowest world-rank on the node */
+  Task_NodeID = (int *) malloc(NTask * sizeof(int));
+  Exchange_SendOffset = (int *) malloc(NTask * sizeof(int));
+  Exchange_RecvOffset = (int *) malloc(NTask * sizeof(int));
+  Exchange_NRequests_Alloc = 4 * NTask; /* data + (sampled) checksum messages in both directions; grown if messages are split */
+  Exchange_Requests = (MPI_Request *) malloc(Exchange_NRequests_Alloc * sizeof(MPI_Request));
+#ifdef MPISENDRECV_CHECKSUM_SAMPLED
+  Exchange_NSent = (unsigned long long *) calloc(NTask, sizeof(unsigned long long));
+  Exchange_NRecv = (unsigned long long *) calloc(NTask, sizeof(unsigned long long));
+  Exchange_SendChecksum = (unsigned long long *) malloc(NTask * sizeof(unsigned long long));
+  Exchange_RecvChecksum = (unsigned long long *) malloc(NTask * sizeof(unsigned long long));
+  Exchange_RecvSampled = (char *) calloc(NTask, sizeof(char));
+#endif
+  MPI_Allgather(&node_leader, 1, MPI_INT, Task_NodeID, 1, MPI_INT, MPI_COMM_WORLD);
+  for(j = 0; j < NTask; j++) {if(Task_NodeID[j] == j) {n_nodes++;}}
+  if(ThisTask == 0) {printf("MPI node topology: %d tasks on %d shared-memory nodes\n", NTask, n_nodes);}
+}
+
+/** returns the world-rank of the lowest task on the same shared-memory node as 'task' (so tasks on a common node share this id) */
+int mpi_task_node_leader(int task) {return Task_NodeID ? Task_NodeID[task] : task;}
+
+
+/** Fletcher-style 64-bit checksum (word-wise, so it runs at memory bandwidth, and position-dependent, so it also catches
+    re-ordered or shifted data, which a plain byte-sum does not) of a buffer of 'nbytes' bytes */
+unsigned long long mpi_buffer_checksum(void *buf, size_t nbytes)
+{
+  unsigned long long s1 = 0, s2 = 0, w; size_t i, nwords = nbytes / sizeof(unsigned long long); unsigned char *c = (unsigned char *) buf;
+  for(i = 0; i < nwords; i++) {memcpy(&w, c + i * sizeof(unsigned long long), sizeof(unsigned long long)); s1 += w; s2 += s1;}
+  for(i = nwords * sizeof(unsigned long long); i < nbytes; i++) {s1 += c[i]; s2 += s1;}
+  return s1 ^ (s2 << 1) ^ ((unsigned long long) nbytes << 48);
+}
+
+
+/** Returns the next free slot of Exchange_Requests (and counts it in n_requests), growing the array if it is full */
+static MPI_Request *mpi_exchange_next_request(int *n_requests)
+{
+  if(*n_requests >= Exchange_NRequests_Alloc)
+    {Exchange_NRequests_Alloc *= 2; Exchange_Requests = (MPI_Request *) realloc(Exchange_Requests, Exchange_NRequests_Alloc * sizeof(MPI_Request));}
+  return &Exchange_Requests[(*n_requests)++];
+}
+
+
+/** Posts a non-blocking send (is_send=1) or receive (is_send=0) of n_items elements of item_size bytes each, appending
+    the request(s) to Exchange_Requests. Messages that would exceed 2^31-1 bytes are described with a contiguous derived
+    datatype of one element (so the MPI 'count' stays small) instead of being split into sequential rounds; with
+    MPISENDRECV_SIZELIMIT set, messages are still split into pieces below that limit, but the pieces are all posted at once. */
+static void mpi_post_exchange_message(int is_send, char *buf, size_t n_items, size_t item_size, MPI_Datatype *item_type, int task, int tag, int *n_requests)
+{
+  size_t n_items_piece = n_items, offset = 0;
+#ifdef MPISENDRECV_SIZELIMIT
+  n_items_piece = (((size_t) MPISENDRECV_SIZELIMIT) * 1024 * 1024) / item_size; if(n_items_piece < 1) {n_items_piece = 1;}
+#endif
+  while(offset < n_items)
+    {
+      size_t n_now = (n_items - offset < n_items_piece) ? (n_items - offset) : n_items_piece, nbytes = n_now * item_size;
+      MPI_Datatype type = MPI_BYTE; int count = (int) nbytes;
+      if(nbytes > (size_t) INT_MAX)
+        {
+          if(*item_type == MPI_DATATYPE_NULL) {MPI_Type_contiguous((int) item_size, MPI_BYTE, item_type); MPI_Type_commit(item_type);}
+          type = *item_type; count = (int) n_now; /* counts are ints already, so n_now always fits */
+        }
+      if(is_send) {MPI_Isend(buf + offset * item_size, count, type, task, tag, MPI_COMM_WORLD, mpi_exchange_next_request(n_requests));}
+        else {MPI_Irecv(buf + offset * item_size, count, type, task, tag, MPI_COMM_WORLD, mpi_exchange_next_request(n_requests));}
+      offset += n_now;
+    }
+}
+
+
+/** Exchanges variable-length blocks between this task and every partner recvTask = ThisTask ^ ngrp, for
+    ngrp_min <= ngrp < ngrp_max (the same partner set as the hypercube loops it replaces, so memory-limited sub-chunking
+    works unchanged). Only partners with a non-zero send or receive count are touched, and all messages are posted at once
+    instead of in 2^PTask sequential rounds: partners on the same node are posted first, so they can complete over shared
+    memory while the inter-node messages are in flight. Counts and offsets are in units of item_size bytes; if send_offset
+    (or recv_offset) is NULL, that buffer is taken to be packed contiguously in ngrp-order, as the import buffers of the
+    neighbor loops are. Messages larger than 2GB are handled directly (see mpi_post_exchange_message). With
+    MPISENDRECV_CHECKSUM_SAMPLED, one in every N messages to each partner carries a checksum, sent alongside the data (so no
+    extra round-trip is added) and verified by the receiver once the exchange completes. */
+void mpi_exchange_with_partners(void *sendbuf, int *send_count, int *send_offset, void *recvbuf, int *recv_count, int *recv_offset,
+                                size_t item_size, int ngrp_min, int ngrp_max, int tag)
+{
+  int ngrp, recvTask, off_send = 0, off_recv = 0;
+  for(ngrp = ngrp_min; ngrp < ngrp_max; ngrp++) /* offsets follow the hypercube order, so the buffer layout is unchanged */
+    {
+      recvTask = ThisTask ^ ngrp;
+      if(recvTask >= NTask) {continue;}
+      Exchange_SendOffset[recvTask] = send_offset ? send_offset[recvTask] : off_send; off_send += send_count[recvTask];
+      Exchange_RecvOffset[recvTask] = recv_offset ? recv_offset[recvTask] : off_recv; off_recv += recv_count[recvTask];
+    }
+
+#if !defined(NO_ISEND_IRECV_IN_EXCHANGES) && !defined(MPISENDRECV_CHECKSUM)
+  int pass, n_requests = 0; MPI_Datatype item_type = MPI_DATATYPE_NULL;
+  for(pass = 0; pass < 2; pass++) /* pass 0: partners on our own node, pass 1: all others */
+    {
+      for(ngrp = ngrp_min; ngrp < ngrp_max; ngrp++)
+        {
+          recvTask = ThisTask ^ ngrp;
+          if(recvTask >= NTask) {continue;}
+          if((Task_NodeID[recvTask] == Task_NodeID[ThisTask]) != (pass == 0)) {continue;}
+          if(recv_count[recvTask] > 0)
+            {
+              mpi_post_exchange_message(0, (char *) recvbuf + item_size * Exchange_RecvOffset[recvTask], recv_count[recvTask], item_size, &item_type, recvTask, tag, &n_requests);
+#ifdef MPISENDRECV_CHECKSUM_SAMPLED
+              Exchange_RecvSampled[recvTask] = ((Exchange_NRecv[recvTask]++ % EXCHANGE_CHECKSUM_EVERY) == 0);
+              if(Exchange_RecvSampled[recvTask]) {MPI_Irecv(&Exchange_RecvChecksum[recvTask], 1, MPI_UNSIGNED_LONG_LONG, recvTask, TAG_EXCHANGE_CHECKSUM, MPI_COMM_WORLD, mpi_exchange_next_request(&n_requests));}
+#endif
+            }
+          if(send_count[recvTask] > 0)
+            {
+              mpi_post_exchange_message(1, (char *) sendbuf + item_size * Exchange_SendOffset[recvTask], send_count[recvTask], item_size, &item_type, recvTask, tag, &n_requests);
+#ifdef MPISENDRECV_CHECKSUM_SAMPLED
+              if((Exchange_NSent[recvTask]++ % EXCHANGE_CHECKSUM_EVERY) == 0)
+                {
+                  Exchange_SendChecksum[recvTask] = mpi_buffer_checksum((char *) sendbuf + item_size * Exchange_SendOffset[recvTask], item_size * send_count[recvTask]);
+                  MPI_Isend(&Exchange_SendChecksum[recvTask], 1, MPI_UNSIGNED_LONG_LONG, recvTask, TAG_EXCHANGE_CHECKSUM, MPI_COMM_WORLD, mpi_exchange_next_request(&n_requests));
+                }
+#endif
+            }
+        }
+    }
+  MPI_Waitall(n_requests, Exchange_Requests, MPI_STATUSES_IGNORE);
+  if(item_type != MPI_DATATYPE_NULL) {MPI_Type_free(&item_type);}
+#ifdef MPISENDRECV_CHECKSUM_SAMPLED
+  for(ngrp = ngrp_min; ngrp < ngrp_max; ngrp++)
+    {
+      recvTask = ThisTask ^ ngrp;
+      if(recvTask >= NTask) {continue;}
+      if(recv_count[recvTask] > 0 && Exchange_RecvSampled[recvTask])
+        {
+          unsigned long long checksum = mpi_buffer_checksum((char *) recvbuf + item_size * Exchange_RecvOffset[recvTask], item_size * recv_count[recvTask]);
+          if(checksum != Exchange_RecvChecksum[recvTask])
+            {
+              printf("Task=%d: checksum mismatch for message %llu (%d items of %d bytes, tag=%d) received from task=%d: %llx != %llx\n", ThisTask,
+                     Exchange_NRecv[recvTask] - 1, recv_count[recvTask], (int) item_size, tag, recvTask, checksum, Exchange_RecvChecksum[recvTask]);
+              fflush(stdout); endrun(1234);
+            }
+        }
+    }
+#endif
+#else
+  for(ngrp = ngrp_min; ngrp < ngrp_max; ngrp++) /* blocking pairwise version (needed for the full Sendrecv-checksum wrapper) */
+    {
+      recvTask = ThisTask ^ ngrp;
+      if(recvTask >= NTask) {continue;}
+      if(send_count[recvTask] > 0 || recv_count[recvTask] > 0)
+        {
+          MPI_Sendrecv((char *) sendbuf + item_size * Exchange_SendOffset[recvTask], send_count[recvTask] * item_size, MPI_BYTE, recvTask, tag,
+                       (char *) recvbuf + item_size * Exchange_RecvOffset[recvTask], recv_count[recvTask] * item_size, MPI_BYTE, recvTask, tag,
+                       MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+    }
+#endif
+}
+
+
+
+#ifndef SPARSE_COUNTS_MIN_NTASK
+#define SPARSE_COUNTS_MIN_NTASK 64 /* below this many tasks, a plain MPI_Alltoall of the counts is always cheap enough */
+#endif
+#define SPARSE_COUNTS_DENSE_FRACTION 8 /* use the dense MPI_Alltoall if any task has more than NTask/8 non-zero partners */
+
+/** Replacement for MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT, MPI_COMM_WORLD), for the common case where
+    each task only sends to a few others. Uses the non-blocking consensus ('NBX') protocol: every task sends its non-zero
+    counts with synchronous sends, receives whatever arrives, and enters a non-blocking barrier once all its own sends have
+    been matched; when the barrier completes, all messages have been delivered. The cost is then set by the number of actual
+    partners (plus a log(NTask) barrier), instead of by NTask. If the pattern is dense on any task, or NTask is small, this
+    falls back to MPI_Alltoall. Must be called by all tasks. */
+void mpi_sparse_alltoall_counts(int *send_count, int *recv_count)
+{
+  int j, n_partners = 0, n_partners_max = NTask;
+#ifndef NO_SPARSE_COUNT_EXCHANGE
+  for(j = 0; j < NTask; j++) {if(j != ThisTask && send_count[j] != 0) {n_partners++;}}
+  /* all tasks must agree on which of the two paths to take */
+  if(NTask >= SPARSE_COUNTS_MIN_NTASK) {MPI_Allreduce(&n_partners, &n_partners_max, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);}
+#endif
+  if(NTask < SPARSE_COUNTS_MIN_NTASK || SPARSE_COUNTS_DENSE_FRACTION * n_partners_max > NTask)
+    {
+      MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT, MPI_COMM_WORLD);
+      return;
+    }
+
+  /* back-to-back calls can overlap (a task leaves once the barrier completes, while others are still draining theirs), so
+     each call uses its own tag: the calls are collective, so all tasks step through the same sequence of tags */
+  static int tag_epoch = 0; int tag = TAG_SPARSE_COUNTS + tag_epoch; tag_epoch = (tag_epoch + 1) % SPARSE_COUNTS_TAG_EPOCHS;
+  int n_requests = 0, flag, sends_done, barrier_active = 0, all_done = 0; MPI_Request barrier_request; MPI_Status status;
+  for(j = 0; j < NTask; j++) {recv_count[j] = 0;}
+  recv_count[ThisTask] = send_count[ThisTask];
+  for(j = 0; j < NTask; j++)
+    {
+      if(j != ThisTask && send_count[j] != 0)
+        {MPI_Issend(&send_count[j], 1, MPI_INT, j, tag, MPI_COMM_WORLD, mpi_exchange_next_request(&n_requests));}
+    }
+  while(!all_done)
+    {
+      MPI_Iprobe(MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, &flag, &status);
+      if(flag) {MPI_Recv(&recv_count[status.MPI_SOURCE], 1, MPI_INT, status.MPI_SOURCE, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);}
+      if(barrier_active) {MPI_Test(&barrier_request, &all_done, MPI_STATUS_IGNORE);}
+      else
+        {
+          MPI_Testall(n_requests, Exchange_Requests, &sends_done, MPI_STATUSES_IGNORE);
+          if(sends_done) {MPI_Ibarrier(MPI_COMM_WORLD, &barrier_request); barrier_active = 1;}
+        }
+    }
+}
+
+
+
 #ifdef MPISENDRECV_CHECKSUM
 
 #undef MPI_Sendrecv
@@ -424,36 +657,28 @@ int MPI_Sizelimited_Sendrecv(void *sendbuf, int sendcount, MPI_Datatype sendtype
     }
     
     count_limit = (int) ((((long long) MPISENDRECV_SIZELIMIT) * 1024 * 1024) / size_sendtype);
-    
-    while(sendcount > 0 || recvcount > 0)
+    if(count_limit < 1) {count_limit = 1;}
+    if(sendcount > count_limit) {printf("imposing size limit on MPI_Sendrecv() on task=%d (send of size=%lld)\n", ThisTask, (long long) sendcount * size_sendtype);}
+    
+    /* post all the pieces at once (rather than one blocking round-trip per piece), so splitting costs no extra latency */
+    int n_pieces = (sendcount + count_limit - 1) / count_limit + (recvcount + count_limit - 1) / count_limit, n_requests = 0, last_recv = -1;
+    MPI_Request *requests = (MPI_Request *) malloc((n_pieces + 1) * sizeof(MPI_Request));
+    MPI_Status *statuses = (MPI_Status *) malloc((n_pieces + 1) * sizeof(MPI_Status));
+    for(iter = 0; iter < recvcount; iter += recv_now)
     {
-        if(sendcount > count_limit)
-        {
-            send_now = count_limit;
-            if(iter == 0)
-            {
-                printf("imposing size limit on MPI_Sendrecv() on task=%d (send of size=%d)\n", ThisTask, sendcount * size_sendtype);
-                //fflush(stdout);
-            }
-            iter++;
-        }
-        else
-            send_now = sendcount;
-        
-        if(recvcount > count_limit)
-            recv_now = count_limit;
-        else
-            recv_now = recvcount;
-        
-        MPI_Sendrecv(sendbuf, send_now, sendtype, dest, sendtag,
-                     recvbuf, recv_now, recvtype, source, recvtag, comm, status);
-        
-        sendcount -= send_now;
-        recvcount -= recv_now;
-        
-        sendbuf += send_now * size_sendtype;
-        recvbuf += recv_now * size_recvtype;
+        recv_now = (recvcount - iter > count_limit) ? count_limit : (recvcount - iter);
+        last_recv = n_requests;
+        MPI_Irecv((char *) recvbuf + (size_t) iter * size_recvtype, recv_now, recvtype, source, recvtag, comm, &requests[n_requests++]);
+    }
+    for(iter = 0; iter < sendcount; iter += send_now)
+    {
+        send_now = (sendcount - iter > count_limit) ? count_limit : (sendcount - iter);
+        MPI_Isend((char *) sendbuf + (size_t) iter * size_sendtype, send_now, sendtype, dest, sendtag, comm, &requests[n_requests++]);
     }
+    MPI_Waitall(n_requests, requests, statuses);
+    if(status != MPI_STATUS_IGNORE && last_recv >= 0) {*status = statuses[last_recv];}
+    free(statuses);
+    free(requests);
     
     return 0;
 }
@@ -26,6 +26,9 @@ dz = NGB_PERIODIC_BOX_LONG_Z(P[p].Pos[0] - searchcenter[0], P[p].Pos[1] - search
 if(dz > dist) continue;
 if(dx * dx + dy * dy + dz * dz > dist * dist) continue;
 #endif
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+if(mode == 0 && target >= 0) {P[target].WorkCount[WORK_NGBVISITED]++;}
+#endif
 ngblist[numngb++] = p;  /* Note: unlike in previous versions of the code, the buffer can hold up to all particles. note also the threaded-vs-unthreaded use of n vs N in ngblist */
 }
 else
@@ -41,6 +44,35 @@ else
 #endif
         if(mode == 1) {endrun(123128);}
         
+#ifdef NGB_EXPORT_CULLING_RMAX
+        if(target >= 0)
+        {   /* pre-filter the export: re-test the remote top-level node this pseudo-particle stands for, with the mutual search radius capped at the
+                caller's maximum interaction range, so the element is not sent to a task where it cannot find an interacting neighbor */
+            int no_pseudo = no, no_top = DomainNodeIndex[no - (maxPart + maxNodes)];
+            no = Nextnode[no - maxNodes]; /* so a failed node check below ('continue') moves on to the next element of the walk */
+            current = &Nodes[no_top];
+            if(current->Ti_current != ti_Current)
+            {
+                LOCK_PARTNODEDRIFT;
+#ifdef _OPENMP
+#pragma omp critical(_partnodedrift_)
+#endif
+                force_drift_node(no_top, ti_Current);
+                UNLOCK_PARTNODEDRIFT;
+            }
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+            Ngb_Export_Culling_Count[0]++;
+            dist = DMIN(DMAX(Extnodes[no_top].hmax, hsml), NGB_EXPORT_CULLING_RMAX) + 0.5 * current->len;
+#include "ngb_codeblock_checknode.h"
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+            Ngb_Export_Culling_Count[1]++;
+            no = no_pseudo; /* passed: go on with the export below */
+        }
+#endif
         if(target >= 0)	/* if no target is given, export will not occur */
         {
             if(exportflag[task = DomainTask[no - (maxPart + maxNodes)]] != target)
@@ -77,6 +109,9 @@ else
                 DataIndexTable[nexp].Task = task;
                 DataIndexTable[nexp].Index = target;
                 DataIndexTable[nexp].IndexGet = nexp;
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+                if(mode == 0) {P[target].WorkCount[WORK_EXPORTS]++;}
+#endif
             }
 #ifndef DONOTUSENODELIST
             DataNodeList[exportindex[task]].NodeList[exportnodecount[task]++] = DomainNodeIndex[no - (maxPart + maxNodes)];
@@ -120,6 +155,9 @@ else
     {
         if(current->u.d.mass)	/* open cell */
         {
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+            if(mode == 0 && target >= 0) {P[target].WorkCount[WORK_NODESOPENED]++;}
+#endif
             no = current->u.d.nextnode;
             continue;
         }
@@ -132,6 +170,9 @@ else
 #endif
     no = current->u.d.sibling;	/* in case the node can be discarded */
 #include "ngb_codeblock_checknode.h"
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+    if(mode == 0 && target >= 0) {P[target].WorkCount[WORK_NODESOPENED]++;}
+#endif
     no = current->u.d.nextnode;	// ok, we need to open the node //
 }
 }
@@ -16,19 +16,18 @@
  * This file was originally part of the GADGET3 code by Volker Springel.
  */
 
-#define TRANSFER_SIZE_LIMIT  1000000000
-
-#define TAG_TRANSFER  100
+#define PSORT_SAMPLE_BYTES_MAX  (32*1024*1024) /* cap on the total size of the splitter samples gathered on the root task */
+#define PSORT_OVERSAMPLE_MAX    64                /* maximum number of regular samples taken per task */
+#define PSORT_MIN_PER_THREAD    4096              /* below this many elements per thread, the local sort is done by one thread */
 
 static void serial_sort(char *base, size_t nmemb, size_t size, int (*compar) (const void *, const void *));
 static void msort_serial_with_tmp(char *base, size_t n, size_t s, int (*compar) (const void *, const void *),
 				  char *t);
-static void get_local_rank(char *element,
-			   size_t tie_braking_rank,
-			   char *base,
-			   size_t nmemb, size_t size, size_t noffs_thistask,
-			   long long left, long long right,
-			   size_t * loc, int (*compar) (const void *, const void *));
+static void merge_sorted_runs(char *base, char *tmp, size_t *run_offset, int nruns, size_t recsize, int with_rank,
+			      int (*compar) (const void *, const void *));
+static int compare_with_rank(const char *a, const char *b, size_t recsize, int with_rank, int (*compar) (const void *, const void *));
+static size_t find_splitter_position(char *splitter, char *base, size_t nmemb, size_t size, size_t noffs_thistask,
+				     int (*compar) (const void *, const void *));
 
 
 
@@ -37,9 +36,16 @@ void parallel_sort(void *base, size_t nmemb, size_t size, int (*compar) (const v
   parallel_sort_comm(base, nmemb, size, compar, MPI_COMM_WORLD);
 }
 
+
+/* Parallel sample sort. Every task sorts its data locally, a set of regular samples of the sorted data is gathered on the root
+   task, which chooses the Local_NTask-1 splitters, and the data is exchanged with a single MPI_Alltoallv and merged locally
+   (the incoming pieces are already sorted). To keep the interface of the previous rank-bisection version, every task ends up
+   with exactly as many elements as it started with: since the data is then already globally ordered, this only requires
+   a second, neighbor-only, shift of the elements across the (approximate) splitter boundaries. Equal elements are ordered
+   by their rank in the initial distribution, so that many identical keys can still be split across tasks. */
 void parallel_sort_comm(void *base, size_t nmemb, size_t size, int (*compar) (const void *, const void *), MPI_Comm comm)
 {
-  int i, j, max_task, ranks_not_found, Local_ThisTask, Local_NTask, Local_PTask, Color;
+  int i, j, Local_ThisTask, Local_NTask, Color;
   MPI_Comm MPI_CommLocal;
 
   /* we create a communicator that contains just those tasks with nmemb > 0. This makes 
@@ -60,7 +66,7 @@ void parallel_sort_comm(void *base, size_t nmemb, size_t size, int (*compar) (co
 
   if(Local_NTask > 1 && Color == 1)
     {
-      for(Local_PTask = 0; Local_NTask > (1 << Local_PTask); Local_PTask++);
+      size_t recsize = size + sizeof(size_t); /* samples and splitters carry their global rank in the initial order, to break ties */
 
       size_t *nlist = (size_t *) mymalloc("nlist", Local_NTask * sizeof(size_t));
       size_t *noffs = (size_t *) mymalloc("noffs", Local_NTask * sizeof(size_t));
@@ -69,239 +75,144 @@ void parallel_sort_comm(void *base, size_t nmemb, size_t size, int (*compar) (co
 
       for(i = 1, noffs[0] = 0; i < Local_NTask; i++) noffs[i] = noffs[i - 1] + nlist[i - 1];
 
-      char *element_guess = (char *) mymalloc("element_guess", (Local_NTask - 1) * size);
-      size_t *element_tie_braking_rank = (size_t *) mymalloc("element_tie_braking_rank", (Local_NTask - 1) * sizeof(size_t));
-      size_t *desired_glob_rank = (size_t *) mymalloc("desired_glob_rank", (Local_NTask - 1) * sizeof(size_t));
-      size_t *current_glob_rank = (size_t *) mymalloc("current_glob_rank", (Local_NTask - 1) * sizeof(size_t));
-      size_t *current_loc_rank = (size_t *) mymalloc("current_loc_rank", (Local_NTask - 1) * sizeof(size_t));
-      long long *range_left = (long long *) mymalloc("range_left", (Local_NTask - 1) * sizeof(long long));
-      long long *range_right = (long long *) mymalloc("range_right", (Local_NTask - 1) * sizeof(long long));
-      int *max_loc = (int *) mymalloc("max_loc", (Local_NTask - 1) * sizeof(int));
-      size_t max_nmemb;
-
-      /* find the largest nmemb value and initialize the guesses with the median element found there */
-      for(i = 0, max_task = max_nmemb = 0; i < Local_NTask; i++)
-	if(max_nmemb < nlist[i])
-	  {
-	    max_nmemb = nlist[i];
-	    max_task = i;
-	  }
-
-      if(Local_ThisTask == max_task) memcpy(element_guess, (char *) base + size * (max_nmemb / 2), size);
-
-      MPI_Bcast(element_guess, size, MPI_BYTE, max_task, MPI_CommLocal);
+      /* take regular samples of the locally-sorted data */
+      int n_samples = PSORT_SAMPLE_BYTES_MAX / (Local_NTask * recsize);
+      if(n_samples > PSORT_OVERSAMPLE_MAX) n_samples = PSORT_OVERSAMPLE_MAX;
+      if(n_samples < 1) n_samples = 1;
+      if((size_t) n_samples > nmemb) n_samples = nmemb;
 
-      for(i = 1; i < Local_NTask - 1; i++) memcpy(element_guess + i * size, element_guess, size);
-
-      for(i = 0; i < Local_NTask - 1; i++)
+      char *samples = (char *) mymalloc("samples", n_samples * recsize);
+      for(j = 0; j < n_samples; j++)
 	{
-	  desired_glob_rank[i] = noffs[i + 1];
-	  element_tie_braking_rank[i] = (max_nmemb / 2) + noffs[max_task];
-	  max_loc[i] = max_task;
-
-	  range_left[i] = 0;	/* first element that it can be */
-	  range_right[i] = nmemb;	/* first element that it can not be */
-
-	  current_glob_rank[i] = 0;
+	  size_t k = ((2 * (size_t) j + 1) * nmemb) / (2 * (size_t) n_samples), rank = noffs[Local_ThisTask] + k;
+	  memcpy(samples + j * recsize, (char *) base + k * size, size);
+	  memcpy(samples + j * recsize + size, &rank, sizeof(size_t));
 	}
 
-      int iter = 0;
-
-      do
-	{
-	  for(i = 0; i < Local_NTask - 1; i++)
-	    {
-	      if(current_glob_rank[i] != desired_glob_rank[i])
-		{
-		  get_local_rank(element_guess + i * size, element_tie_braking_rank[i],
-				 (char *) base, nmemb, size, noffs[Local_ThisTask],
-				 range_left[i], range_right[i], &current_loc_rank[i], compar);
-		}
-	    }
-
-	  /* now compute the global ranks by summing the local ranks */
-	  size_t *list = (size_t *) mymalloc("list", Local_NTask * sizeof(size_t));
-	  for(i = 0; i < Local_NTask - 1; i++)
-	    {
-	      if(current_glob_rank[i] != desired_glob_rank[i])
-		{
-		  MPI_Allgather(&current_loc_rank[i], sizeof(size_t), MPI_BYTE, list, sizeof(size_t),
-				MPI_BYTE, MPI_CommLocal);
-
-		  for(j = 0, current_glob_rank[i] = 0; j < Local_NTask; j++)
-		    current_glob_rank[i] += list[j];
-		}
-	    }
-	  myfree(list);
-
-	  for(i = 0, ranks_not_found = 0; i < Local_NTask - 1; i++)
-	    {
-	      if(current_glob_rank[i] != desired_glob_rank[i])	/* here we're not yet done */
-		{
-		  ranks_not_found++;
-
-		  if(current_glob_rank[i] < desired_glob_rank[i])
-		    {
-		      range_left[i] = current_loc_rank[i];
-
-		      if(Local_ThisTask == max_loc[i])	// && range_right[i] == range_left[i]+1)
-			{
-			  range_left[i]++;
-			}
-		    }
-
-		  if(current_glob_rank[i] > desired_glob_rank[i])
-		    range_right[i] = current_loc_rank[i];
-		}
-	    }
-
-	  /* now we need to determine new element guesses */
-
-	  long long *range_len_list =
-	    (long long *) mymalloc("range_len_list", Local_NTask * sizeof(long long));
+      int *sample_bytes = (int *) mymalloc("sample_bytes", Local_NTask * sizeof(int));
+      int *sample_offset = (int *) mymalloc("sample_offset", Local_NTask * sizeof(int));
+      int my_sample_bytes = n_samples * recsize;
+      MPI_Allgather(&my_sample_bytes, 1, MPI_INT, sample_bytes, 1, MPI_INT, MPI_CommLocal);
+      for(i = 1, sample_offset[0] = 0; i < Local_NTask; i++) sample_offset[i] = sample_offset[i - 1] + sample_bytes[i - 1];
+      size_t n_samples_tot = (sample_offset[Local_NTask - 1] + sample_bytes[Local_NTask - 1]) / recsize;
 
-	  for(i = 0; i < Local_NTask - 1; i++)
-	    {
-	      if(current_glob_rank[i] != desired_glob_rank[i])	/* here we're not yet done */
-		{
-		  long long max_range_len, range_len = range_right[i] - range_left[i] + 1;
-		  MPI_Allgather(&range_len, sizeof(long long), MPI_BYTE, range_len_list, sizeof(long long),
-				MPI_BYTE, MPI_CommLocal);
-
-		  /* find the largest one, and the cpu that holds it */
-		  for(j = 0, max_loc[i] = max_range_len = 0; j < Local_NTask; j++)
-		    if(max_range_len < range_len_list[j])
-		      {
-			max_range_len = range_len_list[j];
-			max_loc[i] = j;
-		      }
-
-		  if(Local_ThisTask == max_loc[i])
-		    {
-		      long long mid = (range_left[i] + range_right[i]) / 2;
-
-		      memcpy(element_guess + i * size, (char *) base + mid * size, size);
-		      element_tie_braking_rank[i] = mid + noffs[Local_ThisTask];
-		    }
-
-		  MPI_Bcast(element_guess + i * size, size, MPI_BYTE, max_loc[i], MPI_CommLocal);
-		  MPI_Bcast(&element_tie_braking_rank[i], sizeof(size_t), MPI_BYTE, max_loc[i],
-			    MPI_CommLocal);
-		}
-	    }
+      char *splitters = (char *) mymalloc("splitters", (Local_NTask - 1) * recsize);
+      char *samples_all = (char *) mymalloc("samples_all", (Local_ThisTask == 0 ? n_samples_tot : 1) * recsize);
+      char *samples_tmp = (char *) mymalloc("samples_tmp", (Local_ThisTask == 0 ? n_samples_tot : 1) * recsize);
+      size_t *sample_run = (size_t *) mymalloc("sample_run", (Local_NTask + 1) * sizeof(size_t));
 
-	  myfree(range_len_list);
+      MPI_Gatherv(samples, my_sample_bytes, MPI_BYTE, samples_all, sample_bytes, sample_offset, MPI_BYTE, 0, MPI_CommLocal);
 
-	  iter++;
+      if(Local_ThisTask == 0)
+	{
+	  /* the samples of each task arrive sorted, so a merge gives the sorted list. each sample then stands for
+	     nlist[t]/n_samples(t) elements of its task t, which lets us place the splitters at the desired global ranks */
+	  for(i = 0; i <= Local_NTask; i++) sample_run[i] = (i < Local_NTask ? sample_offset[i] : sample_offset[i - 1] + sample_bytes[i - 1]) / recsize;
+	  merge_sorted_runs(samples_all, samples_tmp, sample_run, Local_NTask, recsize, 1, compar);
 
-	  if(iter > 800 + 3*NTask && Local_ThisTask == 0)
+	  double cumulative = 0;
+	  for(j = 0, i = 0; j < (int) n_samples_tot && i < Local_NTask - 1; j++)
 	    {
-	      printf("iter=%d: ranks_not_found=%d  Local_NTask=%d\n", iter, ranks_not_found, Local_NTask); fflush(stdout);
-	      if(iter > 900 + 3*NTask) terminate("can't find the split points. That's odd");
+	      size_t rank; int t, t_lo = 0, t_hi = Local_NTask - 1;
+	      memcpy(&rank, samples_all + j * recsize + size, sizeof(size_t));
+	      while(t_lo < t_hi) {t = (t_lo + t_hi + 1) / 2; if(noffs[t] <= rank) {t_lo = t;} else {t_hi = t - 1;}} /* task the sample came from */
+	      cumulative += (double) nlist[t_lo] / (double) (sample_bytes[t_lo] / recsize);
+	      while(i < Local_NTask - 1 && cumulative >= (double) noffs[i + 1]) {memcpy(splitters + i * recsize, samples_all + j * recsize, recsize); i++;}
 	    }
+	  for(; i < Local_NTask - 1; i++) memcpy(splitters + i * recsize, samples_all + (n_samples_tot - 1) * recsize, recsize);
 	}
-      while(ranks_not_found);
-
 
-      /* At this point we have found all the elements corresponding to the desired split points */
-      /* we can now go ahead and determine how many elements of the local CPU have to go to each other CPU */
+      MPI_Bcast(splitters, (Local_NTask - 1) * recsize, MPI_BYTE, 0, MPI_CommLocal);
 
+      /* determine how many elements of the local CPU have to go to each other CPU */
       size_t *Send_count = (size_t *) mymalloc("Send_count", Local_NTask * sizeof(size_t));
       size_t *Recv_count = (size_t *) mymalloc("Recv_count", Local_NTask * sizeof(size_t));
-      size_t *Send_offset = (size_t *) mymalloc("Send_offset", Local_NTask * sizeof(size_t));
-      size_t *Recv_offset = (size_t *) mymalloc("Recv_offset", Local_NTask * sizeof(size_t));
-
-      for(i = 0; i < Local_NTask; i++)
-	Send_count[i] = 0;
-
-      int target = 0;
+      size_t *Send_offset = (size_t *) mymalloc("Send_offset", (Local_NTask + 1) * sizeof(size_t));
+      size_t *Recv_offset = (size_t *) mymalloc("Recv_offset", (Local_NTask + 1) * sizeof(size_t));
+      int *send_int = (int *) mymalloc("send_int", 4 * Local_NTask * sizeof(int)), *sdispl_int = send_int + Local_NTask;
+      int *recv_int = sdispl_int + Local_NTask, *rdispl_int = recv_int + Local_NTask;
 
-      for(i = 0; i < (int)nmemb; i++)
+      for(i = 0, Send_offset[0] = 0; i < Local_NTask - 1; i++)
 	{
-	  while(target < Local_NTask - 1)
-	    {
-	      int cmp = compar((char *) base + i * size, element_guess + target * size);
-	      if(cmp == 0)
-		{
-		  if(i + noffs[Local_ThisTask] < element_tie_braking_rank[target])
-		    cmp = -1;
-		  else if(i + noffs[Local_ThisTask] > element_tie_braking_rank[target])
-		    cmp = +1;
-		}
-	      if(cmp >= 0)
-		target++;
-	      else
-		break;
-	    }
-	  Send_count[target]++;
+	  Send_offset[i + 1] = find_splitter_position(splitters + i * recsize, (char *) base, nmemb, size, noffs[Local_ThisTask], compar);
+	  if(Send_offset[i + 1] < Send_offset[i]) Send_offset[i + 1] = Send_offset[i];
 	}
+      Send_offset[Local_NTask] = nmemb;
+      for(i = 0; i < Local_NTask; i++) Send_count[i] = Send_offset[i + 1] - Send_offset[i];
 
       MPI_Alltoall(Send_count, sizeof(size_t), MPI_BYTE, Recv_count, sizeof(size_t), MPI_BYTE, MPI_CommLocal);
 
       size_t nimport;
-
-      for(j = 0, nimport = 0, Recv_offset[0] = 0, Send_offset[0] = 0; j < Local_NTask; j++)
+      for(j = 0, nimport = 0, Recv_offset[0] = 0; j < Local_NTask; j++)
 	{
 	  nimport += Recv_count[j];
-
-	  if(j > 0)
-	    {
-	      Send_offset[j] = Send_offset[j - 1] + Send_count[j - 1];
-	      Recv_offset[j] = Recv_offset[j - 1] + Recv_count[j - 1];
-	    }
+	  Recv_offset[j + 1] = Recv_offset[j] + Recv_count[j];
 	}
 
-      if(nimport != nmemb)
-	terminate("nimport != nmemb");
+      MPI_Datatype MPI_Element;
+      MPI_Type_contiguous(size, MPI_BYTE, &MPI_Element);
+      MPI_Type_commit(&MPI_Element);
 
-      char *basetmp = (char *) mymalloc("basetmp", nmemb * size);
+      char *basetmp = (char *) mymalloc("basetmp", nimport * size);
+      char *mergetmp = (char *) mymalloc("mergetmp", nimport * size);
 
-      int ngrp, recvTask;
-
-      /* exchange the data */
-      for(ngrp = 0; ngrp < (1 << Local_PTask); ngrp++)
+      /* exchange the data (counts in units of elements, so the int-arguments of MPI_Alltoallv don't overflow) */
+      for(j = 0; j < Local_NTask; j++)
 	{
-	  recvTask = Local_ThisTask ^ ngrp;
-
-	  if(recvTask < Local_NTask)
-	    {
-	      if(Send_count[recvTask] > 0 || Recv_count[recvTask] > 0)
-		{
-#ifndef MPISENDRECV_SIZELIMIT
-		  if(Send_count[recvTask] > TRANSFER_SIZE_LIMIT || Recv_count[recvTask] > TRANSFER_SIZE_LIMIT)
-		    terminate("we are above TRANSFER_SIZE_LIMIT");
-#endif
-		  MPI_Sendrecv((char *) base + Send_offset[recvTask] * size,
-			       Send_count[recvTask] * size, MPI_BYTE,
-			       recvTask, TAG_TRANSFER,
-			       basetmp + Recv_offset[recvTask] * size,
-			       Recv_count[recvTask] * size, MPI_BYTE,
-			       recvTask, TAG_TRANSFER, MPI_CommLocal, MPI_STATUS_IGNORE);
-		}
-	    }
+	  send_int[j] = Send_count[j]; sdispl_int[j] = Send_offset[j];
+	  recv_int[j] = Recv_count[j]; rdispl_int[j] = Recv_offset[j];
 	}
+      MPI_Alltoallv(base, send_int, sdispl_int, MPI_Element, basetmp, recv_int, rdispl_int, MPI_Element, MPI_CommLocal);
 
-      /* instead of doing another serial sort at the end, we could also exploit that the different incoming pieces
-         are already individually sorted. This can be used in a variant of merge sort to do the final step a bit quicker */
+      /* the incoming pieces are individually sorted: merge them rather than sorting again */
+      merge_sorted_runs(basetmp, mergetmp, Recv_offset, Local_NTask, size, 0, compar);
 
-      memcpy(base, basetmp, nmemb * size);
-      myfree(basetmp);
-      serial_sort((char*)base, nmemb, size, compar);
+      /* now shift elements across the task boundaries so every task again holds nmemb elements. the data is globally
+         ordered at this point, so this only moves contiguous pieces between neighboring tasks */
+      size_t *nnew = (size_t *) mymalloc("nnew", Local_NTask * sizeof(size_t));
+      MPI_Allgather(&nimport, sizeof(size_t), MPI_BYTE, nnew, sizeof(size_t), MPI_BYTE, MPI_CommLocal);
+      size_t my_start, start_t, count_total;
+      for(j = 0, start_t = 0, my_start = 0; j < Local_NTask; j++)
+	{
+	  if(j == Local_ThisTask) my_start = start_t;
+	  start_t += nnew[j];
+	}
+      for(j = 0, start_t = 0, count_total = 0; j < Local_NTask; j++)
+	{
+	  size_t lo, hi;
+	  /* what we send to task j: overlap of our current range with the range task j should finally hold */
+	  lo = (my_start > noffs[j]) ? my_start : noffs[j];
+	  hi = (my_start + nimport < noffs[j] + nlist[j]) ? my_start + nimport : noffs[j] + nlist[j];
+	  send_int[j] = (hi > lo) ? hi - lo : 0; sdispl_int[j] = (hi > lo) ? lo - my_start : 0;
+	  /* what we receive from task j: overlap of its current range with the range we should finally hold */
+	  lo = (start_t > noffs[Local_ThisTask]) ? start_t : noffs[Local_ThisTask];
+	  hi = (start_t + nnew[j] < noffs[Local_ThisTask] + nmemb) ? start_t + nnew[j] : noffs[Local_ThisTask] + nmemb;
+	  recv_int[j] = (hi > lo) ? hi - lo : 0; rdispl_int[j] = (hi > lo) ? lo - noffs[Local_ThisTask] : 0;
+	  count_total += recv_int[j];
+	  start_t += nnew[j];
+	}
+      if(count_total != nmemb)
+	terminate("count_total != nmemb");
 
+      MPI_Alltoallv(basetmp, send_int, sdispl_int, MPI_Element, base, recv_int, rdispl_int, MPI_Element, MPI_CommLocal);
 
+      MPI_Type_free(&MPI_Element);
+
+      myfree(nnew);
+      myfree(mergetmp);
+      myfree(basetmp);
+      myfree(send_int);
       myfree(Recv_offset);
       myfree(Send_offset);
       myfree(Recv_count);
       myfree(Send_count);
-
-      myfree(max_loc);
-      myfree(range_right);
-      myfree(range_left);
-      myfree(current_loc_rank);
-      myfree(current_glob_rank);
-      myfree(desired_glob_rank);
-      myfree(element_tie_braking_rank);
-      myfree(element_guess);
+      myfree(sample_run);
+      myfree(samples_tmp);
+      myfree(samples_all);
+      myfree(splitters);
+      myfree(sample_offset);
+      myfree(sample_bytes);
+      myfree(samples);
       myfree(noffs);
       myfree(nlist);
     }
@@ -310,106 +221,104 @@ void parallel_sort_comm(void *base, size_t nmemb, size_t size, int (*compar) (co
 }
 
 
-
-static void get_local_rank(char *element,	/* element of which we want the rank */
-			   size_t tie_braking_rank,	/* the inital global rank of this element (needed for braking ties) */
-			   char *base,	/* base address of local data */
-			   size_t nmemb, size_t size,	/* number and size of local data */
-			   size_t noffs_thistask,	/* cumulative length of data on lower tasks */
-			   long long left, long long right,	/* range of elements on local task that may hold the element */
-			   size_t * loc,	/* output: local rank of the element */
-			   int (*compar) (const void *, const void *))	/* user-specified  comparison function */
+/* compares two records (an element, optionally followed by a size_t global rank used to break ties between equal elements) */
+static int compare_with_rank(const char *a, const char *b, size_t recsize, int with_rank, int (*compar) (const void *, const void *))
 {
-  if(right < left)
-    terminate("right < left");
+  int cmp = compar(a, b);
+  if(cmp == 0 && with_rank)
+    {
+      size_t rank_a, rank_b;
+      memcpy(&rank_a, a + recsize - sizeof(size_t), sizeof(size_t));
+      memcpy(&rank_b, b + recsize - sizeof(size_t), sizeof(size_t));
+      if(rank_a < rank_b) cmp = -1;
+      else if(rank_a > rank_b) cmp = +1;
+    }
+  return cmp;
+}
+
 
-  if(left == 0 && right == (int)(nmemb + 1))
+/* returns the number of local (sorted) elements which come before the splitter, where local element i has the global
+   rank noffs_thistask+i for breaking ties */
+static size_t find_splitter_position(char *splitter, char *base, size_t nmemb, size_t size, size_t noffs_thistask,
+				     int (*compar) (const void *, const void *))
+{
+  size_t left = 0, right = nmemb, splitter_rank;
+  memcpy(&splitter_rank, splitter + size, sizeof(size_t));
+  while(left < right)
     {
-      if(compar(base + (nmemb - 1) * size, element) < 0)
-	{
-	  *loc = nmemb;
-	  return;
-	}
-      else if(compar(base, element) > 0)
+      size_t mid = left + (right - left) / 2;
+      int cmp = compar(base + mid * size, splitter);
+      if(cmp == 0)
 	{
-	  *loc = 0;
-	  return;
+	  if(mid + noffs_thistask < splitter_rank) cmp = -1;
+	  else if(mid + noffs_thistask > splitter_rank) cmp = +1;
 	}
+      if(cmp < 0) left = mid + 1;
+      else right = mid;
     }
+  return left;
+}
 
 
-  if(right == left)		/* looks like we already converged to the proper rank */
-    {
-      *loc = left;
-    }
-  else
+/* merges the nruns consecutive sorted runs [run_offset[r], run_offset[r+1]) of base (in units of records of recsize bytes)
+   into one sorted array, by pairwise merging (each pass is done in parallel over pairs); tmp must hold as much as base */
+static void merge_sorted_runs(char *base, char *tmp, size_t *run_offset, int nruns, size_t recsize, int with_rank,
+			      int (*compar) (const void *, const void *))
+{
+  char *src = base, *dst = tmp, *swap;
+  int r, step;
+
+  for(step = 1; step < nruns; step *= 2)
     {
-      if(compar(base + (right - 1) * size, element) < 0)	/* the last element is smaller, hence all elements are on the left */
-	*loc = (right - 1) + 1;
-      else if(compar(base + left * size, element) > 0)	/* the first element is already larger, hence no element is on the left */
-	*loc = left;
-      else
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for(r = 0; r < nruns; r += 2 * step)
 	{
-	  while(right > left)
+	  int r_mid = (r + step < nruns) ? r + step : nruns, r_end = (r + 2 * step < nruns) ? r + 2 * step : nruns;
+	  char *a = src + run_offset[r] * recsize, *a_end = src + run_offset[r_mid] * recsize;
+	  char *b = a_end, *b_end = src + run_offset[r_end] * recsize, *out = dst + run_offset[r] * recsize;
+	  while(a < a_end && b < b_end)
 	    {
-	      long long mid = ((right - 1) + left) / 2;
-
-	      int cmp = compar(base + mid * size, element);
-	      if(cmp == 0)
-		{
-		  if(mid + noffs_thistask < tie_braking_rank)
-		    cmp = -1;
-		  else if(mid + noffs_thistask > tie_braking_rank)
-		    cmp = +1;
-		}
-
-	      if(cmp == 0)	/* element has exactly been found */
-		{
-		  *loc = mid;
-		  break;
-		}
-
-	      if((right - 1) == left)	/* elements is not on this CPU */
-		{
-		  if(cmp < 0)
-		    *loc = mid + 1;
-		  else
-		    *loc = mid;
-		  break;
-		}
-
-	      if(cmp < 0)
-		{
-		  left = mid + 1;
-		}
-	      else
-		{
-		  if((right - 1) == left + 1)
-		    {
-		      if(mid != left)
-			{
-			  printf("-->left=%lld  right=%lld\n", left, right);
-			  terminate("can't be");
-			}
-		      *loc = left;
-		      break;
-		    }
-
-		  right = mid;
-		}
+	      if(compare_with_rank(b, a, recsize, with_rank, compar) < 0) {memcpy(out, b, recsize); b += recsize;}
+	      else {memcpy(out, a, recsize); a += recsize;}
+	      out += recsize;
 	    }
+	  if(a < a_end) {memcpy(out, a, a_end - a); out += a_end - a;}
+	  if(b < b_end) {memcpy(out, b, b_end - b);}
 	}
+      swap = src; src = dst; dst = swap;
     }
+
+  if(src != base)
+    memcpy(base, src, run_offset[nruns] * recsize);
 }
 
+
+/* local sort: with OpenMP, each thread merge-sorts one chunk of the data and the chunks are then merged */
 static void serial_sort(char *base, size_t nmemb, size_t size, int (*compar) (const void *, const void *))
 {
   const size_t storage = nmemb * size;
+  int i, nchunks = 1;
 
   char *tmp = (char *) mymalloc("char *tmp", storage);
 
-  msort_serial_with_tmp(base, nmemb, size, compar, tmp);
+#ifdef _OPENMP
+  nchunks = omp_get_max_threads();
+  if(nmemb < (size_t) nchunks * PSORT_MIN_PER_THREAD) nchunks = 1;
+#endif
+  size_t *run_offset = (size_t *) mymalloc("run_offset", (nchunks + 1) * sizeof(size_t));
+  for(i = 0; i <= nchunks; i++) run_offset[i] = (nmemb * i) / nchunks;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1)
+#endif
+  for(i = 0; i < nchunks; i++)
+    msort_serial_with_tmp(base + run_offset[i] * size, run_offset[i + 1] - run_offset[i], size, compar, tmp + run_offset[i] * size);
+
+  merge_sorted_runs(base, tmp, run_offset, nchunks, size, 0, compar);
 
+  myfree(run_offset);
   myfree(tmp);
 }
 
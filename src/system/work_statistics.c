@@ -0,0 +1,115 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../allvars.h"
+#include "../proto.h"
+
+/*
+ * This file contains the per-particle work diagnostics enabled with OUTPUT_PARTICLE_WORK_STATISTICS. Each particle carries
+ *  a set of counters (WorkCount[WORK_PARTS]: tree-nodes opened, neighbors visited, exports generated, hsml-iterations,
+ *  cooling/chemistry solver steps, and gravity interactions) which are incremented inside the neighbor-search, density,
+ *  gravity, and cooling loops. At the end of each loop the routine below bins the counters of the active particles into
+ *  log2-spaced histograms (written per-task), and gathers the top-K most expensive particles onto the root task so that
+ *  pathological regions (huge neighbor counts, very deep walks, hsml-iterations failing to converge) can be located
+ *  without attaching a profiler. The counters are then re-zeroed, so each entry refers to a single loop call.
+ */
+
+#ifdef OUTPUT_PARTICLE_WORK_STATISTICS
+
+#if (OUTPUT_PARTICLE_WORK_STATISTICS+0 > 0)
+#define WORKSTAT_TOPK (OUTPUT_PARTICLE_WORK_STATISTICS) /* number of most-expensive particles to record per loop */
+#else
+#define WORKSTAT_TOPK 10 /* default if no value is given */
+#endif
+#define WORKSTAT_NBINS 33 /* bin 0 holds particles with zero counts, bin b>0 holds counts in [2^(b-1), 2^b) */
+
+static const char *WorkCount_Name[WORK_PARTS] = {"nodes", "ngbs", "exports", "iters", "solver", "gravint"};
+
+struct workstat_record
+{
+    MyIDType ID;
+    int Task, Type, TimeBin;
+    double Pos[3], Hsml, Cost;
+    int WorkCount[WORK_PARTS];
+};
+
+static int workstat_record_compare(const void *a, const void *b)
+{
+    if(((struct workstat_record *) a)->Cost > ((struct workstat_record *) b)->Cost) {return -1;}
+    if(((struct workstat_record *) a)->Cost < ((struct workstat_record *) b)->Cost) {return +1;}
+    return 0;
+}
+
+
+/*! write the log2-binned histograms of the per-particle work counters for this task, and the global top-K most expensive
+    particles (to the root task file), for the loop named 'loopname'. must be called by all tasks, since it is collective. */
+void report_particle_work_statistics(const char *loopname)
+{
+    int i, j, k, n_topk = 0; long long hist[WORK_PARTS][WORKSTAT_NBINS], count_total[WORK_PARTS], count_max[WORK_PARTS], n_active = 0;
+    struct workstat_record topk[WORKSTAT_TOPK];
+    if(FdWorkStats == NULL) /* loops run inside init() come before open_outputfiles(): discard their counts (the same on all tasks, so this stays collective) */
+    {
+        for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {for(k = 0; k < WORK_PARTS; k++) {P[i].WorkCount[k] = 0;}}
+        return;
+    }
+    memset(hist, 0, WORK_PARTS * WORKSTAT_NBINS * sizeof(long long));
+    for(k = 0; k < WORK_PARTS; k++) {count_total[k] = count_max[k] = 0;}
+
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i])
+    {
+        double cost = 0; n_active++;
+        for(k = 0; k < WORK_PARTS; k++)
+        {
+            int c = P[i].WorkCount[k], bin = 0;
+            if(c > 0) {bin = 1; while((bin < WORKSTAT_NBINS-1) && (c >> bin)) {bin++;}}
+            hist[k][bin]++; count_total[k] += c; if(c > count_max[k]) {count_max[k] = c;}
+            cost += c;
+        }
+        if(cost <= 0) {continue;}
+        if(n_topk == WORKSTAT_TOPK && cost <= topk[n_topk-1].Cost) {continue;}
+        /* insert into the (sorted, descending) local top-K list */
+        if(n_topk < WORKSTAT_TOPK) {n_topk++;}
+        for(j = n_topk - 1; j > 0 && topk[j-1].Cost < cost; j--) {topk[j] = topk[j-1];}
+        topk[j].ID = P[i].ID; topk[j].Task = ThisTask; topk[j].Type = P[i].Type; topk[j].TimeBin = P[i].TimeBin;
+        if(topk[j].TimeBin < 0) {topk[j].TimeBin = -topk[j].TimeBin - 1;} /* density-type loops temporarily flag converged elements with negative bins */
+        for(k = 0; k < 3; k++) {topk[j].Pos[k] = P[i].Pos[k];}
+        topk[j].Hsml = PPP[i].Hsml; topk[j].Cost = cost;
+        for(k = 0; k < WORK_PARTS; k++) {topk[j].WorkCount[k] = P[i].WorkCount[k];}
+    }
+    for(i = FirstActiveParticle; i >= 0; i = NextActiveParticle[i]) {for(k = 0; k < WORK_PARTS; k++) {P[i].WorkCount[k] = 0;}} /* re-zero for the next loop */
+
+    /* per-task histograms: only counters which were actually touched in this loop are written */
+    for(k = 0; k < WORK_PARTS; k++)
+    {
+        if(count_total[k] <= 0) {continue;}
+        fprintf(FdWorkStats, "%lld %g %s %s %lld %lld %lld :", (long long) All.NumCurrentTiStep, All.Time, loopname, WorkCount_Name[k], n_active, count_total[k], count_max[k]);
+        for(j = 0; j < WORKSTAT_NBINS; j++) {fprintf(FdWorkStats, " %lld", hist[k][j]);}
+        fprintf(FdWorkStats, "\n");
+    }
+    fflush(FdWorkStats);
+
+    /* gather the local top-K lists and write the global top-K from the root task */
+    for(j = n_topk; j < WORKSTAT_TOPK; j++) {topk[j].Cost = -1;} /* pad, so every task sends the same amount */
+    struct workstat_record *topk_all = NULL;
+    if(ThisTask == 0) {topk_all = (struct workstat_record *) mymalloc("topk_all", NTask * WORKSTAT_TOPK * sizeof(struct workstat_record));}
+    MPI_Gather(topk, WORKSTAT_TOPK * sizeof(struct workstat_record), MPI_BYTE, topk_all, WORKSTAT_TOPK * sizeof(struct workstat_record), MPI_BYTE, 0, MPI_COMM_WORLD);
+    if(ThisTask == 0)
+    {
+        qsort(topk_all, NTask * WORKSTAT_TOPK, sizeof(struct workstat_record), workstat_record_compare);
+        for(j = 0; j < WORKSTAT_TOPK; j++)
+        {
+            if(topk_all[j].Cost <= 0) {break;}
+            fprintf(FdWorkStragglers, "%lld %g %s %d %llu %d %d %d %g %g %g %g %g :", (long long) All.NumCurrentTiStep, All.Time, loopname, j,
+                    (unsigned long long) topk_all[j].ID, topk_all[j].Task, topk_all[j].Type, topk_all[j].TimeBin,
+                    topk_all[j].Pos[0], topk_all[j].Pos[1], topk_all[j].Pos[2], topk_all[j].Hsml, topk_all[j].Cost);
+            for(k = 0; k < WORK_PARTS; k++) {fprintf(FdWorkStragglers, " %d", topk_all[j].WorkCount[k]);}
+            fprintf(FdWorkStragglers, "\n");
+        }
+        fflush(FdWorkStragglers);
+        myfree(topk_all);
+    }
+}
+
+#endif
@@ -111,4 +111,7 @@
 
 #define TAG_MPI_GENERIC_COM_BUFFER_A 103
 #define TAG_MPI_GENERIC_COM_BUFFER_B 104
+#define TAG_SPARSE_COUNTS 300 /* base of a rotating range of SPARSE_COUNTS_TAG_EPOCHS tags, one per call of mpi_sparse_alltoall_counts */
+#define SPARSE_COUNTS_TAG_EPOCHS 16
+#define TAG_EXCHANGE_CHECKSUM 106
 
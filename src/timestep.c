@@ -245,6 +245,9 @@ integertime get_timestep(int p,		/*!< particle index */
 	    double dr = sqrt(P[p].comp_dx[0]*P[p].comp_dx[0] + P[p].comp_dx[1]*P[p].comp_dx[1] + P[p].comp_dx[2]*P[p].comp_dx[2]);
 	    double dt_bin = sqrt(dr*dr*dr / (All.G * (P[p].Mass + P[p].comp_Mass)));
         if(0.005*P[p].COM_dt_tidal>dt_bin) {P[p].SuperTimestepFlag=2;} // external timestep is appropriately larger than 'internal' timestep, so use super-timestepping routine [constant here stricter for more aggressive routine]
+#endif
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+        if(fewbody_subsystem_is_decoupled(p)) {P[p].SuperTimestepFlag=3;} // external perturbations are slow compared to the orbit: integrate it privately as a decoupled subsystem
 #endif
     }
 #endif
@@ -349,6 +352,9 @@ integertime get_timestep(int p,		/*!< particle index */
     
 #if (SINGLE_STAR_TIMESTEPPING > 0)
     if(P[p].SuperTimestepFlag>=2) {dt_tidal = sqrt(2*All.ErrTolIntAccuracy) * P[p].COM_dt_tidal;}
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+    if(P[p].SuperTimestepFlag>=3) {dt_tidal = sqrt(2*All.ErrTolIntAccuracy) * P[p].fewbody_pair_dt_tidal;} // same limit on both members of a decoupled pair
+#endif
 #endif
     dt=DMIN(dt,dt_tidal);
 #endif
@@ -371,6 +377,10 @@ integertime get_timestep(int p,		/*!< particle index */
             dr=sqrt(dr); if(dv>0) {dv=sqrt(dv);} else {dv=0;}
             double dt_2body_base = 1/(1./P[p].min_bh_approach_time + 1./P[p].min_bh_freefall_time); // timestep is harmonic mean of freefall and approach time
 	        binary_dt_2body = 1. / (dv / dr + sqrt(All.G * Mtot / (dr*dr*dr)));
+#ifdef SINGLE_STAR_FEWBODY_SUBSYSTEMS
+            if(P[p].SuperTimestepFlag >= 3) {dt_2body = sqrt(2*All.ErrTolIntAccuracy) * 0.3 * P[p].fewbody_pair_tapp_ext;} // decoupled: the orbit is sub-stepped in the drift, and the approach of other stars (already checked against the orbit for the pair as a whole) limits the step (the tidal limit is applied above)
+            else
+#endif
 	        if(fabs(binary_dt_2body - dt_2body_base)/dt_2body_base < 1e-2)
 	        { // If consistent with the binary parameters, we choose a super-timestep that gives ~constant number of timesteps per orbit
                 double SUPERTIMESTEPPING_NUM_STEPS_PER_ORBIT = 50;
@@ -972,7 +982,7 @@ void find_dt_displacement_constraint(double hfac /*!<  should be  a^2*H(a)  */ )
                 asmth = All.Asmth[0];
 #ifdef PM_PLACEHIGHRESREGION
                 if(((1 << type) & (PM_PLACEHIGHRESREGION)))
-                    asmth = All.Asmth[1];
+                    asmth = All.Asmth[PM_NGRIDS-1]; /* finest (nested) level, to be conservative */
 #endif
                 if(asmth < dmean)
                     dt = All.MaxRMSDisplacementFac * hfac * asmth / sqrt(v_sum[type] / count_sum[type]);
@@ -367,7 +367,7 @@ void dynamic_diff_calc(void) {
             
             tstart = my_second();
             
-            MPI_Alltoall(Send_count, 1, MPI_INT, Recv_count, 1, MPI_INT, MPI_COMM_WORLD);
+            mpi_sparse_alltoall_counts(Send_count, Recv_count);
             
             tend = my_second();
             timewait1 += timediff(tstart, tend);